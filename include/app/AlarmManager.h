@@ -0,0 +1,265 @@
+/**
+ * @file AlarmManager.h
+ * @brief Declaration of the AlarmManager class.
+ *
+ * This file contains the AlarmManager class, which turns the EPICS alarms of the PVs (alarm.severity
+ * and alarm.status) into OPC UA Alarms & Conditions: one AlarmConditionType instance per PV, created
+ * the first time the PV alarms, below an "Alarms" folder that notifies its events to the Server object.
+ *
+ * The workers only compare the alarm of every update with the previous one and mark the PVs whose
+ * alarm changed. A dedicated thread takes every marked PV at each wakeup and builds and fires their
+ * events as a batch, so a plant trip that alarms thousands of PVs at once never delays the values.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __ALARMMANAGER_H__
+#define __ALARMMANAGER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pvxs/data.h>
+#include <uanodeid.h>
+#include <opcua_alarmconditiontype.h>
+
+class MyNodeIOEventManager;
+class EPICStoOPCUAGateway;
+
+/**
+ * @class AlarmManager
+ * @brief Alarms & Conditions of the PVs of the gateway.
+ *
+ * The condition of a PV is active while its severity is not NO_ALARM. A new or more severe alarm
+ * has to be acknowledged again. Only the state of a PV at the wakeup of the event thread is
+ * reported, so an alarm that comes and goes between two wakeups does not fire an event.
+ *
+ * This class is thread-safe.
+ *
+ */
+class AlarmManager {
+
+private:
+
+    /**
+     * @struct Pending
+     * @brief Alarm of a PV, as seen by the workers.
+     *
+     */
+    struct Pending {
+        /**
+         * @brief Last severity and status received, packed as severity << 16 | status.
+         *
+         */
+        uint32_t state = 0;
+
+        /**
+         * @brief Message of the alarm.
+         *
+         */
+        std::string message;
+
+        /**
+         * @brief EPICS timestamp of the change (OPC UA DateTime), or 0.
+         *
+         */
+        int64_t timestamp = 0;
+
+        /**
+         * @brief Whether the PV is in m_dirty.
+         *
+         */
+        bool queued = false;
+    };
+
+    /**
+     * @struct Condition
+     * @brief Condition of a PV. Only used by the event thread and acknowledge().
+     *
+     */
+    struct Condition {
+        OpcUa::AlarmConditionType * pCondition = nullptr;
+        uint32_t state = 0;
+        bool active = false;
+        bool acked = true;
+        UaByteString eventId;   // EventId of the last event, the one a client acknowledges
+    };
+
+    /**
+     * @brief Node manager where the conditions are created.
+     *
+     */
+    MyNodeIOEventManager * m_pNodeManager;
+
+    /**
+     * @brief Gateway, for the names and nodes of the PVs.
+     *
+     */
+    EPICStoOPCUAGateway * m_pGateway;
+
+    /**
+     * @brief Folder of the conditions.
+     *
+     */
+    UaNodeId m_folderId;
+
+    /**
+     * @brief Alarm of every PV as seen by the workers, indexed by the identifier of the PV.
+     *
+     */
+    std::vector<Pending> m_pending;
+
+    /**
+     * @brief PVs whose alarm changed since the last wakeup, in order of change.
+     *
+     */
+    std::vector<uint32_t> m_dirty;
+
+    /**
+     * @brief Mutex that protects m_pending and m_dirty.
+     *
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief Wakes up the event thread.
+     *
+     */
+    std::condition_variable m_cv;
+
+    /**
+     * @brief Conditions, indexed by the identifier of the PV.
+     *
+     */
+    std::vector<Condition> m_conditions;
+
+    /**
+     * @brief Identifier of the PV of every condition, for the acknowledgements.
+     *
+     */
+    std::unordered_map<const OpcUa::AcknowledgeableConditionType*, uint32_t> m_conditionPVs;
+
+    /**
+     * @brief Mutex that protects m_conditions and m_conditionPVs.
+     *
+     */
+    std::mutex m_conditionsMutex;
+
+    /**
+     * @brief Event thread.
+     *
+     */
+    std::thread m_thread;
+
+    /**
+     * @brief Flag to stop the event thread.
+     *
+     */
+    std::atomic<bool> m_stopping{false};
+
+    /**
+     * @brief Number of events fired.
+     *
+     */
+    std::atomic<uint64_t> m_events{0};
+
+    /**
+     * @brief Loop of the event thread.
+     *
+     */
+    void run();
+
+    /**
+     * @brief Fire the event of a PV whose alarm changed. Must be called with m_conditionsMutex locked.
+     *
+     * @param pvId Identifier of the PV.
+     * @param pending Alarm of the PV.
+     * @param receiveTime Time of the batch.
+     */
+    void fire(uint32_t pvId, const Pending & pending, const UaDateTime & receiveTime);
+
+    /**
+     * @brief Create the condition of a PV. Must be called with m_conditionsMutex locked.
+     *
+     * @param pvId Identifier of the PV.
+     * @return The condition, or nullptr if the PV is not mapped.
+     */
+    OpcUa::AlarmConditionType * createCondition(uint32_t pvId);
+
+public:
+
+    /**
+     * @brief Construct a new AlarmManager object.
+     *
+     * @param pNodeManager Node manager where the conditions are created.
+     * @param pGateway Gateway of the PVs.
+     */
+    AlarmManager(MyNodeIOEventManager * pNodeManager, EPICStoOPCUAGateway * pGateway);
+
+    /**
+     * @brief Destroy the AlarmManager object. Stops the event thread.
+     *
+     */
+    ~AlarmManager();
+
+    AlarmManager(const AlarmManager &) = delete;
+    AlarmManager & operator=(const AlarmManager &) = delete;
+
+    /**
+     * @brief Create the folder of the conditions and start the event thread. The server must be started.
+     *
+     * @return true if the folder was created.
+     */
+    bool start();
+
+    /**
+     * @brief Fire the pending events and stop the event thread.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Check the alarm of an update of a PV. Only a change of severity or status is queued.
+     * Called by the workers for every update.
+     *
+     * @param pvId Identifier of the PV.
+     * @param value Value received from the PV. The values without alarm field are ignored.
+     */
+    void update(uint32_t pvId, const pvxs::Value & value);
+
+    /**
+     * @brief Acknowledge the condition of a PV, from the Acknowledge method of a client.
+     *
+     * @param pCondition Condition acknowledged.
+     * @param eventId EventId of the event acknowledged by the client. It must be the last event of the condition.
+     * @param comment Comment of the client.
+     * @return OpcUa_Good, OpcUa_BadEventIdUnknown if the event is not the last one of the condition,
+     * OpcUa_BadConditionBranchAlreadyAcked if it was acknowledged, or OpcUa_BadNodeIdUnknown if it is not the
+     * condition of a PV.
+     */
+    UaStatus acknowledge(OpcUa::AcknowledgeableConditionType * pCondition, const UaByteString & eventId,
+                         const UaLocalizedText & comment);
+
+    /**
+     * @brief Number of events fired.
+     *
+     */
+    uint64_t events() const { return m_events.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Load the configuration of the alarms from a file of "key = value" lines.
+     * The only key is "enabled" (true or false).
+     *
+     * @param path Path of the file.
+     * @return true if the file exists and does not disable the alarms.
+     */
+    static bool loadConfig(const std::string & path);
+};
+
+#endif  // __ALARMMANAGER_H__
@@ -0,0 +1,142 @@
+/**
+ * @file ArrayIOManager.h
+ * @brief Declaration of the ArrayIOManager class.
+ *
+ * This file contains the IOManager of the Value attribute of the array PVs (NTScalarArray) of
+ * MyNodeIOEventManager. A Read with an IndexRange converts only the elements of the range from the
+ * PVXS buffer of the last array received, instead of copying the whole value of the node and slicing
+ * it, and a Write with an IndexRange is forwarded to the gateway as a put of a range.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __ARRAYIOMANAGER_H__
+#define __ARRAYIOMANAGER_H__
+
+#include <cstdint>
+#include "iomanager.h"
+#include "variablehandle.h"
+
+class EPICStoOPCUAGateway;
+
+/**
+ * @class PVVariableHandle
+ * @brief VariableHandle of the Value attribute of an array PV, with the identifier of the PV in the gateway.
+ *
+ */
+class PVVariableHandle : public VariableHandle {
+public:
+    /**
+     * @brief Identifier of the PV.
+     *
+     */
+    uint32_t m_pvId = 0;
+};
+
+/**
+ * @class ArrayIOManager
+ * @brief IOManager that reads and writes ranges of the array PVs through the gateway.
+ *
+ * Only the Read and Write services are partial, and only the writes to writable variables are routed here.
+ * The monitored items stay on the nodes: the SDK samples the whole array and applies the IndexRange of
+ * each item, so a monitored item is not notified partially. The operations are answered inside beginRead()
+ * and beginWrite(), since the data is already in memory.
+ *
+ * This class is thread-safe.
+ *
+ */
+class ArrayIOManager : public IOManager {
+
+private:
+
+    /**
+     * @struct Transaction
+     * @brief Context of a transaction, the handle returned by beginTransaction().
+     *
+     */
+    struct Transaction {
+        IOManagerCallback * pCallback;
+        OpcUa_UInt32 hTransaction;
+        OpcUa_TimestampsToReturn timestampsToReturn;
+    };
+
+    /**
+     * @brief Gateway that holds the arrays and sends the puts.
+     *
+     */
+    EPICStoOPCUAGateway * m_pGateway;
+
+public:
+
+    /**
+     * @brief Construct a new ArrayIOManager object.
+     *
+     * @param pGateway Gateway that holds the arrays and sends the puts.
+     */
+    explicit ArrayIOManager(EPICStoOPCUAGateway * pGateway);
+
+    UaStatus beginTransaction(
+        IOManagerCallback * pCallback,
+        const ServiceContext & serviceContext,
+        OpcUa_UInt32 hTransaction,
+        OpcUa_UInt32 totalItemCountHint,
+        OpcUa_Double maxAge,
+        OpcUa_TimestampsToReturn timestampsToReturn,
+        TransactionType transactionType,
+        OpcUa_Handle & hIOManagerContext
+    );
+
+    /**
+     * @brief Not supported: the monitored items of the array PVs use the IOManager of the nodes,
+     * getVariableHandle() never routes them here.
+     *
+     */
+    UaStatus beginStartMonitoring(
+        OpcUa_Handle hIOManagerContext,
+        OpcUa_UInt32 callbackHandle,
+        IOVariableCallback * pIOVariableCallback,
+        VariableHandle * pVariableHandle,
+        MonitoringContext & monitoringContext
+    );
+
+    UaStatus beginModifyMonitoring(
+        OpcUa_Handle hIOManagerContext,
+        OpcUa_UInt32 callbackHandle,
+        OpcUa_UInt32 hIOVariable,
+        MonitoringContext & monitoringContext
+    );
+
+    UaStatus beginStopMonitoring(
+        OpcUa_Handle hIOManagerContext,
+        OpcUa_UInt32 callbackHandle,
+        OpcUa_UInt32 hIOVariable
+    );
+
+    /**
+     * @brief Read the elements of the IndexRange of the request from the gateway.
+     *
+     */
+    UaStatus beginRead(
+        OpcUa_Handle hIOManagerContext,
+        OpcUa_UInt32 callbackHandle,
+        VariableHandle * pVariableHandle,
+        OpcUa_ReadValueId * pReadValueId
+    );
+
+    /**
+     * @brief Enqueue a put of the elements of the IndexRange of the request. The result is the result
+     * of the enqueue, the put itself is asynchronous as for the scalar PVs.
+     *
+     */
+    UaStatus beginWrite(
+        OpcUa_Handle hIOManagerContext,
+        OpcUa_UInt32 callbackHandle,
+        VariableHandle * pVariableHandle,
+        OpcUa_WriteValue * pWriteValue
+    );
+
+    UaStatus finishTransaction(OpcUa_Handle hIOManagerContext);
+};
+
+#endif  // __ARRAYIOMANAGER_H__
@@ -0,0 +1,332 @@
+/**
+ * @file ClientLoadGenerator.h
+ * @brief Declaration of the ClientLoadGenerator class and the ClientLoadConfig structure.
+ *
+ * This file contains the declaration of the ClientLoadGenerator class, the northbound counterpart
+ * of LoadGenerator. It opens many OPC UA sessions with the client SDK, as many HMIs would, creates
+ * monitored items on the gateway variables and issues storms of Read and Write requests, measuring
+ * the notification latency and the throughput of OpcServer and MyNodeIOEventManager.
+ *
+ * With LoadGenerator as the EPICS source both ends run on the same machine, so the latency of a
+ * notification (arrival time minus source timestamp) is the end-to-end latency of the gateway.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __CLIENTLOADGENERATOR_H__
+#define __CLIENTLOADGENERATOR_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <uasession.h>
+#include <uasubscription.h>
+
+/**
+ * @struct ClientLoadConfig
+ * @brief Configuration of the client load generator.
+ *
+ */
+struct ClientLoadConfig {
+    /**
+     * @brief Endpoint of the server.
+     *
+     */
+    std::string url = "opc.tcp://localhost:48010";
+
+    /**
+     * @brief Namespace of the gateway variables.
+     *
+     */
+    std::string namespaceUri = "TFG:OPCUA_EPICS";
+
+    /**
+     * @brief File with the nodes to monitor and read: a PV name or a node identifier per line.
+     *
+     */
+    std::string nodesFile;
+
+    /**
+     * @brief File with the nodes to write, in the same format. Empty disables the Write storm.
+     *
+     */
+    std::string writeNodesFile;
+
+    /**
+     * @brief Number of sessions.
+     *
+     */
+    size_t sessions = 1;
+
+    /**
+     * @brief Monitored items of every session. The sessions take consecutive windows of the nodes, wrapping around.
+     *
+     */
+    size_t itemsPerSession = 1000;
+
+    /**
+     * @brief Sampling interval of the monitored items, in ms. 0 reports every change.
+     *
+     */
+    double samplingInterval = 0.0;
+
+    /**
+     * @brief Queue size of the monitored items.
+     *
+     */
+    uint32_t queueSize = 1;
+
+    /**
+     * @brief Publishing interval of the subscriptions, in ms.
+     *
+     */
+    double publishingInterval = 100.0;
+
+    /**
+     * @brief Read requests per second of every session. 0 disables the Read storm.
+     *
+     */
+    double readRate = 0.0;
+
+    /**
+     * @brief Nodes of a Read request.
+     *
+     */
+    size_t readBatch = 100;
+
+    /**
+     * @brief Write requests per second of every session. 0 disables the Write storm.
+     *
+     */
+    double writeRate = 0.0;
+
+    /**
+     * @brief Nodes of a Write request.
+     *
+     */
+    size_t writeBatch = 10;
+
+    /**
+     * @brief Maximum requests of a session waiting for their response. The requests over the limit are skipped and counted.
+     *
+     */
+    uint32_t maxOutstanding = 16;
+
+    /**
+     * @brief Duration of the measurement. 0 runs until the shutdown.
+     *
+     */
+    std::chrono::seconds duration{60};
+
+    /**
+     * @brief Time between reports.
+     *
+     */
+    std::chrono::seconds reportInterval{10};
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Lock-free histogram of latencies in microseconds, with a relative error of 1/16.
+ *
+ * The values are grouped by powers of two, every power of two divided in 16 linear buckets.
+ *
+ */
+class LatencyHistogram {
+
+private:
+
+    /**
+     * @brief Number of buckets: values up to 2^40 us.
+     *
+     */
+    static constexpr size_t BucketCount = 38 * 16;
+
+    std::atomic<uint64_t> m_buckets[BucketCount];
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_max{0};
+
+    static size_t bucketOf(uint64_t value);
+    static uint64_t lowerBound(size_t bucket);
+
+public:
+
+    LatencyHistogram() { reset(); }
+
+    /**
+     * @brief Add a latency.
+     *
+     * @param micros Latency in microseconds. Negative latencies (clock differences) are counted as 0.
+     */
+    void add(int64_t micros);
+
+    /**
+     * @brief Number of latencies added.
+     *
+     */
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Maximum latency added.
+     *
+     */
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Latency under which a fraction of the latencies are.
+     *
+     * @param fraction Fraction, 0.99 for the 99th percentile.
+     * @return Lower bound of the bucket of the percentile, in microseconds.
+     */
+    uint64_t percentile(double fraction) const;
+
+    /**
+     * @brief Remove every latency. Not atomic with add().
+     *
+     */
+    void reset();
+};
+
+/**
+ * @class ClientLoadGenerator
+ * @brief Drives an OPC UA server with many client sessions, monitored items and Read/Write storms.
+ *
+ * The monitored items are created in one subscription per session. The storms use the asynchronous
+ * services (beginRead, beginWrite), so one thread drives every session at the configured rates.
+ * The Write storm writes back the values read from the write nodes when the sessions start.
+ *
+ */
+class ClientLoadGenerator {
+
+private:
+
+    class ClientSession;
+
+    /**
+     * @brief Configuration of the generator.
+     *
+     */
+    ClientLoadConfig m_config;
+
+    /**
+     * @brief Identifiers of the nodes to monitor and read (string NodeIds without namespace).
+     *
+     */
+    std::vector<std::string> m_nodes;
+
+    /**
+     * @brief Identifiers of the nodes to write.
+     *
+     */
+    std::vector<std::string> m_writeNodes;
+
+    /**
+     * @brief Sessions.
+     *
+     */
+    std::vector<std::unique_ptr<ClientSession>> m_sessions;
+
+    /**
+     * @brief Thread of the Read and Write storms.
+     *
+     */
+    std::thread m_stormThread;
+
+    /**
+     * @brief Flag to stop the storm thread.
+     *
+     */
+    std::atomic<bool> m_stopping{false};
+
+    /**
+     * @brief Latencies of the notifications (arrival minus source timestamp).
+     *
+     */
+    LatencyHistogram m_notificationLatency;
+
+    /**
+     * @brief Round-trip times of the Read and Write requests.
+     *
+     */
+    LatencyHistogram m_readLatency;
+    LatencyHistogram m_writeLatency;
+
+    /**
+     * @brief Counters.
+     *
+     */
+    std::atomic<uint64_t> m_notifications{0};
+    std::atomic<uint64_t> m_reads{0};
+    std::atomic<uint64_t> m_writes{0};
+    std::atomic<uint64_t> m_skipped{0};
+    std::atomic<uint64_t> m_errors{0};
+
+    /**
+     * @brief Loop of the storm thread.
+     *
+     */
+    void storm();
+
+    /**
+     * @brief Read a nodes file.
+     *
+     */
+    static bool readNodes(const std::string & path, std::vector<std::string> & nodes);
+
+public:
+
+    /**
+     * @brief Construct a new ClientLoadGenerator object.
+     *
+     * @param config Configuration of the generator.
+     */
+    explicit ClientLoadGenerator(const ClientLoadConfig & config);
+
+    /**
+     * @brief Destroy the ClientLoadGenerator object. Stops the generator.
+     *
+     */
+    ~ClientLoadGenerator();
+
+    ClientLoadGenerator(const ClientLoadGenerator &) = delete;
+    ClientLoadGenerator & operator=(const ClientLoadGenerator &) = delete;
+
+    /**
+     * @brief Read the nodes files, connect the sessions, create the monitored items and start the storms.
+     *
+     * @return Number of sessions connected.
+     */
+    size_t start();
+
+    /**
+     * @brief Stop the storms, delete the subscriptions and disconnect the sessions.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Print the throughput and the latencies since the last report, and reset them.
+     *
+     * @param seconds Time since the last report.
+     */
+    void report(double seconds);
+
+    /**
+     * @brief Load the configuration from a file of "key = value" lines.
+     *
+     * @param path Path of the file.
+     * @param config Output parameter with the configuration. The keys that are not in the file keep their value.
+     * @return true if the file exists.
+     */
+    static bool loadConfig(const std::string & path, ClientLoadConfig & config);
+
+    friend class ClientSession;
+};
+
+#endif  // __CLIENTLOADGENERATOR_H__
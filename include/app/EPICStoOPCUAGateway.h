@@ -18,7 +18,7 @@
  * 
  * It is designed to integrate with a custom node manager from OPC UA (MyNodeIOEventManager).
  * 
- * It do not implement behaviour for OPC UA events like alarms or conditions. 
+ * The EPICS alarms of the PVs can be exposed as OPC UA Alarms & Conditions (see AlarmManager).
  * 
  * @author Pablo Del Río López
  * @date 2025-06-01
@@ -33,6 +33,8 @@
 #include <string>
 #include <uanodeid.h>
 #include <myNodeIOEventManager.h>
+#include <updateRecorder.h>
+#include <pvTrace.h>
 #include <unordered_map>
 #include <thread>
 #include <atomic>
@@ -40,6 +42,19 @@
 #include <uabasenodes.h>
 #include <uadatavalue.h>
 #include <pvxs/nt.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <eventQueue.h>
+#include <pvCatalog.h>
+#include <pvNameTable.h>
+#include <indexRange.h>
+#include <StructureMapper.h>
+#include <AlarmManager.h>
 
 using namespace pvxs;
 using namespace pvxs::client;
@@ -66,6 +81,18 @@ struct PutRequest {
      */
     UaDataValue dataValue;
 
+    /**
+     * @brief Identifier of the EPICS process variable in the gateway's PVNameTable.
+     * 
+     */
+    uint32_t pvId = PVNameTable::InvalidId;
+
+    /**
+     * @brief Range of the elements written, for the array PVs. The whole array by default.
+     * 
+     */
+    IndexRange range;
+
     /**
      * @brief Construct a new and empty PutRequest object.
      * 
@@ -77,34 +104,75 @@ struct PutRequest {
      * 
      * @param var Pointer to the UaVariable.
      * @param val Data value to be written to the EPICS process variable.
+     * @param id Identifier of the EPICS process variable.
+     */
+    PutRequest(const UaVariable * var, UaDataValue val, uint32_t id)
+    : variable(var), dataValue(val), pvId(id) {}
+
+};
+
+/**
+ * @struct MonitorUpdate
+ * @brief Represents a value received from the subscription to an EPICS process variable.
+ * 
+ * The values are popped from the pvxs::client::Subscription in the PVXS event callback and
+ * enqueued to be converted and written to the OPC UA node by the gateway's worker thread(s).
+ * 
+ */
+struct MonitorUpdate {
+    /**
+     * @brief Identifier of the EPICS process variable in the gateway's PVNameTable.
+     * 
      */
-    PutRequest(const UaVariable * var, UaDataValue val)
-    : variable(var), dataValue(val) {}
+    uint32_t pvId = PVNameTable::InvalidId;
 
+    /**
+     * @brief The value received from the EPICS process variable.
+     * 
+     */
+    Value value;
+
+    /**
+     * @brief Construct a new and empty MonitorUpdate object.
+     * 
+     */
+    MonitorUpdate() = default;
+
+    /**
+     * @brief Construct a new MonitorUpdate object with a given PV identifier and Value.
+     * 
+     * @param id Identifier of the EPICS process variable.
+     * @param val The value received from the EPICS process variable.
+     */
+    MonitorUpdate(uint32_t id, Value && val)
+    : pvId(id), value(std::move(val)) {}
 };
 
-using GatewayEvent = std::variant<shared_ptr<pvxs::client::Subscription>, shared_ptr<PutRequest>>;
+using GatewayEvent = std::variant<shared_ptr<MonitorUpdate>, shared_ptr<PutRequest>>;
 
 /**
  * @struct PVMapping
- * @brief Represents a mapping between an EPICS PV name and an OPC UA NodeId.
+ * @brief Represents a mapping between an interned EPICS PV and an OPC UA NodeId.
  * 
- * This structure is used to establish a link between a named EPICS process variable
- * and its corresponding OPC UA node.
+ * This structure is used to establish a link between an EPICS process variable
+ * and its corresponding OPC UA node. The mappings are indexed by the identifier of the PV
+ * in the gateway's PVNameTable, which also holds the PV name.
  * 
  */
 struct PVMapping {
     /**
-     * @brief The name of the EPICS process variable.
+     * @brief The associated UaNodeId, built from the node name interned in the PVNameTable.
      * 
      */
-    string epicsName;
+    UaNodeId nodeId;
 
     /**
-     * @brief The associated UaNodeId
+     * @brief Prototype of the puts to the PV: an empty clone of the first value received in this run.
+     * Every put clones it and assigns only the written field. A put to a PV that has not been described yet
+     * seeds it from a get of the PV.
      * 
      */
-    UaNodeId nodeId;
+    Value putPrototype;
 
     /**
      * @brief Construct a new PVMapping object.
@@ -113,14 +181,47 @@ struct PVMapping {
     PVMapping() = default;
 
     /**
-     * @brief Construct a new PVMapping object with a given string and UaNodeId
+     * @brief Construct a new PVMapping object with a given UaNodeId
      * 
-     * @param name The EPICS process variable name
      * @param node The associated UaNodeId
      * 
      */
-    PVMapping(string name, UaNodeId node) 
-    : epicsName(name), nodeId(node) {}
+    explicit PVMapping(const UaNodeId & node) 
+    : nodeId(node) {}
+};
+
+/**
+ * @struct CachedValue
+ * @brief Last value received from an EPICS process variable, already converted to OPC UA.
+ * 
+ * The gateway keeps one per PV, so other publishers (e.g. PubSubPublisher) read the values
+ * without subscribing to the PVs again.
+ * 
+ */
+struct CachedValue {
+    /**
+     * @brief The converted value. Null until the first update is received.
+     * 
+     */
+    UaVariant value;
+
+    /**
+     * @brief StatusCode of the value.
+     * 
+     */
+    OpcUa_StatusCode statusCode = OpcUa_BadWaitingForInitialData;
+
+    /**
+     * @brief EPICS timestamp of the value, in 100 ns intervals since 1601-01-01 (OPC UA DateTime).
+     * 
+     */
+    int64_t sourceTimestamp = 0;
+
+    /**
+     * @brief Number of updates received. Allows readers to detect the changes.
+     * 
+     */
+    uint64_t version = 0;
 };
 
 
@@ -138,10 +239,23 @@ private:
     
     /**
      * @brief Thread-safe, bounded, multi-producer, multi-consumer FIFO queue. 
-     * The GatewayEvent that this queue manages could be pvxs::client::Subscription or PutRequest.
+     * The GatewayEvent that this queue manages could be MonitorUpdate or PutRequest.
+     * The key of every event is the identifier of the EPICS PV.
+     * 
+     * PutRequests and MonitorUpdates that change the alarm severity go through the fast lane,
+     * so operator commands never wait behind the telemetry of the normal lane.
+     * 
+     * The queue is closed by stop() to stop the intake and release the workers.
      * 
      */
-    MPMCFIFO<shared_ptr<GatewayEvent>> m_workQueue{100};
+    EventQueue<shared_ptr<GatewayEvent>, uint32_t> m_workQueue;
+
+    /**
+     * @brief Policy applied to the MonitorUpdates when the work queue is full.
+     * PutRequests always use OverflowPolicy::Block, so they are never dropped.
+     * 
+     */
+    OverflowPolicy m_overflowPolicy;
 
     /**
      * @brief An independent PVA protocol client instance.
@@ -155,6 +269,12 @@ private:
      */
     vector<shared_ptr<Subscription>> m_subcriptions;
 
+    /**
+     * @brief Mutex that protects m_subcriptions, which grows when the background discovery finds new PVs.
+     * 
+     */
+    mutex m_subscriptionsMutex;
+
     /**
      * @brief Pointer to MyNodeIoEventManager.
      * 
@@ -162,23 +282,123 @@ private:
     MyNodeIOEventManager * m_pNodeManager;
 
     /**
-     * @brief Stores mappings from EPICS PV names to their corresponding OPC UA nodes.
+     * @brief Converts the structured values (NTTable, NTNDArray and custom structures) to OPC UA structures.
      * 
-     * Key: EPICS process variable name (string).  
-     * Value: PVMapping structure containing the OPC UA NodeId.
      */
-    unordered_map<string, PVMapping> m_pvMapName;
+    StructureMapper m_structureMapper;
 
     /**
-     * @brief Stores mappings from UaNodeIds (as string) to EPICS PV names.
+     * @brief Interned names of the mapped EPICS PVs and the string identifiers of their OPC UA nodes.
      * 
-     * This allow quick reverse lookups from OPC UA nodes to their associated EPICS names.
+     * Gives every PV the identifier used to index m_mappings and m_catalog, and allows
+     * reverse lookups from OPC UA nodes to their associated PVs.
      * 
-     * Key: OPC UA NodeId (string format).  
-     * Value: PVMapping structure containing the EPICS PV name.
+     */
+    PVNameTable m_pvNames;
+
+    /**
+     * @brief Mapping of every PV to its OPC UA node, indexed by the identifier of the PV.
+     * 
+     * A deque never moves its elements when it grows, so a reference obtained with m_mapMutex
+     * locked stays valid after unlocking it.
+     * 
+     */
+    deque<PVMapping> m_mappings;
+
+    /**
+     * @brief Description of every mapped PV, persisted in the catalog snapshot.
+     * Indexed by the identifier of the PV. The name and NodeId are only filled when it is saved.
      * 
      */
-    unordered_map<string, PVMapping> m_pvMapUaNode;
+    deque<PVCatalogEntry> m_catalog;
+
+    /**
+     * @brief Readers-writer mutex that protects m_pvNames, m_mappings and m_catalog.
+     * 
+     * The tables are read by the workers and the OPC UA threads, and written when a PV is mapped.
+     * 
+     */
+    mutable shared_mutex m_mapMutex;
+
+    /**
+     * @brief Last value of every PV, indexed by the identifier of the PV.
+     * 
+     */
+    deque<CachedValue> m_values;
+
+    /**
+     * @brief Sticky error state of every PV, indexed by the identifier of the PV.
+     * OpcUa_Good, or the status of the last failed conversion or update, which is only reported once.
+     * 
+     */
+    deque<OpcUa_StatusCode> m_errorStates;
+
+    /**
+     * @brief Mutex that protects m_values and m_errorStates. It is locked after m_mapMutex when both are needed.
+     * 
+     */
+    mutable mutex m_valueMutex;
+
+    /**
+     * @brief Path of the catalog snapshot. Empty if the snapshot is disabled.
+     * 
+     */
+    string m_snapshotPath;
+
+    /**
+     * @brief Recorder of the forwarded updates. Null if the recorder is disabled.
+     * 
+     */
+    unique_ptr<UpdateRecorder> m_pRecorder;
+
+    /**
+     * @brief Trace of the monitor updates received. Null if the capture is disabled.
+     * 
+     */
+    unique_ptr<TraceWriter> m_pTraceWriter;
+
+    /**
+     * @brief Alarms & Conditions of the PVs. Null if the alarms are disabled.
+     * 
+     */
+    unique_ptr<AlarmManager> m_pAlarmManager;
+
+    /**
+     * @brief Whether the PVs were mapped from the catalog snapshot instead of the network discovery.
+     * 
+     */
+    bool m_warmStart = false;
+
+    /**
+     * @brief Number of PVs mapped when the gateway started. The PVs with a higher identifier were mapped afterwards.
+     * 
+     */
+    uint32_t m_snapshotSize = 0;
+
+    /**
+     * @brief Thread that checks the PVs restored from the snapshot against the live discovery.
+     * 
+     */
+    thread m_discoveryThread;
+
+    /**
+     * @brief Mutex used by the discovery to wait for the PVA servers.
+     * 
+     */
+    mutex m_discoveryMutex;
+
+    /**
+     * @brief Condition variable signaled when the PVA servers reply or the discovery is aborted.
+     * 
+     */
+    condition_variable m_discoveryCv;
+
+    /**
+     * @brief Whether the discovery has to be aborted because the gateway is stopping.
+     * Protected by m_discoveryMutex.
+     * 
+     */
+    bool m_discoveryAborted = false;
 
     /**
      * @brief Number of workers threads used to process queued events.
@@ -202,46 +422,219 @@ private:
      */
     atomic<bool> m_running{false};
 
+    /**
+     * @brief Time limit for the workers to flush the pending PutRequests during the shutdown,
+     * as the tick count of chrono::steady_clock.
+     * 
+     * Written by stop() before m_draining is set, so a worker that sees m_draining reads the final value.
+     * 
+     */
+    atomic<chrono::steady_clock::rep> m_drainDeadline{0};
+
+    /**
+     * @brief Whether the workers are flushing the pending PutRequests before stopping.
+     * 
+     * Set by stop() when the work queue is closed, not when m_running is cleared: until then,
+     * e.g. while the discovery thread finishes, the events are processed as usual.
+     * 
+     */
+    atomic<bool> m_draining{false};
+
+    /**
+     * @brief Number of PutRequests discarded, or put operations still in flight, when the drain deadline
+     * expired during the shutdown.
+     * 
+     */
+    atomic<int> m_droppedPuts{0};
+
+    /**
+     * @struct PendingPut
+     * @brief Put operation in flight. The operation is cancelled if its handle is released, so it is kept
+     * until it completes or times out.
+     * 
+     */
+    struct PendingPut {
+        uint32_t pvId = PVNameTable::InvalidId;
+        string epicsName;
+        shared_ptr<Operation> operation;
+        chrono::steady_clock::time_point deadline;
+        bool done = false;
+    };
+
+    /**
+     * @brief Put operations in flight, by the identifier given when they are issued.
+     * 
+     */
+    unordered_map<uint64_t, PendingPut> m_pendingPuts;
+
+    /**
+     * @brief Identifier of the next put operation.
+     * 
+     */
+    uint64_t m_nextPutId = 0;
+
+    /**
+     * @brief Mutex that protects m_pendingPuts and m_nextPutId. Never held while an operation is cancelled,
+     * since the cancellation waits for its completion callback.
+     * 
+     */
+    mutex m_putsMutex;
+
+    /**
+     * @brief Condition variable signaled when a put operation completes.
+     * 
+     */
+    condition_variable m_putsCv;
+
+    /**
+     * @brief Keep a put operation until it completes, and release the completed ones and cancel the ones
+     * that timed out.
+     * 
+     * @param putId Identifier of the operation.
+     * @param pvId Identifier of the PV.
+     * @param epicsName Name of the PV.
+     * @param operation The operation.
+     */
+    void trackPut(uint64_t putId, uint32_t pvId, const string & epicsName, shared_ptr<Operation> operation);
+
+    /**
+     * @brief Mark a put operation as completed. Called from its completion callback.
+     * 
+     * @param putId Identifier of the operation.
+     */
+    void finishPut(uint64_t putId);
+
     /**
      * @brief Internal loop that processes events from the work queue.
      * 
-     * Runs in a dedicated thread. Handles both Put operations and Subscription updates
+     * Runs in a dedicated thread. Handles both Put operations and Monitor updates
      * using a variant-based dispatcher.
      * 
+     * Once the work queue is closed (m_draining), Monitor updates are discarded and only the pending PutRequests
+     * are processed until the queue is empty or the drain deadline expires.
+     * 
      */
     void processQueue();
 
+    /**
+     * @brief Get the maximum time for the completion of a put operation, or of the get that seeds its prototype.
+     * 
+     * @return One second while running, or the time left until the drain deadline while draining.
+     */
+    chrono::milliseconds putTimeout() const;
+
+    /**
+     * @brief RPC operations sent to the PVA servers to ask for their PV names.
+     * 
+     */
     vector<std::shared_ptr<Operation>> m_RPCforPVNames;
 
+    /**
+     * @brief Discover the PVA servers of the network.
+     * 
+     * Waits 500 ms for the servers to reply, unless the discovery is aborted.
+     * 
+     * @return Set with the addresses of the servers.
+     */
     set<string> listServers();
 
+    /**
+     * @brief Ask every PVA server for the names of its PVs.
+     * 
+     * Waits up to 3 s for the servers to reply, unless the discovery is aborted.
+     * 
+     * @param servers Addresses of the servers.
+     * @return Vector with the names of the PVs.
+     */
     vector<string> listPVNames(const set<string> & servers);
 
-    vector<string> m_pvNames;
+    /**
+     * @brief Find the identifier of the PV mapped to an OPC UA node.
+     * Must be called with m_mapMutex locked.
+     * 
+     * Reads the string identifier of the node in place, without converting the NodeId to a string.
+     * 
+     * @param nodeId OPC UA UaNodeId.
+     * @return Identifier of the PV, or PVNameTable::InvalidId if the node is not mapped.
+     */
+    uint32_t findPV(const UaNodeId & nodeId) const;
+
+    /**
+     * @brief Subscribe to a PV and queue its updates.
+     * Does nothing if the gateway is not running.
+     * 
+     * @param pvId Identifier of the EPICS process variable.
+     */
+    void subscribe(uint32_t pvId);
 
     /**
-     * @brief Converts a PVXS Value to an OPC UA UaVariant.
+     * @brief Check the PVs restored from the snapshot against the live discovery.
+     * 
+     * Runs in m_discoveryThread. Maps and subscribes the new PVs and saves the snapshot.
+     * 
+     */
+    void verifyCatalog();
+
+    /**
+     * @brief Read the record type (the RTYP field) of the PVs of the catalog that do not have it yet.
+     * 
+     * Blocks until every PV replies or its probe times out, a PV without reply keeps an empty record type
+     * and is probed again after the next discovery. Stops early if the discovery is aborted.
+     * 
+     */
+    void probeRecordTypes();
+
+    /**
+     * @brief Number of record type probes in flight at a time.
+     * 
+     */
+    static constexpr size_t RecordTypeProbeBatch = 1000;
+
+    /**
+     * @brief Refresh the NT type and metadata of a PV in the catalog, and the prototype of its puts,
+     * from a received value. Only the first value received in each run is used.
+     * 
+     * @param pvId Identifier of the EPICS process variable.
+     * @param value The value received from the PV.
+     */
+    void describePV(uint32_t pvId, const Value & value);
+
+    /**
+     * @brief Write the catalog to the snapshot file, if enabled.
+     * 
+     */
+    void saveSnapshot();
+
+    /**
+     * @brief Converts a PVXS Value of an NTScalar or an NTEnum to an OPC UA UaVariant.
+     * Every scalar type of TypeMap is supported, strings included. The structured values are converted
+     * by m_structureMapper. It does not throw.
      * 
      * @param value The PVXS Value to be converted.
-     * @return UaVariant with the corresponding Value. Can be empty.
+     * @param variant Output parameter with the corresponding value. Unchanged if the conversion fails.
+     * @return OpcUa_Good, OpcUa_BadNotSupported if the type is not supported or OpcUa_BadTypeMismatch
+     * if the value does not match its type.
      */
-    UaVariant convertValueToVariant(const Value & value);
+    OpcUa_StatusCode convertValueToVariant(const Value & value, UaVariant & variant);
 
     /**
-     * @brief Converts a OPC UA UaVariant to a PVXS Value.
+     * @brief Set the error state of a PV. The error is reported once, when the PV enters the state,
+     * and the recovery is reported when the PV returns to OpcUa_Good.
      * 
-     * @param dataValue The OPC UA data to convert.
-     * @return Value with the corresponding value. Can be empty.
+     * @param pvId Identifier of the PV.
+     * @param status Result of the last update of the PV.
+     * @param operation Operation that produced the status, used in the report.
      */
-    Value convertUaDataValueToPvxsValue(const UaDataValue & dataValue);
+    void setErrorState(uint32_t pvId, OpcUa_StatusCode status, const char * operation);
 
     /**
-     * @brief creates a new string in which the colon is replaced by a dot.
+     * @brief Check whether a PV is already in an error state.
      * 
-     * @param input String with initial value
-     * @return String with dot.
+     * @param pvId Identifier of the PV.
+     * @param status Error state.
+     * @return true if the last update of the PV produced the same status.
      */
-    string replaceColonsWithDots(const string& input);
+    bool inErrorState(uint32_t pvId, OpcUa_StatusCode status) const;
 
 
 public:
@@ -251,8 +644,14 @@ public:
      * 
      * @param pNodeManager Pointer to MyNodeIOEventManager.
      * @param numThreads Number of workers attending the event queue.
+     * @param overflowPolicy Policy applied to the monitor updates when the event queue is full.
+     * @param fastWeight Events of the fast lane served for each event of the normal lane. 0 for strict priority.
+     * @param snapshotPath Path of the catalog snapshot. If the file is valid, the PVs are mapped from it and
+     * checked against the network discovery in the background. Empty to always use the network discovery.
      */
-    EPICStoOPCUAGateway(MyNodeIOEventManager * pNodeManager, int numThreads = 1);
+    EPICStoOPCUAGateway(MyNodeIOEventManager * pNodeManager, int numThreads = 1,
+                        OverflowPolicy overflowPolicy = OverflowPolicy::Coalesce, unsigned fastWeight = 8,
+                        const string & snapshotPath = "");
 
     /**
      * @brief Destroy the EPICStoOPCUAGateway object.
@@ -260,18 +659,62 @@ public:
      */
     ~EPICStoOPCUAGateway();
 
+    /**
+     * @brief Record every update forwarded to OPC UA to segment files (see UpdateRecorder).
+     * Must be called before start().
+     * 
+     * @param config Configuration of the recorder.
+     * @return true if the recorder started.
+     */
+    bool enableRecorder(const RecorderConfig & config);
+
+    /**
+     * @brief Capture every monitor update received, with its arrival time, to a trace file
+     * that TraceReplayer can replay. Must be called before start().
+     * 
+     * @param path Path of the trace file.
+     * @return true if the trace file was created.
+     */
+    bool enableCapture(const string & path);
+
+    /**
+     * @brief Expose the EPICS alarms of the PVs as OPC UA Alarms & Conditions (see AlarmManager).
+     * The OPC UA server must be started. Must be called before start().
+     * 
+     * @return true if the folder of the conditions was created.
+     */
+    bool enableAlarms();
+
+    /**
+     * @brief Get the AlarmManager of the gateway.
+     * 
+     * @return The AlarmManager, or nullptr if the alarms are disabled.
+     */
+    AlarmManager * alarmManager() const { return m_pAlarmManager.get(); }
+
     /**
      * @brief Start the gateway and its internal work thread(s).
      * Initializes the processing queue and begins handling EPICS subscriptions
      * and OPC UA write tasks.
+     * After a warm start, also starts the verification of the catalog against the network discovery.
      */
     void start();
 
     /**
      * @brief Stops the gateway and join all runnings threads.
      * 
+     * The shutdown is done in three steps:
+     * - Stops the intake of the work queue and cancels every subscription.
+     * - Lets the workers flush the pending PutRequests until the queue is empty or the timeout expires.
+     * - Closes the PVXS context, which cancels every operation still in progress.
+     * 
+     * A discovery in progress is aborted, and the catalog snapshot is saved at the end.
+     * 
+     * Calling this method more than once has no effect.
+     * 
+     * @param drainTimeout Maximum time to flush the pending PutRequests.
      */
-    void stop();
+    void stop(chrono::milliseconds drainTimeout = chrono::milliseconds(500));
 
     /**
      * @brief Enqueue a Put task to be processed asynchronously.
@@ -285,14 +728,52 @@ public:
     void enqueuePutTask(const UaVariable * variable, const UaDataValue& value);
 
     /**
-     * @brief Registers a mapping between an EPICS PV name and an OPC UA node.
+     * @brief Enqueue a Put task that writes a range of the elements of an array PV.
+     * 
+     * PVAccess has no put of a part of an array, so the worker puts the whole array: the last one
+     * received with the elements of the range replaced (copy on write).
+     * 
+     * @param pvId Identifier of the array PV.
+     * @param range Range of the elements written.
+     * @param value Elements written.
+     * The write is checked against the last array received before it is queued, so a range out of the array
+     * or a value that does not fit fails synchronously.
+     * 
+     * @return OpcUa_Good if the task was enqueued, OpcUa_BadNotWritable if the PV is not an array PV,
+     * OpcUa_BadIndexRangeNoData if the range is out of the array, OpcUa_BadIndexRangeInvalid if the number of elements
+     * does not match the range, OpcUa_BadTypeMismatch if the elements can not be converted to the type of the array,
+     * OpcUa_BadWaitingForInitialData if no array has been received or OpcUa_BadShutdown if the gateway is stopping.
+     */
+    OpcUa_StatusCode enqueueArrayPut(uint32_t pvId, const IndexRange & range, const UaVariant & value);
+
+    /**
+     * @brief Whether a PV is an NTScalarArray mapped to a one-dimensional variable.
+     * 
+     * @param pvId Identifier of the PV.
+     */
+    bool isArrayPV(uint32_t pvId);
+
+    /**
+     * @brief Read a range of the elements of an array PV, converting only those elements.
+     * 
+     * @param pvId Identifier of the array PV.
+     * @param range Range of the elements.
+     * @param variant Output parameter with the elements.
+     * @param sourceTimestamp Output parameter with the EPICS timestamp of the array (OPC UA DateTime), or 0.
+     * @return StatusCode of the value, or the error of the range (e.g. OpcUa_BadIndexRangeNoData).
+     */
+    OpcUa_StatusCode readArrayRange(uint32_t pvId, const IndexRange & range, UaVariant & variant, int64_t & sourceTimestamp);
+
+    /**
+     * @brief Registers a mapping between an EPICS PV name and an OPC UA node, and adds the PV to the catalog.
      * 
      * @param name The EPICS process variable.
-     * @param pvMapping The mapping structure containing name and node ID.
+     * @param nodeName String identifier of the OPC UA node in the namespace of the node manager.
+     * If empty, it is the PV name with the colons replaced by dots.
      * @return true if the mapping was added successfully.
      * @return false if the name already exists or in any error.
      */
-    bool addMapping(const string & name, const PVMapping & pvMapping);
+    bool addMapping(const string & name, const string & nodeName = "");
 
     /**
      * @brief Checks if an EPICS name is already mapped.
@@ -312,12 +793,78 @@ public:
      */
     bool isMapped(const UaNodeId & nodeId);
 
+    /**
+     * @brief Get the maximum number of events that the work queue has held.
+     * 
+     * @return High-watermark of the work queue.
+     */
+    size_t queueHighWatermark() const;
+
+    /**
+     * @brief Get the number of monitor updates dropped or coalesced for every EPICS PV.
+     * 
+     * @return Map with the EPICS PV names that have dropped updates and their number of drops.
+     */
+    unordered_map<string, uint64_t> droppedUpdates() const;
+
+    /**
+     * @brief Get the identifier of a mapped EPICS PV.
+     * 
+     * @param name The EPICS process variable name.
+     * @return Identifier of the PV, or PVNameTable::InvalidId if the PV is not mapped.
+     */
+    uint32_t pvId(const string & name) const;
+
+    /**
+     * @brief Get the identifier of the EPICS PV mapped to an OPC UA node.
+     * 
+     * @param nodeId UaNodeId of the node.
+     * @return Identifier of the PV, or PVNameTable::InvalidId if the node is not mapped.
+     */
+    uint32_t pvId(const UaNodeId & nodeId) const;
+
+    /**
+     * @brief Get the number of mapped PVs. The identifiers of the PVs are 0 to pvCount() - 1.
+     * 
+     */
+    uint32_t pvCount() const;
+
+    /**
+     * @brief Copy the catalog entry of a PV, with its name and node name.
+     * 
+     * @param pvId Identifier of the PV.
+     * @param entry Output parameter with the entry.
+     * @return true if the PV exists.
+     */
+    bool catalogEntry(uint32_t pvId, PVCatalogEntry & entry) const;
+
+    /**
+     * @brief Visit the catalog entries from a PV in order, without copying them.
+     * The visitor runs with the catalog locked, so it must not call the gateway nor the node manager.
+     * 
+     * @param firstId Identifier of the first PV to visit.
+     * @param visitor Called with the identifier, the name, the node name and the entry of every PV
+     * (the names of the entry are empty). Returns false to stop the visit.
+     */
+    void visitCatalog(uint32_t firstId,
+                      const function<bool(uint32_t, string_view, string_view, const PVCatalogEntry &)> & visitor) const;
+
+    /**
+     * @brief Copy the last values of a set of PVs from the value cache.
+     * Every value is read under the same lock, so the set is consistent.
+     * 
+     * @param pvIds Identifiers of the PVs.
+     * @param values Output parameter with the value of every PV, in the same order. 
+     * Invalid identifiers get an empty CachedValue.
+     */
+    void readValues(const vector<uint32_t> & pvIds, vector<CachedValue> & values) const;
+
 
     /**
      * @class GatewayHandler
      * @brief Internal handler class used to process variant-based work items.
      * 
-     * Implements calleable operators for handling Subscriptions and PutRequest events. 
+     * Implements calleable operators for handling MonitorUpdate and PutRequest events. 
      * 
      */
     class GatewayHandler {
@@ -337,19 +884,20 @@ public:
             explicit GatewayHandler(EPICStoOPCUAGateway* ptr) : m_self(ptr) {}
 
             /**
-             * @brief Handles a Subscription event.
+             * @brief Handles a MonitorUpdate event.
              * 
-             * Called when a new EPICS subscriptions message is received.
-             * Reenqueue the subscription when it has been processed.
+             * Called when a value received from an EPICS subscription is dequeued.
+             * Converts the value and updates the associated OPC UA node.
              * 
-             * @param subscription Shared pointer to the subscription object.
+             * @param update Shared pointer to the MonitorUpdate.
              */
-            void operator()(shared_ptr<Subscription> & subscription) const;
+            void operator()(shared_ptr<MonitorUpdate> & update) const;
 
             /**
              * @brief Handles a PutRequest event.
              * 
-             * Called when a write (Put) operation is dequeued.
+             * Called when a write (Put) operation is dequeued. The payload is an empty clone of the
+             * put prototype of the PV (see PVMapping) with only the written field assigned.
              * 
              * @param putRequest Shared pointer to the PutRequest.
              */
@@ -0,0 +1,143 @@
+/**
+ * @file GatewayHistoryManager.h
+ * @brief Declaration of the GatewayHistoryManager class.
+ *
+ * This file contains the history manager of MyNodeIOEventManager. It answers the HistoryRead
+ * service (ReadRawModifiedDetails and ReadProcessedDetails) from the in-memory history of the
+ * PVs (HistoryStore), so a trend display gets the last minutes of a PV without an archiver.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __GATEWAYHISTORYMANAGER_H__
+#define __GATEWAYHISTORYMANAGER_H__
+
+#include <cstdint>
+#include <vector>
+#include "historymanagerbase.h"
+#include <historyStore.h>
+
+/**
+ * @class PVHistoryVariableHandle
+ * @brief HistoryVariableHandle of a PV, with the identifier of the PV in the gateway.
+ *
+ * The handle does not reference the node, so the history of a PV that is not materialized
+ * in the address space can be read as well.
+ *
+ */
+class PVHistoryVariableHandle : public HistoryVariableHandle {
+public:
+    /**
+     * @brief Identifier of the PV.
+     *
+     */
+    uint32_t m_pvId = 0;
+};
+
+/**
+ * @class GatewayHistoryManager
+ * @brief HistoryManager that reads the history of the PVs from a HistoryStore.
+ *
+ * Only the raw values and the processed values of the Average, Minimum, Maximum, Count, Start and End
+ * aggregates are supported. The Average is the mean of the samples of the interval, not time-weighted.
+ * The raw reads return the bounding values if they are requested, the processed reads ignore them.
+ *
+ */
+class GatewayHistoryManager : public HistoryManagerBase {
+
+private:
+
+    /**
+     * @brief History of the PVs.
+     *
+     */
+    const HistoryStore * m_pHistory;
+
+    /**
+     * @struct RawValue
+     * @brief Value of the response of a raw read.
+     *
+     */
+    struct RawValue {
+        /**
+         * @brief Sample of the history, or null for a bounding value that was not found.
+         *
+         */
+        const HistorySample * pSample;
+
+        /**
+         * @brief Timestamp of the value.
+         *
+         */
+        int64_t timestamp;
+    };
+
+    /**
+     * @brief Get every value of the response of a raw read, in the requested order (OPC UA Part 11, 6.4.3).
+     * Forwards the range is [startTime, endTime), backwards (endTime, startTime]. Without startTime the
+     * values are returned backwards from endTime, endTime included.
+     *
+     * @param pvId Identifier of the PV.
+     * @param startTime Start of the request. Null (0) if not specified.
+     * @param endTime End of the request. Null (0) if not specified.
+     * @param returnBounds Whether the bounding values are added to the values of the range.
+     * @param samples Output parameter with the samples of the PV, sorted by time. The values point to them.
+     * @param values Output parameter with the values. Their timestamps never go back in the requested order.
+     * @return true if the values are in reverse order.
+     */
+    bool rawValues(uint32_t pvId, int64_t startTime, int64_t endTime, bool returnBounds,
+                   std::vector<HistorySample> & samples, std::vector<RawValue> & values) const;
+
+    /**
+     * @brief Fill a DataValue of a response.
+     *
+     */
+    static void setDataValue(OpcUa_DataValue & dataValue, const UaVariant & value, OpcUa_StatusCode statusCode,
+                             int64_t timestamp, OpcUa_TimestampsToReturn timestampsToReturn);
+
+public:
+
+    /**
+     * @brief Construct a new GatewayHistoryManager object.
+     *
+     * @param pHistory History of the PVs.
+     */
+    explicit GatewayHistoryManager(const HistoryStore * pHistory);
+
+    /**
+     * @brief Read the raw samples of a PV, up to maxValues per call. The rest is returned with continuation points.
+     *
+     */
+    UaStatus readRaw(
+        const ServiceContext & serviceContext,
+        HistoryVariableHandle * pVariableHandle,
+        HistoryReadCPUserDataBase ** ppContinuationPoint,
+        OpcUa_TimestampsToReturn timestampsToReturn,
+        OpcUa_UInt32 maxValues,
+        OpcUa_DateTime & startTime,
+        OpcUa_DateTime & endTime,
+        OpcUa_Boolean returnBounds,
+        OpcUa_HistoryReadValueId * pReadValueId,
+        UaDataValues & dataValues) override;
+
+    /**
+     * @brief Read the aggregate of the samples of a PV in every resampleInterval of the time range.
+     * If startTime is after endTime, the intervals are returned backwards from startTime.
+     *
+     */
+    UaStatus readProcessed(
+        const ServiceContext & serviceContext,
+        HistoryVariableHandle * pVariableHandle,
+        HistoryReadCPUserDataBase ** ppContinuationPoint,
+        OpcUa_TimestampsToReturn timestampsToReturn,
+        OpcUa_DateTime & startTime,
+        OpcUa_DateTime & endTime,
+        OpcUa_Double resampleInterval,
+        OpcUa_NodeId & aggregateType,
+        OpcUa_AggregateConfiguration & aggregateConfiguration,
+        OpcUa_HistoryReadValueId * pReadValueId,
+        UaDataValues & dataValues) override;
+};
+
+#endif  // __GATEWAYHISTORYMANAGER_H__
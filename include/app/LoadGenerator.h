@@ -0,0 +1,352 @@
+/**
+ * @file LoadGenerator.h
+ * @brief Declaration of the LoadGenerator class and the LoadConfig structure.
+ *
+ * This file contains the declaration of the LoadGenerator class, which simulates the IOCs of the
+ * IOCs directory without building or running them. The records of their .db files are multiplied by
+ * a factor and served by an embedded PVXS server, with the same normative types as the soft IOCs,
+ * so a gateway can be scale-tested with 100k PVs on a single machine.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __LOADGENERATOR_H__
+#define __LOADGENERATOR_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pvxs/data.h>
+#include <pvxs/server.h>
+#include <pvxs/sharedpv.h>
+#include <dbFile.h>
+
+/**
+ * @struct LoadConfig
+ * @brief Configuration of the load generator.
+ *
+ */
+struct LoadConfig {
+    /**
+     * @brief Number of copies of every record. The copy i of a record is named "<name>_<i>",
+     * with a multiplier of 1 the records keep their names.
+     *
+     */
+    size_t multiplier = 1;
+
+    /**
+     * @brief Factor applied to the scan rates. 10 scans a "1 second" record every 100 ms.
+     *
+     */
+    double rateScale = 1.0;
+
+    /**
+     * @brief Scan period of the input records without a periodic SCAN. 0 leaves them passive.
+     *
+     */
+    std::chrono::milliseconds passivePeriod{0};
+
+    /**
+     * @brief Maximum step of the random walk, as a fraction of the range of the record.
+     *
+     */
+    double walkStep = 0.01;
+
+    /**
+     * @brief Probability that a binary or multi-bit record changes its state in a scan.
+     *
+     */
+    double stateChange = 0.1;
+
+    /**
+     * @brief Time between bursts. 0 disables the bursts.
+     *
+     */
+    std::chrono::milliseconds burstInterval{0};
+
+    /**
+     * @brief Fraction of the PVs updated by a burst.
+     *
+     */
+    double burstFraction = 0.1;
+
+    /**
+     * @brief Updates posted back-to-back to every PV of a burst. The steps of a burst are ten
+     * times larger, so the analog records cross their alarm limits.
+     *
+     */
+    size_t burstUpdates = 10;
+
+    /**
+     * @brief Seed of the random walks, a run can be repeated.
+     *
+     */
+    uint64_t seed = 1;
+};
+
+/**
+ * @class LoadGenerator
+ * @brief Serves simulated copies of the records of EPICS databases through an embedded PVA server.
+ *
+ * The record types are served as the soft IOCs serve them:
+ * - ai and ao: NTScalar double, with display limits (LOPR/HOPR or DRVL/DRVH), units and description.
+ * - longin and longout: NTScalar int32. int64in and int64out: NTScalar int64.
+ * - bi, bo, mbbi and mbbo: NTEnum with the state names as choices.
+ *
+ * The analog records follow a random walk inside their range and take the alarm severity of their
+ * HIHI/HIGH/LOW/LOLO limits. Every periodic SCAN rate has a scan thread, as in an IOC, that posts
+ * all its PVs at once. The output records accept puts. The records of other types are ignored.
+ *
+ */
+class LoadGenerator {
+
+private:
+
+    /**
+     * @brief Kind of value of a simulated record.
+     *
+     */
+    enum class Kind { Double, Int32, Int64, Enum };
+
+    /**
+     * @struct SimulatedPV
+     * @brief State of a simulated record.
+     *
+     */
+    struct SimulatedPV {
+        pvxs::server::SharedPV pv;
+
+        /**
+         * @brief Initial value with the metadata of the record until the PV is open, then its empty clone.
+         *
+         */
+        pvxs::Value prototype;
+
+        Kind kind;
+
+        /**
+         * @brief Current value, or index of the current state.
+         *
+         */
+        double value;
+
+        /**
+         * @brief Range of the random walk.
+         *
+         */
+        double low;
+        double high;
+
+        /**
+         * @brief Number of states of an enum.
+         *
+         */
+        uint32_t states;
+
+        /**
+         * @brief Alarm limits (HIHI, HIGH, LOW, LOLO). NaN if the record does not set them.
+         *
+         */
+        double hihi;
+        double highAlarm;
+        double lowAlarm;
+        double lolo;
+    };
+
+    /**
+     * @struct ScanList
+     * @brief PVs scanned with the same period, by the same thread.
+     *
+     */
+    struct ScanList {
+        std::chrono::nanoseconds period;
+        std::vector<size_t> pvs;
+    };
+
+    /**
+     * @brief Configuration of the load generator.
+     *
+     */
+    LoadConfig m_config;
+
+    /**
+     * @brief Embedded PVA server.
+     *
+     */
+    pvxs::server::Server m_server;
+
+    /**
+     * @brief Simulated PVs.
+     *
+     */
+    std::vector<SimulatedPV> m_pvs;
+
+    /**
+     * @brief Number of mutexes that protect the PVs.
+     *
+     */
+    static constexpr size_t MutexStripes = 256;
+
+    /**
+     * @brief Mutexes of the PVs between the scan threads, the burst thread and the puts. A PV uses the mutex index % MutexStripes.
+     *
+     */
+    std::mutex m_pvMutexes[MutexStripes];
+
+    /**
+     * @brief Scan lists, by period in nanoseconds.
+     *
+     */
+    std::map<int64_t, ScanList> m_scanLists;
+
+    /**
+     * @brief Scan threads and the burst thread.
+     *
+     */
+    std::vector<std::thread> m_threads;
+
+    /**
+     * @brief Flag to stop the threads, protected by m_stopMutex.
+     *
+     */
+    bool m_stopping = false;
+
+    /**
+     * @brief Mutex and condition variable that wake up the threads when the generator stops.
+     *
+     */
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCv;
+
+    /**
+     * @brief Whether the generator is running.
+     *
+     */
+    bool m_running = false;
+
+    /**
+     * @brief Number of updates posted.
+     *
+     */
+    std::atomic<uint64_t> m_posted{0};
+
+    /**
+     * @brief Create the simulated PV of a record copy.
+     *
+     * @return false if the record type is not supported.
+     */
+    bool addRecord(const DbRecord & record, const std::string & pvName);
+
+    /**
+     * @brief Advance the state of a PV and post it.
+     * The caller must hold the mutex of the PV.
+     *
+     * @param index Index of the PV.
+     * @param scale Factor of the step of the random walk.
+     * @param random Random generator of the calling thread.
+     */
+    void step(size_t index, double scale, std::mt19937_64 & random);
+
+    /**
+     * @brief Post the current state of a PV, with the alarm severity of its value.
+     * The caller must hold the mutex of the PV.
+     *
+     */
+    void post(SimulatedPV & simulated);
+
+    /**
+     * @brief Loop of a scan thread.
+     *
+     */
+    void scan(const ScanList & list, uint64_t seed);
+
+    /**
+     * @brief Loop of the burst thread.
+     *
+     */
+    void burst(uint64_t seed);
+
+    /**
+     * @brief Wait until a time point or until the generator stops.
+     *
+     * @return false if the generator is stopping.
+     */
+    bool waitUntil(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Parse a SCAN field.
+     *
+     * @return Scan period, or 0 for the non-periodic scans (Passive, I/O Intr, Event).
+     */
+    static std::chrono::nanoseconds scanPeriod(const std::string & scan);
+
+public:
+
+    /**
+     * @brief Construct a new LoadGenerator object.
+     * The PVA server is configured from the environment (EPICS_PVAS_*).
+     *
+     * @param config Configuration of the load generator.
+     */
+    explicit LoadGenerator(const LoadConfig & config);
+
+    /**
+     * @brief Destroy the LoadGenerator object. Stops the threads and the server.
+     *
+     */
+    ~LoadGenerator();
+
+    LoadGenerator(const LoadGenerator &) = delete;
+    LoadGenerator & operator=(const LoadGenerator &) = delete;
+
+    /**
+     * @brief Create the simulated PVs of the records of some databases. Must be called before start().
+     *
+     * @param records Records read with DbFile.
+     * @return Number of PVs created.
+     */
+    size_t load(const std::vector<DbRecord> & records);
+
+    /**
+     * @brief Start the PVA server, the scan threads and the burst thread.
+     *
+     */
+    void start();
+
+    /**
+     * @brief Stop the threads and the PVA server.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Number of simulated PVs.
+     *
+     */
+    size_t size() const { return m_pvs.size(); }
+
+    /**
+     * @brief Number of updates posted since the start.
+     *
+     */
+    uint64_t posted() const { return m_posted.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Load the configuration from a file of "key = value" lines.
+     *
+     * @param path Path of the file.
+     * @param config Output parameter with the configuration. The keys that are not in the file keep their value.
+     * @return true if the file exists.
+     */
+    static bool loadConfig(const std::string & path, LoadConfig & config);
+};
+
+#endif  // __LOADGENERATOR_H__
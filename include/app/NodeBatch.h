@@ -0,0 +1,193 @@
+/**
+ * @file NodeBatch.h
+ * @brief Declaration of the NodeBatch class.
+ *
+ * This file contains the batch builder of the address space. The objects, nodes and references of
+ * a batch are collected first and committed to MyNodeIOEventManager with a single acquisition of
+ * the node lock, instead of one lock per node.
+ *
+ * Every object is committed with all its variables before the reference from its parent is added,
+ * so a client that browses the address space during the build never sees a partial object.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __NODEBATCH_H__
+#define __NODEBATCH_H__
+
+#include <memory>
+#include <vector>
+#include <iocBasicObject.h>
+
+/**
+ * @class NodeBatch
+ * @brief Collects the nodes of the address space and commits them at once.
+ *
+ * The batch owns the collected nodes until it is committed. The nodes of a batch that is destroyed
+ * without commit() are released.
+ *
+ * This class is not thread-safe. A batch must be built and committed by a single thread.
+ *
+ */
+class NodeBatch {
+
+    friend class MyNodeIOEventManager;
+
+private:
+
+    /**
+     * @struct PendingObject
+     * @brief Object instance waiting to be committed.
+     *
+     */
+    struct PendingObject {
+        /**
+         * @brief The new object.
+         *
+         */
+        IocBasicObject * pObject;
+
+        /**
+         * @brief Descriptors of the variables of its ObjectType.
+         *
+         */
+        std::shared_ptr<const std::vector<IocVariableTemplate>> pTemplate;
+
+        /**
+         * @brief Parent of the object (source of the Organizes reference).
+         *
+         */
+        UaNodeId parentNodeId;
+    };
+
+    /**
+     * @struct PendingNode
+     * @brief Node waiting to be committed.
+     *
+     */
+    struct PendingNode {
+        /**
+         * @brief The new node.
+         *
+         */
+        UaNode * pNode;
+
+        /**
+         * @brief Parent of the node (source of the reference).
+         *
+         */
+        UaNodeId parentNodeId;
+
+        /**
+         * @brief Type of the reference from the parent.
+         *
+         */
+        UaNodeId referenceTypeId;
+    };
+
+    /**
+     * @struct PendingReference
+     * @brief Reference between existing nodes, or nodes of the batch, waiting to be committed.
+     *
+     */
+    struct PendingReference {
+        UaNodeId sourceNodeId;
+        UaNodeId targetNodeId;
+        UaNodeId referenceTypeId;
+    };
+
+    /**
+     * @brief Node manager where the batch is committed.
+     *
+     */
+    MyNodeIOEventManager * m_pNodeManager;
+
+    /**
+     * @brief Collected objects, in insertion order.
+     *
+     */
+    std::vector<PendingObject> m_objects;
+
+    /**
+     * @brief Collected nodes, in insertion order. They are committed after the objects.
+     *
+     */
+    std::vector<PendingNode> m_nodes;
+
+    /**
+     * @brief Collected references. They are committed after every node.
+     *
+     */
+    std::vector<PendingReference> m_references;
+
+public:
+
+    /**
+     * @brief Construct a new NodeBatch object.
+     *
+     * @param pNodeManager Node manager where the batch is committed.
+     */
+    explicit NodeBatch(MyNodeIOEventManager * pNodeManager);
+
+    NodeBatch(const NodeBatch &) = delete;
+    NodeBatch & operator=(const NodeBatch &) = delete;
+
+    /**
+     * @brief Destroy the NodeBatch object. Releases the nodes that have not been committed.
+     *
+     */
+    ~NodeBatch();
+
+    /**
+     * @brief Reserve space for the objects of the batch.
+     *
+     * @param objects Expected number of objects.
+     */
+    void reserve(size_t objects);
+
+    /**
+     * @brief Add an object that "inherits" from the ObjectType that is definied by the typeId.
+     * The variables of the type are resolved now and instantiated in commit().
+     *
+     * @param objectName Name of the object.
+     * @param typeId ObjectType of this object.
+     * @param objectId UaNodeId of the new object.
+     * @param parentNodeId The parent node in the address space (source of the Organizes reference).
+     */
+    void addObject(const UaString & objectName, int typeId, const UaNodeId & objectId, const UaNodeId & parentNodeId);
+
+    /**
+     * @brief Add a node created by the caller. The batch takes its ownership.
+     *
+     * @param pNode The new node.
+     * @param parentNodeId The parent node in the address space.
+     * @param referenceTypeId Type of the reference from the parent.
+     */
+    void addNode(UaNode * pNode, const UaNodeId & parentNodeId, const UaNodeId & referenceTypeId);
+
+    /**
+     * @brief Add a reference between two nodes. The nodes can be part of the batch.
+     *
+     * @param sourceNodeId Source of the reference.
+     * @param targetNodeId Target of the reference.
+     * @param referenceTypeId Type of the reference.
+     */
+    void addReference(const UaNodeId & sourceNodeId, const UaNodeId & targetNodeId, const UaNodeId & referenceTypeId);
+
+    /**
+     * @brief Number of objects and nodes collected.
+     *
+     */
+    size_t size() const { return m_objects.size() + m_nodes.size(); }
+
+    /**
+     * @brief Commit the batch to the node manager under a single acquisition of the node lock.
+     * The batch is empty afterwards and can be reused.
+     *
+     * @return UaStatus of the first operation that failed, or Good.
+     */
+    UaStatus commit();
+};
+
+#endif  // __NODEBATCH_H__
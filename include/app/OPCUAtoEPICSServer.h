@@ -0,0 +1,224 @@
+/**
+ * @file OPCUAtoEPICSServer.h
+ * @brief Declaration of the OPCUAtoEPICSServer class.
+ *
+ * This file contains the declaration of the OPCUAtoEPICSServer class, which publishes
+ * selected OPC UA variables of MyNodeIOEventManager as PVAccess process variables
+ * through an embedded PVXS server.
+ *
+ * It is the opposite direction of EPICStoOPCUAGateway: EPICS clients (archivers, CSS, ...)
+ * can read the data of the OPC UA side, e.g. PLC values, without a second gateway process.
+ *
+ * The PVs are fed directly from the value changes of the nodes, there is no polling:
+ * - Writes of OPC UA clients, through MyNodeIOEventManager::afterSetAttributeValue().
+ * - Internal updates, through MyNodeIOEventManager::updateVariable().
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __OPCUATOEPICSSERVER_H__
+#define __OPCUATOEPICSSERVER_H__
+
+#include <atomic>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <pvxs/data.h>
+#include <pvxs/server.h>
+#include <pvxs/sharedpv.h>
+#include <uabasenodes.h>
+#include <uadatavalue.h>
+#include <uanodeid.h>
+#include <myNodeIOEventManager.h>
+
+/**
+ * @struct PublishedPV
+ * @brief Represents an OPC UA variable published as a PVAccess process variable.
+ *
+ */
+struct PublishedPV {
+    /**
+     * @brief Name of the published PV.
+     *
+     */
+    std::string pvName;
+
+    /**
+     * @brief UaNodeId of the published variable.
+     *
+     */
+    UaNodeId nodeId;
+
+    /**
+     * @brief PV served by the PVXS server.
+     *
+     */
+    pvxs::server::SharedPV pv;
+
+    /**
+     * @brief Empty clone of the initial value of the PV, used to build every update.
+     *
+     */
+    pvxs::Value prototype;
+
+    /**
+     * @brief Whether the PV is an NTEnum (TwoStateDiscreteType and MultiStateDiscreteType variables).
+     *
+     */
+    bool isEnum = false;
+};
+
+/**
+ * @class OPCUAtoEPICSServer
+ * @brief Serves OPC UA variables of MyNodeIOEventManager as PVAccess PVs.
+ *
+ * Every published variable is served by a SharedPV of an embedded pvxs::server::Server.
+ * The data types follow the conventions of EPICStoOPCUAGateway:
+ * - Boolean and Int16 variables are NTEnum PVs, with the states of the variable as choices.
+ * - Double, Int32 and Int64 variables are NTScalar PVs, with the engineering units and the EURange as display metadata.
+ *
+ * The StatusCode of the value is mapped to the alarm severity of the PV (Good: NO_ALARM,
+ * Uncertain: MINOR, Bad: INVALID). Writable variables accept puts from PVA clients.
+ *
+ */
+class OPCUAtoEPICSServer {
+
+private:
+
+    /**
+     * @brief Node manager that owns the published variables.
+     *
+     */
+    MyNodeIOEventManager * m_pNodeManager;
+
+    /**
+     * @brief Embedded PVA server.
+     *
+     */
+    pvxs::server::Server m_server;
+
+    /**
+     * @brief Published PVs, indexed by their variable node.
+     *
+     * The nodes are looked up by address because every value change already provides the node,
+     * so the NodeId does not need to be compared.
+     *
+     */
+    std::unordered_map<const UaNode *, PublishedPV> m_pvs;
+
+    /**
+     * @brief Readers-writer mutex that protects m_pvs. The value changes only read it.
+     *
+     */
+    mutable std::shared_mutex m_mutex;
+
+    /**
+     * @brief Whether the PVA server is running.
+     *
+     */
+    std::atomic<bool> m_running{false};
+
+    /**
+     * @brief Build the initial value of a published variable.
+     *
+     * @param pVariable Variable to publish.
+     * @param isEnum Output parameter. Whether the PV is an NTEnum.
+     * @return Initial value of the PV, or an invalid Value if the data type is not supported.
+     */
+    pvxs::Value createValue(UaVariable * pVariable, bool & isEnum) const;
+
+    /**
+     * @brief Copy an OPC UA value, its timestamp and its status to a PVXS value.
+     *
+     * @param value PVXS value created from the prototype of the PV.
+     * @param dataValue OPC UA value.
+     * @param isEnum Whether the PV is an NTEnum.
+     * @return true if the value was copied.
+     * @return false if the data type of the value is not supported.
+     */
+    static bool fillValue(pvxs::Value & value, const UaDataValue & dataValue, bool isEnum);
+
+    /**
+     * @brief Convert the value of a put from a PVA client to an OPC UA variant.
+     *
+     * @param value Value received from the client.
+     * @param current Current value of the variable, which determines the data type.
+     * @param variant Output parameter with the converted value.
+     * @return true if the value was converted.
+     * @return false if the value does not have the data type of the variable.
+     */
+    static bool convertPut(const pvxs::Value & value, const UaVariant & current, UaVariant & variant);
+
+public:
+
+    /**
+     * @brief Construct a new OPCUAtoEPICSServer object.
+     * The PVA server is configured from the EPICS_PVAS_* environment variables.
+     *
+     * @param pNodeManager Node manager that owns the variables to be published.
+     */
+    explicit OPCUAtoEPICSServer(MyNodeIOEventManager * pNodeManager);
+
+    OPCUAtoEPICSServer(const OPCUAtoEPICSServer &) = delete;
+    OPCUAtoEPICSServer & operator=(const OPCUAtoEPICSServer &) = delete;
+
+    /**
+     * @brief Destroy the OPCUAtoEPICSServer object. Stops the PVA server.
+     *
+     */
+    ~OPCUAtoEPICSServer();
+
+    /**
+     * @brief Publish an OPC UA variable as a PV.
+     * It can be called before and after start().
+     *
+     * @param nodeId UaNodeId of the variable in the namespace of the node manager.
+     * @param pvName Name of the PV.
+     * @return true if the variable was published.
+     * @return false if the node is not a variable, its data type is not supported, or the node or name are already published.
+     */
+    bool publish(const UaNodeId & nodeId, const std::string & pvName);
+
+    /**
+     * @brief Publish the variables listed in a text file.
+     *
+     * Every line contains the string identifier of a node in the namespace of the node manager
+     * and, optionally, the name of the PV. By default, the PV name is the identifier with the dots
+     * replaced by colons. Empty lines and lines starting with '#' are ignored.
+     *
+     * @param path Path of the file.
+     * @return Number of published variables.
+     */
+    size_t publishFromFile(const std::string & path);
+
+    /**
+     * @brief Start serving the published PVs.
+     *
+     */
+    void start();
+
+    /**
+     * @brief Stop serving the PVs. The clients are disconnected.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Number of published PVs.
+     *
+     * @return Number of PVs.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Post the new value of a node to its PV. Does nothing if the node is not published.
+     * Called by the node manager for every value change.
+     *
+     * @param pNode Node whose value has changed.
+     * @param dataValue New value of the node.
+     */
+    void valueChanged(const UaNode * pNode, const UaDataValue & dataValue);
+};
+
+#endif  // __OPCUATOEPICSSERVER_H__
@@ -0,0 +1,275 @@
+/**
+ * @file PubSubPublisher.h
+ * @brief Declaration of the PubSubPublisher class and the PubSubConfig structure.
+ *
+ * This file contains the declaration of the OPC UA PubSub publisher of the gateway. It packs
+ * a preconfigured set of EPICS PVs into UADP NetworkMessages and sends them to a UDP multicast group
+ * at a fixed publishing interval. A single stream serves any number of subscribers, instead of one
+ * set of monitored items per client session.
+ *
+ * The values are read from the value cache of EPICStoOPCUAGateway, so the publisher does not
+ * subscribe to the PVs again and never touches the address space.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __PUBSUBPUBLISHER_H__
+#define __PUBSUBPUBLISHER_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <EPICStoOPCUAGateway.h>
+#include <uadpEncoder.h>
+
+/**
+ * @struct PubSubConfig
+ * @brief Configuration of the PubSub publisher.
+ *
+ * The DataSetMetaData is preconfigured: its fields are the PVs of pvNames, in the same order,
+ * and the subscribers must be configured with the same list and ConfigurationVersion.
+ *
+ */
+struct PubSubConfig {
+    /**
+     * @brief Multicast group (or unicast address) where the messages are sent.
+     *
+     */
+    std::string address = "239.0.0.1";
+
+    /**
+     * @brief UDP port. 4840 is the port registered for opc.udp.
+     *
+     */
+    uint16_t port = 4840;
+
+    /**
+     * @brief Address of the local interface used to send multicast messages. Empty for the default interface.
+     *
+     */
+    std::string interfaceAddress;
+
+    /**
+     * @brief Time to live of the multicast messages. 1 keeps them in the local network.
+     *
+     */
+    int ttl = 1;
+
+    /**
+     * @brief PublisherId of the NetworkMessages.
+     *
+     */
+    uint16_t publisherId = 1;
+
+    /**
+     * @brief Identifier of the WriterGroup.
+     *
+     */
+    uint16_t writerGroupId = 1;
+
+    /**
+     * @brief Identifier of the DataSetWriter.
+     *
+     */
+    uint16_t dataSetWriterId = 1;
+
+    /**
+     * @brief Major ConfigurationVersion of the DataSetMetaData. Must be changed when pvNames changes.
+     *
+     */
+    uint32_t majorVersion = 1;
+
+    /**
+     * @brief Minor ConfigurationVersion of the DataSetMetaData.
+     *
+     */
+    uint32_t minorVersion = 0;
+
+    /**
+     * @brief Publishing interval of the WriterGroup.
+     *
+     */
+    std::chrono::milliseconds publishingInterval{100};
+
+    /**
+     * @brief A key frame with every field is sent every keyFrameCount messages.
+     * The messages in between are delta frames with the changed fields, or keep alive messages.
+     *
+     */
+    unsigned keyFrameCount = 10;
+
+    /**
+     * @brief EPICS PVs of the DataSet, one field per PV.
+     *
+     */
+    std::vector<std::string> pvNames;
+};
+
+/**
+ * @class PubSubPublisher
+ * @brief Publishes EPICS PVs from the gateway's value cache as a UADP PubSub stream.
+ *
+ * A dedicated thread builds one NetworkMessage with one DataSetMessage per publishing interval.
+ * The fields use the DataValue encoding, so every PV carries its EPICS timestamp and status.
+ *
+ */
+class PubSubPublisher {
+
+private:
+
+    /**
+     * @brief Gateway whose value cache is published.
+     *
+     */
+    EPICStoOPCUAGateway * m_pGateway;
+
+    /**
+     * @brief Configuration of the publisher.
+     *
+     */
+    PubSubConfig m_config;
+
+    /**
+     * @brief Identifiers of the PVs of the DataSet in the gateway, in field order.
+     *
+     */
+    std::vector<uint32_t> m_pvIds;
+
+    /**
+     * @brief Values read from the cache in the current publishing cycle.
+     *
+     */
+    std::vector<CachedValue> m_values;
+
+    /**
+     * @brief Version of every field in the last message that contained it.
+     *
+     */
+    std::vector<uint64_t> m_sentVersions;
+
+    /**
+     * @brief Encoder of the NetworkMessages. Its buffer is reused by every message.
+     *
+     */
+    UadpEncoder m_encoder;
+
+    /**
+     * @brief Views of the elements of a String array field. Reused by every message.
+     *
+     */
+    std::vector<std::string_view> m_strings;
+
+    /**
+     * @brief UDP socket, or -1 if the publisher is not running.
+     *
+     */
+    int m_socket = -1;
+
+    /**
+     * @brief Sequence number of the NetworkMessages and the DataSetMessages.
+     *
+     */
+    uint16_t m_sequenceNumber = 0;
+
+    /**
+     * @brief Publishing thread.
+     *
+     */
+    std::thread m_thread;
+
+    /**
+     * @brief Mutex and condition variable used to wake up the publishing thread when the publisher stops.
+     *
+     */
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    /**
+     * @brief Whether the publishing thread must finish. Protected by m_mutex.
+     *
+     */
+    bool m_stopping = false;
+
+    /**
+     * @brief Open the UDP socket and set the multicast options.
+     *
+     * @return true if the socket is ready.
+     * @return false otherwise.
+     */
+    bool openSocket();
+
+    /**
+     * @brief Publishing thread. Sends one message per publishing interval until stop() is called.
+     *
+     */
+    void run();
+
+    /**
+     * @brief Build and send the message of a publishing cycle.
+     *
+     */
+    void publish();
+
+    /**
+     * @brief Encode a field of the DataSetMessage.
+     *
+     * @param value Cached value of the field.
+     */
+    void writeField(const CachedValue & value);
+
+public:
+
+    /**
+     * @brief Construct a new PubSubPublisher object.
+     *
+     * @param pGateway Gateway whose value cache is published.
+     * @param config Configuration of the publisher.
+     */
+    PubSubPublisher(EPICStoOPCUAGateway * pGateway, const PubSubConfig & config);
+
+    PubSubPublisher(const PubSubPublisher &) = delete;
+    PubSubPublisher & operator=(const PubSubPublisher &) = delete;
+
+    /**
+     * @brief Destroy the PubSubPublisher object. Stops the publishing thread.
+     *
+     */
+    ~PubSubPublisher();
+
+    /**
+     * @brief Resolve the PVs of the DataSet, open the socket and start publishing.
+     * The PVs that are not mapped by the gateway are published with a Bad status.
+     *
+     * @return true if the publisher started.
+     * @return false if the socket could not be opened.
+     */
+    bool start();
+
+    /**
+     * @brief Stop publishing and close the socket.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Read the configuration of the publisher from a text file.
+     *
+     * Every line is a "key = value" pair, with the keys address, port, interface, ttl, publisherId,
+     * writerGroupId, dataSetWriterId, majorVersion, minorVersion, interval (ms), keyFrameCount and pv.
+     * The key pv can be repeated, once per field of the DataSet. Lines starting with '#' are ignored.
+     *
+     * @param path Path of the file.
+     * @param config Output parameter with the configuration. Missing keys keep their default value.
+     * @return true if the file was read and it has at least one PV.
+     * @return false otherwise.
+     */
+    static bool loadConfig(const std::string & path, PubSubConfig & config);
+};
+
+#endif  // __PUBSUBPUBLISHER_H__
@@ -0,0 +1,372 @@
+/**
+ * @file StructureMapper.h
+ * @brief Declaration of the StructureMapper class.
+ *
+ * This file contains the declaration of the StructureMapper class, which converts the structured
+ * EPICS Normative Types to OPC UA structures:
+ * - NTTable: array of structures, one structure per row with one field per column.
+ * - NTNDArray: NDArrayImage structure with the unique id, the dimensions, the data type and the raw data as ByteString.
+ * - NTScalarArray of numbers or booleans: one-dimensional array of the element type. An update whose array is equal to
+ *   the previous one is suppressed. The monitored items with an IndexRange are filtered by the SDK, which compares
+ *   the range of each item with the one it notified last.
+ *   The last array is kept, so the reads and writes of a range of elements only copy the elements of the range.
+ * - Any other structure: OPC UA structure generated from the PVXS type, with nested structures for the sub-structures.
+ *
+ * The OPC UA DataTypes are generated and registered in MyNodeIOEventManager the first time a type is seen.
+ * Each type is compiled once into an encoder that is cached by the signature of the type, and every PV keeps
+ * a reference to its encoder, so an update only walks the fields of the value.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __STRUCTUREMAPPER_H__
+#define __STRUCTUREMAPPER_H__
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <pvxs/data.h>
+#include <uanodeid.h>
+#include <uastructuredefinition.h>
+#include <uavariant.h>
+#include <indexRange.h>
+#include <myNodeIOEventManager.h>
+
+/**
+ * @class StructureMapper
+ * @brief Converts structured PVXS values to OPC UA ExtensionObjects.
+ *
+ * The fields of type union, any or array of structures are not supported and are left out of the generated DataTypes.
+ *
+ * This class is thread-safe.
+ *
+ */
+class StructureMapper {
+
+private:
+
+    /**
+     * @struct StructEncoder
+     * @brief Encoder of a PVXS structure type, compiled once per type.
+     *
+     */
+    struct StructEncoder {
+        /**
+         * @brief Generated OPC UA structure.
+         *
+         */
+        UaStructureDefinition definition;
+
+        /**
+         * @brief Position of every supported member of the PVXS structure, in the order of the definition fields.
+         *
+         */
+        std::vector<size_t> members;
+
+        /**
+         * @brief Encoders of the fields that are structures. Null for the other fields.
+         *
+         */
+        std::vector<std::shared_ptr<const StructEncoder>> nested;
+    };
+
+    /**
+     * @enum Kind
+     * @brief Mapping applied to the value of a PV.
+     *
+     */
+    enum class Kind { Table, NDArray, ScalarArray, Struct };
+
+    /**
+     * @struct PVEncoder
+     * @brief Encoder selected for a PV, checked against every update.
+     *
+     */
+    struct PVEncoder {
+        /**
+         * @brief Mapping of the PV.
+         *
+         */
+        Kind kind;
+
+        /**
+         * @brief Type id of the value (e.g. "epics:nt/NTTable:1.0").
+         *
+         */
+        std::string id;
+
+        /**
+         * @brief Number of members of the value. A different number means that the type has changed.
+         *
+         */
+        size_t memberCount;
+
+        /**
+         * @brief Encoder of the value (Struct) or of the rows (Table). Null for NDArray.
+         *
+         */
+        std::shared_ptr<const StructEncoder> encoder;
+
+        /**
+         * @brief Element type of the variable (ScalarArray). Later updates of another type are converted to it.
+         *
+         */
+        pvxs::ArrayType elementType = pvxs::ArrayType::Null;
+    };
+
+    /**
+     * @struct ArrayState
+     * @brief Last array forwarded for an NTScalarArray PV.
+     *
+     */
+    struct ArrayState {
+        /**
+         * @brief Mutex that serializes the updates of the PV.
+         *
+         */
+        std::mutex mutex;
+
+        /**
+         * @brief Last array forwarded. A reference to the PVXS buffer, not a copy.
+         *
+         */
+        pvxs::shared_array<const void> last;
+
+        /**
+         * @brief Whether an array has been forwarded. The last one can be empty.
+         *
+         */
+        bool forwarded = false;
+    };
+
+    /**
+     * @brief Node manager where the DataTypes and the variables of the structured PVs are created.
+     *
+     */
+    MyNodeIOEventManager * m_pNodeManager;
+
+    /**
+     * @brief Definition of the NDArrayImage structure used for every NTNDArray.
+     *
+     */
+    UaStructureDefinition m_ndArrayDefinition;
+
+    /**
+     * @brief Compiled encoders, indexed by the signature of their PVXS type.
+     *
+     */
+    std::unordered_map<std::string, std::shared_ptr<const StructEncoder>> m_encoders;
+
+    /**
+     * @brief Encoder of every PV, indexed by the identifier of the PV in the gateway.
+     *
+     */
+    std::vector<std::shared_ptr<const PVEncoder>> m_pvEncoders;
+
+    /**
+     * @brief Last array of every NTScalarArray PV, indexed by the identifier of the PV in the gateway.
+     *
+     */
+    std::vector<std::unique_ptr<ArrayState>> m_arrayStates;
+
+    /**
+     * @brief Mutex that protects m_encoders, m_pvEncoders and m_arrayStates.
+     *
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief Build the signature of a PVXS structure type: the names and type codes of its members, recursively.
+     *
+     * @param value Structure.
+     * @return Signature of the type.
+     */
+    static std::string signature(const pvxs::Value & value);
+
+    /**
+     * @brief Get the encoder of a structure type, compiling and registering it if it is new.
+     * Must be called with m_mutex locked.
+     *
+     * @param value Structure.
+     * @param name Name of the generated DataType.
+     * @param row Whether the structure holds the columns of an NTTable. The DataType is then the type of a row:
+     * one scalar field per array member, of the element type of the column. The other members are skipped.
+     * @return Encoder of the type.
+     */
+    std::shared_ptr<const StructEncoder> compile(const pvxs::Value & value, const std::string & name, bool row = false);
+
+    /**
+     * @brief Get the encoder of a PV, compiling it if the PV is new or its type has changed.
+     *
+     * @param pvId Identifier of the PV.
+     * @param nodeId UaNodeId of the variable of the PV, created if it does not exist.
+     * @param value Value of the PV.
+     * @return Encoder of the PV, or null if the value is not supported.
+     */
+    std::shared_ptr<const PVEncoder> encoderOf(uint32_t pvId, const UaNodeId & nodeId, const pvxs::Value & value);
+
+    /**
+     * @brief Encode a structure with its compiled encoder.
+     *
+     * @param encoder Encoder of the type of the structure.
+     * @param value Structure.
+     * @param variant Output parameter with the ExtensionObject.
+     */
+    static void encodeStruct(const StructEncoder & encoder, const pvxs::Value & value, UaVariant & variant);
+
+    /**
+     * @brief Encode the rows of an NTTable as an array of ExtensionObjects.
+     *
+     * @param encoder Encoder of the rows.
+     * @param value NTTable.
+     * @param variant Output parameter with the array.
+     */
+    static void encodeTable(const StructEncoder & encoder, const pvxs::Value & value, UaVariant & variant);
+
+    /**
+     * @brief Encode an NTNDArray as an NDArrayImage.
+     *
+     * @param value NTNDArray.
+     * @param variant Output parameter with the ExtensionObject.
+     */
+    void encodeNDArray(const pvxs::Value & value, UaVariant & variant) const;
+
+    /**
+     * @brief Get the array state of a PV, creating it the first time.
+     *
+     * @param pvId Identifier of the PV.
+     * @return State of the PV, valid while the StructureMapper exists.
+     */
+    ArrayState & arrayStateOf(uint32_t pvId);
+
+    /**
+     * @brief Same as arrayStateOf(), with m_mutex already locked.
+     *
+     */
+    ArrayState & arrayStateLocked(uint32_t pvId);
+
+    /**
+     * @brief Get the array state of an NTScalarArray PV.
+     *
+     * @param pvId Identifier of the PV.
+     * @param elementType Output parameter with the element type of the variable of the PV.
+     * @return State of the PV, or nullptr if the PV is not an NTScalarArray.
+     */
+    ArrayState * scalarArrayOf(uint32_t pvId, pvxs::ArrayType & elementType);
+
+    /**
+     * @brief Check a write of a range of an NTScalarArray PV against the last array forwarded.
+     * Must be called with the mutex of the state locked.
+     *
+     * @param state Array state of the PV.
+     * @param elementType Element type of the variable of the PV.
+     * @param range Range of elements written.
+     * @param from Type of the elements written.
+     * @param count Number of elements written.
+     * @param to Output parameter with the element type of the array to put.
+     * @return The same codes as mergeRange().
+     */
+    static OpcUa_StatusCode checkWrite(const ArrayState & state, pvxs::ArrayType elementType, const IndexRange & range,
+                                       pvxs::ArrayType from, size_t count, pvxs::ArrayType & to);
+
+    /**
+     * @brief Encode an NTScalarArray as an array of the element type of its variable, unless it has not changed.
+     *
+     * @param pvId Identifier of the PV.
+     * @param encoder Encoder of the PV.
+     * @param value NTScalarArray.
+     * @param variant Output parameter with the array.
+     * @return OpcUa_Good, OpcUa_GoodNoData if the array is equal to the last one forwarded, or OpcUa_BadTypeMismatch
+     * if the elements cannot be converted to the type of the variable.
+     */
+    OpcUa_StatusCode encodeScalarArray(uint32_t pvId, const PVEncoder & encoder, const pvxs::Value & value, UaVariant & variant);
+
+public:
+
+    /**
+     * @brief Construct a new StructureMapper object.
+     *
+     * @param pNodeManager Node manager where the DataTypes and the variables of the structured PVs are created.
+     */
+    explicit StructureMapper(MyNodeIOEventManager * pNodeManager);
+
+    /**
+     * @brief Whether a value is handled by this class, i.e. it is not an NTScalar or an NTEnum.
+     *
+     * @param value Value received from a PV.
+     * @return true if the value is structured.
+     */
+    static bool isStructured(const pvxs::Value & value);
+
+    /**
+     * @brief Convert a scalar or an array of scalars to an OPC UA variant.
+     *
+     * @param value PVXS field.
+     * @param variant Output parameter with the converted value.
+     * @return true if the field was converted.
+     * @return false if its type is not supported.
+     */
+    static bool fieldToVariant(const pvxs::Value & value, UaVariant & variant);
+
+    /**
+     * @brief Convert a structured value to an OPC UA variant.
+     *
+     * @param pvId Identifier of the PV in the gateway.
+     * @param nodeId UaNodeId of the variable of the PV. It is created the first time, with the generated DataType.
+     * @param value Value received from the PV.
+     * @param variant Output parameter with the ExtensionObject, or the array of ExtensionObjects for NTTable.
+     * @return OpcUa_Good, OpcUa_GoodNoData if the value is an array equal to the last one (nothing to forward),
+     * OpcUa_BadNotSupported if the value is not supported or OpcUa_BadTypeMismatch if it could not be encoded.
+     */
+    OpcUa_StatusCode convert(uint32_t pvId, const UaNodeId & nodeId, const pvxs::Value & value, UaVariant & variant);
+
+    /**
+     * @brief Whether a PV is an NTScalarArray mapped to a one-dimensional variable.
+     *
+     * @param pvId Identifier of the PV.
+     */
+    bool isScalarArray(uint32_t pvId);
+
+    /**
+     * @brief Convert a range of the last array forwarded for an NTScalarArray PV. Only the elements
+     * of the range are copied, so the cost does not depend on the size of the array.
+     *
+     * @param pvId Identifier of the PV.
+     * @param range Range of elements. It is clipped to the size of the array.
+     * @param variant Output parameter with the elements, of the element type of the variable.
+     * @return OpcUa_Good, OpcUa_BadIndexRangeNoData if the range starts after the end of the array,
+     * OpcUa_BadWaitingForInitialData if no array has been forwarded or OpcUa_BadNotSupported if the PV is not an NTScalarArray.
+     */
+    OpcUa_StatusCode readRange(uint32_t pvId, const IndexRange & range, UaVariant & variant);
+
+    /**
+     * @brief Build the array to put to an NTScalarArray PV for a write of a range of its elements.
+     * The elements out of the range are taken from the last array forwarded.
+     *
+     * @param pvId Identifier of the PV.
+     * @param range Range of elements written. The whole array replaces the array of the PV.
+     * @param value Elements written, as many as the range.
+     * @param array Output parameter with the array to put, of the element type of the PV.
+     * @return OpcUa_Good, OpcUa_BadIndexRangeNoData if the range is out of the array,
+     * OpcUa_BadIndexRangeInvalid if the number of elements does not match, OpcUa_BadTypeMismatch
+     * if they cannot be converted or OpcUa_BadNotSupported if the PV is not an NTScalarArray.
+     */
+    OpcUa_StatusCode mergeRange(uint32_t pvId, const IndexRange & range, const UaVariant & value,
+                                pvxs::shared_array<const void> & array);
+
+    /**
+     * @brief Check a write of a range of an NTScalarArray PV against the last array forwarded, without
+     * building the array, so the Write service can reject it before the put is queued.
+     *
+     * @param pvId Identifier of the PV.
+     * @param range Range of elements written.
+     * @param value Elements written.
+     * @return The same codes as mergeRange().
+     */
+    OpcUa_StatusCode checkRange(uint32_t pvId, const IndexRange & range, const UaVariant & value);
+};
+
+#endif  // __STRUCTUREMAPPER_H__
@@ -0,0 +1,135 @@
+/**
+ * @file TraceReplayer.h
+ * @brief Declaration of the TraceReplayer class.
+ *
+ * This file contains the declaration of the TraceReplayer class, which serves the PVs of a trace
+ * captured by EPICStoOPCUAGateway (see pvTrace.h) through an embedded PVXS server and posts their
+ * updates with the recorded timing. A gateway pointed at the replayer receives the same stream of
+ * monitor updates as in production, so regressions can be reproduced and compared run by run.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __TRACEREPLAYER_H__
+#define __TRACEREPLAYER_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <pvxs/data.h>
+#include <pvxs/server.h>
+#include <pvxs/sharedpv.h>
+
+/**
+ * @struct ReplayStats
+ * @brief Result of a replay.
+ *
+ */
+struct ReplayStats {
+    /**
+     * @brief Number of updates posted.
+     *
+     */
+    uint64_t updates = 0;
+
+    /**
+     * @brief Duration of the replay.
+     *
+     */
+    std::chrono::nanoseconds duration{0};
+
+    /**
+     * @brief Maximum delay of an update over its scheduled time. Always 0 at maximum speed.
+     *
+     */
+    std::chrono::nanoseconds maxLag{0};
+};
+
+/**
+ * @class TraceReplayer
+ * @brief Replays a trace of monitor updates through an embedded PVA server.
+ *
+ * Every PV of the trace is a read-only SharedPV. It is opened with its first update, reopened when
+ * its type changes and every other update is posted. The speed scales the recorded inter-arrival
+ * times: 1 replays in real time, N is N times faster and 0 posts the updates as fast as possible.
+ *
+ */
+class TraceReplayer {
+
+private:
+
+    /**
+     * @brief Path of the trace file.
+     *
+     */
+    std::string m_path;
+
+    /**
+     * @brief Embedded PVA server.
+     *
+     */
+    pvxs::server::Server m_server;
+
+    /**
+     * @brief PVs of the trace, indexed by their identifier in the trace.
+     *
+     */
+    std::vector<pvxs::server::SharedPV> m_pvs;
+
+    /**
+     * @brief Whether the type of a PV changed since its last update, indexed by its identifier in the trace.
+     *
+     */
+    std::vector<bool> m_typeChanged;
+
+    /**
+     * @brief Flag to abort the replay.
+     *
+     */
+    std::atomic<bool> m_stopping{false};
+
+public:
+
+    /**
+     * @brief Construct a new TraceReplayer object.
+     * The PVA server is configured from the environment (EPICS_PVAS_*).
+     *
+     * @param path Path of the trace file.
+     */
+    explicit TraceReplayer(const std::string & path);
+
+    /**
+     * @brief Destroy the TraceReplayer object. Closes the PVs and stops the server.
+     *
+     */
+    ~TraceReplayer();
+
+    TraceReplayer(const TraceReplayer &) = delete;
+    TraceReplayer & operator=(const TraceReplayer &) = delete;
+
+    /**
+     * @brief Replay the trace once. The server is started by the first replay, the PVs stay
+     * open between replays so the trace can be looped.
+     *
+     * @param speed Speed factor. 0 for maximum speed.
+     * @return Statistics of the replay.
+     */
+    ReplayStats replay(double speed);
+
+    /**
+     * @brief Abort the replay in progress. Can be called from any thread.
+     *
+     */
+    void stop() { m_stopping = true; }
+
+    /**
+     * @brief Check if the replay was aborted.
+     *
+     */
+    bool stopped() const { return m_stopping.load(); }
+};
+
+#endif  // __TRACEREPLAYER_H__
@@ -17,7 +17,23 @@
 #include "uaeuinformation.h"
 #include "uarange.h"
 #include "opcua_baseanalogtype.h"
+#include "uastructuredefinition.h"
+#include "propertyStore.h"
+#include "historyStore.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
 class EPICStoOPCUAGateway;
+class OPCUAtoEPICSServer;
+class NodeBatch;
+class GatewayHistoryManager;
+class ArrayIOManager;
+struct IocVariableTemplate;
+struct PVCatalogEntry;
 
 /**
  * @class MyNodeIOEventManager
@@ -29,6 +45,8 @@ class EPICStoOPCUAGateway;
  * - Integration with an EPICStoOPCUAGateway for data exchange.
  * - Update values in external EPICS IOCs.
  * - Receive and apply values update from external EPICS IOCs.
+ * - Notify the value changes to an OPCUAtoEPICSServer that publishes variables as EPICS PVs.
+ * - Fire the events of the conditions of the PVs, and forward their acknowledgements.
  * 
  * This class disables the copying constructor and the assignment operator to avoid misuses of this class.
  * 
@@ -46,13 +64,209 @@ private:
      * 
      */
     EPICStoOPCUAGateway * m_pEPICSGateway; 
+
+    /**
+     * @brief Pointer to the OPC_UA-EPICS server. Null if no variable is published.
+     * 
+     */
+    OPCUAtoEPICSServer * m_pEPICSServer = nullptr;
+
+    /**
+     * @brief Descriptors of the variables of every ObjectType that has been instantiated, indexed by the typeId.
+     * Resolved on the first instance of the type and shared by the rest.
+     * 
+     */
+    std::unordered_map<int, std::shared_ptr<const std::vector<IocVariableTemplate>>> m_objectTypeTemplates;
+
+    /**
+     * @brief Mutex that protects m_objectTypeTemplates. It is locked before m_mutexNodes.
+     * 
+     */
+    std::mutex m_templatesMutex;
+
+    /**
+     * @brief Interned property values of the instances of the IOC variables.
+     * 
+     */
+    PropertyStore m_propertyStore;
+
+    /**
+     * @brief In-memory history of the PVs. Null if the history is disabled.
+     * 
+     */
+    std::unique_ptr<HistoryStore> m_pHistoryStore;
+
+    /**
+     * @brief History manager that answers the HistoryRead service from m_pHistoryStore.
+     * 
+     */
+    std::unique_ptr<GatewayHistoryManager> m_pHistoryManager;
+
+    /**
+     * @brief IOManager of the Read and Write of the array PVs. Created when the gateway is set.
+     * 
+     */
+    std::unique_ptr<ArrayIOManager> m_pArrayIOManager;
+
+    /**
+     * @struct LazyNode
+     * @brief Variable of a PV materialized on demand.
+     * 
+     */
+    struct LazyNode {
+        /**
+         * @brief The variable.
+         * 
+         */
+        UaVariable * pVariable;
+
+        /**
+         * @brief Position of the PV in m_lazyLru.
+         * 
+         */
+        std::list<uint32_t>::iterator lru;
+    };
+
+    /**
+     * @brief Maximum number of PV variables materialized on demand. 0 disables the lazy address space.
+     * 
+     */
+    std::atomic<size_t> m_lazyCapacity{0};
+
+    /**
+     * @brief Folder that organizes the PVs materialized on demand.
+     * 
+     */
+    UaNodeId m_lazyFolderId;
+
+    /**
+     * @brief Identifiers of the materialized PVs, the most recently used first.
+     * 
+     */
+    std::list<uint32_t> m_lazyLru;
+
+    /**
+     * @brief Materialized PVs, indexed by the identifier of the PV in the gateway.
+     * 
+     */
+    std::unordered_map<uint32_t, LazyNode> m_lazyNodes;
+
+    /**
+     * @brief Mutex that protects the lazy address space. The updates of the variables lock it shared,
+     * so a variable is never evicted while it is being updated. It is locked before m_mutexNodes.
+     * 
+     */
+    std::shared_mutex m_lazyMutex;
+
+    /**
+     * @brief Get the variable of a PV of the gateway, materializing it if it does not exist.
+     * The variable becomes the most recently used one.
+     * 
+     * @param nodeId UaNodeId of the variable.
+     * @return The variable, or NULL if the node is not a PV that can be materialized.
+     */
+    UaVariable * materialize(const UaNodeId & nodeId);
+
+    /**
+     * @brief Create the variable of a PV from its catalog entry and its cached value.
+     * Must be called with m_lazyMutex locked.
+     * 
+     * @param pvId Identifier of the PV.
+     * @param nodeId UaNodeId of the variable.
+     * @return The variable, or NULL if the type of the PV is not known or not supported.
+     */
+    UaVariable * createLazyVariable(uint32_t pvId, const UaNodeId & nodeId);
+
+    /**
+     * @brief Delete the least recently used variables until the capacity is respected.
+     * The variables with monitored items are never evicted. Must be called with m_lazyMutex locked.
+     * 
+     */
+    void evictLazyNodes();
+
+    /**
+     * @brief Get the OPC UA types of a PV from its catalog entry.
+     * 
+     * @param entry Catalog entry of the PV.
+     * @param dataTypeId Output parameter with the DataType of the variable.
+     * @param typeDefinitionId Output parameter with the VariableType of the variable.
+     * @return true if the PV is an NTScalar or an NTEnum with a supported type.
+     */
+    static bool lazyTypesOf(const PVCatalogEntry & entry, OpcUa_UInt32 & dataTypeId, OpcUa_UInt32 & typeDefinitionId);
+
+    /**
+     * @brief Get the access level of the variable of a PV from its record type.
+     * As the variables of the ObjectTypes, only the output records are writable.
+     * Used by the lazy variables and by the variables of the array PVs.
+     * 
+     * @param entry Catalog entry of the PV.
+     * @return CurrentRead, and CurrentWrite if the PV is an output record. A PV of an unknown record type is read-only.
+     */
+    static OpcUa_Byte accessLevelOf(const PVCatalogEntry & entry);
+
+    /**
+     * @brief Number of catalog entries read each time the catalog is locked while browsing the lazy folder.
+     * 
+     */
+    static constexpr size_t LazyBrowseChunk = 1024;
+
+    /**
+     * @brief Browse the folder of the lazy PVs from the catalog of the gateway, without materializing them.
+     * Respects the maximum number of references of the request, and returns a continuation point with the next PV.
+     * 
+     * @param browseContext Browse parameters.
+     * @param references Output parameter with the references to the PVs.
+     * @return UaStatus with error code of the operation.
+     */
+    UaStatus browseLazyFolder(BrowseContext & browseContext, UaReferenceDescriptions & references);
+
+    /**
+     * @brief Discard the cached descriptors of an ObjectType whose variables have changed.
+     * 
+     * @param typeNodeId UaNodeId of the ObjectType.
+     */
+    void invalidateObjectTypeTemplate(const UaNodeId & typeNodeId);
     
 public:
+    /**
+     * @brief Default size of the node hash table of NodeManagerBase.
+     * 
+     */
+    static constexpr OpcUa_Int32 DefaultHashTableSize = 10007;
+
+    /**
+     * @brief Default maximum number of PV variables materialized on demand.
+     * 
+     */
+    static constexpr size_t DefaultLazyCapacity = 100000;
+
     /**
      * @brief Construct a new MyNodeIOEventManager object.
      * 
+     * @param hashTableSize Size of the node hash table. The table is never resized, so it must be sized
+     * for the expected number of nodes. @see hashTableSizeFor
+     */
+    explicit MyNodeIOEventManager(OpcUa_Int32 hashTableSize = DefaultHashTableSize);
+
+    /**
+     * @brief Get a size of the node hash table for an expected number of nodes.
+     * 
+     * @param expectedNodes Expected number of nodes of the address space.
+     * @return A prime with a load factor below 0.75, and at least DefaultHashTableSize.
+     */
+    static OpcUa_Int32 hashTableSizeFor(size_t expectedNodes);
+
+    /**
+     * @brief Get the default LocaleId of the nodes of this node manager.
+     * 
+     */
+    const UaString & defaultLocaleId() const { return m_defaultLocaleId; }
+
+    /**
+     * @brief Get the store of the interned property values.
+     * 
      */
-    MyNodeIOEventManager();
+    PropertyStore & propertyStore() { return m_propertyStore; }
 
     /**
      * @brief Destructor of MyNodeIOEventManager object.
@@ -139,16 +353,147 @@ public:
         const UaNodeId & parentNodeId               // Node of the parent;
     );
 
+    /**
+     * @brief Get the descriptors of the variables of an ObjectType, resolving them the first time.
+     * 
+     * @param typeId Identifier of the ObjectType.
+     * @return Descriptors of the supported variables of the ObjectType. Empty if the type does not exist.
+     */
+    std::shared_ptr<const std::vector<IocVariableTemplate>> getObjectTypeTemplate(int typeId);
+
+    /**
+     * @brief Commit the nodes of a batch under a single acquisition of m_mutexNodes.
+     * Every object is added with its variables before the reference from its parent.
+     * Use NodeBatch::commit().
+     * 
+     * @param batch Batch to commit.
+     * @return UaStatus of the first operation that failed, or Good.
+     */
+    UaStatus commitBatch(NodeBatch & batch);
+
+    /**
+     * @brief Enable the lazy address space. The PVs of the gateway without a node are materialized when
+     * a client browses, reads, writes or monitors them, under a "PVs" folder of the Objects folder,
+     * and the least recently used ones are evicted when there are more than capacity.
+     * Must be called after the server has started and the gateway has been set.
+     * 
+     * @param capacity Maximum number of materialized PVs. The monitored ones are never evicted, so it can be exceeded.
+     * @return UaStatus with error code of the operation.
+     */
+    UaStatus enableLazyNodes(size_t capacity);
+
+    /**
+     * @brief Get the number of PVs materialized on demand.
+     * 
+     */
+    size_t lazyNodeCount();
+
+    /**
+     * @brief Materialize the PV of the node before the SDK resolves the handle of a Read, Write or
+     * CreateMonitoredItems. The Read and Write of the value of an array PV go to the ArrayIOManager,
+     * which handles their IndexRange without copying the whole array.
+     * 
+     */
+    VariableHandle * getVariableHandle(
+        Session * pSession,
+        VariableHandle::ServiceType serviceType,
+        OpcUa_NodeId * pNodeId,
+        OpcUa_Int32 attributeId
+    );
+
+    /**
+     * @brief Browse the folder of the lazy PVs from the catalog, and materialize the PV of any other browsed node.
+     * 
+     */
+    UaStatus browse(
+        const ServiceContext & serviceContext,
+        BrowseContext & browseContext,
+        UaReferenceDescriptions & references
+    );
+
+    /**
+     * @brief Keep the variables with new monitored items at the front of the LRU list.
+     * 
+     */
+    void variableCacheMonitoringChanged(UaVariableCache * pVariable, TransactionType transactionType);
+
+    /**
+     * @brief Enable the in-memory history of the PVs, served through HistoryRead.
+     * Must be called before the server starts, so the variables are created as historizing.
+     * 
+     * @param samplesPerPV Number of samples kept per PV.
+     * @param maxPVs Maximum number of historized PVs.
+     */
+    void enableHistory(size_t samplesPerPV, size_t maxPVs);
+
+    /**
+     * @brief Get the in-memory history of the PVs.
+     * 
+     * @return The history, or nullptr if it is disabled.
+     */
+    HistoryStore * historyStore() const { return m_pHistoryStore.get(); }
+
+    /**
+     * @brief Mark a new variable as historizing, if the history is enabled.
+     * 
+     * @param pVariable Variable of a PV.
+     */
+    void setHistorizing(OpcUa::BaseDataVariableType * pVariable) const;
+
+    /**
+     * @brief Resolve the handle of a HistoryRead of a PV. The node does not need to be materialized.
+     * 
+     */
+    HistoryVariableHandle * getHistoryVariableHandle(
+        Session * pSession,
+        HistoryVariableHandle::ServiceType serviceType,
+        OpcUa_NodeId * pNodeId,
+        UaStatus & result
+    ) const;
+
     /**
      * @brief Update a variable node value.
+     * The new value is also posted to the OPC_UA-EPICS server, if the variable is published.
      * 
      * @param nodeId UaNodeId of the variable to be updated.
-     * @param variant Value to update with.
+     * @param variant Value to update with. Empty when statusCode is Bad.
+     * @param statusCode StatusCode of the new value, shown to the clients.
+     * @param sourceTimestamp SourceTimestamp of the new value (100 ns since 1601-01-01), e.g. the EPICS timestamp
+     * of the update. The current time if 0.
      * @return UaStatus with error code of the operation. 
      *      Return OpcUa_BadNodeIdUnknown if the nodeId do not exist.
      *      Return OpcUa_BadNodeIdRejected if the nodeId is not a variable. 
      */
-    UaStatus updateVariable(UaNodeId & nodeId, UaVariant & variant);
+    UaStatus updateVariable(const UaNodeId & nodeId, const UaVariant & variant, OpcUa_StatusCode statusCode = OpcUa_Good,
+                            int64_t sourceTimestamp = 0);
+
+    /**
+     * @brief Register a structured DataType generated at runtime, so clients can decode its values.
+     * 
+     * @param definition Definition of the structure, with its DataType and binary encoding NodeIds.
+     * @return UaStatus with error code of the operation.
+     */
+    UaStatus registerStructure(const UaStructureDefinition & definition);
+
+    /**
+     * @brief Create a BaseDataVariableType node below the Objects folder for a structured value.
+     * Does nothing if the node already exists.
+     * 
+     * @param nodeId UaNodeId of the new variable.
+     * @param name Browse and display name of the variable.
+     * @param dataTypeId DataType of the variable.
+     * @param valueRank Value rank of the variable: scalar or one dimension.
+     * @param writable Whether the variable can be written: only the array PVs can. Then it is writable
+     * if the record type of the PV is an output record, as the variables of the scalar PVs.
+     * @return UaStatus with error code of the operation. 
+     */
+    UaStatus createStructureVariable(
+        const UaNodeId & nodeId,
+        const UaString & name,
+        const UaNodeId & dataTypeId,
+        OpcUa_Int32 valueRank,
+        bool writable = false
+    );
 
     /**
      * @brief Set pointer to EPICS-to-OPCUA gateway,
@@ -157,6 +502,13 @@ public:
      */
     void setEPICSGateway(EPICStoOPCUAGateway * pEPICSGateway);
 
+    /**
+     * @brief Set pointer to OPC_UA-EPICS server.
+     * 
+     * @param pEPICSServer Pointer to OPCUAtoEPICSServer instance, or nullptr to stop notifying the value changes.
+     */
+    void setEPICSServer(OPCUAtoEPICSServer * pEPICSServer);
+
     // NodeManagerUaNode implementation https://documentation.unified-automation.com/uasdkcpp/1.8.6/html/classNodeManagerUaNode.html
 
     /**
@@ -173,6 +525,25 @@ public:
      */
     virtual UaStatus   beforeShutDown();
 
+    // EventManagerUaNode implementation https://documentation.unified-automation.com/uasdkcpp/1.8.6/html/classEventManagerUaNode.html
+
+    /**
+     * @brief Method that is called when a client calls the Acknowledge method of a condition.
+     * The conditions of the PVs are acknowledged by the AlarmManager of m_pEPICSGateway.
+     * 
+     * @param serviceContext General context for the service calls.
+     * @param pCondition Condition to acknowledge.
+     * @param EventId EventId of the event acknowledged.
+     * @param Comment Comment of the client.
+     * @return UaStatus with error code of the operation.
+     */
+    virtual UaStatus OnAcknowledge(
+        const ServiceContext & serviceContext,
+        OpcUa::AcknowledgeableConditionType * pCondition,
+        const UaByteString & EventId,
+        const UaLocalizedText & Comment
+    );
+
     // IOManagerUaNode implementation https://documentation.unified-automation.com/uasdkcpp/1.8.6/html/classIOManagerUaNode.html
 
     /**
@@ -197,6 +568,22 @@ public:
         OpcUa_Boolean & checkWriteMask
     );	
 
+    /**
+     * @brief Event that is called after the value of an attributte of a Node was set by a client.
+     * Posts the new value to the OPC_UA-EPICS server, if the variable is published.
+     * 
+     * @param pSession Interface of the Session context for the attribute write.
+     * @param pNode Interface of the UaNode that was updated.
+     * @param attributeId Attribute id indicating the attribute that was set.
+     * @param dataValue New value of the attribute.
+     */
+    void afterSetAttributeValue(
+        Session * pSession, 
+        UaNode * pNode, 
+        OpcUa_Int32 attributeId, 
+        const UaDataValue & dataValue
+    );
+
     /**
      * @brief Get the instance declaration node of a variable for a numeric identifier.
      * 
@@ -211,7 +598,7 @@ public:
      * after this method.
      * 
      * @param numericIdentifier Numeric identifier for the ObjectType.
-     * @return std::vector<UaVariable*> Vector with pointers to variables of the ObjectType.
+     * @return std::vector<UaVariable*> Vector with pointers to variables of the ObjectType. Empty if the type does not exist.
      */
     std::vector<UaVariable*> getVariablesFromObjectType(OpcUa_UInt32 numericIdentifier);
 
@@ -286,6 +673,8 @@ public:
         pBaseAnalogType->setEngineeringUnits(EngineeringUnits);
         pBaseAnalogType->setEURange(EURange);
         pBaseAnalogType->setInstrumentRange(InstrumentRange);
+
+        invalidateObjectTypeTemplate(sourceNode);
     
         return result;
     }
@@ -17,6 +17,8 @@
 #include "myNodeIOEventManager.h"
 #include <memory>
 #include <EPICStoOPCUAGateway.h>
+#include <OPCUAtoEPICSServer.h>
+#include <PubSubPublisher.h>
 class UaServer;
 
 /**
@@ -73,6 +75,25 @@ public:
      */
     virtual void addEPICSGateway(EPICStoOPCUAGateway * gate);
 
+    /**
+     * @brief Adds an OPC_UA-to-EPICS server, which publishes variables as PVA PVs, to the server.
+     * This class will delete the EPICS server when this class destroy itself.
+     * This method will start the EPICS server. 
+     * @param pEPICSServer Pointer to the OPC_UA-to-EPICS server object.
+     * @see OPCUAtoEPICSServer
+     */
+    virtual void addEPICSServer(OPCUAtoEPICSServer * pEPICSServer);
+
+    /**
+     * @brief Adds a PubSub publisher, which publishes the values of the gateway as UADP messages, to the server.
+     * The EPICS-to-OPC_UA Gateway must be added before.
+     * This class will delete the publisher when this class destroy itself.
+     * This method will start the publisher. 
+     * @param pPublisher Pointer to the PubSub publisher object.
+     * @see PubSubPublisher
+     */
+    virtual void addPubSubPublisher(PubSubPublisher * pPublisher);
+
     /**
      * @brief Sets the custom node manager for this server instance.
      * It can be setted with addNodeManager() too, but then the pointer to the node manager will not be initialized.
@@ -99,6 +120,16 @@ protected:
      */
     virtual UaStatus afterStartUp();
 
+    /**
+     * @brief Pre-shutdown routine.
+     * 
+     * Stops the PubSub publisher, the EPICS-to-OPC_UA Gateway and the OPC_UA-to-EPICS server before
+     * the node managers are shut down, so the gateway workers never update nodes that are being destroyed.
+     * 
+     * @return UaStatus indicating success or failure.
+     */
+    virtual UaStatus beforeShutdown();
+
 private:
     /**
      * @brief Pointer to the EPICS-to-OPC_UA Gateway of the server.
@@ -106,6 +137,18 @@ private:
      */
     EPICStoOPCUAGateway * m_pGateway = nullptr;
 
+    /**
+     * @brief Pointer to the OPC_UA-to-EPICS server, or nullptr if no variable is published.
+     * @see OPCUAtoEPICSServer
+     */
+    OPCUAtoEPICSServer * m_pEPICSServer = nullptr;
+
+    /**
+     * @brief Pointer to the PubSub publisher, or nullptr if PubSub is not configured.
+     * @see PubSubPublisher
+     */
+    PubSubPublisher * m_pPublisher = nullptr;
+
     /**
      * @brief Pointer to the custom node manager created for this project.
      * @see MyNodeIOEventManager
@@ -0,0 +1,74 @@
+/**
+ * @file arrayKernels.h
+ * @brief Declaration of the ArrayKernels class.
+ *
+ * This file defines the vectorized kernels used by the gateway for the array PVs: the comparison of
+ * two versions of an array, which finds the range of elements that changed, and the conversion of
+ * the elements of a PVXS array to the element type of its OPC UA variable.
+ *
+ * The kernels are selected once, at the first call, from the instruction sets of the CPU: AVX2,
+ * SSE2 (always available on x86-64) or portable scalar code on other architectures. They are built
+ * with per-function target attributes, so the binary runs on any x86-64 CPU.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __ARRAYKERNELS_H__
+#define __ARRAYKERNELS_H__
+
+#include <cstddef>
+#include <pvxs/data.h>
+
+/**
+ * @class ArrayKernels
+ * @brief Compare and convert kernels for large arrays. Every method is thread-safe.
+ *
+ */
+class ArrayKernels {
+
+public:
+
+    /**
+     * @brief Name of the selected instruction set: "avx2", "sse2" or "scalar".
+     *
+     */
+    static const char * instructionSet();
+
+    /**
+     * @brief Find the range of elements that differ between two arrays of the same type and size.
+     * The elements are compared bit by bit, so a NaN that does not change is not a change.
+     *
+     * @param pOld Previous version of the array.
+     * @param pNew New version of the array.
+     * @param count Number of elements of both arrays.
+     * @param elementSize Size of an element, in bytes.
+     * @param first Output parameter with the first element that differs.
+     * @param end Output parameter with the element after the last one that differs.
+     * @return false if the arrays are equal.
+     */
+    static bool dirtyRange(const void * pOld, const void * pNew, size_t count, size_t elementSize, size_t & first, size_t & end);
+
+    /**
+     * @brief Check if the elements of a type can be converted to another type without losing information
+     * (same type, or a wider integer or floating point type).
+     *
+     * @param from Type of the input elements.
+     * @param to Type of the output elements.
+     */
+    static bool canConvert(pvxs::ArrayType from, pvxs::ArrayType to);
+
+    /**
+     * @brief Convert the elements of an array to another type.
+     *
+     * @param pIn Input elements.
+     * @param from Type of the input elements.
+     * @param pOut Output elements. Room for count elements of the output type.
+     * @param to Type of the output elements.
+     * @param count Number of elements.
+     * @return false if the conversion is not supported (see canConvert()). Nothing is written.
+     */
+    static bool convert(const void * pIn, pvxs::ArrayType from, void * pOut, pvxs::ArrayType to, size_t count);
+};
+
+#endif  // __ARRAYKERNELS_H__
@@ -0,0 +1,94 @@
+/**
+ * @file dbFile.h
+ * @brief Declaration of the DbFile class and the DbRecord structure.
+ *
+ * This file defines a reader of EPICS database files (.db), the record definitions loaded by the
+ * IOCs of the IOCs directory. Only the record instances and their fields are read: record(type, "name")
+ * and grecord() with field(NAME, "value") entries. info(), alias() and the other statements are skipped.
+ * Macros ($(P), ${P}) are not expanded.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __DBFILE_H__
+#define __DBFILE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @struct DbRecord
+ * @brief Record instance of an EPICS database.
+ *
+ */
+struct DbRecord {
+    /**
+     * @brief Record type (ai, ao, bi, ...).
+     *
+     */
+    std::string type;
+
+    /**
+     * @brief Record name, the name of its PV.
+     *
+     */
+    std::string name;
+
+    /**
+     * @brief Fields of the record, by field name.
+     *
+     */
+    std::map<std::string, std::string> fields;
+
+    /**
+     * @brief Get a field of the record.
+     *
+     * @param fieldName Name of the field.
+     * @param defaultValue Value returned if the field is not set.
+     * @return Value of the field.
+     */
+    const std::string & field(const std::string & fieldName, const std::string & defaultValue) const;
+
+    /**
+     * @brief Get a numeric field of the record.
+     *
+     * @param fieldName Name of the field.
+     * @param defaultValue Value returned if the field is not set or it is not a number.
+     * @return Value of the field.
+     */
+    double number(const std::string & fieldName, double defaultValue) const;
+};
+
+/**
+ * @class DbFile
+ * @brief Reads the record instances of EPICS database files.
+ *
+ */
+class DbFile {
+
+public:
+
+    /**
+     * @brief Read the records of a database file.
+     * A record defined twice is merged, as the IOC does: the later fields replace the earlier ones.
+     *
+     * @param path Path of the .db file.
+     * @param records Output parameter. The records are appended.
+     * @return false if the file could not be read or it has a syntax error. The records read before the error are kept.
+     */
+    static bool parse(const std::string & path, std::vector<DbRecord> & records);
+
+    /**
+     * @brief Read the records of every .db file of a directory and its subdirectories,
+     * or of a single file if the path is a file.
+     *
+     * @param path Path of the directory or the file.
+     * @param records Output parameter. The records are appended.
+     * @return Number of files read.
+     */
+    static size_t parseAll(const std::string & path, std::vector<DbRecord> & records);
+};
+
+#endif  // __DBFILE_H__
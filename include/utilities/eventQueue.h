@@ -0,0 +1,485 @@
+/**
+ * @file eventQueue.h
+ * @brief Declaration and implementation of the EventQueue class template.
+ *
+ * This file defines the bounded work queue used by the gateway to hand events from
+ * the PVXS client callbacks and the OPC UA node manager to the gateway's worker thread(s).
+ *
+ * Unlike pvxs::MPMCFIFO, the queue can be closed. Closing the queue stops the intake of new
+ * elements and wakes up every blocked producer and consumer, so the shutdown of the workers
+ * does not depend on pushing sentinels into a queue that may be full.
+ *
+ * Every element is pushed with a key that identifies its source (the EPICS process variable),
+ * so that the queue can apply an overflow policy per source and account for the dropped elements.
+ *
+ * The queue has two lanes: a fast lane for latency sensitive elements (writes and alarm changes)
+ * and a normal lane for the rest. Each lane has its own capacity, so a full normal lane never
+ * blocks or drops fast elements.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __EVENTQUEUE_H__
+#define __EVENTQUEUE_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * @enum OverflowPolicy
+ * @brief Behaviour of EventQueue::push() when the queue is full.
+ *
+ */
+enum class OverflowPolicy {
+    /**
+     * @brief Block the producer until there is room in the queue.
+     *
+     */
+    Block,
+
+    /**
+     * @brief Discard the oldest queued element of the same key. If the key has nothing queued,
+     * discard the oldest element of the key with more queued elements.
+     *
+     */
+    DropOldestPerPV,
+
+    /**
+     * @brief Discard the element being pushed.
+     *
+     */
+    DropNewest,
+
+    /**
+     * @brief Replace the queued element of the same key, keeping its position in the queue.
+     * Elements are coalesced even if the queue is not full. If the key has nothing queued and
+     * the queue is full, the element being pushed is discarded.
+     *
+     */
+    Coalesce
+};
+
+/**
+ * @enum Lane
+ * @brief Lane of the EventQueue where an element is pushed.
+ *
+ */
+enum class Lane {
+    /**
+     * @brief Lane served before the normal lane.
+     *
+     */
+    Fast = 0,
+
+    /**
+     * @brief Lane for the bulk of the elements.
+     *
+     */
+    Normal = 1
+};
+
+/**
+ * @class EventQueue
+ * @brief Thread-safe, bounded, multi-producer, multi-consumer FIFO queue that can be closed.
+ *
+ * Once close() is called, push() is rejected and pop() keeps returning the elements that were
+ * already queued until the queue is empty. This allows the consumers to flush the pending work
+ * before they finish.
+ *
+ * The queue counts the elements dropped by the overflow policies for each key and keeps the
+ * high-watermark of its size.
+ *
+ * pop() serves the lanes with a weighted priority scheduler: while both lanes have elements, it
+ * serves up to fastWeight elements of the fast lane for each element of the normal lane.
+ * A fastWeight of 0 means strict priority, so the normal lane is only served when the fast lane is empty.
+ *
+ * An element pushed to the fast lane supersedes the elements of the same key that are still in
+ * the normal lane, because they are older and would overwrite it when processed. Elements pushed
+ * with OverflowPolicy::Block, like writes, never supersede other elements, and they are never
+ * replaced or dropped by the elements of the other policies, even if they share the key.
+ *
+ * @tparam T Type of the elements of the queue.
+ * @tparam Key Type of the key that identifies the source of the elements.
+ */
+template<typename T, typename Key = std::string>
+class EventQueue {
+
+private:
+
+    /**
+     * @struct Entry
+     * @brief Queued element with its key.
+     *
+     */
+    struct Entry {
+        Key key;
+        T item;
+
+        /**
+         * @brief Whether the element was pushed with OverflowPolicy::Block. It can not be replaced nor dropped.
+         *
+         */
+        bool pinned;
+    };
+
+    /**
+     * @struct KeyState
+     * @brief Accounting of the elements of a key.
+     *
+     */
+    struct KeyState {
+        /**
+         * @brief Number of elements of the key in each lane that can be replaced or dropped.
+         *
+         */
+        size_t pending[2] = {0, 0};
+
+        /**
+         * @brief Number of elements of the key dropped by the overflow policies.
+         *
+         */
+        uint64_t drops = 0;
+    };
+
+    /**
+     * @brief Mutex that protects every member of the queue.
+     *
+     */
+    mutable std::mutex m_mutex;
+
+    /**
+     * @brief Condition variable signaled when an element is pushed or the queue is closed.
+     *
+     */
+    std::condition_variable m_notEmpty;
+
+    /**
+     * @brief Condition variables signaled when an element is popped from each lane or the queue is closed.
+     *
+     */
+    std::condition_variable m_notFull[2];
+
+    /**
+     * @brief Elements of each lane with their keys.
+     *
+     */
+    std::deque<Entry> m_lanes[2];
+
+    /**
+     * @brief Accounting of every key that has been pushed.
+     *
+     */
+    std::unordered_map<Key, KeyState> m_keys;
+
+    /**
+     * @brief Keys with queued elements in each lane, ordered by their number of queued elements,
+     * so the chattiest key is found without scanning every key.
+     *
+     */
+    std::set<std::pair<size_t, Key>> m_byPending[2];
+
+    /**
+     * @brief Maximum number of elements of each lane.
+     *
+     */
+    const size_t m_capacity[2];
+
+    /**
+     * @brief Maximum number of consecutive elements of the fast lane served while the normal lane waits.
+     *
+     */
+    const unsigned m_fastWeight;
+
+    /**
+     * @brief Number of consecutive elements served from the fast lane.
+     *
+     */
+    unsigned m_fastServed = 0;
+
+    /**
+     * @brief Maximum number of elements that the queue has held.
+     *
+     */
+    size_t m_highWatermark = 0;
+
+    /**
+     * @brief Whether the queue has been closed.
+     *
+     */
+    bool m_closed = false;
+
+    /**
+     * @brief Find the oldest queued element of a key in a lane that can be replaced or dropped.
+     * Must be called with m_mutex locked.
+     *
+     * @param key Key of the element.
+     * @param lane Index of the lane.
+     * @return Iterator to the element, or end() if the key has nothing to replace or drop in the lane.
+     */
+    typename std::deque<Entry>::iterator findOldest(const Key & key, size_t lane) {
+        std::deque<Entry> & queue = m_lanes[lane];
+        auto itKey = m_keys.find(key);
+        if(itKey == m_keys.end() || itKey->second.pending[lane] == 0)
+            return queue.end();
+
+        for(auto it = queue.begin(); it != queue.end(); ++it)
+            if(it->key == key && !it->pinned)
+                return it;
+        return queue.end();
+    }
+
+    /**
+     * @brief Get the key with more elements to replace or drop in a lane.
+     * Must be called with m_mutex locked and m_byPending[lane] not empty.
+     *
+     * @param lane Index of the lane.
+     * @return Key with more queued elements.
+     */
+    const Key & chattiestKey(size_t lane) const {
+        return m_byPending[lane].rbegin()->second;
+    }
+
+    /**
+     * @brief Change the number of queued elements of a key in a lane. Must be called with m_mutex locked.
+     *
+     * @param key Key of the elements.
+     * @param state Accounting of the key.
+     * @param lane Index of the lane.
+     * @param queued true when an element is queued, false when it is removed.
+     */
+    void addPending(const Key & key, KeyState & state, size_t lane, bool queued) {
+        size_t & pending = state.pending[lane];
+        if(pending > 0)
+            m_byPending[lane].erase(std::make_pair(pending, key));
+        pending = queued ? pending + 1 : pending - 1;
+        if(pending > 0)
+            m_byPending[lane].emplace(pending, key);
+    }
+
+    /**
+     * @brief Remove the elements of a key from the normal lane. Must be called with m_mutex locked.
+     *
+     * @param key Key of the elements.
+     */
+    void supersede(const Key & key) {
+        std::deque<Entry> & queue = m_lanes[static_cast<size_t>(Lane::Normal)];
+        KeyState & state = m_keys[key];
+        for(auto it = queue.begin(); state.pending[static_cast<size_t>(Lane::Normal)] > 0 && it != queue.end(); ){
+            if(it->key == key && !it->pinned){
+                it = queue.erase(it);
+                addPending(key, state, static_cast<size_t>(Lane::Normal), false);
+                ++state.drops;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /**
+     * @brief Queue an element. Must be called with m_mutex locked and room in the lane.
+     *
+     * @param key Key of the element.
+     * @param item Element to queue.
+     * @param lane Index of the lane.
+     * @param pinned Whether the element can not be replaced nor dropped.
+     */
+    void enqueue(const Key & key, T && item, size_t lane, bool pinned) {
+        m_lanes[lane].push_back(Entry{key, std::move(item), pinned});
+        KeyState & state = m_keys[key];
+        if(!pinned)
+            addPending(key, state, lane, true);
+        size_t total = m_lanes[0].size() + m_lanes[1].size();
+        if(total > m_highWatermark)
+            m_highWatermark = total;
+    }
+
+    /**
+     * @brief Choose the lane of the next element to pop. Must be called with m_mutex locked and the queue not empty.
+     *
+     * @return Index of the lane.
+     */
+    size_t nextLane() {
+        const size_t fast = static_cast<size_t>(Lane::Fast);
+        const size_t normal = static_cast<size_t>(Lane::Normal);
+
+        if(m_lanes[normal].empty() || (!m_lanes[fast].empty() && (m_fastWeight == 0 || m_fastServed < m_fastWeight))){
+            ++m_fastServed;
+            return fast;
+        }
+        m_fastServed = 0;
+        return normal;
+    }
+
+public:
+
+    /**
+     * @brief Construct a new EventQueue object.
+     *
+     * @param capacity Maximum number of elements of the normal lane.
+     * @param fastCapacity Maximum number of elements of the fast lane.
+     * @param fastWeight Elements of the fast lane served for each element of the normal lane. 0 for strict priority.
+     */
+    EventQueue(size_t capacity, size_t fastCapacity, unsigned fastWeight = 0)
+    : m_capacity{fastCapacity, capacity}, m_fastWeight(fastWeight) {}
+
+    /**
+     * @brief Push an element at the end of a lane, applying the overflow policy when the lane is full.
+     *
+     * @param item Element to push.
+     * @param key Key that identifies the source of the element.
+     * @param policy Behaviour when the lane is full.
+     * @param lane Lane where the element is pushed.
+     * @return true if the element was queued or coalesced.
+     * @return false if the queue is closed or the element was dropped.
+     */
+    bool push(T item, const Key & key, OverflowPolicy policy = OverflowPolicy::Block, Lane lane = Lane::Normal) {
+        const size_t idx = static_cast<size_t>(lane);
+        std::deque<Entry> & queue = m_lanes[idx];
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if(policy == OverflowPolicy::Block)
+            m_notFull[idx].wait(lock, [this, &queue, idx]() { return m_closed || queue.size() < m_capacity[idx]; });
+        if(m_closed)
+            return false;
+
+        const bool superseding = (lane == Lane::Fast && policy != OverflowPolicy::Block);
+
+        if(policy == OverflowPolicy::Coalesce){
+            auto it = findOldest(key, idx);
+            if(it != queue.end()){
+                it->item = std::move(item);
+                ++m_keys[key].drops;
+                if(superseding)
+                    supersede(key);
+                return true;
+            }
+        }
+
+        if(queue.size() >= m_capacity[idx]){
+            switch(policy){
+                case OverflowPolicy::DropOldestPerPV: {
+                    auto it = findOldest(key, idx);
+                    if(it == queue.end() && !m_byPending[idx].empty())
+                        it = findOldest(chattiestKey(idx), idx);
+                    // A lane full of pinned elements
+                    if(it == queue.end()){
+                        ++m_keys[key].drops;
+                        return false;
+                    }
+                    KeyState & victim = m_keys[it->key];
+                    addPending(it->key, victim, idx, false);
+                    ++victim.drops;
+                    queue.erase(it);
+                    break;
+                }
+
+                default:
+                    ++m_keys[key].drops;
+                    return false;
+            }
+        }
+
+        if(superseding)
+            supersede(key);
+
+        enqueue(key, std::move(item), idx, policy == OverflowPolicy::Block);
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Pop the next element of the queue, chosen by the lane scheduler.
+     * Blocks while the queue is empty and open.
+     *
+     * @param item Output parameter with the popped element.
+     * @return true if an element was popped.
+     * @return false if the queue is closed and empty.
+     */
+    bool pop(T & item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this]() { return m_closed || !m_lanes[0].empty() || !m_lanes[1].empty(); });
+        if(m_lanes[0].empty() && m_lanes[1].empty())
+            return false;
+
+        size_t lane = nextLane();
+        std::deque<Entry> & queue = m_lanes[lane];
+        Entry & entry = queue.front();
+        item = std::move(entry.item);
+        if(!entry.pinned)
+            addPending(entry.key, m_keys[entry.key], lane, false);
+        queue.pop_front();
+        lock.unlock();
+        m_notFull[lane].notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Stop the intake of the queue and wake up every blocked thread.
+     * The elements already queued can still be popped.
+     *
+     */
+    void close() {
+        {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull[0].notify_all();
+        m_notFull[1].notify_all();
+    }
+
+    /**
+     * @brief Check whether the queue has been closed.
+     *
+     * @return true if the queue is closed.
+     * @return false otherwise.
+     */
+    bool isClosed() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed;
+    }
+
+    /**
+     * @brief Get the number of elements of the queue.
+     *
+     * @return Number of elements of both lanes.
+     */
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_lanes[0].size() + m_lanes[1].size();
+    }
+
+    /**
+     * @brief Get the maximum number of elements that the queue has held.
+     *
+     * @return High-watermark of the queue.
+     */
+    size_t highWatermark() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_highWatermark;
+    }
+
+    /**
+     * @brief Get the number of elements dropped or coalesced for every key.
+     *
+     * @return Map with the keys that have dropped elements and their number of drops.
+     */
+    std::unordered_map<Key, uint64_t> drops() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::unordered_map<Key, uint64_t> result;
+        for(const auto & [key, state] : m_keys)
+            if(state.drops > 0)
+                result.emplace(key, state.drops);
+        return result;
+    }
+};
+
+#endif  // __EVENTQUEUE_H__
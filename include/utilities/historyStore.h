@@ -0,0 +1,319 @@
+/**
+ * @file historyStore.h
+ * @brief Declaration of the HistoryStore class.
+ *
+ * This file defines the in-memory history of the PVs of the gateway. Every PV gets a fixed-size
+ * ring of sample blocks, filled on the update path of the gateway, that keeps the last samples
+ * of the PV for the HistoryRead service of OPC UA.
+ *
+ * The blocks store the samples in structure-of-arrays layout and delta-encoded: the timestamps as
+ * 32-bit differences with the previous sample, the values as the difference (integers) or the XOR
+ * of the bits (doubles) with the previous value. A block holds the samples of a single status
+ * code and data type; a change of either starts a new block.
+ *
+ * The memory of a PV is allocated once, with its first sample, so the memory budget is
+ * bytesPerPV() times the number of historized PVs and the update path never allocates.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __HISTORYSTORE_H__
+#define __HISTORYSTORE_H__
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <uavariant.h>
+
+struct HistoryConfig;
+
+/**
+ * @struct HistorySample
+ * @brief Sample of a PV decoded from the history.
+ *
+ */
+struct HistorySample {
+    /**
+     * @brief Source timestamp, in 100 ns intervals since 1601-01-01 (OPC UA DateTime).
+     *
+     */
+    int64_t timestamp;
+
+    /**
+     * @brief Bits of the value: a double, or an integer sign-extended to 64 bits.
+     *
+     */
+    uint64_t bits;
+
+    /**
+     * @brief OpcUa_BuiltInType of the value. OpcUaType_Null for a sample without value.
+     *
+     */
+    uint8_t type;
+
+    /**
+     * @brief StatusCode of the sample.
+     *
+     */
+    OpcUa_StatusCode statusCode;
+
+    /**
+     * @brief Value of the sample as a double, for the aggregates.
+     *
+     */
+    double toDouble() const;
+
+    /**
+     * @brief Value of the sample as a UaVariant of its original type.
+     *
+     */
+    void toVariant(UaVariant & variant) const;
+};
+
+/**
+ * @class HistoryStore
+ * @brief Fixed-size rings of delta-encoded samples, one per PV.
+ *
+ * Only scalar Boolean, integer and Double values are historized. Samples with a Bad status are kept
+ * without value, so a reader sees when the PV was not available.
+ *
+ * This class is thread-safe. The rings are protected by a fixed set of striped mutexes.
+ *
+ */
+class HistoryStore {
+
+public:
+
+    /**
+     * @brief Number of samples of a block.
+     *
+     */
+    static constexpr size_t BlockSamples = 64;
+
+    /**
+     * @brief Default number of samples kept per PV: 10 minutes at 1 Hz.
+     *
+     */
+    static constexpr size_t DefaultSamplesPerPV = 600;
+
+    /**
+     * @brief Default maximum number of historized PVs.
+     *
+     */
+    static constexpr size_t DefaultMaxPVs = 50000;
+
+private:
+
+    /**
+     * @struct Block
+     * @brief Samples of a PV with the same status code and data type.
+     *
+     */
+    struct Block {
+        /**
+         * @brief Timestamp of the first sample.
+         *
+         */
+        int64_t firstTime;
+
+        /**
+         * @brief Bits of the value of the first sample.
+         *
+         */
+        uint64_t firstBits;
+
+        /**
+         * @brief StatusCode of every sample of the block.
+         *
+         */
+        OpcUa_StatusCode statusCode;
+
+        /**
+         * @brief OpcUa_BuiltInType of every sample of the block.
+         *
+         */
+        uint8_t type;
+
+        /**
+         * @brief Number of samples of the block.
+         *
+         */
+        uint16_t count;
+
+        /**
+         * @brief Timestamp of every sample minus the previous one. The first one is 0.
+         *
+         */
+        uint32_t timeDeltas[BlockSamples];
+
+        /**
+         * @brief Value of every sample encoded against the previous one. The first one is 0.
+         *
+         */
+        uint64_t valueDeltas[BlockSamples];
+    };
+
+    /**
+     * @struct Ring
+     * @brief Ring of blocks of a PV.
+     *
+     */
+    struct Ring {
+        /**
+         * @brief Blocks of the PV. Null until the first sample.
+         *
+         */
+        std::unique_ptr<Block[]> blocks;
+
+        /**
+         * @brief Index of the oldest block.
+         *
+         */
+        uint32_t first = 0;
+
+        /**
+         * @brief Number of blocks in use.
+         *
+         */
+        uint32_t used = 0;
+
+        /**
+         * @brief Timestamp of the last sample, the base of the next delta.
+         *
+         */
+        int64_t lastTime = 0;
+
+        /**
+         * @brief Bits of the last value, the base of the next delta.
+         *
+         */
+        uint64_t lastBits = 0;
+    };
+
+    /**
+     * @brief Number of mutexes that protect the rings.
+     *
+     */
+    static constexpr size_t LockStripes = 64;
+
+    /**
+     * @brief Number of blocks of every ring.
+     *
+     */
+    uint32_t m_blocksPerPV;
+
+    /**
+     * @brief Maximum number of historized PVs. PVs with a greater identifier are not historized.
+     *
+     */
+    size_t m_maxPVs;
+
+    /**
+     * @brief Rings of the PVs, indexed by the identifier of the PV.
+     *
+     */
+    std::unique_ptr<Ring[]> m_rings;
+
+    /**
+     * @brief Mutexes of the rings. The ring of a PV is protected by m_locks[pvId % LockStripes].
+     *
+     */
+    mutable std::unique_ptr<std::mutex[]> m_locks;
+
+    /**
+     * @brief Start a new block in a ring, overwriting the oldest one if the ring is full.
+     *
+     */
+    Block & nextBlock(Ring & ring);
+
+public:
+
+    /**
+     * @brief Construct a new HistoryStore object.
+     *
+     * @param samplesPerPV Minimum number of samples kept per PV, while its status and type do not change.
+     * @param maxPVs Maximum number of historized PVs.
+     */
+    HistoryStore(size_t samplesPerPV, size_t maxPVs);
+
+    HistoryStore(const HistoryStore &) = delete;
+    HistoryStore & operator=(const HistoryStore &) = delete;
+
+    /**
+     * @brief Encode a value of a UaVariant as the bits of a HistorySample.
+     *
+     * @param variant Value.
+     * @param type Output parameter with the OpcUa_BuiltInType of the value.
+     * @param bits Output parameter with the bits of the value.
+     * @return true if the value can be historized (scalar Boolean, integer or floating point).
+     */
+    static bool encode(const UaVariant & variant, uint8_t & type, uint64_t & bits);
+
+    /**
+     * @brief Append a sample to the history of a PV. Allocates only with the first sample of the PV.
+     *
+     * @param pvId Identifier of the PV.
+     * @param timestamp Source timestamp of the sample (OPC UA DateTime).
+     * @param value Value of the sample. Ignored if the status is Bad.
+     * @param statusCode StatusCode of the sample.
+     * @return true if the sample was stored.
+     * @return false if the PV or the type of the value are not historized.
+     */
+    bool append(uint32_t pvId, int64_t timestamp, const UaVariant & value, OpcUa_StatusCode statusCode);
+
+    /**
+     * @brief Read the samples of a PV in a time range, in the order they were stored.
+     *
+     * @param pvId Identifier of the PV.
+     * @param startTime Start of the range, included.
+     * @param endTime End of the range, included.
+     * @param samples Output parameter with the samples.
+     * @return Number of samples read.
+     */
+    size_t read(uint32_t pvId, int64_t startTime, int64_t endTime, std::vector<HistorySample> & samples) const;
+
+    /**
+     * @brief Memory allocated for every historized PV, in bytes.
+     *
+     */
+    size_t bytesPerPV() const { return m_blocksPerPV * sizeof(Block); }
+
+    /**
+     * @brief Memory needed if every PV is historized, in bytes.
+     *
+     */
+    size_t memoryBudget() const { return m_maxPVs * (bytesPerPV() + sizeof(Ring)); }
+
+    /**
+     * @brief Load the configuration of the history from a file of "key = value" lines.
+     *
+     * @param path Path of the file.
+     * @param config Output parameter with the configuration.
+     * @return true if the file exists and both sizes are greater than 0.
+     */
+    static bool loadConfig(const std::string & path, HistoryConfig & config);
+};
+
+/**
+ * @struct HistoryConfig
+ * @brief Configuration of the history.
+ *
+ */
+struct HistoryConfig {
+    /**
+     * @brief Minimum number of samples kept per PV.
+     *
+     */
+    size_t samplesPerPV = HistoryStore::DefaultSamplesPerPV;
+
+    /**
+     * @brief Maximum number of historized PVs.
+     *
+     */
+    size_t maxPVs = HistoryStore::DefaultMaxPVs;
+};
+
+#endif  // __HISTORYSTORE_H__
@@ -0,0 +1,59 @@
+/**
+ * @file indexRange.h
+ * @brief Declaration of the IndexRange structure.
+ *
+ * This file defines the range of elements selected by the IndexRange parameter of the OPC UA
+ * Read, Write and CreateMonitoredItems services ("5" or "0:99"). Only one-dimensional ranges
+ * are supported, because the array PVs of the gateway are one-dimensional variables.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __INDEXRANGE_H__
+#define __INDEXRANGE_H__
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @struct IndexRange
+ * @brief Range [first, end) of elements of an array. The default range selects the whole array.
+ *
+ */
+struct IndexRange {
+    /**
+     * @brief First element of the range.
+     *
+     */
+    size_t first = 0;
+
+    /**
+     * @brief Element after the last one of the range. SIZE_MAX up to the end of the array.
+     *
+     */
+    size_t end = SIZE_MAX;
+
+    /**
+     * @brief Whether the range selects the whole array.
+     *
+     */
+    bool isAll() const { return first == 0 && end == SIZE_MAX; }
+
+    /**
+     * @brief Whether the range has elements in common with the range [first, end).
+     *
+     */
+    bool overlaps(size_t otherFirst, size_t otherEnd) const { return first < otherEnd && otherFirst < end; }
+
+    /**
+     * @brief Parse the IndexRange of a request.
+     *
+     * @param text IndexRange: empty (whole array), "a" (one element) or "a:b" with a < b (both included).
+     * @param range Output parameter with the range.
+     * @return false if the syntax is not valid or the range has more than one dimension.
+     */
+    static bool parse(const char * text, IndexRange & range);
+};
+
+#endif  // __INDEXRANGE_H__
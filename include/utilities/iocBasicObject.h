@@ -14,7 +14,108 @@
 #include <methodmanager.h>
 #include <methodhandleuanode.h>
 
+#include <opcua_basedatavariabletype.h>
 #include <myNodeIOEventManager.h>
+#include <propertyStore.h>
+
+/**
+ * @class IocSharedVariable
+ * @brief Instance of an IOC variable whose properties read the interned values of the PropertyStore.
+ * 
+ * The typed classes of the SDK (AnalogItemType, TwoStateDiscreteType and MultiStateDiscreteType) create
+ * their own property nodes with their own values. This class only has the value of the variable and reports
+ * the type definition of the instance declaration. Its properties are its own SharedValueProperty children,
+ * which store no value.
+ */
+class IocSharedVariable : public OpcUa::BaseDataVariableType
+{
+    UA_DISABLE_COPY(IocSharedVariable);
+
+private:
+    /**
+     * @brief Type definition of the instance declaration.
+     */
+    UaNodeId m_typeDefinitionId;
+
+public:
+    /**
+     * @brief Constructor.
+     * @param pParent Object of the variable.
+     * @param pInstanceDeclaration Variable of the ObjectType.
+     * @param pNodeConfig Node manager.
+     * @param pSharedMutex Mutex shared by the nodes of the object.
+     * @param typeDefinitionId Type definition of the instance declaration.
+     */
+    IocSharedVariable(
+        UaNode * pParent,
+        UaVariable * pInstanceDeclaration,
+        NodeManagerConfig * pNodeConfig,
+        UaMutexRefCounted * pSharedMutex,
+        const UaNodeId & typeDefinitionId)
+        : OpcUa::BaseDataVariableType(pParent, pInstanceDeclaration, pNodeConfig, pSharedMutex),
+          m_typeDefinitionId(typeDefinitionId) {}
+
+    /**
+     * @brief Constructor of a variable without instance declaration, e.g. a PV materialized on demand.
+     * @param nodeId UaNodeId of the variable.
+     * @param name Browse name and display name of the variable.
+     * @param browseNameNameSpaceIndex Namespace of the browse name.
+     * @param initialValue Initial value. Its type is the DataType of the variable.
+     * @param accessLevel Access level of the value.
+     * @param pNodeConfig Node manager.
+     * @param typeDefinitionId Type definition of the variable.
+     */
+    IocSharedVariable(
+        const UaNodeId & nodeId,
+        const UaString & name,
+        OpcUa_UInt16 browseNameNameSpaceIndex,
+        const UaVariant & initialValue,
+        OpcUa_Byte accessLevel,
+        NodeManagerConfig * pNodeConfig,
+        const UaNodeId & typeDefinitionId)
+        : OpcUa::BaseDataVariableType(nodeId, name, browseNameNameSpaceIndex, initialValue, accessLevel, pNodeConfig),
+          m_typeDefinitionId(typeDefinitionId) {}
+
+    /**
+     * @brief Type definition of the instance declaration, e.g. AnalogItemType.
+     */
+    UaNodeId typeDefinitionId() const override { return m_typeDefinitionId; }
+};
+
+/**
+ * @struct IocVariableTemplate
+ * @brief Descriptor of a variable of an ObjectType, resolved once per type.
+ * 
+ * Records the type definition of the instances and the interned property values that the properties
+ * of every instance read, so instantiating a type does not inspect its variables again.
+ */
+struct IocVariableTemplate
+{
+    /**
+     * @brief Instance declaration of the variable in the ObjectType.
+     */
+    UaVariable * pInstanceDeclaration;
+
+    /**
+     * @brief Type definition of the instances (AnalogItemType, TwoStateDiscreteType or MultiStateDiscreteType).
+     */
+    UaNodeId typeDefinitionId;
+
+    /**
+     * @brief Interned values of the properties of every instance.
+     */
+    std::vector<PropertyHandle> properties;
+
+    /**
+     * @brief Resolve the descriptor of an instance declaration and intern its properties.
+     * Currently only works with the variable types supported by IocBasicObject::addVariable.
+     * @param pInstanceDeclarationVar Pointer to the variable of the ObjectType.
+     * @param propertyStore Store of the interned property values.
+     * @param variableTemplate Output parameter with the descriptor.
+     * @return true if the type of the variable is supported.
+     */
+    static bool resolve(UaVariable * pInstanceDeclarationVar, PropertyStore & propertyStore, IocVariableTemplate & variableTemplate);
+};
 
 /**
  * @class IocBasicObject
@@ -73,6 +174,14 @@ public:
      */
     UaStatus addVariable(UaVariable * pInstanceDeclarationVar);
 
+    /**
+     * @brief Add a variable to this instance from its precomputed descriptor.
+     * The property nodes of the variable read the interned values of the descriptor, the instance declaration is not inspected.
+     * @param variableTemplate Descriptor of the variable of the ObjectType of this instance.
+     * @return UaStatus with error code of the operation.
+     */
+    UaStatus addVariable(const IocVariableTemplate & variableTemplate);
+
     /**
      * @brief Determines the UaNodeId representing the ObjectType associated with this instance.
      * @return UaNodeId representing the ObjectType of this instance.
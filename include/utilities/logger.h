@@ -0,0 +1,452 @@
+/**
+ * @file logger.h
+ * @brief Declaration of the Logger class and its sinks.
+ *
+ * This file contains the asynchronous logger of the gateway. The threads that log a message only
+ * format it into a fixed-size record and push it to a lock-free ring buffer; a dedicated thread
+ * writes the records to the sinks. Logging never blocks a worker thread: if the ring is full the
+ * record is dropped and counted.
+ *
+ * The messages about a PV are rate limited per PV, so an error storm in a few PVs can not flood
+ * the ring and hide the messages of the rest of the gateway.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @enum LogLevel
+ * @brief Severity of a log message.
+ *
+ */
+enum class LogLevel : uint8_t { Debug, Info, Warning, Error };
+
+/**
+ * @struct LogRecord
+ * @brief Log message as stored in the ring buffer.
+ *
+ */
+struct LogRecord {
+    /**
+     * @brief Maximum length of the text. Longer messages are truncated.
+     *
+     */
+    static constexpr size_t MaxText = 232;
+
+    /**
+     * @brief Time of the message, in nanoseconds since the Unix epoch.
+     *
+     */
+    int64_t timestamp;
+
+    /**
+     * @brief Identifier of the PV of the message, or Logger::NoPV.
+     *
+     */
+    uint32_t pvId;
+
+    /**
+     * @brief Length of the text.
+     *
+     */
+    uint16_t length;
+
+    /**
+     * @brief Severity of the message.
+     *
+     */
+    LogLevel level;
+
+    /**
+     * @brief Text of the message, not null-terminated.
+     *
+     */
+    char text[MaxText];
+};
+
+/**
+ * @class LogSink
+ * @brief Destination of the log records. Only called from the thread of the logger.
+ *
+ */
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+
+    /**
+     * @brief Write a record.
+     *
+     * @param record Record to write.
+     */
+    virtual void write(const LogRecord & record) = 0;
+
+    /**
+     * @brief Flush the written records. Called when the ring buffer is empty.
+     *
+     */
+    virtual void flush() {}
+};
+
+/**
+ * @class ConsoleSink
+ * @brief Writes human readable lines to stdout, and the warnings and errors to stderr.
+ *
+ */
+class ConsoleSink : public LogSink {
+public:
+    void write(const LogRecord & record) override;
+    void flush() override;
+};
+
+/**
+ * @class JsonSink
+ * @brief Writes one JSON object per line: {"ts":ns,"level":"error","pv":id,"msg":"text"}.
+ *
+ */
+class JsonSink : public LogSink {
+private:
+    FILE * m_file;
+
+public:
+    /**
+     * @brief Construct a new JsonSink object.
+     *
+     * @param path Path of the file. The records are appended to it.
+     */
+    explicit JsonSink(const std::string & path);
+    ~JsonSink() override;
+
+    /**
+     * @brief Whether the file was opened.
+     *
+     */
+    bool isOpen() const { return m_file != nullptr; }
+
+    void write(const LogRecord & record) override;
+    void flush() override;
+};
+
+/**
+ * @class BinarySink
+ * @brief Writes the records in a compact binary format: timestamp (int64), pvId (uint32), level (uint8),
+ * length (uint16) and the text, all little-endian.
+ *
+ */
+class BinarySink : public LogSink {
+private:
+    FILE * m_file;
+
+public:
+    /**
+     * @brief Construct a new BinarySink object.
+     *
+     * @param path Path of the file. The records are appended to it.
+     */
+    explicit BinarySink(const std::string & path);
+    ~BinarySink() override;
+
+    /**
+     * @brief Whether the file was opened.
+     *
+     */
+    bool isOpen() const { return m_file != nullptr; }
+
+    void write(const LogRecord & record) override;
+    void flush() override;
+};
+
+#if defined(__GNUC__)
+#  define LOGGER_PRINTF(formatIndex, argsIndex) __attribute__((format(printf, formatIndex, argsIndex)))
+#else
+#  define LOGGER_PRINTF(formatIndex, argsIndex)
+#endif
+
+/**
+ * @class Logger
+ * @brief Asynchronous logger with levels, per-PV rate limiting and pluggable sinks.
+ *
+ * The ring buffer is a bounded multi-producer queue where every slot has a sequence number, so the producers
+ * only compete for the write position with a compare-and-swap. The messages are formatted with printf syntax
+ * in the calling thread, without allocating memory.
+ *
+ * The messages logged before start() are kept in the ring and written when the logger starts. The messages
+ * logged after stop() are written directly by the caller.
+ *
+ * This class is thread-safe.
+ *
+ */
+class Logger {
+
+public:
+
+    /**
+     * @brief pvId of the messages that are not about a PV.
+     *
+     */
+    static constexpr uint32_t NoPV = UINT32_MAX;
+
+private:
+
+    /**
+     * @brief Number of records of the ring buffer. Must be a power of two.
+     *
+     */
+    static constexpr size_t Capacity = 4096;
+
+    /**
+     * @brief Number of slots of the rate limiter. The PVs with the same identifier modulo RateSlots share a slot.
+     *
+     */
+    static constexpr size_t RateSlots = 4096;
+
+    /**
+     * @struct Cell
+     * @brief Slot of the ring buffer.
+     *
+     */
+    struct Cell {
+        /**
+         * @brief Position that the slot expects: equal to the write position when it is free,
+         * and to the write position plus one when it holds a record.
+         *
+         */
+        std::atomic<size_t> sequence;
+
+        /**
+         * @brief Stored record.
+         *
+         */
+        LogRecord record;
+    };
+
+    /**
+     * @brief Ring buffer.
+     *
+     */
+    std::unique_ptr<Cell[]> m_cells;
+
+    /**
+     * @brief Next write position, shared by the producers.
+     *
+     */
+    alignas(64) std::atomic<size_t> m_writePos{0};
+
+    /**
+     * @brief Next read position, only used by the thread of the logger.
+     *
+     */
+    alignas(64) size_t m_readPos = 0;
+
+    /**
+     * @brief Rate limiter: the second of the window in the high 32 bits and the messages in the window in the low 32 bits.
+     *
+     */
+    std::unique_ptr<std::atomic<uint64_t>[]> m_rates;
+
+    /**
+     * @brief Minimum level of the messages that are logged.
+     *
+     */
+    std::atomic<LogLevel> m_level{LogLevel::Info};
+
+    /**
+     * @brief Maximum number of messages per PV and second. 0 disables the limit.
+     *
+     */
+    std::atomic<uint32_t> m_pvRateLimit{10};
+
+    /**
+     * @brief Number of messages dropped because the ring buffer was full.
+     *
+     */
+    std::atomic<uint64_t> m_dropped{0};
+
+    /**
+     * @brief Destinations of the records.
+     *
+     */
+    std::vector<std::unique_ptr<LogSink>> m_sinks;
+
+    /**
+     * @brief Thread that writes the records to the sinks.
+     *
+     */
+    std::thread m_thread;
+
+    /**
+     * @brief Mutex that protects m_sinks outside of the thread of the logger, and the waits of the thread.
+     *
+     */
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    /**
+     * @brief Whether the thread of the logger is sleeping, so the producers only notify it when needed.
+     *
+     */
+    std::atomic<bool> m_sleeping{false};
+
+    /**
+     * @brief Whether the thread of the logger must finish. Protected by m_mutex.
+     *
+     */
+    bool m_stopping = false;
+
+    /**
+     * @brief Whether the logger has been stopped. The messages are then written by the caller.
+     *
+     */
+    std::atomic<bool> m_stopped{false};
+
+    Logger();
+
+    /**
+     * @brief Check the rate limit of a PV.
+     *
+     * @param pvId Identifier of the PV.
+     * @param suppressed Output parameter with the number of messages suppressed in the previous window of the PV.
+     * @return true if the message can be logged.
+     */
+    bool allow(uint32_t pvId, uint32_t & suppressed);
+
+    /**
+     * @brief Format a message and push it to the ring buffer.
+     *
+     */
+    void push(LogLevel level, uint32_t pvId, const char * format, va_list args);
+
+    /**
+     * @brief Pop a record from the ring buffer. Only called from the thread of the logger, or after it is stopped.
+     *
+     * @param record Output parameter with the record.
+     * @return true if a record was popped.
+     */
+    bool pop(LogRecord & record);
+
+    /**
+     * @brief Write every pending record to the sinks and flush them.
+     *
+     */
+    void drain();
+
+    /**
+     * @brief Thread of the logger.
+     *
+     */
+    void run();
+
+public:
+
+    Logger(const Logger &) = delete;
+    Logger & operator=(const Logger &) = delete;
+
+    /**
+     * @brief Destroy the Logger object. Stops the thread and writes the pending records.
+     *
+     */
+    ~Logger();
+
+    /**
+     * @brief Get the logger of the process.
+     *
+     */
+    static Logger & instance();
+
+    /**
+     * @brief Set the minimum level of the messages that are logged.
+     *
+     */
+    void setLevel(LogLevel level) { m_level.store(level, std::memory_order_relaxed); }
+
+    /**
+     * @brief Whether the messages of a level are logged.
+     *
+     */
+    bool enabled(LogLevel level) const { return level >= m_level.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Set the maximum number of messages per PV and second. 0 disables the limit.
+     *
+     */
+    void setPVRateLimit(uint32_t messagesPerSecond) { m_pvRateLimit.store(messagesPerSecond, std::memory_order_relaxed); }
+
+    /**
+     * @brief Add a destination of the records. Must be called before start().
+     *
+     * @param sink Sink. The logger takes its ownership.
+     */
+    void addSink(std::unique_ptr<LogSink> sink);
+
+    /**
+     * @brief Start the thread of the logger. Adds a ConsoleSink if there is no sink.
+     *
+     */
+    void start();
+
+    /**
+     * @brief Stop the thread of the logger and write the pending records.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Log a message.
+     *
+     * @param level Severity of the message.
+     * @param format printf format of the message, followed by its arguments.
+     */
+    void log(LogLevel level, const char * format, ...) LOGGER_PRINTF(3, 4);
+
+    /**
+     * @brief Log a message about a PV, subject to the rate limit of the PV.
+     *
+     * @param level Severity of the message.
+     * @param pvId Identifier of the PV in the gateway.
+     * @param format printf format of the message, followed by its arguments.
+     */
+    void logPV(LogLevel level, uint32_t pvId, const char * format, ...) LOGGER_PRINTF(4, 5);
+
+    /**
+     * @brief Get the number of messages dropped because the ring buffer was full.
+     *
+     */
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Configure the logger from a text file.
+     *
+     * Every line is a "key = value" pair, with the keys level (debug, info, warning or error), pvRate
+     * (messages per PV and second), console (true or false), json (path) and binary (path).
+     * Lines starting with '#' are ignored.
+     *
+     * @param path Path of the file.
+     * @return true if the file was read.
+     * @return false otherwise. The logger keeps its defaults.
+     */
+    bool loadConfig(const std::string & path);
+};
+
+/**
+ * @brief Shortcuts for the logger of the process. The arguments are not evaluated if the level is disabled.
+ *
+ */
+#define LOG_DEBUG(...)   do { if (Logger::instance().enabled(LogLevel::Debug))   Logger::instance().log(LogLevel::Debug, __VA_ARGS__); } while (0)
+#define LOG_INFO(...)    do { if (Logger::instance().enabled(LogLevel::Info))    Logger::instance().log(LogLevel::Info, __VA_ARGS__); } while (0)
+#define LOG_WARNING(...) do { if (Logger::instance().enabled(LogLevel::Warning)) Logger::instance().log(LogLevel::Warning, __VA_ARGS__); } while (0)
+#define LOG_ERROR(...)   do { if (Logger::instance().enabled(LogLevel::Error))   Logger::instance().log(LogLevel::Error, __VA_ARGS__); } while (0)
+
+#endif  // __LOGGER_H__
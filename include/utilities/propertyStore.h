@@ -0,0 +1,287 @@
+/**
+ * @file propertyStore.h
+ * @brief Declaration of the PropertyStore class.
+ *
+ * This file defines the flyweight store of the property values of the IOC variables. The values of
+ * the properties with the same name and value (EngineeringUnits, EURange, InstrumentRange, TrueState,
+ * FalseState and EnumStrings) are interned once, and the property node of every instance reads the
+ * shared value instead of owning a copy of it.
+ *
+ * Every instance keeps its own property nodes, children of the variable: a Property is the target of a
+ * single HasProperty reference (OPC UA Part 3), so one node can not be shared by several variables.
+ * The saving is therefore limited to the values: a facility with thousands of analog channels of a few
+ * unit types stores a few EUInformation and Range values instead of three per channel, but still has
+ * three small property nodes per channel. statistics() measures the bytes of values that the nodes read
+ * from the store instead of owning, and the node manager logs it once the address space is built.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __PROPERTYSTORE_H__
+#define __PROPERTYSTORE_H__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <uabasenodes.h>
+#include <opcua_propertytype.h>
+#include <uaeuinformation.h>
+#include <uarange.h>
+
+class MyNodeIOEventManager;
+
+/**
+ * @struct PropertyValue
+ * @brief Interned value of a property, with the attributes of its nodes.
+ *
+ */
+struct PropertyValue {
+    /**
+     * @brief Standard browse name of the property (namespace 0).
+     *
+     */
+    const char * browseName;
+
+    /**
+     * @brief Value of the property.
+     *
+     */
+    UaDataValue value;
+
+    /**
+     * @brief DataType of the property.
+     *
+     */
+    OpcUa_UInt32 dataTypeId;
+
+    /**
+     * @brief ValueRank of the property.
+     *
+     */
+    OpcUa_Int32 valueRank;
+
+    /**
+     * @brief Memory used by the value: the stack structures and the strings it owns.
+     *
+     */
+    size_t bytes;
+};
+
+/**
+ * @brief Handle of an interned property value, shared by the property nodes that read it.
+ *
+ */
+typedef std::shared_ptr<const PropertyValue> PropertyHandle;
+
+/**
+ * @class SharedValueProperty
+ * @brief Property node of a variable whose value is an interned PropertyValue.
+ *
+ * The node has no value storage of its own and is read-only: a write would change every variable
+ * with the same property value.
+ *
+ */
+class SharedValueProperty : public OpcUa::PropertyType
+{
+    UA_DISABLE_COPY(SharedValueProperty);
+
+private:
+    /**
+     * @brief Interned value.
+     */
+    PropertyHandle m_pValue;
+
+public:
+    /**
+     * @brief Constructor.
+     * @param nodeId UaNodeId of the property.
+     * @param pValue Interned value.
+     * @param pNodeConfig Node manager.
+     */
+    SharedValueProperty(const UaNodeId & nodeId, const PropertyHandle & pValue, NodeManagerConfig * pNodeConfig);
+
+    /**
+     * @brief Value of the property, the interned one.
+     */
+    UaDataValue value(Session * pSession) override;
+};
+
+/**
+ * @class PropertyStore
+ * @brief Interns the property values of the IOC variables by name and value.
+ *
+ * addProperty() creates the property node of a variable that reads an interned value. The store
+ * mutex only protects the map of values: the nodes are added to the node manager without it.
+ *
+ * This class is thread-safe.
+ *
+ */
+class PropertyStore {
+
+public:
+
+    /**
+     * @struct Statistics
+     * @brief Memory of the interned values and of the copies they replace.
+     *
+     */
+    struct Statistics {
+        /**
+         * @brief Number of interned values.
+         *
+         */
+        size_t values;
+
+        /**
+         * @brief Bytes of the interned values.
+         *
+         */
+        size_t valueBytes;
+
+        /**
+         * @brief Number of property nodes created by addProperty().
+         *
+         */
+        size_t nodes;
+
+        /**
+         * @brief Bytes that the property nodes would use if each one had its own copy of the value.
+         *
+         */
+        size_t copiedBytes;
+    };
+
+private:
+
+    /**
+     * @brief Node manager where the property nodes are created.
+     *
+     */
+    MyNodeIOEventManager * m_pNodeManager;
+
+    /**
+     * @brief Interned values, indexed by the name and the value of the property.
+     *
+     */
+    std::unordered_map<std::string, PropertyHandle> m_properties;
+
+    /**
+     * @brief Mutex that protects m_properties and m_valueBytes.
+     *
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief Bytes of the interned values.
+     *
+     */
+    size_t m_valueBytes = 0;
+
+    /**
+     * @brief Number of property nodes created by addProperty().
+     *
+     */
+    std::atomic<size_t> m_nodes{0};
+
+    /**
+     * @brief Bytes of the values read by the property nodes created by addProperty().
+     *
+     */
+    std::atomic<size_t> m_copiedBytes{0};
+
+    /**
+     * @brief Get the interned value of a property, interning it the first time.
+     *
+     * @param key Name and value of the property.
+     * @param browseName Standard browse name of the property.
+     * @param value Value of the property.
+     * @param dataTypeId DataType of the property.
+     * @param valueRank ValueRank of the property.
+     * @param bytes Memory used by the value.
+     * @return Handle of the interned value.
+     */
+    PropertyHandle intern(const std::string & key, const char * browseName, const UaVariant & value,
+                          OpcUa_UInt32 dataTypeId, OpcUa_Int32 valueRank, size_t bytes);
+
+public:
+
+    /**
+     * @brief Construct a new PropertyStore object.
+     *
+     * @param pNodeManager Node manager where the property nodes are created.
+     */
+    explicit PropertyStore(MyNodeIOEventManager * pNodeManager);
+
+    /**
+     * @brief Get the interned EngineeringUnits property with a value.
+     *
+     */
+    PropertyHandle engineeringUnits(const UaEUInformation & engineeringUnits);
+
+    /**
+     * @brief Get the interned EURange property with a value.
+     *
+     */
+    PropertyHandle euRange(const UaRange & range);
+
+    /**
+     * @brief Get the interned InstrumentRange property with a value.
+     *
+     */
+    PropertyHandle instrumentRange(const UaRange & range);
+
+    /**
+     * @brief Get the interned FalseState property with a value.
+     *
+     */
+    PropertyHandle falseState(const UaLocalizedText & text);
+
+    /**
+     * @brief Get the interned TrueState property with a value.
+     *
+     */
+    PropertyHandle trueState(const UaLocalizedText & text);
+
+    /**
+     * @brief Get the interned EnumStrings property with a value.
+     *
+     */
+    PropertyHandle enumStrings(const UaLocalizedTextArray & texts);
+
+    /**
+     * @brief Number of interned values.
+     *
+     */
+    size_t size();
+
+    /**
+     * @brief Memory of the interned values compared with one copy per property node.
+     *
+     */
+    Statistics statistics();
+
+    /**
+     * @brief Create the property node of a variable, child of the variable through HasProperty,
+     * that reads an interned value. Its NodeId is the one of the variable followed by the browse name.
+     *
+     * @param pVariable Variable, already in the node manager.
+     * @param pValue Interned value. Nothing is created if it is null.
+     * @return UaStatus with error code of the operation.
+     */
+    UaStatus addProperty(UaVariable * pVariable, const PropertyHandle & pValue);
+
+    /**
+     * @brief Read a property of a variable, interned or not, through its HasProperty references.
+     *
+     * @param pVariable Variable.
+     * @param browseName Name of the property.
+     * @param value Output parameter with the value of the property.
+     * @return true if the variable has the property.
+     */
+    static bool readProperty(UaVariable * pVariable, const char * browseName, UaVariant & value);
+};
+
+#endif  // __PROPERTYSTORE_H__
@@ -0,0 +1,142 @@
+/**
+ * @file pvCatalog.h
+ * @brief Declaration of the PVCatalog class and the PVCatalogEntry structure.
+ *
+ * This file defines the persistent catalog of the EPICS process variables known by the gateway.
+ * The catalog is stored in a compact, versioned binary file that is memory-mapped when it is loaded,
+ * so the gateway can map and subscribe every PV at startup without waiting for the network discovery.
+ *
+ * File layout (native byte order, little-endian in every supported platform):
+ * - Header: magic "PVCATLG", format version, number of entries and location of the string table.
+ * - Records: one fixed-size record per entry with references into the string table.
+ * - String table: every string of the catalog, one after the other.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __PVCATALOG_H__
+#define __PVCATALOG_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct PVCatalogEntry
+ * @brief Description of an EPICS process variable stored in the catalog.
+ *
+ */
+struct PVCatalogEntry {
+    /**
+     * @brief The name of the EPICS process variable.
+     *
+     */
+    std::string epicsName;
+
+    /**
+     * @brief String identifier of the associated OPC UA node.
+     *
+     */
+    std::string nodeId;
+
+    /**
+     * @brief Normative Type id of the PV (e.g. "epics:nt/NTScalar:1.0"). Empty if not known yet.
+     *
+     */
+    std::string ntId;
+
+    /**
+     * @brief pvxs::TypeCode::code_t of the value field (the index field for NTEnum).
+     *
+     */
+    uint8_t valueType = 0;
+
+    /**
+     * @brief Engineering units of the PV (display.units).
+     *
+     */
+    std::string units;
+
+    /**
+     * @brief Lower display limit of the PV (display.limitLow).
+     *
+     */
+    double limitLow = 0.0;
+
+    /**
+     * @brief Upper display limit of the PV (display.limitHigh).
+     *
+     */
+    double limitHigh = 0.0;
+
+    /**
+     * @brief Names of the states of an NTEnum PV (value.choices).
+     *
+     */
+    std::vector<std::string> choices;
+
+    /**
+     * @brief Record type of the PV (RTYP), e.g. "ao". Empty if not known yet.
+     *
+     */
+    std::string recordType;
+
+    /**
+     * @brief Whether the metadata has been refreshed from a live update in this run. Not persisted.
+     *
+     */
+    bool described = false;
+};
+
+/**
+ * @class PVCatalog
+ * @brief Reads and writes the binary snapshot of the PV catalog.
+ *
+ */
+class PVCatalog {
+
+public:
+
+    /**
+     * @brief Version of the file format. Files with another version are rejected.
+     *
+     */
+    static constexpr uint32_t FormatVersion = 2;
+
+    /**
+     * @brief Write the catalog to a file.
+     *
+     * The catalog is written to a temporary file that replaces the previous one,
+     * so a crash while saving never leaves a corrupted snapshot.
+     *
+     * @param path Path of the file.
+     * @param entries Entries of the catalog.
+     * @return true if the file was written.
+     * @return false otherwise.
+     */
+    static bool save(const std::string & path, const std::vector<PVCatalogEntry> & entries);
+
+    /**
+     * @brief Read the catalog from a file.
+     *
+     * The file is memory-mapped and validated before any entry is returned.
+     *
+     * @param path Path of the file.
+     * @param entries Output parameter with the entries of the catalog.
+     * @return true if the file exists, has the current version and is consistent.
+     * @return false otherwise.
+     */
+    static bool load(const std::string & path, std::vector<PVCatalogEntry> & entries);
+
+    /**
+     * @brief Read the number of entries of a catalog file from its header, without loading the entries.
+     * Used to size the address space before the catalog is loaded.
+     *
+     * @param path Path of the file.
+     * @return Number of entries, or 0 if the file does not exist or has another version.
+     */
+    static uint32_t count(const std::string & path);
+};
+
+#endif  // __PVCATALOG_H__
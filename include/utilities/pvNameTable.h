@@ -0,0 +1,253 @@
+/**
+ * @file pvNameTable.h
+ * @brief Declaration of the PVNameTable class.
+ *
+ * This file defines the table of interned EPICS process variable names used by the gateway.
+ * Every PV name gets a stable integer identifier that the gateway uses everywhere instead of
+ * the name itself: as key of the work queue, to index its per-PV tables and in the queued events.
+ *
+ * The table also precomputes the string identifier of the OPC UA node of each PV (the PV name
+ * with the colons replaced by dots), so the NodeIds are built from the table without temporary strings.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __PVNAMETABLE_H__
+#define __PVNAMETABLE_H__
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class PVNameTable
+ * @brief Arena-backed table of interned PV names with stable integer identifiers.
+ *
+ * The strings are stored null-terminated in large blocks that are never moved, so the views returned
+ * by the table stay valid for its whole life. Names and node names are indexed by two Robin Hood
+ * hash tables that only store identifiers and keep the full hash of every string, so growing
+ * the indexes never hashes a string again.
+ *
+ * This class is not thread-safe. The owner must synchronize the access.
+ *
+ */
+class PVNameTable {
+
+private:
+
+    /**
+     * @struct Slot
+     * @brief Slot of a Robin Hood hash index.
+     *
+     */
+    struct Slot {
+        /**
+         * @brief Identifier stored in the slot, or InvalidId if the slot is empty.
+         *
+         */
+        uint32_t id;
+
+        /**
+         * @brief Distance from the slot to the ideal slot of the identifier.
+         *
+         */
+        uint32_t distance;
+    };
+
+    /**
+     * @struct Entry
+     * @brief Interned strings and hashes of a PV.
+     *
+     */
+    struct Entry {
+        /**
+         * @brief The EPICS process variable name.
+         *
+         */
+        std::string_view name;
+
+        /**
+         * @brief String identifier of the OPC UA node of the PV.
+         *
+         */
+        std::string_view nodeName;
+
+        /**
+         * @brief Hash of the name.
+         *
+         */
+        uint64_t nameHash;
+
+        /**
+         * @brief Hash of the node name.
+         *
+         */
+        uint64_t nodeHash;
+    };
+
+    /**
+     * @brief Size of each block of the arena.
+     *
+     */
+    static constexpr size_t BlockSize = 64 * 1024;
+
+    /**
+     * @brief Blocks of the arena where the strings are stored.
+     *
+     */
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+
+    /**
+     * @brief Bytes used of the last block of the arena.
+     *
+     */
+    size_t m_blockUsed = BlockSize;
+
+    /**
+     * @brief Entries of the table. The identifier of a PV is its position.
+     *
+     */
+    std::vector<Entry> m_entries;
+
+    /**
+     * @brief Robin Hood index of the names. Its size is always a power of two.
+     *
+     */
+    std::vector<Slot> m_byName;
+
+    /**
+     * @brief Robin Hood index of the node names. Its size is always a power of two.
+     *
+     */
+    std::vector<Slot> m_byNode;
+
+    /**
+     * @brief Copy a string to the arena and append a null terminator.
+     *
+     * @param str String to copy.
+     * @param replaceColons Whether the colons are replaced by dots in the copy.
+     * @return View of the copy, without the null terminator.
+     */
+    std::string_view store(std::string_view str, bool replaceColons = false);
+
+    /**
+     * @brief Insert an identifier in an index. The index must have room.
+     *
+     * @param index Index where the identifier is inserted.
+     * @param id Identifier to insert.
+     * @param hash Hash of the string of the identifier.
+     */
+    static void insert(std::vector<Slot> & index, uint32_t id, uint64_t hash);
+
+    /**
+     * @brief Look up a string in an index.
+     *
+     * @param index Index where the string is looked up.
+     * @param str String to look up.
+     * @param hash Hash of the string.
+     * @param byNode Whether the index stores node names instead of names.
+     * @return Identifier of the string, or InvalidId if it is not in the index.
+     */
+    uint32_t lookup(const std::vector<Slot> & index, std::string_view str, uint64_t hash, bool byNode) const;
+
+    /**
+     * @brief Add a PV to the table if its name is not interned yet.
+     *
+     * @param name The EPICS process variable name.
+     * @param nodeName String from which the node name is stored.
+     * @param replaceColons Whether the colons of nodeName are replaced by dots.
+     * @return Identifier of the name, new or existing.
+     */
+    uint32_t add(std::string_view name, std::string_view nodeName, bool replaceColons);
+
+    /**
+     * @brief Double the size of both indexes when the load factor would exceed 0.75.
+     *
+     * @param count Number of entries that the indexes have to hold.
+     */
+    void grow(size_t count);
+
+public:
+
+    /**
+     * @brief Identifier returned when a name is not in the table.
+     *
+     */
+    static constexpr uint32_t InvalidId = UINT32_MAX;
+
+    /**
+     * @brief Hash function of the table (64-bit FNV-1a).
+     *
+     * @param str String to hash.
+     * @return Hash of the string.
+     */
+    static uint64_t hash(std::string_view str);
+
+    /**
+     * @brief Intern a PV name. Its node name is the name with the colons replaced by dots.
+     *
+     * @param name The EPICS process variable name.
+     * @return Identifier of the name, new or existing.
+     */
+    uint32_t intern(std::string_view name);
+
+    /**
+     * @brief Intern a PV name with a given node name.
+     * If the name is already in the table, the node name is ignored.
+     *
+     * @param name The EPICS process variable name.
+     * @param nodeName String identifier of the OPC UA node of the PV.
+     * @return Identifier of the name, new or existing.
+     */
+    uint32_t intern(std::string_view name, std::string_view nodeName);
+
+    /**
+     * @brief Find the identifier of a PV name.
+     *
+     * @param name The EPICS process variable name.
+     * @return Identifier of the name, or InvalidId if it is not in the table.
+     */
+    uint32_t find(std::string_view name) const;
+
+    /**
+     * @brief Find the identifier of a PV by the string identifier of its OPC UA node.
+     *
+     * @param nodeName String identifier of the OPC UA node.
+     * @return Identifier of the PV, or InvalidId if it is not in the table.
+     */
+    uint32_t findByNode(std::string_view nodeName) const;
+
+    /**
+     * @brief Get the name of a PV. The view is null-terminated.
+     *
+     * @param id Identifier of the PV. Must be valid.
+     * @return View of the interned name.
+     */
+    std::string_view name(uint32_t id) const { return m_entries[id].name; }
+
+    /**
+     * @brief Get the string identifier of the OPC UA node of a PV. The view is null-terminated.
+     *
+     * @param id Identifier of the PV. Must be valid.
+     * @return View of the interned node name.
+     */
+    std::string_view nodeName(uint32_t id) const { return m_entries[id].nodeName; }
+
+    /**
+     * @brief Get the number of PVs of the table.
+     *
+     * @return Number of PVs. The identifiers go from 0 to size() - 1.
+     */
+    size_t size() const { return m_entries.size(); }
+
+    /**
+     * @brief Reserve room for a number of PVs, so the indexes do not grow while they are interned.
+     *
+     * @param count Number of PVs.
+     */
+    void reserve(size_t count);
+};
+
+#endif  // __PVNAMETABLE_H__
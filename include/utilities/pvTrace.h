@@ -0,0 +1,307 @@
+/**
+ * @file pvTrace.h
+ * @brief Declaration of the TraceWriter and TraceReader classes.
+ *
+ * This file defines the binary trace of the monitor updates received by the gateway. A trace keeps
+ * the name of every PV, the complete pvxs Value of every update and its arrival time, so a stream of
+ * production traffic (alarm bursts, IOC reboot storms) can be replayed later with TraceReplayer.
+ *
+ * Format of a trace: the header "PVXTRACE" and a version, then a sequence of records:
+ * - 'N' pv name: first time a PV appears.
+ * - 'T' pv type: type of the next updates of the PV, when it is new or changes.
+ * - 'U' pv arrival value: an update. The arrival time is the difference in nanoseconds with the previous update.
+ *
+ * The types and the values are encoded recursively, field by field, with varints for the integers.
+ * The selected member of a union is part of the type, so the type changes when the selection changes.
+ * The elements of the arrays of unions are recorded as variant unions (any).
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __PVTRACE_H__
+#define __PVTRACE_H__
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <pvxs/data.h>
+
+/**
+ * @class TraceWriter
+ * @brief Writes the monitor updates of the gateway to a trace file.
+ *
+ * This class is thread-safe. The updates are serialized under a mutex and written to a buffered file,
+ * so the capture mode slows down the PVXS client workers: it is meant for capturing, not for production.
+ *
+ */
+class TraceWriter {
+
+private:
+
+    /**
+     * @struct PVState
+     * @brief What has been written about a PV.
+     *
+     */
+    struct PVState {
+        /**
+         * @brief Whether the name of the PV has been written.
+         *
+         */
+        bool named = false;
+
+        /**
+         * @brief Encoded type of the last update of the PV.
+         *
+         */
+        std::vector<uint8_t> type;
+    };
+
+    /**
+     * @brief Trace file. Null if it could not be opened.
+     *
+     */
+    FILE * m_file;
+
+    /**
+     * @brief Mutex that protects the file and the states.
+     *
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief State of every PV, indexed by the identifier of the PV.
+     *
+     */
+    std::vector<PVState> m_pvs;
+
+    /**
+     * @brief Start of the capture.
+     *
+     */
+    std::chrono::steady_clock::time_point m_start;
+
+    /**
+     * @brief Arrival time of the last update, in nanoseconds since m_start.
+     *
+     */
+    int64_t m_lastArrival = 0;
+
+    /**
+     * @brief Encoded type of the current update, reused between updates.
+     *
+     */
+    std::vector<uint8_t> m_type;
+
+    /**
+     * @brief Encoded value of the current update, reused between updates.
+     *
+     */
+    std::vector<uint8_t> m_value;
+
+    /**
+     * @brief Number of updates written.
+     *
+     */
+    uint64_t m_updates = 0;
+
+    /**
+     * @brief Write a record.
+     *
+     */
+    void writeRecord(char tag, uint32_t pvId, const std::vector<uint8_t> & payload, const int64_t * pArrival);
+
+public:
+
+    /**
+     * @brief Construct a new TraceWriter object and create the trace file.
+     *
+     * @param path Path of the trace file.
+     */
+    explicit TraceWriter(const std::string & path);
+
+    /**
+     * @brief Destroy the TraceWriter object. Flushes and closes the file.
+     *
+     */
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter & operator=(const TraceWriter &) = delete;
+
+    /**
+     * @brief Check if the trace file is open.
+     *
+     */
+    bool isOpen() const { return m_file != nullptr; }
+
+    /**
+     * @brief Write an update, with its arrival time.
+     *
+     * @param pvId Identifier of the PV in the trace.
+     * @param name Name of the PV. Only written the first time.
+     * @param value Value received from the monitor.
+     */
+    void write(uint32_t pvId, const std::string & name, const pvxs::Value & value);
+
+    /**
+     * @brief Number of updates written.
+     *
+     */
+    uint64_t updates();
+
+    /**
+     * @brief Encode the type of a Value.
+     *
+     * @param value Value.
+     * @param buffer Buffer where the type is appended.
+     */
+    static void encodeType(const pvxs::Value & value, std::vector<uint8_t> & buffer);
+
+    /**
+     * @brief Encode the fields of a Value. The type must be encoded with encodeType().
+     *
+     * @param value Value.
+     * @param buffer Buffer where the fields are appended.
+     */
+    static void encodeValue(const pvxs::Value & value, std::vector<uint8_t> & buffer);
+
+    /**
+     * @brief Load the path of the trace from a file of "key = value" lines (key "trace").
+     *
+     * @param path Path of the file.
+     * @param tracePath Output parameter with the path of the trace.
+     * @return true if the file exists and sets a trace.
+     */
+    static bool loadConfig(const std::string & path, std::string & tracePath);
+};
+
+/**
+ * @struct TraceEvent
+ * @brief Record read from a trace.
+ *
+ */
+struct TraceEvent {
+    /**
+     * @brief Kind of the record.
+     *
+     */
+    enum class Kind { Name, Type, Update } kind;
+
+    /**
+     * @brief Identifier of the PV in the trace.
+     *
+     */
+    uint32_t pvId = 0;
+
+    /**
+     * @brief Name of the PV (Name).
+     *
+     */
+    std::string name;
+
+    /**
+     * @brief Arrival time of the update, in nanoseconds since the start of the capture (Update).
+     *
+     */
+    int64_t arrival = 0;
+
+    /**
+     * @brief The new type, as an empty Value (Type), or the value of the update (Update).
+     *
+     */
+    pvxs::Value value;
+};
+
+/**
+ * @class TraceReader
+ * @brief Reads the records of a trace file, in order.
+ *
+ * This class is not thread-safe.
+ *
+ */
+class TraceReader {
+
+private:
+
+    /**
+     * @brief Trace file. Null if it could not be opened or it is not a trace.
+     *
+     */
+    FILE * m_file;
+
+    /**
+     * @brief Empty Value with the current type of every PV, indexed by the identifier of the PV.
+     *
+     */
+    std::vector<pvxs::Value> m_prototypes;
+
+    /**
+     * @brief Arrival time of the last update.
+     *
+     */
+    int64_t m_lastArrival = 0;
+
+    /**
+     * @brief Payload of the current record, reused between records.
+     *
+     */
+    std::vector<uint8_t> m_payload;
+
+public:
+
+    /**
+     * @brief Construct a new TraceReader object and open the trace file.
+     *
+     * @param path Path of the trace file.
+     */
+    explicit TraceReader(const std::string & path);
+
+    /**
+     * @brief Destroy the TraceReader object.
+     *
+     */
+    ~TraceReader();
+
+    TraceReader(const TraceReader &) = delete;
+    TraceReader & operator=(const TraceReader &) = delete;
+
+    /**
+     * @brief Check if the trace file is open.
+     *
+     */
+    bool isOpen() const { return m_file != nullptr; }
+
+    /**
+     * @brief Read the next record.
+     *
+     * @param event Output parameter with the record.
+     * @return false at the end of the trace, or if the trace is corrupted.
+     */
+    bool next(TraceEvent & event);
+
+    /**
+     * @brief Decode a type encoded with TraceWriter::encodeType().
+     *
+     * @param pData Start of the type. Advanced to the end of the type.
+     * @param pEnd End of the data.
+     * @return Empty Value of the type. Throws std::runtime_error if the data is corrupted.
+     */
+    static pvxs::Value decodeType(const uint8_t *& pData, const uint8_t * pEnd);
+
+    /**
+     * @brief Decode the fields of a Value encoded with TraceWriter::encodeValue().
+     *
+     * @param pData Start of the fields. Advanced to the end of the fields.
+     * @param pEnd End of the data.
+     * @param value Value of the type of the fields, where they are stored.
+     * Throws std::runtime_error if the data is corrupted.
+     */
+    static void decodeValue(const uint8_t *& pData, const uint8_t * pEnd, pvxs::Value & value);
+};
+
+#endif  // __PVTRACE_H__
@@ -70,6 +70,9 @@ void RegisterSignalHandler();
 /* Use this to check if the shutdown flag is set. */
 unsigned int ShutDownFlag();
 
+/* Use this to block the calling thread until the shutdown flag is set. */
+void WaitForShutDown();
+
 /* Use this to get the application path created with new. Delete returned char array if not NULL. */
 char* getAppPath();
 
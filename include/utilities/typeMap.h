@@ -0,0 +1,336 @@
+/**
+ * @file typeMap.h
+ * @brief Declaration of the TypeMap class.
+ *
+ * This file contains the compile-time table that maps every scalar type of PVXS (TypeCode) to its
+ * OPC UA built-in type and DataType, with the conversions of both directions. The conversions are
+ * generated from one template per direction and a small traits class per C++ type, so adding a type
+ * is one traits specialization and one row of the table.
+ *
+ * The strings are copied through a per-thread buffer that keeps its capacity, so a string PV
+ * (stringin, stringout, lsi, lso) does not reallocate at every update once its buffer has grown.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __TYPEMAP_H__
+#define __TYPEMAP_H__
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <pvxs/data.h>
+#include <uavariant.h>
+#include <opcua_identifiers.h>
+
+namespace typemap {
+
+/**
+ * @struct UaScalar
+ * @brief How a C++ type is set to and read from a UaVariant. One specialization per type of the table.
+ *
+ */
+template<typename T> struct UaScalar;
+
+template<> struct UaScalar<bool> {
+    static void set(UaVariant & variant, bool x) { variant.setBool(x ? OpcUa_True : OpcUa_False); }
+    static bool get(const UaVariant & variant, bool & x) {
+        OpcUa_Boolean value;
+        if (OpcUa_IsBad(variant.toBool(value))) return false;
+        x = value != OpcUa_False;
+        return true;
+    }
+};
+
+template<> struct UaScalar<int8_t> {
+    static void set(UaVariant & variant, int8_t x) { variant.setSByte(x); }
+    static bool get(const UaVariant & variant, int8_t & x) {
+        OpcUa_SByte value;
+        if (OpcUa_IsBad(variant.toSByte(value))) return false;
+        x = value;
+        return true;
+    }
+};
+
+template<> struct UaScalar<uint8_t> {
+    static void set(UaVariant & variant, uint8_t x) { variant.setByte(x); }
+    static bool get(const UaVariant & variant, uint8_t & x) {
+        OpcUa_Byte value;
+        if (OpcUa_IsBad(variant.toByte(value))) return false;
+        x = value;
+        return true;
+    }
+};
+
+template<> struct UaScalar<int16_t> {
+    static void set(UaVariant & variant, int16_t x) { variant.setInt16(x); }
+    static bool get(const UaVariant & variant, int16_t & x) {
+        OpcUa_Int16 value;
+        if (OpcUa_IsBad(variant.toInt16(value))) return false;
+        x = value;
+        return true;
+    }
+};
+
+template<> struct UaScalar<uint16_t> {
+    static void set(UaVariant & variant, uint16_t x) { variant.setUInt16(x); }
+    static bool get(const UaVariant & variant, uint16_t & x) {
+        OpcUa_UInt16 value;
+        if (OpcUa_IsBad(variant.toUInt16(value))) return false;
+        x = value;
+        return true;
+    }
+};
+
+template<> struct UaScalar<int32_t> {
+    static void set(UaVariant & variant, int32_t x) { variant.setInt32(x); }
+    static bool get(const UaVariant & variant, int32_t & x) {
+        OpcUa_Int32 value;
+        if (OpcUa_IsBad(variant.toInt32(value))) return false;
+        x = value;
+        return true;
+    }
+};
+
+template<> struct UaScalar<uint32_t> {
+    static void set(UaVariant & variant, uint32_t x) { variant.setUInt32(x); }
+    static bool get(const UaVariant & variant, uint32_t & x) {
+        OpcUa_UInt32 value;
+        if (OpcUa_IsBad(variant.toUInt32(value))) return false;
+        x = value;
+        return true;
+    }
+};
+
+template<> struct UaScalar<int64_t> {
+    static void set(UaVariant & variant, int64_t x) { variant.setInt64(x); }
+    static bool get(const UaVariant & variant, int64_t & x) {
+        OpcUa_Int64 value;
+        if (OpcUa_IsBad(variant.toInt64(value))) return false;
+        x = static_cast<int64_t>(value);
+        return true;
+    }
+};
+
+template<> struct UaScalar<uint64_t> {
+    static void set(UaVariant & variant, uint64_t x) { variant.setUInt64(x); }
+    static bool get(const UaVariant & variant, uint64_t & x) {
+        OpcUa_UInt64 value;
+        if (OpcUa_IsBad(variant.toUInt64(value))) return false;
+        x = static_cast<uint64_t>(value);
+        return true;
+    }
+};
+
+template<> struct UaScalar<float> {
+    static void set(UaVariant & variant, float x) { variant.setFloat(x); }
+    static bool get(const UaVariant & variant, float & x) { return OpcUa_IsGood(variant.toFloat(x)); }
+};
+
+template<> struct UaScalar<double> {
+    static void set(UaVariant & variant, double x) { variant.setDouble(x); }
+    static bool get(const UaVariant & variant, double & x) { return OpcUa_IsGood(variant.toDouble(x)); }
+};
+
+/**
+ * @brief Read a scalar field of PVXS into a variant.
+ *
+ */
+template<typename T>
+bool toVariant(const pvxs::Value & field, UaVariant & variant) {
+    T x;
+    if (!field.as(x))
+        return false;
+    UaScalar<T>::set(variant, x);
+    return true;
+}
+
+/**
+ * @brief Write a variant into a scalar field of PVXS, converted to the type of the field.
+ *
+ */
+template<typename T>
+bool fromVariant(const UaVariant & variant, pvxs::Value & field) {
+    T x;
+    if (!UaScalar<T>::get(variant, x))
+        return false;
+    return field.tryFrom(x);
+}
+
+// A Boolean written to the index of an NTEnum (bi, bo)
+template<>
+inline bool fromVariant<bool>(const UaVariant & variant, pvxs::Value & field) {
+    bool x;
+    if (!UaScalar<bool>::get(variant, x))
+        return false;
+    return field.type().code == pvxs::TypeCode::Bool ? field.tryFrom(x) : field.tryFrom(int32_t(x ? 1 : 0));
+}
+
+// Strings, through the buffer of the thread and a single allocation for the variant
+template<>
+bool toVariant<std::string>(const pvxs::Value & field, UaVariant & variant);
+
+template<>
+bool fromVariant<std::string>(const UaVariant & variant, pvxs::Value & field);
+
+/**
+ * @struct Entry
+ * @brief A row of the table of TypeMap.
+ *
+ */
+struct Entry {
+    /**
+     * @brief Scalar type of PVXS.
+     *
+     */
+    pvxs::TypeCode::code_t code;
+
+    /**
+     * @brief Built-in type of the variants.
+     *
+     */
+    OpcUa_BuiltInType builtInType;
+
+    /**
+     * @brief Numeric identifier of the OPC UA DataType of the nodes.
+     *
+     */
+    OpcUa_UInt32 dataTypeId;
+
+    /**
+     * @brief Whether the nodes of the NTScalar PVs of the type are AnalogItemType.
+     *
+     */
+    bool analog;
+
+    /**
+     * @brief Conversion of a scalar field of PVXS to a variant.
+     *
+     */
+    bool (*toVariant)(const pvxs::Value & field, UaVariant & variant);
+
+    /**
+     * @brief Conversion of a variant to a scalar field of PVXS.
+     *
+     */
+    bool (*fromVariant)(const UaVariant & variant, pvxs::Value & field);
+};
+
+/**
+ * @brief Every scalar type of PVXS supported by the gateway.
+ *
+ */
+inline constexpr Entry Entries[] = {
+    {pvxs::TypeCode::Bool,    OpcUaType_Boolean, OpcUaId_Boolean, false, &toVariant<bool>,        &fromVariant<bool>},
+    {pvxs::TypeCode::Int8,    OpcUaType_SByte,   OpcUaId_SByte,   true,  &toVariant<int8_t>,      &fromVariant<int8_t>},
+    {pvxs::TypeCode::UInt8,   OpcUaType_Byte,    OpcUaId_Byte,    true,  &toVariant<uint8_t>,     &fromVariant<uint8_t>},
+    {pvxs::TypeCode::Int16,   OpcUaType_Int16,   OpcUaId_Int16,   true,  &toVariant<int16_t>,     &fromVariant<int16_t>},
+    {pvxs::TypeCode::UInt16,  OpcUaType_UInt16,  OpcUaId_UInt16,  true,  &toVariant<uint16_t>,    &fromVariant<uint16_t>},
+    {pvxs::TypeCode::Int32,   OpcUaType_Int32,   OpcUaId_Int32,   true,  &toVariant<int32_t>,     &fromVariant<int32_t>},
+    {pvxs::TypeCode::UInt32,  OpcUaType_UInt32,  OpcUaId_UInt32,  true,  &toVariant<uint32_t>,    &fromVariant<uint32_t>},
+    {pvxs::TypeCode::Int64,   OpcUaType_Int64,   OpcUaId_Int64,   true,  &toVariant<int64_t>,     &fromVariant<int64_t>},
+    {pvxs::TypeCode::UInt64,  OpcUaType_UInt64,  OpcUaId_UInt64,  true,  &toVariant<uint64_t>,    &fromVariant<uint64_t>},
+    {pvxs::TypeCode::Float32, OpcUaType_Float,   OpcUaId_Float,   true,  &toVariant<float>,       &fromVariant<float>},
+    {pvxs::TypeCode::Float64, OpcUaType_Double,  OpcUaId_Double,  true,  &toVariant<double>,      &fromVariant<double>},
+    {pvxs::TypeCode::String,  OpcUaType_String,  OpcUaId_String,  false, &toVariant<std::string>, &fromVariant<std::string>},
+};
+
+inline constexpr size_t Count = sizeof(Entries) / sizeof(Entries[0]);
+
+// Row of every TypeCode, -1 if it is not in the table
+constexpr std::array<int8_t, 256> indexByCode() {
+    std::array<int8_t, 256> index{};
+    for (size_t i = 0; i < index.size(); ++i)
+        index[i] = -1;
+    for (size_t i = 0; i < Count; ++i)
+        index[static_cast<uint8_t>(Entries[i].code)] = static_cast<int8_t>(i);
+    return index;
+}
+
+// Row of every built-in type, -1 if it is not in the table
+constexpr std::array<int8_t, 32> indexByBuiltInType() {
+    std::array<int8_t, 32> index{};
+    for (size_t i = 0; i < index.size(); ++i)
+        index[i] = -1;
+    for (size_t i = 0; i < Count; ++i)
+        index[static_cast<size_t>(Entries[i].builtInType)] = static_cast<int8_t>(i);
+    return index;
+}
+
+inline constexpr std::array<int8_t, 256> ByCode = indexByCode();
+inline constexpr std::array<int8_t, 32> ByBuiltInType = indexByBuiltInType();
+
+// Every type appears once in each direction
+constexpr bool isBijective() {
+    for (size_t i = 0; i < Count; ++i)
+        if (ByCode[static_cast<uint8_t>(Entries[i].code)] != static_cast<int8_t>(i)
+            || ByBuiltInType[static_cast<size_t>(Entries[i].builtInType)] != static_cast<int8_t>(i))
+            return false;
+    return true;
+}
+static_assert(isBijective(), "Every TypeCode and built-in type must appear once in typemap::Entries");
+
+}
+
+/**
+ * @class TypeMap
+ * @brief Mapping between the scalar types of PVXS and the built-in types of OPC UA (see typemap::Entries).
+ *
+ * Every lookup is constexpr, so the mapping of a type can be checked at compile time.
+ *
+ */
+class TypeMap {
+
+public:
+
+    typedef typemap::Entry Entry;
+
+    /**
+     * @brief Find the row of a scalar type of PVXS.
+     *
+     * @param code Scalar type.
+     * @return The row, or nullptr if the type is not supported.
+     */
+    static constexpr const Entry * find(pvxs::TypeCode::code_t code) {
+        int8_t i = typemap::ByCode[static_cast<uint8_t>(code)];
+        return i < 0 ? nullptr : &typemap::Entries[i];
+    }
+
+    /**
+     * @brief Find the row of a built-in type of OPC UA.
+     *
+     * @param type Built-in type.
+     * @return The row, or nullptr if the type is not supported.
+     */
+    static constexpr const Entry * find(OpcUa_BuiltInType type) {
+        size_t t = static_cast<size_t>(type);
+        int8_t i = t < typemap::ByBuiltInType.size() ? typemap::ByBuiltInType[t] : -1;
+        return i < 0 ? nullptr : &typemap::Entries[i];
+    }
+
+    /**
+     * @brief Convert a scalar field of PVXS to a variant of the built-in type of its TypeCode.
+     *
+     * @param field Scalar field.
+     * @param variant Output parameter with the value. Unchanged if the conversion fails.
+     * @return OpcUa_Good, OpcUa_BadNotSupported if the type is not in the table or OpcUa_BadTypeMismatch
+     * if the field can not be read.
+     */
+    static OpcUa_StatusCode toVariant(const pvxs::Value & field, UaVariant & variant);
+
+    /**
+     * @brief Convert a variant to an existing scalar field of PVXS, converted to the type of the field.
+     *
+     * @param variant Value to convert.
+     * @param field Scalar field.
+     * @return OpcUa_Good, or OpcUa_BadTypeMismatch if the type of the variant is not in the table or
+     * the value does not fit in the field.
+     */
+    static OpcUa_StatusCode fromVariant(const UaVariant & variant, pvxs::Value & field);
+};
+
+static_assert(TypeMap::find(pvxs::TypeCode::Float32)->builtInType == OpcUaType_Float, "ai records with Float32 precision");
+static_assert(TypeMap::find(OpcUaType_String)->code == pvxs::TypeCode::String, "stringin, stringout, lsi and lso");
+
+#endif  // __TYPEMAP_H__
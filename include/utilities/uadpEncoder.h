@@ -0,0 +1,219 @@
+/**
+ * @file uadpEncoder.h
+ * @brief Declaration of the UadpEncoder class.
+ *
+ * This file defines the encoder of the UADP NetworkMessages (OPC UA Part 14, 7.2.2) sent by the
+ * PubSub publisher of the gateway. Only the subset needed by the publisher is implemented:
+ * - NetworkMessage header with UInt16 PublisherId, GroupHeader, PayloadHeader and Timestamp. No security.
+ * - One DataSetMessage per NetworkMessage, key frames and delta frames, with DataValue field encoding.
+ * - DataValues with a Variant of a Boolean, number or String, scalar or one-dimensional array,
+ *   StatusCode and SourceTimestamp.
+ *
+ * The encoder does not depend on the OPC UA SDK. Every value is written in the binary
+ * encoding of OPC UA Part 6 (little-endian). The values of Booleans and numbers are taken in the
+ * memory layout of their built-in type, which is the same encoding on the little-endian hosts
+ * supported by the gateway.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __UADPENCODER_H__
+#define __UADPENCODER_H__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class UadpEncoder
+ * @brief Writes UADP NetworkMessages to a reusable buffer.
+ *
+ * A message is written with beginNetworkMessage(), beginDataSetMessage(), one of the
+ * DataValue writers per field (preceded by fieldIndex() in delta frames) and endDataSetMessage().
+ * The buffer keeps its capacity between messages, so the publisher does not allocate once it is warm.
+ *
+ */
+class UadpEncoder {
+
+private:
+
+    /**
+     * @brief Buffer where the message is written.
+     *
+     */
+    std::vector<uint8_t> m_buffer;
+
+    /**
+     * @brief Position of the FieldCount of the DataSetMessage being written.
+     *
+     */
+    size_t m_fieldCountPos = 0;
+
+    /**
+     * @brief Number of fields written in the DataSetMessage being written.
+     *
+     */
+    uint16_t m_fieldCount = 0;
+
+    void writeByte(uint8_t value) { m_buffer.push_back(value); }
+    void writeUInt16(uint16_t value);
+    void writeUInt32(uint32_t value);
+    void writeUInt64(uint64_t value);
+    void writeDateTime(int64_t value) { writeUInt64(static_cast<uint64_t>(value)); }
+
+    /**
+     * @brief Write the DataValue encoding mask and the Variant encoding mask of a field.
+     *
+     * @param builtInType Built-in type id of the value.
+     * @param array Whether the value is a one-dimensional array.
+     * @param statusCode StatusCode of the value. It is only written if it is not Good.
+     * @param sourceTimestamp SourceTimestamp of the value (100 ns since 1601-01-01). It is only written if not 0.
+     */
+    void beginDataValue(uint8_t builtInType, bool array, uint32_t statusCode, int64_t sourceTimestamp);
+
+    /**
+     * @brief Write the StatusCode and the SourceTimestamp of a field, if they were announced by beginDataValue().
+     *
+     */
+    void endDataValue(uint32_t statusCode, int64_t sourceTimestamp);
+
+public:
+
+    /**
+     * @brief Built-in type ids of OPC UA Part 6 used by the encoder.
+     *
+     */
+    enum BuiltInType : uint8_t {
+        Boolean = 1,
+        SByte = 2,
+        Byte = 3,
+        Int16 = 4,
+        UInt16 = 5,
+        Int32 = 6,
+        UInt32 = 7,
+        Int64 = 8,
+        UInt64 = 9,
+        Float = 10,
+        Double = 11,
+        String = 12
+    };
+
+    /**
+     * @brief Size of the encoding of a Boolean or number built-in type.
+     *
+     * @param builtInType Built-in type id.
+     * @return 1, 2, 4 or 8 bytes, or 0 if the type is not a Boolean or a number.
+     */
+    static size_t fixedSize(uint8_t builtInType);
+
+    /**
+     * @brief Type of a DataSetMessage.
+     *
+     */
+    enum class MessageType : uint8_t {
+        KeyFrame = 0,
+        DeltaFrame = 1,
+        KeepAlive = 3
+    };
+
+    /**
+     * @brief Start a new NetworkMessage, discarding the previous one.
+     *
+     * @param publisherId PublisherId of the publisher.
+     * @param writerGroupId Identifier of the WriterGroup.
+     * @param groupVersion Version of the configuration of the WriterGroup.
+     * @param sequenceNumber Sequence number of the NetworkMessage in the WriterGroup.
+     * @param dataSetWriterId Identifier of the DataSetWriter of the only DataSetMessage.
+     * @param timestamp Publishing time (100 ns since 1601-01-01).
+     */
+    void beginNetworkMessage(uint16_t publisherId, uint16_t writerGroupId, uint32_t groupVersion,
+                             uint16_t sequenceNumber, uint16_t dataSetWriterId, int64_t timestamp);
+
+    /**
+     * @brief Write the header of the DataSetMessage.
+     *
+     * @param type Key frame, delta frame or keep alive.
+     * @param sequenceNumber Sequence number of the DataSetMessage in the DataSetWriter.
+     * @param majorVersion Major ConfigurationVersion of the DataSetMetaData.
+     * @param minorVersion Minor ConfigurationVersion of the DataSetMetaData.
+     */
+    void beginDataSetMessage(MessageType type, uint16_t sequenceNumber, uint32_t majorVersion, uint32_t minorVersion);
+
+    /**
+     * @brief Write the index of the next field. Only for delta frames.
+     *
+     * @param index Index of the field in the DataSetMetaData.
+     */
+    void fieldIndex(uint16_t index) { writeUInt16(index); }
+
+    /**
+     * @brief Write a field with a scalar Boolean or number.
+     *
+     * @param builtInType Built-in type id of the value. Its fixedSize() must not be 0.
+     * @param pValue Value, in the memory layout of the built-in type.
+     * @param statusCode StatusCode of the value.
+     * @param sourceTimestamp SourceTimestamp of the value (100 ns since 1601-01-01), 0 if unknown.
+     */
+    void writeScalar(uint8_t builtInType, const void * pValue, uint32_t statusCode, int64_t sourceTimestamp);
+
+    /**
+     * @brief Write a field with a one-dimensional array of Booleans or numbers.
+     *
+     * @param builtInType Built-in type id of the elements. Its fixedSize() must not be 0.
+     * @param pValues Contiguous elements, in the memory layout of the built-in type.
+     * @param count Number of elements.
+     * @param statusCode StatusCode of the value.
+     * @param sourceTimestamp SourceTimestamp of the value (100 ns since 1601-01-01), 0 if unknown.
+     */
+    void writeArray(uint8_t builtInType, const void * pValues, uint32_t count, uint32_t statusCode, int64_t sourceTimestamp);
+
+    /**
+     * @brief Write a field with a scalar String.
+     *
+     * @param value UTF-8 bytes of the string.
+     * @param statusCode StatusCode of the value.
+     * @param sourceTimestamp SourceTimestamp of the value (100 ns since 1601-01-01), 0 if unknown.
+     */
+    void writeString(std::string_view value, uint32_t statusCode, int64_t sourceTimestamp);
+
+    /**
+     * @brief Write a field with a one-dimensional array of Strings.
+     *
+     * @param pValues UTF-8 bytes of every string.
+     * @param count Number of strings.
+     * @param statusCode StatusCode of the value.
+     * @param sourceTimestamp SourceTimestamp of the value (100 ns since 1601-01-01), 0 if unknown.
+     */
+    void writeStringArray(const std::string_view * pValues, uint32_t count, uint32_t statusCode, int64_t sourceTimestamp);
+
+    /**
+     * @brief Write a field without value, e.g. a PV that has not been received yet.
+     *
+     * @param statusCode Bad StatusCode of the field.
+     */
+    void writeEmpty(uint32_t statusCode);
+
+    /**
+     * @brief Write the FieldCount of the DataSetMessage. Keep alive messages have no fields.
+     *
+     */
+    void endDataSetMessage();
+
+    /**
+     * @brief Get the encoded NetworkMessage.
+     *
+     * @return Data of the message.
+     */
+    const uint8_t * data() const { return m_buffer.data(); }
+
+    /**
+     * @brief Get the size of the encoded NetworkMessage.
+     *
+     * @return Size in bytes.
+     */
+    size_t size() const { return m_buffer.size(); }
+};
+
+#endif  // __UADPENCODER_H__
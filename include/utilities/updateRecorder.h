@@ -0,0 +1,367 @@
+/**
+ * @file updateRecorder.h
+ * @brief Declaration of the UpdateRecorder class and the RecorderConfig structure.
+ *
+ * This file defines the on-disk recorder of the updates forwarded by the gateway. Every update
+ * (PV id, timestamp, value, status and alarm severity) is pushed to a lock-free ring and written by
+ * a dedicated thread to segment files, so the update path never waits for the disk.
+ *
+ * A segment is a memory-mapped file of compressed blocks. The updates of a block are grouped in
+ * runs of the same PV, and every run is delta-encoded with varints: the timestamps as differences,
+ * the integer values as differences and the doubles as the XOR with the previous value.
+ * When a segment is full, an index with the position and the time range of every run is appended
+ * to it, so the updates of a PV in a time range are read without decoding the rest.
+ *
+ * The identifiers of the PVs are the identifiers of the gateway, the positions of the PVs in the
+ * catalog snapshot (pvcatalog.bin).
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#ifndef __UPDATERECORDER_H__
+#define __UPDATERECORDER_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <historyStore.h>
+
+/**
+ * @struct RecorderConfig
+ * @brief Configuration of the recorder.
+ *
+ */
+struct RecorderConfig {
+    /**
+     * @brief Directory of the segment files. It must exist.
+     *
+     */
+    std::string directory;
+
+    /**
+     * @brief Size of a segment file, in bytes.
+     *
+     */
+    size_t segmentBytes = 64 << 20;
+
+    /**
+     * @brief Maximum number of updates of a block.
+     *
+     */
+    size_t blockRecords = 4096;
+
+    /**
+     * @brief Maximum time an update waits in memory before its block is written.
+     *
+     */
+    std::chrono::milliseconds flushInterval{1000};
+
+    /**
+     * @brief Capacity of the ring between the update path and the writer thread. Power of two.
+     *
+     */
+    size_t ringCapacity = 1 << 18;
+
+    /**
+     * @brief Number of segment files kept in the directory, the ones of the previous runs included.
+     * The oldest ones are deleted. 0 keeps every segment.
+     *
+     */
+    size_t maxSegments = 0;
+};
+
+/**
+ * @struct RecordedUpdate
+ * @brief Update of a PV read from the segment files.
+ *
+ */
+struct RecordedUpdate {
+    /**
+     * @brief Identifier of the PV.
+     *
+     */
+    uint32_t pvId;
+
+    /**
+     * @brief EPICS alarm severity of the update.
+     *
+     */
+    uint8_t severity;
+
+    /**
+     * @brief Timestamp, value and status of the update.
+     *
+     */
+    HistorySample sample;
+};
+
+/**
+ * @class UpdateRecorder
+ * @brief Records the updates of the gateway to segmented, memory-mapped, block-compressed files.
+ *
+ * record() is lock-free and never blocks: when the ring is full the update is dropped and counted.
+ *
+ */
+class UpdateRecorder {
+
+private:
+
+    /**
+     * @struct Record
+     * @brief Update queued for the writer thread.
+     *
+     */
+    struct Record {
+        int64_t timestamp;
+        uint64_t bits;
+        uint32_t pvId;
+        OpcUa_StatusCode statusCode;
+        uint8_t type;
+        uint8_t severity;
+    };
+
+    /**
+     * @struct Cell
+     * @brief Cell of the ring. The sequence number tells whether the cell is free or holds a record.
+     *
+     */
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    /**
+     * @struct IndexEntry
+     * @brief Position and time range of a run of updates of a PV in a segment.
+     *
+     */
+    struct IndexEntry {
+        uint32_t pvId;
+        uint32_t count;
+        uint64_t offset;
+        int64_t minTime;
+        int64_t maxTime;
+    };
+
+    /**
+     * @brief Configuration of the recorder.
+     *
+     */
+    RecorderConfig m_config;
+
+    /**
+     * @brief Cells of the ring (multiple producers, single consumer).
+     *
+     */
+    std::unique_ptr<Cell[]> m_cells;
+
+    /**
+     * @brief Next position to write in the ring.
+     *
+     */
+    alignas(64) std::atomic<size_t> m_writePos{0};
+
+    /**
+     * @brief Next position to read from the ring. Only used by the writer thread.
+     *
+     */
+    alignas(64) size_t m_readPos = 0;
+
+    /**
+     * @brief Number of updates dropped because the ring was full.
+     *
+     */
+    std::atomic<uint64_t> m_dropped{0};
+
+    /**
+     * @brief Writer thread.
+     *
+     */
+    std::thread m_thread;
+
+    /**
+     * @brief Flag to stop the writer thread.
+     *
+     */
+    std::atomic<bool> m_stopping{false};
+
+    /**
+     * @brief Sequence number of the current segment.
+     *
+     */
+    uint64_t m_segmentNumber = 0;
+
+    /**
+     * @brief File descriptor of the current segment. -1 if there is no open segment.
+     *
+     */
+    int m_fd = -1;
+
+    /**
+     * @brief Mapping of the current segment.
+     *
+     */
+    uint8_t * m_pMapping = nullptr;
+
+    /**
+     * @brief Bytes written to the current segment.
+     *
+     */
+    size_t m_segmentUsed = 0;
+
+    /**
+     * @brief Index of the runs of the current segment.
+     *
+     */
+    std::vector<IndexEntry> m_index;
+
+    /**
+     * @brief Updates of the block being built.
+     *
+     */
+    std::vector<Record> m_pending;
+
+    /**
+     * @brief Encoded block, reused between blocks.
+     *
+     */
+    std::vector<uint8_t> m_block;
+
+    /**
+     * @brief Paths of the segment files of the directory, the ones of the previous runs included, the oldest first.
+     *
+     */
+    std::vector<std::string> m_segments;
+
+    /**
+     * @brief Take a record from the ring.
+     *
+     * @return false if the ring is empty.
+     */
+    bool pop(Record & record);
+
+    /**
+     * @brief Loop of the writer thread.
+     *
+     */
+    void run();
+
+    /**
+     * @brief Encode the pending updates as a block and write it to the current segment.
+     *
+     */
+    void writeBlock();
+
+    /**
+     * @brief Create and map a new segment file.
+     *
+     * @return false if the file could not be created.
+     */
+    bool openSegment();
+
+    /**
+     * @brief Append the index to the current segment and close it.
+     *
+     */
+    void closeSegment();
+
+    /**
+     * @brief Decode the updates of a run.
+     *
+     * @param pData Start of the run.
+     * @param pEnd End of the data that can be read.
+     * @param pvId Only the updates of this PV are decoded.
+     * @param startTime Start of the time range, included.
+     * @param endTime End of the time range, included.
+     * @param updates Output parameter with the updates.
+     * @return End of the run, or nullptr if the data is corrupted.
+     */
+    static const uint8_t * decodeRun(const uint8_t * pData, const uint8_t * pEnd, uint32_t pvId,
+                                     int64_t startTime, int64_t endTime, std::vector<RecordedUpdate> & updates);
+
+    /**
+     * @brief Read the updates of a PV from a segment file.
+     *
+     */
+    static void readSegment(const std::string & path, uint32_t pvId, int64_t startTime, int64_t endTime,
+                            std::vector<RecordedUpdate> & updates);
+
+public:
+
+    /**
+     * @brief Construct a new UpdateRecorder object.
+     *
+     * @param config Configuration of the recorder.
+     */
+    explicit UpdateRecorder(const RecorderConfig & config);
+
+    /**
+     * @brief Destroy the UpdateRecorder object. Stops the writer thread.
+     *
+     */
+    ~UpdateRecorder();
+
+    UpdateRecorder(const UpdateRecorder &) = delete;
+    UpdateRecorder & operator=(const UpdateRecorder &) = delete;
+
+    /**
+     * @brief Start the writer thread.
+     *
+     * @return false if the first segment could not be created.
+     */
+    bool start();
+
+    /**
+     * @brief Write the queued updates, close the current segment and stop the writer thread.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Queue an update. Lock-free, never blocks and never allocates.
+     *
+     * @param pvId Identifier of the PV.
+     * @param timestamp Source timestamp (OPC UA DateTime).
+     * @param value Value forwarded to OPC UA. Only the scalar values are recorded, with Bad status they are ignored.
+     * @param statusCode StatusCode forwarded to OPC UA.
+     * @param severity EPICS alarm severity.
+     */
+    void record(uint32_t pvId, int64_t timestamp, const UaVariant & value, OpcUa_StatusCode statusCode, uint8_t severity);
+
+    /**
+     * @brief Number of updates dropped because the ring was full.
+     *
+     */
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Read the recorded updates of a PV in a time range from the segments of a directory.
+     *
+     * The segments without index (the last one of a run that did not stop cleanly) are scanned block by block.
+     *
+     * @param directory Directory of the segment files.
+     * @param pvId Identifier of the PV.
+     * @param startTime Start of the time range, included.
+     * @param endTime End of the time range, included.
+     * @param updates Output parameter with the updates, in recording order.
+     * @return Number of updates read.
+     */
+    static size_t read(const std::string & directory, uint32_t pvId, int64_t startTime, int64_t endTime,
+                       std::vector<RecordedUpdate> & updates);
+
+    /**
+     * @brief Load the configuration of the recorder from a file of "key = value" lines.
+     *
+     * @param path Path of the file.
+     * @param config Output parameter with the configuration.
+     * @return true if the file exists and sets a directory.
+     */
+    static bool loadConfig(const std::string & path, RecorderConfig & config);
+};
+
+#endif  // __UPDATERECORDER_H__
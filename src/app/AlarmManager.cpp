@@ -0,0 +1,286 @@
+#include "AlarmManager.h"
+#include <EPICStoOPCUAGateway.h>
+#include <logger.h>
+#include <opcua_foldertype.h>
+#include <algorithm>
+#include <fstream>
+
+using pvxs::Value;
+
+namespace {
+
+const char * const SeverityNames[] = {"NO_ALARM", "MINOR", "MAJOR", "INVALID"};
+
+// OPC UA severity (1-1000) of an EPICS severity
+OpcUa_UInt16 severityOf(uint32_t severity) {
+    switch (severity) {
+        case 0:  return 1;
+        case 1:  return 500;
+        case 2:  return 800;
+        default: return 900;
+    }
+}
+
+UaDateTime fromTicks(int64_t ticks) {
+    OpcUa_DateTime dateTime;
+    dateTime.dwLowDateTime = static_cast<OpcUa_UInt32>(ticks & 0xFFFFFFFF);
+    dateTime.dwHighDateTime = static_cast<OpcUa_UInt32>(static_cast<uint64_t>(ticks) >> 32);
+    return UaDateTime(dateTime);
+}
+
+// EventId of an event of a PV: the identifier of the PV and the number of the event, unique in the process
+UaByteString eventIdOf(uint32_t pvId, uint64_t sequence) {
+    OpcUa_Byte bytes[12];
+    for (int i = 0; i < 4; ++i)
+        bytes[i] = static_cast<OpcUa_Byte>(pvId >> (8 * i));
+    for (int i = 0; i < 8; ++i)
+        bytes[4 + i] = static_cast<OpcUa_Byte>(sequence >> (8 * i));
+    return UaByteString(static_cast<OpcUa_Int32>(sizeof(bytes)), bytes);
+}
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+}
+
+AlarmManager::AlarmManager(MyNodeIOEventManager * pNodeManager, EPICStoOPCUAGateway * pGateway)
+    : m_pNodeManager(pNodeManager), m_pGateway(pGateway) {}
+
+AlarmManager::~AlarmManager() {
+    stop();
+}
+
+bool AlarmManager::start() {
+
+    OpcUa_UInt16 ns = m_pNodeManager->getNameSpaceIndex();
+    m_folderId = UaNodeId("Alarms", ns);
+
+    // The folder is the notifier of the conditions, and the Server object of the folder,
+    // so a client that subscribes to the events of the Server receives them
+    OpcUa::FolderType * pFolder = new OpcUa::FolderType(m_folderId, "Alarms", ns, m_pNodeManager);
+    pFolder->setEventNotifier(Ua_EventNotifier_SubscribeToEvents);
+    UaStatus ret = m_pNodeManager->addNodeAndReference(OpcUaId_ObjectsFolder, pFolder, OpcUaId_Organizes);
+    if (ret.isBad()) {
+        LOG_ERROR("Error creating the Alarms folder: %s", ret.toString().toUtf8());
+        return false;
+    }
+    m_pNodeManager->registerEventNotifier(OpcUaId_Server, m_folderId);
+
+    m_stopping = false;
+    m_thread = std::thread(&AlarmManager::run, this);
+    return true;
+}
+
+void AlarmManager::stop() {
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+        LOG_INFO("Fired %llu alarm events", static_cast<unsigned long long>(m_events.load()));
+    }
+}
+
+void AlarmManager::update(uint32_t pvId, const Value & value) {
+
+    Value severityField = value["alarm.severity"];
+    if (!severityField.valid())
+        return;
+    int32_t severity = 0, status = 0;
+    severityField.as(severity);
+    value["alarm.status"].as(status);
+    uint32_t state = (static_cast<uint32_t>(std::min(std::max(severity, 0), 3)) << 16) | static_cast<uint16_t>(status);
+
+    bool wake;
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (pvId >= m_pending.size())
+        m_pending.resize(pvId + 1);
+    Pending & pending = m_pending[pvId];
+    if (pending.state == state)
+        return;
+
+    // A transition: only now the message and the timestamp are read
+    pending.state = state;
+    pending.message.clear();
+    value["alarm.message"].as(pending.message);
+    int64_t seconds, nanoseconds;
+    if (value["timeStamp.secondsPastEpoch"].as(seconds) && value["timeStamp.nanoseconds"].as(nanoseconds))
+        pending.timestamp = seconds * 10000000 + nanoseconds / 100 + 116444736000000000LL;
+    else
+        pending.timestamp = 0;
+
+    if (pending.queued)
+        return;
+    pending.queued = true;
+    wake = m_dirty.empty();
+    m_dirty.push_back(pvId);
+    }
+    if (wake)
+        m_cv.notify_one();
+}
+
+void AlarmManager::run() {
+
+    std::vector<uint32_t> batch;
+    std::vector<Pending> states;
+
+    for (;;) {
+        {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_dirty.empty() || m_stopping.load(); });
+        if (m_dirty.empty())
+            return;
+
+        // Everything that changed since the last wakeup, with its latest state
+        batch.swap(m_dirty);
+        states.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            Pending & pending = m_pending[batch[i]];
+            pending.queued = false;
+            states[i].state = pending.state;
+            states[i].message = pending.message;
+            states[i].timestamp = pending.timestamp;
+        }
+        }
+
+        UaDateTime receiveTime = UaDateTime::now();
+        {
+        std::lock_guard<std::mutex> lock(m_conditionsMutex);
+        for (size_t i = 0; i < batch.size(); ++i)
+            fire(batch[i], states[i], receiveTime);
+        }
+        batch.clear();
+    }
+}
+
+OpcUa::AlarmConditionType * AlarmManager::createCondition(uint32_t pvId) {
+
+    PVCatalogEntry entry;
+    if (!m_pGateway->catalogEntry(pvId, entry))
+        return nullptr;
+
+    OpcUa_UInt16 ns = m_pNodeManager->getNameSpaceIndex();
+    UaNodeId sourceId(entry.nodeId.c_str(), ns);
+    OpcUa::AlarmConditionType * pCondition = new OpcUa::AlarmConditionType(
+        UaNodeId(("Alarms." + entry.nodeId).c_str(), ns),
+        entry.nodeId.c_str(),
+        ns,
+        m_pNodeManager,
+        sourceId,
+        entry.epicsName.c_str());
+    pCondition->setConditionName("EPICSAlarm");
+    pCondition->setEnabledState(OpcUa_True);
+    pCondition->setActiveState(OpcUa_False);
+    pCondition->setAckedState(OpcUa_True);
+    pCondition->setRetain(OpcUa_False);
+
+    UaStatus ret = m_pNodeManager->addNodeAndReference(m_folderId, pCondition, OpcUaId_HasComponent);
+    if (ret.isBad()) {
+        Logger::instance().logPV(LogLevel::Error, pvId, "Error creating the condition of the PV: %s", ret.toString().toUtf8());
+        return nullptr;
+    }
+    m_conditionPVs[pCondition] = pvId;
+    return pCondition;
+}
+
+void AlarmManager::fire(uint32_t pvId, const Pending & pending, const UaDateTime & receiveTime) {
+
+    if (pvId >= m_conditions.size())
+        m_conditions.resize(pvId + 1);
+    Condition & condition = m_conditions[pvId];
+
+    // Back to the state reported last time, e.g. an alarm that came and went between two wakeups
+    if (condition.state == pending.state)
+        return;
+
+    uint32_t severity = pending.state >> 16;
+    uint32_t previousSeverity = condition.state >> 16;
+    condition.state = pending.state;
+
+    // A PV without any alarm yet does not need a condition
+    if (condition.pCondition == nullptr) {
+        if (severity == 0)
+            return;
+        condition.pCondition = createCondition(pvId);
+        if (condition.pCondition == nullptr)
+            return;
+    }
+
+    // A new alarm, or a more severe one, has to be acknowledged again
+    bool active = severity != 0;
+    if (active && severity > previousSeverity)
+        condition.acked = false;
+    condition.active = active;
+
+    std::string text = SeverityNames[severity];
+    if (!pending.message.empty())
+        text += " " + pending.message;
+
+    OpcUa::AlarmConditionType * pCondition = condition.pCondition;
+    pCondition->setActiveState(active ? OpcUa_True : OpcUa_False);
+    pCondition->setAckedState(condition.acked ? OpcUa_True : OpcUa_False);
+    pCondition->setRetain((active || !condition.acked) ? OpcUa_True : OpcUa_False);
+    pCondition->setSeverity(severityOf(severity));
+    pCondition->setMessage(UaLocalizedText("en", text.c_str()));
+    condition.eventId = eventIdOf(pvId, ++m_events);
+    pCondition->triggerEvent(pending.timestamp != 0 ? fromTicks(pending.timestamp) : receiveTime, receiveTime, condition.eventId);
+}
+
+UaStatus AlarmManager::acknowledge(OpcUa::AcknowledgeableConditionType * pCondition, const UaByteString & eventId,
+                                   const UaLocalizedText & comment) {
+
+    std::lock_guard<std::mutex> lock(m_conditionsMutex);
+    auto it = m_conditionPVs.find(pCondition);
+    if (it == m_conditionPVs.end())
+        return OpcUa_BadNodeIdUnknown;
+
+    // Only the last event can be acknowledged, the client may not have seen a newer alarm yet
+    Condition & condition = m_conditions[it->second];
+    if (!(eventId == condition.eventId))
+        return OpcUa_BadEventIdUnknown;
+    if (condition.acked)
+        return OpcUa_BadConditionBranchAlreadyAcked;
+    condition.acked = true;
+
+    // The condition leaves the list of the clients once it is acknowledged and no longer active
+    condition.pCondition->setAckedState(OpcUa_True);
+    condition.pCondition->setRetain(condition.active ? OpcUa_True : OpcUa_False);
+    condition.pCondition->setComment(comment);
+    UaDateTime now = UaDateTime::now();
+    condition.eventId = eventIdOf(it->second, ++m_events);
+    condition.pCondition->triggerEvent(now, now, condition.eventId);
+    return OpcUa_Good;
+}
+
+bool AlarmManager::loadConfig(const std::string & path) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    bool enabled = true;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        if (key == "enabled" && (value == "true" || value == "false"))
+            enabled = value == "true";
+        else
+            LOG_WARNING("Alarms: unknown key or invalid value %s in %s", line.c_str(), path.c_str());
+    }
+
+    return enabled;
+}
@@ -0,0 +1,145 @@
+#include "ArrayIOManager.h"
+#include <EPICStoOPCUAGateway.h>
+#include <indexRange.h>
+#include <uadatavalue.h>
+
+namespace {
+
+UaDateTime fromTicks(int64_t ticks) {
+    OpcUa_DateTime dateTime;
+    dateTime.dwLowDateTime = static_cast<OpcUa_UInt32>(ticks & 0xFFFFFFFF);
+    dateTime.dwHighDateTime = static_cast<OpcUa_UInt32>(static_cast<uint64_t>(ticks) >> 32);
+    return UaDateTime(dateTime);
+}
+
+}
+
+ArrayIOManager::ArrayIOManager(EPICStoOPCUAGateway * pGateway) : m_pGateway(pGateway) {}
+
+UaStatus ArrayIOManager::beginTransaction(
+    IOManagerCallback * pCallback,
+    const ServiceContext & serviceContext,
+    OpcUa_UInt32 hTransaction,
+    OpcUa_UInt32 totalItemCountHint,
+    OpcUa_Double maxAge,
+    OpcUa_TimestampsToReturn timestampsToReturn,
+    TransactionType transactionType,
+    OpcUa_Handle & hIOManagerContext
+) {
+    OpcUa_ReferenceParameter(serviceContext);
+    OpcUa_ReferenceParameter(totalItemCountHint);
+    OpcUa_ReferenceParameter(maxAge);
+
+    if (transactionType != IOManager::TransactionRead && transactionType != IOManager::TransactionWrite)
+        return OpcUa_BadNotSupported;
+
+    Transaction * pTransaction = new Transaction;
+    pTransaction->pCallback = pCallback;
+    pTransaction->hTransaction = hTransaction;
+    pTransaction->timestampsToReturn = timestampsToReturn;
+    hIOManagerContext = static_cast<OpcUa_Handle>(pTransaction);
+    return OpcUa_Good;
+}
+
+UaStatus ArrayIOManager::beginStartMonitoring(
+    OpcUa_Handle hIOManagerContext,
+    OpcUa_UInt32 callbackHandle,
+    IOVariableCallback * pIOVariableCallback,
+    VariableHandle * pVariableHandle,
+    MonitoringContext & monitoringContext
+) {
+    OpcUa_ReferenceParameter(hIOManagerContext);
+    OpcUa_ReferenceParameter(callbackHandle);
+    OpcUa_ReferenceParameter(pIOVariableCallback);
+    OpcUa_ReferenceParameter(pVariableHandle);
+    OpcUa_ReferenceParameter(monitoringContext);
+    return OpcUa_BadNotSupported;
+}
+
+UaStatus ArrayIOManager::beginModifyMonitoring(
+    OpcUa_Handle hIOManagerContext,
+    OpcUa_UInt32 callbackHandle,
+    OpcUa_UInt32 hIOVariable,
+    MonitoringContext & monitoringContext
+) {
+    OpcUa_ReferenceParameter(hIOManagerContext);
+    OpcUa_ReferenceParameter(callbackHandle);
+    OpcUa_ReferenceParameter(hIOVariable);
+    OpcUa_ReferenceParameter(monitoringContext);
+    return OpcUa_BadNotSupported;
+}
+
+UaStatus ArrayIOManager::beginStopMonitoring(
+    OpcUa_Handle hIOManagerContext,
+    OpcUa_UInt32 callbackHandle,
+    OpcUa_UInt32 hIOVariable
+) {
+    OpcUa_ReferenceParameter(hIOManagerContext);
+    OpcUa_ReferenceParameter(callbackHandle);
+    OpcUa_ReferenceParameter(hIOVariable);
+    return OpcUa_BadNotSupported;
+}
+
+UaStatus ArrayIOManager::beginRead(
+    OpcUa_Handle hIOManagerContext,
+    OpcUa_UInt32 callbackHandle,
+    VariableHandle * pVariableHandle,
+    OpcUa_ReadValueId * pReadValueId
+) {
+    Transaction * pTransaction = static_cast<Transaction*>(hIOManagerContext);
+    if (pTransaction == NULL)
+        return OpcUa_BadInvalidArgument;
+
+    UaVariant value;
+    OpcUa_StatusCode status;
+    int64_t sourceTimestamp = 0;
+    IndexRange range;
+    if (!IndexRange::parse(UaString(&pReadValueId->IndexRange).toUtf8(), range))
+        status = OpcUa_BadIndexRangeInvalid;
+    else
+        status = m_pGateway->readArrayRange(static_cast<PVVariableHandle*>(pVariableHandle)->m_pvId, range, value, sourceTimestamp);
+    if (OpcUa_IsBad(status))
+        value.clear();
+
+    bool source = pTransaction->timestampsToReturn == OpcUa_TimestampsToReturn_Source
+                  || pTransaction->timestampsToReturn == OpcUa_TimestampsToReturn_Both;
+    bool server = pTransaction->timestampsToReturn == OpcUa_TimestampsToReturn_Server
+                  || pTransaction->timestampsToReturn == OpcUa_TimestampsToReturn_Both;
+    UaDataValue dataValue(value, status,
+                          (source && sourceTimestamp != 0) ? fromTicks(sourceTimestamp) : UaDateTime(),
+                          server ? UaDateTime::now() : UaDateTime());
+
+    pTransaction->pCallback->finishRead(pTransaction->hTransaction, callbackHandle, dataValue);
+    return OpcUa_Good;
+}
+
+UaStatus ArrayIOManager::beginWrite(
+    OpcUa_Handle hIOManagerContext,
+    OpcUa_UInt32 callbackHandle,
+    VariableHandle * pVariableHandle,
+    OpcUa_WriteValue * pWriteValue
+) {
+    Transaction * pTransaction = static_cast<Transaction*>(hIOManagerContext);
+    if (pTransaction == NULL)
+        return OpcUa_BadInvalidArgument;
+
+    UaStatusCode status;
+    IndexRange range;
+    if (!IndexRange::parse(UaString(&pWriteValue->IndexRange).toUtf8(), range))
+        status = OpcUa_BadIndexRangeInvalid;
+    else if (pWriteValue->Value.StatusCode != OpcUa_Good
+             || pWriteValue->Value.SourceTimestamp.dwHighDateTime != 0 || pWriteValue->Value.SourceTimestamp.dwLowDateTime != 0
+             || pWriteValue->Value.ServerTimestamp.dwHighDateTime != 0 || pWriteValue->Value.ServerTimestamp.dwLowDateTime != 0)
+        status = OpcUa_BadWriteNotSupported;   // Only the value can be written to a PV
+    else
+        status = m_pGateway->enqueueArrayPut(static_cast<PVVariableHandle*>(pVariableHandle)->m_pvId, range,
+                                             UaVariant(pWriteValue->Value.Value));
+
+    pTransaction->pCallback->finishWrite(pTransaction->hTransaction, callbackHandle, status);
+    return OpcUa_Good;
+}
+
+UaStatus ArrayIOManager::finishTransaction(OpcUa_Handle hIOManagerContext) {
+    delete static_cast<Transaction*>(hIOManagerContext);
+    return OpcUa_Good;
+}
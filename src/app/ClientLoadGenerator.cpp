@@ -0,0 +1,539 @@
+#include "ClientLoadGenerator.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <uadatetime.h>
+#include <logger.h>
+
+using namespace UaClientSdk;
+
+namespace {
+
+// Monitored items created per request, a single request for 5k items can exceed the message size
+constexpr size_t CreateChunk = 1000;
+
+int64_t toTicks(const OpcUa_DateTime & dateTime) {
+    return (static_cast<int64_t>(dateTime.dwHighDateTime) << 32) | dateTime.dwLowDateTime;
+}
+
+int64_t nowTicks() {
+    OpcUa_DateTime now = UaDateTime::now();
+    return toTicks(now);
+}
+
+int64_t microsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < 16)
+        return static_cast<size_t>(value);
+    unsigned msb = 63 - __builtin_clzll(value);
+    size_t bucket = (msb - 3) * 16 + ((value >> (msb - 4)) & 15);
+    return std::min(bucket, BucketCount - 1);
+}
+
+uint64_t LatencyHistogram::lowerBound(size_t bucket) {
+    if (bucket < 16)
+        return bucket;
+    unsigned msb = static_cast<unsigned>(bucket / 16) + 3;
+    return (static_cast<uint64_t>(16 + bucket % 16)) << (msb - 4);
+}
+
+void LatencyHistogram::add(int64_t micros) {
+    uint64_t value = micros > 0 ? static_cast<uint64_t>(micros) : 0;
+    m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    uint64_t count = m_count.load(std::memory_order_relaxed);
+    if (count == 0)
+        return 0;
+    uint64_t target = static_cast<uint64_t>(fraction * count);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BucketCount; ++bucket) {
+        seen += m_buckets[bucket].load(std::memory_order_relaxed);
+        if (seen > target)
+            return lowerBound(bucket);
+    }
+    return max();
+}
+
+void LatencyHistogram::reset() {
+    for (auto & bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @class ClientLoadGenerator::ClientSession
+ * @brief A session of the generator, with its subscription and its pending Read and Write requests.
+ *
+ */
+class ClientLoadGenerator::ClientSession : public UaSessionCallback, public UaSubscriptionCallback {
+
+public:
+
+    ClientSession(ClientLoadGenerator * pGenerator, size_t index) : m_pGenerator(pGenerator), m_index(index) {}
+
+    ~ClientSession() {
+        disconnect();
+    }
+
+    bool connect() {
+        const ClientLoadConfig & config = m_pGenerator->m_config;
+        SessionConnectInfo connectInfo;
+        connectInfo.sApplicationName = "EPICS gateway client load generator";
+        connectInfo.sApplicationUri = "urn:localhost:EPICSGateway:ClientLoadGenerator";
+        connectInfo.sProductUri = "urn:EPICSGateway:ClientLoadGenerator";
+        connectInfo.sSessionName = UaString("ClientLoad-%1").arg(static_cast<int>(m_index));
+        connectInfo.bAutomaticReconnect = OpcUa_False;
+        SessionSecurityInfo securityInfo;
+
+        m_pSession = new UaSession();
+        UaStatus status = m_pSession->connect(UaString(config.url.c_str()), connectInfo, securityInfo, this);
+        if (status.isBad()) {
+            LOG_ERROR("Session %zu: connect to %s failed: %s", m_index, config.url.c_str(), status.toString().toUtf8());
+            return false;
+        }
+
+        // Index of the gateway namespace in the namespace table of the server
+        UaStringArray namespaces = m_pSession->getNamespaceTable();
+        UaString namespaceUri(config.namespaceUri.c_str());
+        for (OpcUa_UInt32 i = 0; i < namespaces.length(); ++i) {
+            if (UaString(&namespaces[i]) == namespaceUri) {
+                m_namespaceIndex = static_cast<OpcUa_UInt16>(i);
+                return true;
+            }
+        }
+        LOG_ERROR("Session %zu: namespace %s not found", m_index, config.namespaceUri.c_str());
+        return false;
+    }
+
+    size_t subscribe(const std::vector<std::string> & nodes) {
+        const ClientLoadConfig & config = m_pGenerator->m_config;
+        ServiceSettings serviceSettings;
+        SubscriptionSettings subscriptionSettings;
+        subscriptionSettings.publishingInterval = config.publishingInterval;
+
+        for (const auto & node : nodes)
+            m_readNodes.push_back(UaNodeId(node.c_str(), m_namespaceIndex));
+
+        UaStatus status = m_pSession->createSubscription(serviceSettings, this, 1, subscriptionSettings, OpcUa_True, &m_pSubscription);
+        if (status.isBad()) {
+            LOG_ERROR("Session %zu: createSubscription failed: %s", m_index, status.toString().toUtf8());
+            return 0;
+        }
+
+        size_t created = 0;
+        for (size_t first = 0; first < m_readNodes.size(); first += CreateChunk) {
+            size_t count = std::min(CreateChunk, m_readNodes.size() - first);
+            UaMonitoredItemCreateRequests requests;
+            UaMonitoredItemCreateResults results;
+            requests.create(static_cast<OpcUa_UInt32>(count));
+            for (size_t i = 0; i < count; ++i) {
+                OpcUa_MonitoredItemCreateRequest & request = requests[static_cast<OpcUa_UInt32>(i)];
+                m_readNodes[first + i].copyTo(&request.ItemToMonitor.NodeId);
+                request.ItemToMonitor.AttributeId = OpcUa_Attributes_Value;
+                request.MonitoringMode = OpcUa_MonitoringMode_Reporting;
+                request.RequestedParameters.ClientHandle = static_cast<OpcUa_UInt32>(first + i);
+                request.RequestedParameters.SamplingInterval = config.samplingInterval;
+                request.RequestedParameters.QueueSize = config.queueSize;
+                request.RequestedParameters.DiscardOldest = OpcUa_True;
+            }
+
+            status = m_pSubscription->createMonitoredItems(serviceSettings, OpcUa_TimestampsToReturn_Both, requests, results);
+            if (status.isBad()) {
+                LOG_ERROR("Session %zu: createMonitoredItems failed: %s", m_index, status.toString().toUtf8());
+                break;
+            }
+            for (OpcUa_UInt32 i = 0; i < results.length(); ++i)
+                if (OpcUa_IsGood(results[i].StatusCode))
+                    ++created;
+        }
+        return created;
+    }
+
+    size_t prepareWrites(const std::vector<std::string> & nodes) {
+        // The current values, written back by the Write storm
+        ServiceSettings serviceSettings;
+        for (size_t first = 0; first < nodes.size(); first += CreateChunk) {
+            size_t count = std::min(CreateChunk, nodes.size() - first);
+            UaReadValueIds nodesToRead;
+            UaDataValues values;
+            UaDiagnosticInfos diagnosticInfos;
+            nodesToRead.create(static_cast<OpcUa_UInt32>(count));
+            for (size_t i = 0; i < count; ++i) {
+                UaNodeId(nodes[first + i].c_str(), m_namespaceIndex).copyTo(&nodesToRead[static_cast<OpcUa_UInt32>(i)].NodeId);
+                nodesToRead[static_cast<OpcUa_UInt32>(i)].AttributeId = OpcUa_Attributes_Value;
+            }
+
+            UaStatus status = m_pSession->read(serviceSettings, 0, OpcUa_TimestampsToReturn_Neither, nodesToRead, values, diagnosticInfos);
+            if (status.isBad())
+                break;
+            for (OpcUa_UInt32 i = 0; i < values.length(); ++i) {
+                if (OpcUa_IsGood(values[i].StatusCode)) {
+                    m_writeNodes.push_back(UaNodeId(nodesToRead[i].NodeId));
+                    m_writeValues.push_back(UaVariant(values[i].Value));
+                }
+            }
+        }
+        return m_writeNodes.size();
+    }
+
+    void sendRead(size_t batch) {
+        if (m_readNodes.empty() || !reserve())
+            return;
+
+        UaReadValueIds nodesToRead;
+        size_t count = std::min(batch, m_readNodes.size());
+        nodesToRead.create(static_cast<OpcUa_UInt32>(count));
+        for (size_t i = 0; i < count; ++i) {
+            m_readNodes[m_readCursor].copyTo(&nodesToRead[static_cast<OpcUa_UInt32>(i)].NodeId);
+            nodesToRead[static_cast<OpcUa_UInt32>(i)].AttributeId = OpcUa_Attributes_Value;
+            m_readCursor = (m_readCursor + 1) % m_readNodes.size();
+        }
+
+        ServiceSettings serviceSettings;
+        OpcUa_UInt32 transactionId = track();
+        UaStatus status = m_pSession->beginRead(serviceSettings, 0, OpcUa_TimestampsToReturn_Neither, nodesToRead, transactionId);
+        if (status.isBad())
+            failed(transactionId);
+    }
+
+    void sendWrite(size_t batch) {
+        if (m_writeNodes.empty() || !reserve())
+            return;
+
+        UaWriteValues nodesToWrite;
+        size_t count = std::min(batch, m_writeNodes.size());
+        nodesToWrite.create(static_cast<OpcUa_UInt32>(count));
+        for (size_t i = 0; i < count; ++i) {
+            OpcUa_WriteValue & writeValue = nodesToWrite[static_cast<OpcUa_UInt32>(i)];
+            m_writeNodes[m_writeCursor].copyTo(&writeValue.NodeId);
+            writeValue.AttributeId = OpcUa_Attributes_Value;
+            m_writeValues[m_writeCursor].copyTo(&writeValue.Value.Value);
+            m_writeCursor = (m_writeCursor + 1) % m_writeNodes.size();
+        }
+
+        ServiceSettings serviceSettings;
+        OpcUa_UInt32 transactionId = track();
+        UaStatus status = m_pSession->beginWrite(serviceSettings, nodesToWrite, transactionId);
+        if (status.isBad())
+            failed(transactionId);
+    }
+
+    void disconnect() {
+        if (m_pSession == nullptr)
+            return;
+        ServiceSettings serviceSettings;
+        if (m_pSubscription != nullptr)
+            m_pSession->deleteSubscription(serviceSettings, &m_pSubscription);
+        m_pSession->disconnect(serviceSettings, OpcUa_True);
+        delete m_pSession;
+        m_pSession = nullptr;
+    }
+
+    // UaSessionCallback
+
+    void connectionStatusChanged(OpcUa_UInt32 clientConnectionId, UaClient::ServerStatus serverStatus) override {
+        OpcUa_ReferenceParameter(clientConnectionId);
+        if (serverStatus == UaClient::ConnectionErrorApiReconnect || serverStatus == UaClient::ServerShutdown)
+            LOG_WARNING("Session %zu: connection lost", m_index);
+    }
+
+    void readComplete(OpcUa_UInt32 transactionId, const UaStatus & result, const UaDataValues & values,
+                      const UaDiagnosticInfos & diagnosticInfos) override {
+        OpcUa_ReferenceParameter(diagnosticInfos);
+        complete(transactionId, result, m_pGenerator->m_readLatency, m_pGenerator->m_reads);
+        for (OpcUa_UInt32 i = 0; i < values.length(); ++i)
+            if (OpcUa_IsBad(values[i].StatusCode))
+                m_pGenerator->m_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void writeComplete(OpcUa_UInt32 transactionId, const UaStatus & result, const UaStatusCodeArray & results,
+                       const UaDiagnosticInfos & diagnosticInfos) override {
+        OpcUa_ReferenceParameter(diagnosticInfos);
+        complete(transactionId, result, m_pGenerator->m_writeLatency, m_pGenerator->m_writes);
+        for (OpcUa_UInt32 i = 0; i < results.length(); ++i)
+            if (OpcUa_IsBad(results[i]))
+                m_pGenerator->m_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // UaSubscriptionCallback
+
+    void subscriptionStatusChanged(OpcUa_UInt32 clientSubscriptionHandle, const UaStatus & status) override {
+        OpcUa_ReferenceParameter(clientSubscriptionHandle);
+        LOG_WARNING("Session %zu: subscription status %s", m_index, status.toString().toUtf8());
+    }
+
+    void dataChange(OpcUa_UInt32 clientSubscriptionHandle, const UaDataNotifications & dataNotifications,
+                    const UaDiagnosticInfos & diagnosticInfos) override {
+        OpcUa_ReferenceParameter(clientSubscriptionHandle);
+        OpcUa_ReferenceParameter(diagnosticInfos);
+
+        // Latency from the source timestamp, or from the server timestamp if the source did not set it
+        int64_t now = nowTicks();
+        for (OpcUa_UInt32 i = 0; i < dataNotifications.length(); ++i) {
+            const OpcUa_DataValue & value = dataNotifications[i].Value;
+            int64_t timestamp = toTicks(value.SourceTimestamp);
+            if (timestamp == 0)
+                timestamp = toTicks(value.ServerTimestamp);
+            if (timestamp != 0)
+                m_pGenerator->m_notificationLatency.add((now - timestamp) / 10);
+        }
+        m_pGenerator->m_notifications.fetch_add(dataNotifications.length(), std::memory_order_relaxed);
+    }
+
+    void newEvents(OpcUa_UInt32 clientSubscriptionHandle, UaEventFieldLists & eventFieldList) override {
+        OpcUa_ReferenceParameter(clientSubscriptionHandle);
+        OpcUa_ReferenceParameter(eventFieldList);
+    }
+
+private:
+
+    ClientLoadGenerator * m_pGenerator;
+    size_t m_index;
+    UaSession * m_pSession = nullptr;
+    UaSubscription * m_pSubscription = nullptr;
+    OpcUa_UInt16 m_namespaceIndex = 0;
+
+    std::vector<UaNodeId> m_readNodes;
+    size_t m_readCursor = 0;
+    std::vector<UaNodeId> m_writeNodes;
+    std::vector<UaVariant> m_writeValues;
+    size_t m_writeCursor = 0;
+
+    // Requests waiting for their response, with their send time
+    std::atomic<uint32_t> m_outstanding{0};
+    OpcUa_UInt32 m_nextTransaction = 0;
+    std::mutex m_pendingMutex;
+    std::unordered_map<OpcUa_UInt32, std::chrono::steady_clock::time_point> m_pending;
+
+    bool reserve() {
+        if (m_outstanding.load() >= m_pGenerator->m_config.maxOutstanding) {
+            m_pGenerator->m_skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_outstanding.fetch_add(1);
+        return true;
+    }
+
+    OpcUa_UInt32 track() {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        OpcUa_UInt32 transactionId = ++m_nextTransaction;
+        m_pending[transactionId] = std::chrono::steady_clock::now();
+        return transactionId;
+    }
+
+    void failed(OpcUa_UInt32 transactionId) {
+        {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.erase(transactionId);
+        }
+        m_outstanding.fetch_sub(1);
+        m_pGenerator->m_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void complete(OpcUa_UInt32 transactionId, const UaStatus & result, LatencyHistogram & latency, std::atomic<uint64_t> & counter) {
+        std::chrono::steady_clock::time_point sent;
+        {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        auto it = m_pending.find(transactionId);
+        if (it == m_pending.end())
+            return;
+        sent = it->second;
+        m_pending.erase(it);
+        }
+        m_outstanding.fetch_sub(1);
+
+        if (result.isBad()) {
+            m_pGenerator->m_errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        latency.add(microsSince(sent));
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+ClientLoadGenerator::ClientLoadGenerator(const ClientLoadConfig & config) : m_config(config) {}
+
+ClientLoadGenerator::~ClientLoadGenerator() {
+    stop();
+}
+
+bool ClientLoadGenerator::readNodes(const std::string & path, std::vector<std::string> & nodes) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    // A PV name or a node identifier per line, the PV names are converted as the gateway does
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string node;
+        if (!(fields >> node) || node[0] == '#')
+            continue;
+        std::replace(node.begin(), node.end(), ':', '.');
+        nodes.push_back(node);
+    }
+    return true;
+}
+
+size_t ClientLoadGenerator::start() {
+
+    if (!readNodes(m_config.nodesFile, m_nodes) || m_nodes.empty()) {
+        LOG_ERROR("No nodes to monitor in %s", m_config.nodesFile.c_str());
+        return 0;
+    }
+    if (!m_config.writeNodesFile.empty() && !readNodes(m_config.writeNodesFile, m_writeNodes))
+        LOG_WARNING("The write nodes %s could not be read", m_config.writeNodesFile.c_str());
+
+    size_t items = 0;
+    for (size_t i = 0; i < m_config.sessions; ++i) {
+        auto pSession = std::make_unique<ClientSession>(this, i);
+        if (!pSession->connect())
+            continue;
+
+        // Consecutive windows of the nodes, wrapping around
+        std::vector<std::string> window;
+        size_t count = std::min(m_config.itemsPerSession, m_nodes.size());
+        for (size_t j = 0; j < count; ++j)
+            window.push_back(m_nodes[(i * m_config.itemsPerSession + j) % m_nodes.size()]);
+        items += pSession->subscribe(window);
+        if (m_config.writeRate > 0.0)
+            pSession->prepareWrites(m_writeNodes);
+        m_sessions.push_back(std::move(pSession));
+    }
+    LOG_INFO("Client load: %zu sessions, %zu monitored items", m_sessions.size(), items);
+
+    if (!m_sessions.empty() && (m_config.readRate > 0.0 || m_config.writeRate > 0.0))
+        m_stormThread = std::thread([this]() { storm(); });
+    return m_sessions.size();
+}
+
+void ClientLoadGenerator::storm() {
+
+    // Every tick every session sends the requests it accumulated at its rates
+    const auto tick = std::chrono::milliseconds(10);
+    const double tickSeconds = std::chrono::duration<double>(tick).count();
+    std::vector<double> readCredit(m_sessions.size(), 0.0);
+    std::vector<double> writeCredit(m_sessions.size(), 0.0);
+    auto next = std::chrono::steady_clock::now();
+
+    while (!m_stopping.load()) {
+        next += tick;
+        std::this_thread::sleep_until(next);
+        for (size_t i = 0; i < m_sessions.size(); ++i) {
+            for (readCredit[i] += m_config.readRate * tickSeconds; readCredit[i] >= 1.0; readCredit[i] -= 1.0)
+                m_sessions[i]->sendRead(m_config.readBatch);
+            for (writeCredit[i] += m_config.writeRate * tickSeconds; writeCredit[i] >= 1.0; writeCredit[i] -= 1.0)
+                m_sessions[i]->sendWrite(m_config.writeBatch);
+        }
+    }
+}
+
+void ClientLoadGenerator::stop() {
+
+    m_stopping = true;
+    if (m_stormThread.joinable())
+        m_stormThread.join();
+    m_sessions.clear();
+}
+
+void ClientLoadGenerator::report(double seconds) {
+
+    if (seconds <= 0.0)
+        return;
+
+    printf("notifications %.0f/s latency p50 %.2f ms p99 %.2f ms p99.9 %.2f ms max %.2f ms\n",
+           m_notifications.exchange(0) / seconds,
+           m_notificationLatency.percentile(0.5) / 1e3, m_notificationLatency.percentile(0.99) / 1e3,
+           m_notificationLatency.percentile(0.999) / 1e3, m_notificationLatency.max() / 1e3);
+    if (m_config.readRate > 0.0)
+        printf("reads %.0f/s round trip p50 %.2f ms p99 %.2f ms\n", m_reads.exchange(0) / seconds,
+               m_readLatency.percentile(0.5) / 1e3, m_readLatency.percentile(0.99) / 1e3);
+    if (m_config.writeRate > 0.0)
+        printf("writes %.0f/s round trip p50 %.2f ms p99 %.2f ms\n", m_writes.exchange(0) / seconds,
+               m_writeLatency.percentile(0.5) / 1e3, m_writeLatency.percentile(0.99) / 1e3);
+    printf("skipped %llu errors %llu\n", static_cast<unsigned long long>(m_skipped.exchange(0)),
+           static_cast<unsigned long long>(m_errors.exchange(0)));
+
+    m_notificationLatency.reset();
+    m_readLatency.reset();
+    m_writeLatency.reset();
+}
+
+bool ClientLoadGenerator::loadConfig(const std::string & path, ClientLoadConfig & config) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        try {
+            if (key == "url")
+                config.url = value;
+            else if (key == "namespaceUri")
+                config.namespaceUri = value;
+            else if (key == "nodes")
+                config.nodesFile = value;
+            else if (key == "writeNodes")
+                config.writeNodesFile = value;
+            else if (key == "sessions")
+                config.sessions = static_cast<size_t>(std::stoul(value));
+            else if (key == "itemsPerSession")
+                config.itemsPerSession = static_cast<size_t>(std::stoul(value));
+            else if (key == "samplingInterval")
+                config.samplingInterval = std::stod(value);
+            else if (key == "queueSize")
+                config.queueSize = static_cast<uint32_t>(std::stoul(value));
+            else if (key == "publishingInterval")
+                config.publishingInterval = std::stod(value);
+            else if (key == "readRate")
+                config.readRate = std::stod(value);
+            else if (key == "readBatch")
+                config.readBatch = static_cast<size_t>(std::stoul(value));
+            else if (key == "writeRate")
+                config.writeRate = std::stod(value);
+            else if (key == "writeBatch")
+                config.writeBatch = static_cast<size_t>(std::stoul(value));
+            else if (key == "maxOutstanding")
+                config.maxOutstanding = static_cast<uint32_t>(std::stoul(value));
+            else if (key == "duration")
+                config.duration = std::chrono::seconds(std::stoul(value));
+            else if (key == "reportInterval")
+                config.reportInterval = std::chrono::seconds(std::stoul(value));
+            else
+                LOG_WARNING("Client load: unknown key %s in %s", key.c_str(), path.c_str());
+        } catch (const std::exception &) {
+            LOG_WARNING("Client load: invalid value for %s in %s", key.c_str(), path.c_str());
+        }
+    }
+    return true;
+}
@@ -1,27 +1,67 @@
 #include "EPICStoOPCUAGateway.h"
-#include "iostream"
+#include "logger.h"
+#include "typeMap.h"
 #include "mutex"
 #include "condition_variable"
+#include "algorithm"
+
+namespace {
+
+// Builder of the puts with a payload cloned from the prototype of the PV. The prototype sent by the
+// server is only used if the PV changed its type since the first update of this run.
+struct PutPayload {
+    Value payload;
+
+    Value operator()(Value && prototype) const {
+        if(prototype.equalType(payload))
+            return payload;
+        prototype.assign(payload);
+        return std::move(prototype);
+    }
+};
+
+}
 
 // Workers execution
 void EPICStoOPCUAGateway::processQueue() {
 
     GatewayHandler handler(this);
+    shared_ptr<GatewayEvent> pEvent;
 
-    while(m_running.load()){
+    // pop() only fails when the queue is closed and empty
+    while(m_workQueue.pop(pEvent)){
         //cout << "Soy: " << this_thread::get_id() << " y he llegado a processQueue" << endl;
-        // Obtain the next queue element
-        auto pEvent = m_workQueue.pop();
-        if(pEvent){
-            try{
-                std::visit(handler, *pEvent);
-            } catch (const exception & e) {
-                cerr << "Error processing event: " << e.what() << endl;
+        if(!pEvent)
+            continue;
+
+        // Draining: discard monitor updates and flush puts until the deadline
+        if(m_draining.load(memory_order_acquire)){
+            if(!holds_alternative<shared_ptr<PutRequest>>(*pEvent))
+                continue;
+            if(chrono::steady_clock::now().time_since_epoch().count() >= m_drainDeadline.load(memory_order_relaxed)){
+                ++m_droppedPuts;
+                continue;
             }
         }
+
+        try{
+            std::visit(handler, *pEvent);
+        } catch (const exception & e) {
+            LOG_ERROR("Error processing event: %s", e.what());
+        }
     }
 }
 
+chrono::milliseconds EPICStoOPCUAGateway::putTimeout() const {
+    chrono::milliseconds timeout(1000);
+    if(m_draining.load(memory_order_acquire)){
+        chrono::steady_clock::time_point deadline{chrono::steady_clock::duration(m_drainDeadline.load(memory_order_relaxed))};
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+        timeout = min(timeout, max(left, chrono::milliseconds(0)));
+    }
+    return timeout;
+}
+
 set<string> EPICStoOPCUAGateway::listServers() {
     set<string> ips;
 
@@ -32,16 +72,20 @@ set<string> EPICStoOPCUAGateway::listServers() {
         }
     }).pingAll(true).exec();
 
-    this_thread::sleep_for(chrono::milliseconds(500));
+    // Wait for the servers to reply, or until the gateway is stopping
+    {
+    unique_lock<mutex> lock(m_discoveryMutex);
+    m_discoveryCv.wait_for(lock, chrono::milliseconds(500), [this]() { return m_discoveryAborted; });
+    }
 
+    // Cancel before reading ips, the callback can not run anymore
+    op->cancel();
     return ips;
 }
 
 vector<string> EPICStoOPCUAGateway::listPVNames(const set<string> & servers) {
     vector<string> pvNames;
-    mutex mtx;
-    condition_variable cond_var;
-    atomic<int> remaining{static_cast<int>(servers.size())};
+    int remaining = static_cast<int>(servers.size());
 
     // Ask server to send pv names and wait for replies
     for (const auto& host : servers) {
@@ -58,20 +102,20 @@ vector<string> EPICStoOPCUAGateway::listPVNames(const set<string> & servers) {
 
                         // Lock mutex
                         {
-                        lock_guard<mutex> lock(mtx);
+                        lock_guard<mutex> lock(m_discoveryMutex);
                         pvNames.insert(pvNames.end(), channels.begin(),
                                         channels.end());
                         }
                         // Unlock mutex
 
                     } catch (exception& e) {
-                        cerr << "Error discovering the name of pv variables of server: " << host << endl;
-                        cerr << e.what() << endl;
+                        LOG_ERROR("Error discovering the name of pv variables of server %s: %s", host.c_str(), e.what());
                     }
 
                     // All servers respond with the pv names, so wake up the thread.
+                    lock_guard<mutex> lock(m_discoveryMutex);
                     if (--remaining == 0) {
-                        cond_var.notify_one();
+                        m_discoveryCv.notify_all();
                     }
                 })
                 .exec()
@@ -79,155 +123,271 @@ vector<string> EPICStoOPCUAGateway::listPVNames(const set<string> & servers) {
     }
 
     // Wait for replies
-    std::unique_lock<std::mutex> lock(mtx);
-    // Block thread until remaining == 0
-    cond_var.wait_for(lock, chrono::seconds(3), [&]() { return remaining == 0; }); 
+    std::unique_lock<std::mutex> lock(m_discoveryMutex);
+    // Block thread until remaining == 0 or the gateway is stopping
+    m_discoveryCv.wait_for(lock, chrono::seconds(3), [&]() { return remaining == 0 || m_discoveryAborted; }); 
+    lock.unlock();
+
+    // Cancel the pending operations, which waits for any callback in progress,
+    // so the callbacks do not use the local variables after returning.
+    for (auto & op : m_RPCforPVNames)
+        op->cancel();
 
     // Clear references for operations and return pv names
     m_RPCforPVNames.clear();
     return pvNames;
 }
 
-UaVariant EPICStoOPCUAGateway::convertValueToVariant(const Value& value) {
-    
-    UaVariant variant;
-    try {
-        Value valueField;
-        TypeCode::code_t code;
-        string id = value.id();
-
-        // Its a NTScalar
-        if (id == "epics:nt/NTScalar:1.0") {
-            valueField = value["value"];
-            code = valueField.type().code;
-        }
-        // Its a NTEnum 
-        else if (id == "epics:nt/NTEnum:1.0") {
-            valueField = value["value"]["index"];
-            // Can not exist a mbbi or mbbo with 2 states
-            if(value["value"]["choices"].as<shared_array<const string>>().size() == 2)
-                code = TypeCode::Bool;
-            else
-                code = TypeCode::Int16;
+OpcUa_StatusCode EPICStoOPCUAGateway::convertValueToVariant(const Value& value, UaVariant& variant) {
+
+    // Called for every update: no exceptions nor stream I/O here, the caller reports the errors once
+    Value valueField;
+    TypeCode::code_t code;
+    string id = value.id();
+
+    // Its a NTScalar
+    if (id == "epics:nt/NTScalar:1.0") {
+        valueField = value["value"];
+        code = valueField.type().code;
+    }
+    // Its a NTEnum 
+    else if (id == "epics:nt/NTEnum:1.0") {
+        valueField = value["value.index"];
+        shared_array<const string> choices;
+        if (!value["value.choices"].as(choices))
+            return OpcUa_BadTypeMismatch;
+        // Can not exist a mbbi or mbbo with 2 states
+        code = (choices.size() == 2) ? TypeCode::Bool : TypeCode::Int16;
+    }
+    else {
+        return OpcUa_BadNotSupported;
+    }
+
+    if (!valueField.valid())
+        return OpcUa_BadTypeMismatch;
+
+    const TypeMap::Entry * pEntry = TypeMap::find(code);
+    if (pEntry == nullptr)
+        return OpcUa_BadNotSupported;
+    return pEntry->toVariant(valueField, variant) ? OpcUa_Good : OpcUa_BadTypeMismatch;
+}
+
+void EPICStoOPCUAGateway::setErrorState(uint32_t pvId, OpcUa_StatusCode status, const char * operation) {
+    {
+    lock_guard<mutex> lock(m_valueMutex);
+    if (m_errorStates[pvId] == status)
+        return;
+    m_errorStates[pvId] = status;
+    }
+
+    // Only the transitions are reported
+    string pvName;
+    {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    pvName = m_pvNames.name(pvId);
+    }
+    if (OpcUa_IsBad(status))
+        Logger::instance().logPV(LogLevel::Error, pvId, "PV %s: %s failed with %s. Not reported again until it recovers.",
+                                 pvName.c_str(), operation, UaStatus(status).toString().toUtf8());
+    else
+        Logger::instance().logPV(LogLevel::Info, pvId, "PV %s recovered", pvName.c_str());
+}
+
+bool EPICStoOPCUAGateway::inErrorState(uint32_t pvId, OpcUa_StatusCode status) const {
+    lock_guard<mutex> lock(m_valueMutex);
+    return m_errorStates[pvId] == status;
+}
+
+EPICStoOPCUAGateway::EPICStoOPCUAGateway(MyNodeIOEventManager* pNodeManager, int numThreads,
+                                         OverflowPolicy overflowPolicy, unsigned fastWeight,
+                                         const string & snapshotPath)
+    : m_workQueue(100, 100, fastWeight), m_overflowPolicy(overflowPolicy),
+      m_pNodeManager(pNodeManager), m_structureMapper(pNodeManager), m_snapshotPath(snapshotPath), m_numThreads(numThreads) {    
+
+    m_pvxsContext = Context(Config::from_env().build());
+
+    // Warm start: map the PVs of the snapshot, they are checked against the discovery in start()
+    vector<PVCatalogEntry> entries;
+    if (!m_snapshotPath.empty() && PVCatalog::load(m_snapshotPath, entries)) {
+        m_pvNames.reserve(entries.size());
+        for (PVCatalogEntry & entry : entries) {
+            if (addMapping(entry.epicsName, entry.nodeId))
+                m_catalog.back() = std::move(entry);
         }
-        
-        switch(code){
-            case TypeCode::Bool:
-                variant.setBool(valueField.as<bool>());
-                break;
-            
-            case TypeCode::Float64:
-                variant.setDouble(valueField.as<double>());
-                break;
-
-            case TypeCode::Int16:
-                variant.setInt16(valueField.as<int16_t>());
-                break;
-
-            case TypeCode::Int32:
-                variant.setInt32(valueField.as<int32_t>());
-                break;
-
-            case TypeCode::Int64:
-                variant.setInt64(valueField.as<int64_t>());
-                break;
-
-            default:
-                throw runtime_error("Unsupported value data type");
-                
-                break;
+        m_warmStart = true;
+        LOG_INFO("Restored %zu PVs from %s", m_catalog.size(), m_snapshotPath.c_str());
+    }
+    // Cold start: discover the PVs in the network
+    else {
+        vector<string> pvNames = listPVNames(listServers());
+        m_pvNames.reserve(pvNames.size());
+        for (const string & pvName : pvNames)
+            addMapping(pvName);
+        probeRecordTypes();
+    }
+
+}
+
+uint32_t EPICStoOPCUAGateway::findPV(const UaNodeId & nodeId) const {
+    const OpcUa_NodeId * pNodeId = nodeId;
+    if (pNodeId->NamespaceIndex != m_pNodeManager->getNameSpaceIndex()
+        || pNodeId->IdentifierType != OpcUa_IdentifierType_String)
+        return PVNameTable::InvalidId;
+
+    const OpcUa_CharA * pRaw = OpcUa_String_GetRawString(&pNodeId->Identifier.String);
+    if (pRaw == OpcUa_Null)
+        return PVNameTable::InvalidId;
+    return m_pvNames.findByNode(string_view(pRaw, OpcUa_String_StrSize(&pNodeId->Identifier.String)));
+}
+
+void EPICStoOPCUAGateway::verifyCatalog() {
+
+    vector<string> pvNames = listPVNames(listServers());
+    {
+    lock_guard<mutex> lock(m_discoveryMutex);
+    if (m_discoveryAborted)
+        return;
+    }
+
+    // Map the PVs that are not in the snapshot
+    int added = 0;
+    vector<bool> online;
+    for (const string & pvName : pvNames) {
+        if (addMapping(pvName))
+            ++added;
+
+        uint32_t pvId;
+        {
+        shared_lock<shared_mutex> lock(m_mapMutex);
+        pvId = m_pvNames.find(pvName);
         }
-    } catch(const exception & e){
-        cerr << "Error converting EPICS Value to OPCUA Variant" << endl;
-        cerr << e.what() << endl;
-    }   
-    return variant;
-}
-
-Value EPICStoOPCUAGateway::convertUaDataValueToPvxsValue(const UaDataValue& dataValue) {
-
-    UaVariant variant(*dataValue.value());
-    Value value;
-    try {
-        switch (variant.type()){
-
-            // Boolean -> bi o bo (NTEnum with 2 options)
-            case OpcUa_BuiltInType::OpcUaType_Boolean: {
-                OpcUa_Boolean opcuaBool;
-                variant.toBool(opcuaBool);
-                if(opcuaBool)
-                    value = nt::NTEnum{}.create().update("value.index", 1);
-                else
-                    value = nt::NTEnum{}.create().update("value.index", 0);
-                break;
-            }
+        if (pvId == PVNameTable::InvalidId)
+            continue;
+        if (pvId >= online.size())
+            online.resize(pvId + 1, false);
+        online[pvId] = true;
+    }
 
-            // Double -> ai o ao
-            case OpcUa_BuiltInType::OpcUaType_Double: {
-                double doubleValue;
-                variant.toDouble(doubleValue);
-                value = nt::NTScalar{TypeCode::Float64}.create().update("value", doubleValue);
-                break;
-            }
+    // The record types are known before the first update creates a node for the new PVs,
+    // which get the highest identifiers
+    probeRecordTypes();
+    for (uint32_t pvId = m_snapshotSize; pvId < online.size(); ++pvId)
+        if (online[pvId])
+            subscribe(pvId);
+
+    // The PVs that are not online keep their mapping, they will connect when their IOC is back
+    int offline = 0;
+    for (uint32_t pvId = 0; pvId < m_snapshotSize; ++pvId)
+        if (pvId >= online.size() || !online[pvId])
+            ++offline;
+
+    LOG_INFO("Catalog verified: %d new PVs, %d PVs not found in the network", added, offline);
+    saveSnapshot();
+}
 
-            // Int16 -> mbbi o mbbo
-            case OpcUa_BuiltInType::OpcUaType_Int16: {
-                int16_t integer;
-                variant.toInt16(integer);
-                value = nt::NTEnum{}.create().update("value.index", integer);
-                break;
-            }
+void EPICStoOPCUAGateway::probeRecordTypes() {
 
-            // Int32 -> longin o longout
-            case OpcUa_BuiltInType::OpcUaType_Int32: {
-                int32_t integer;
-                variant.toInt32(integer);
-                value = nt::NTScalar{TypeCode::Int32}.create().update("value", integer);
-                break;
-            }
+    vector<pair<uint32_t, string>> pending;
+    {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    for (uint32_t pvId = 0; pvId < m_catalog.size(); ++pvId)
+        if (m_catalog[pvId].recordType.empty())
+            pending.emplace_back(pvId, string(m_pvNames.name(pvId)));
+    }
+
+    // The IOC serves every field of a record as another channel
+    size_t found = 0;
+    vector<shared_ptr<Operation>> probes;
+    vector<string> recordTypes;
+    for (size_t first = 0; first < pending.size(); first += RecordTypeProbeBatch) {
+        {
+        lock_guard<mutex> lock(m_discoveryMutex);
+        if (m_discoveryAborted)
+            return;
+        }
 
-            // Int64 -> int64in o int64out
-            case OpcUa_BuiltInType::OpcUaType_Int64: {
-                int64_t integer;
-                variant.toInt64(integer);
-                value = nt::NTScalar{TypeCode::Int64}.create().update("value", integer);
-                break;
+        size_t last = min(pending.size(), first + RecordTypeProbeBatch);
+        probes.clear();
+        for (size_t i = first; i < last; ++i)
+            probes.push_back(m_pvxsContext.get(pending[i].second + ".RTYP").exec());
+
+        // One timeout for the whole batch, the probes are in flight at the same time
+        recordTypes.assign(probes.size(), string());
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+        for (size_t i = 0; i < probes.size(); ++i) {
+            chrono::duration<double> remaining = deadline - chrono::steady_clock::now();
+            try {
+                probes[i]->wait(max(remaining.count(), 0.001))["value"].as(recordTypes[i]);
+            } catch (exception &) {
+                // Not an IOC record, or not reachable now
             }
+        }
 
-            default: {
-                throw runtime_error("Unsupported variant data type");
-                break;
+        unique_lock<shared_mutex> lock(m_mapMutex);
+        for (size_t i = 0; i < probes.size(); ++i) {
+            if (!recordTypes[i].empty()) {
+                m_catalog[pending[first + i].first].recordType = recordTypes[i];
+                ++found;
             }
         }
-    } catch(const exception & e){
-        cerr << "Error converting OPCUA Variant to EPICS Value" << endl;
-        cerr << e.what() << endl;
     }
-    return value;
+    LOG_INFO("Record type of %zu of %zu PVs", found, pending.size());
 }
 
-string EPICStoOPCUAGateway::replaceColonsWithDots(const string& input) {
-    string result = input;
-    for (char& c : result) {
-        if (c == ':') {
-            c = '.';
-        }
+void EPICStoOPCUAGateway::describePV(uint32_t pvId, const Value & value) {
+    {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    if (pvId >= m_catalog.size() || m_catalog[pvId].described)
+        return;
     }
-    return result;
-}
 
-EPICStoOPCUAGateway::EPICStoOPCUAGateway(MyNodeIOEventManager* pNodeManager, int numThreads)
-    : m_pNodeManager(pNodeManager), m_numThreads(numThreads) {    
+    unique_lock<shared_mutex> lock(m_mapMutex);
 
-    m_pvxsContext = Context(Config::from_env().build());
+    // Prototype of the puts: the type of the PV without any value
+    m_mappings[pvId].putPrototype = value.cloneEmpty();
 
-    m_pvNames = listPVNames(listServers());
+    PVCatalogEntry & entry = m_catalog[pvId];
+    entry.ntId = value.id();
+    if (entry.ntId == "epics:nt/NTEnum:1.0") {
+        entry.valueType = value["value.index"].type().code;
+        Value choices = value["value.choices"];
+        if (choices.valid()) {
+            auto names = choices.as<shared_array<const string>>();
+            entry.choices.assign(names.begin(), names.end());
+        }
+    } else {
+        entry.valueType = value["value"].type().code;
+    }
+
+    Value units = value["display.units"];
+    if (units.valid())
+        entry.units = units.as<string>();
+    Value limitLow = value["display.limitLow"];
+    Value limitHigh = value["display.limitHigh"];
+    if (limitLow.valid() && limitHigh.valid()) {
+        entry.limitLow = limitLow.as<double>();
+        entry.limitHigh = limitHigh.as<double>();
+    }
+    entry.described = true;
+}
 
-    for (string pvName : m_pvNames) {
-        string stringNodeId = replaceColonsWithDots(pvName);
-        addMapping( pvName, PVMapping(pvName, UaNodeId( stringNodeId.c_str(), m_pNodeManager->getNameSpaceIndex())));
+void EPICStoOPCUAGateway::saveSnapshot() {
+    if (m_snapshotPath.empty())
+        return;
+
+    vector<PVCatalogEntry> entries;
+    {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    entries.reserve(m_catalog.size());
+    for (uint32_t pvId = 0; pvId < m_catalog.size(); ++pvId) {
+        entries.push_back(m_catalog[pvId]);
+        entries.back().epicsName = m_pvNames.name(pvId);
+        entries.back().nodeId = m_pvNames.nodeName(pvId);
+    }
     }
 
+    if (!PVCatalog::save(m_snapshotPath, entries))
+        LOG_ERROR("Error saving the PV catalog snapshot to %s", m_snapshotPath.c_str());
 }
 
 EPICStoOPCUAGateway::~EPICStoOPCUAGateway() {
@@ -239,128 +399,541 @@ void EPICStoOPCUAGateway::start() {
     m_running.store(true);
 
     // Subscribirse to each PV.
-    // They have to be in m_pvMap
-    for(const auto & [pvName, pvMapping] : m_pvMapName){
-
-        m_subcriptions.push_back(
-            m_pvxsContext.monitor(pvMapping.epicsName)
-                .event([this](pvxs::client::Subscription & subscription){
-                    auto eventSub = make_shared<GatewayEvent>(subscription.shared_from_this());
-                    m_workQueue.push(eventSub);
-                }).exec()
-        );
+    // They have to be in m_pvNames
+    uint32_t pvCount;
+    {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    pvCount = static_cast<uint32_t>(m_pvNames.size());
     }
+    // The PVs mapped later by verifyCatalog() are subscribed there
+    m_snapshotSize = pvCount;
+    for(uint32_t pvId = 0; pvId < pvCount; ++pvId)
+        subscribe(pvId);
 
     // Start workers
     for(int i = 0; i<m_numThreads; ++i){
         m_workerThreads.push_back(thread([this](){processQueue();}));
     }
 
+    // The snapshot may be outdated, check it against the network in the background
+    if(m_warmStart)
+        m_discoveryThread = thread([this](){verifyCatalog();});
+
+}
+
+void EPICStoOPCUAGateway::subscribe(uint32_t pvId) {
+
+    string pvName;
+    {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    pvName = m_pvNames.name(pvId);
+    }
+
+    lock_guard<mutex> lock(m_subscriptionsMutex);
+    if(!m_running.load())
+        return;
+
+    m_subcriptions.push_back(
+        m_pvxsContext.monitor(pvName)
+            .event([this, pvId, pvName, lastSeverity = int32_t(-1)](pvxs::client::Subscription & subscription) mutable {
+                // Drain the subscription here, so a full work queue applies the overflow policy
+                // instead of blocking the PVXS client worker.
+                // PVXS only calls this again after pop() finds the queue empty, so the loop goes on
+                // after an exception (e.g. Disconnected when the IOC restarts).
+                for(;;){
+                    try{
+                        Value value = subscription.pop();
+                        if(!value)
+                            break;
+
+                        // Capture mode: the update as received, before any processing
+                        if(m_pTraceWriter)
+                            m_pTraceWriter->write(pvId, pvName, value);
+
+                        // Alarm severity changes take the fast lane
+                        Lane lane = Lane::Normal;
+                        Value severityField = value["alarm.severity"];
+                        if(severityField.valid()){
+                            int32_t severity = severityField.as<int32_t>();
+                            if(lastSeverity >= 0 && severity != lastSeverity)
+                                lane = Lane::Fast;
+                            lastSeverity = severity;
+                        }
+
+                        auto update = make_shared<MonitorUpdate>(pvId, std::move(value));
+                        // Rejected once the gateway is stopping
+                        m_workQueue.push(make_shared<GatewayEvent>(update), pvId, m_overflowPolicy, lane);
+                    } catch (const exception & e) {
+                        Logger::instance().logPV(LogLevel::Error, pvId, "Error in subscription to %s: %s",
+                                                 subscription.name().c_str(), e.what());
+                    }
+                }
+            }).exec()
+    );
 }
 
-void EPICStoOPCUAGateway::stop() {
+void EPICStoOPCUAGateway::stop(chrono::milliseconds drainTimeout) {
     
-    m_running.store(false);
+    // Only the first call stops the gateway
+    {
+    lock_guard<mutex> lock(m_subscriptionsMutex);
+    if(!m_running.exchange(false))
+        return;
+    }
 
-    // Signal to stop workers
-    for(int i = 0; i < m_numThreads; ++i){
-        m_workQueue.push(nullptr);
+    // Abort the background discovery
+    {
+    lock_guard<mutex> lock(m_discoveryMutex);
+    m_discoveryAborted = true;
     }
+    m_discoveryCv.notify_all();
+    if(m_discoveryThread.joinable())
+        m_discoveryThread.join();
+
+    // Stop intake. The deadline is published before the drain mode, and both before closing the queue.
+    m_drainDeadline.store((chrono::steady_clock::now() + drainTimeout).time_since_epoch().count(), memory_order_relaxed);
+    m_draining.store(true, memory_order_release);
+    m_workQueue.close();
+
+    // Cancel every monitor in bulk, no more updates are needed
+    for(auto & subscription : m_subcriptions)
+        subscription->cancel();
+    m_subcriptions.clear();
 
-    // Join to threads
+    // Workers flush the pending puts and finish when the queue is empty
     for(auto & thread : m_workerThreads)
         if(thread.joinable())
             thread.join();
     
-    
     m_workerThreads.clear();
+
+    // The puts in flight complete until the drain deadline, the rest are cancelled with the context
+    unordered_map<uint64_t, PendingPut> pendingPuts;
+    {
+    unique_lock<mutex> lock(m_putsMutex);
+    chrono::steady_clock::time_point deadline{chrono::steady_clock::duration(m_drainDeadline.load(memory_order_relaxed))};
+    auto allDone = [this]() {
+        for(const auto & [putId, put] : m_pendingPuts)
+            if(!put.done)
+                return false;
+        return true;
+    };
+    m_putsCv.wait_until(lock, deadline, allDone);
+    for(const auto & [putId, put] : m_pendingPuts)
+        if(!put.done)
+            ++m_droppedPuts;
+    pendingPuts.swap(m_pendingPuts);
+    }
+    for(auto & [putId, put] : pendingPuts)
+        if(put.operation)
+            put.operation->cancel();
+    pendingPuts.clear();
+
+    // Every update forwarded by the workers is in the ring of the recorder now
+    if(m_pRecorder)
+        m_pRecorder->stop();
+
+    // The last changes of the alarms are fired before the thread stops
+    if(m_pAlarmManager)
+        m_pAlarmManager->stop();
+
+    // The monitors are cancelled, no more updates are captured
+    if(m_pTraceWriter){
+        LOG_INFO("Captured %llu monitor updates", static_cast<unsigned long long>(m_pTraceWriter->updates()));
+        m_pTraceWriter.reset();
+    }
+
+    // Cancel any operation still in progress
+    m_pvxsContext.close();
+
+    if(m_droppedPuts.load() > 0)
+        LOG_WARNING("Gateway stopped with %llu put requests discarded", static_cast<unsigned long long>(m_droppedPuts.load()));
+
+    // Next start will restore the PVs and their metadata from the snapshot
+    saveSnapshot();
+}
+
+bool EPICStoOPCUAGateway::enableRecorder(const RecorderConfig & config) {
+    auto pRecorder = make_unique<UpdateRecorder>(config);
+    if(!pRecorder->start())
+        return false;
+    m_pRecorder = std::move(pRecorder);
+    return true;
+}
+
+bool EPICStoOPCUAGateway::enableCapture(const string & path) {
+    auto pTraceWriter = make_unique<TraceWriter>(path);
+    if(!pTraceWriter->isOpen())
+        return false;
+    m_pTraceWriter = std::move(pTraceWriter);
+    LOG_INFO("Capturing the monitor updates to %s", path.c_str());
+    return true;
+}
+
+bool EPICStoOPCUAGateway::enableAlarms() {
+    auto pAlarmManager = make_unique<AlarmManager>(m_pNodeManager, this);
+    if(!pAlarmManager->start())
+        return false;
+    m_pAlarmManager = std::move(pAlarmManager);
+    return true;
 }
 
 void EPICStoOPCUAGateway::enqueuePutTask(const UaVariable * variable, const UaDataValue& value) {
 
-    auto it = m_pvMapUaNode.find(variable->nodeId().toXmlString().toUtf8());
-    if(it != m_pvMapUaNode.end()){
-        auto request = make_shared<PutRequest>(variable, value);
+    uint32_t pvId;
+    {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    pvId = findPV(variable->nodeId());
+    }
+
+    if(pvId != PVNameTable::InvalidId){
+        auto request = make_shared<PutRequest>(variable, value, pvId);
         auto eventPut = make_shared<GatewayEvent>(request);
-        m_workQueue.push(eventPut);
+        if(!m_workQueue.push(eventPut, pvId, OverflowPolicy::Block, Lane::Fast))
+            Logger::instance().logPV(LogLevel::Warning, pvId, "Put request rejected: the gateway is stopping.");
     } else {
-        cerr << "Variable not found in the UaNodeId mapping." << endl;
+        LOG_ERROR("Variable %s not found in the UaNodeId mapping.", variable->nodeId().toString().toUtf8());
     }
     
 }
 
-bool EPICStoOPCUAGateway::addMapping(const string& name, const PVMapping& pvMapping) {
+OpcUa_StatusCode EPICStoOPCUAGateway::enqueueArrayPut(uint32_t pvId, const IndexRange & range, const UaVariant & value) {
+
+    if(!m_structureMapper.isScalarArray(pvId))
+        return OpcUa_BadNotWritable;
 
-    auto result = m_pvMapName.emplace(name, pvMapping);
-    if (result.second) {
-        auto result = m_pvMapUaNode.emplace(pvMapping.nodeId.toXmlString().toUtf8(), pvMapping);
-        return result.second;  
+    // A range out of the array, of another size or of another type is rejected by the Write service itself
+    OpcUa_StatusCode status = m_structureMapper.checkRange(pvId, range, value);
+    if(OpcUa_IsBad(status))
+        return status;
+
+    auto request = make_shared<PutRequest>(nullptr, UaDataValue(value, OpcUa_Good, UaDateTime(), UaDateTime()), pvId);
+    request->range = range;
+    auto eventPut = make_shared<GatewayEvent>(request);
+    if(!m_workQueue.push(eventPut, pvId, OverflowPolicy::Block, Lane::Fast)){
+        Logger::instance().logPV(LogLevel::Warning, pvId, "Put request rejected: the gateway is stopping.");
+        return OpcUa_BadShutdown;
     }
-    return false;
+    return OpcUa_Good;
+}
+
+bool EPICStoOPCUAGateway::isArrayPV(uint32_t pvId) {
+    return m_structureMapper.isScalarArray(pvId);
+}
+
+OpcUa_StatusCode EPICStoOPCUAGateway::readArrayRange(uint32_t pvId, const IndexRange & range, UaVariant & variant, int64_t & sourceTimestamp) {
+
+    // Only the status and the timestamp come from the value cache, the elements from the PVXS buffer
+    OpcUa_StatusCode status;
+    {
+    lock_guard<mutex> lock(m_valueMutex);
+    if(pvId >= m_values.size())
+        return OpcUa_BadWaitingForInitialData;
+    status = m_values[pvId].statusCode;
+    sourceTimestamp = m_values[pvId].sourceTimestamp;
+    }
+    if(OpcUa_IsBad(status))
+        return status;
+
+    OpcUa_StatusCode ret = m_structureMapper.readRange(pvId, range, variant);
+    return OpcUa_IsBad(ret) ? ret : status;
+}
+
+bool EPICStoOPCUAGateway::addMapping(const string& name, const string& nodeName) {
+
+    unique_lock<shared_mutex> lock(m_mapMutex);
+    if (name.empty() || m_pvNames.find(name) != PVNameTable::InvalidId)
+        return false;
+    string node = nodeName;
+    if (node.empty()) {
+        node = name;
+        replace(node.begin(), node.end(), ':', '.');
+    }
+    // Two PVs can not share a node
+    if (m_pvNames.findByNode(node) != PVNameTable::InvalidId)
+        return false;
+
+    uint32_t pvId = m_pvNames.intern(name, node);
+    m_mappings.emplace_back(UaNodeId(m_pvNames.nodeName(pvId).data(), m_pNodeManager->getNameSpaceIndex()));
+    m_catalog.emplace_back();
+
+    lock_guard<mutex> valueLock(m_valueMutex);
+    m_values.emplace_back();
+    m_errorStates.push_back(OpcUa_Good);
+    return true;
 }
 
 bool EPICStoOPCUAGateway::isMapped(const string& str){
-    return (m_pvMapName.find(str) != m_pvMapName.end());
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    return m_pvNames.find(str) != PVNameTable::InvalidId;
 }
 
 bool EPICStoOPCUAGateway::isMapped(const UaNodeId& nodeId){ 
-    return (m_pvMapUaNode.find(nodeId.toXmlString().toUtf8()) != m_pvMapUaNode.end()); 
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    return findPV(nodeId) != PVNameTable::InvalidId; 
+}
+
+size_t EPICStoOPCUAGateway::queueHighWatermark() const {
+    return m_workQueue.highWatermark();
+}
+
+uint32_t EPICStoOPCUAGateway::pvId(const string & name) const {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    return m_pvNames.find(name);
+}
+
+uint32_t EPICStoOPCUAGateway::pvId(const UaNodeId & nodeId) const {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    return findPV(nodeId);
+}
+
+uint32_t EPICStoOPCUAGateway::pvCount() const {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    return static_cast<uint32_t>(m_mappings.size());
+}
+
+bool EPICStoOPCUAGateway::catalogEntry(uint32_t pvId, PVCatalogEntry & entry) const {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    if(pvId >= m_catalog.size())
+        return false;
+
+    entry = m_catalog[pvId];
+    entry.epicsName = string(m_pvNames.name(pvId));
+    entry.nodeId = string(m_pvNames.nodeName(pvId));
+    return true;
+}
+
+void EPICStoOPCUAGateway::visitCatalog(uint32_t firstId,
+                                       const function<bool(uint32_t, string_view, string_view, const PVCatalogEntry &)> & visitor) const {
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    for(uint32_t pvId = firstId; pvId < m_catalog.size(); ++pvId)
+        if(!visitor(pvId, m_pvNames.name(pvId), m_pvNames.nodeName(pvId), m_catalog[pvId]))
+            return;
 }
 
-void EPICStoOPCUAGateway::GatewayHandler::operator()(shared_ptr<Subscription> & subscription) const {
-    if(subscription){
+void EPICStoOPCUAGateway::readValues(const vector<uint32_t> & pvIds, vector<CachedValue> & values) const {
+    values.resize(pvIds.size());
+
+    lock_guard<mutex> lock(m_valueMutex);
+    for(size_t i = 0; i < pvIds.size(); ++i){
+        if(pvIds[i] < m_values.size())
+            values[i] = m_values[pvIds[i]];
+        else
+            values[i] = CachedValue();
+    }
+}
+
+unordered_map<string, uint64_t> EPICStoOPCUAGateway::droppedUpdates() const {
+    unordered_map<uint32_t, uint64_t> drops = m_workQueue.drops();
+    unordered_map<string, uint64_t> result;
+    result.reserve(drops.size());
+
+    shared_lock<shared_mutex> lock(m_mapMutex);
+    for(const auto & [pvId, count] : drops)
+        result.emplace(m_pvNames.name(pvId), count);
+    return result;
+}
+
+void EPICStoOPCUAGateway::GatewayHandler::operator()(shared_ptr<MonitorUpdate> & update) const {
+    if(update && update->value){
+        // Unexpected errors only, the conversion and update errors are status codes
         try{
-            // cout << "Empieza Evento de monitoreo " << endl;
-            Value value = subscription->pop();
-            if(!value)
+            // The mappings are never removed nor moved, the reference stays valid without the lock
+            const PVMapping * pMapping;
+            {
+            shared_lock<shared_mutex> lock(m_self->m_mapMutex);
+            if(update->pvId >= m_self->m_mappings.size())
                 return;
-            
-            // cout << subscription->name() << endl;
-            auto it = m_self->m_pvMapName.find(subscription->name());
-            if(it != m_self->m_pvMapName.end()){
-                //cout << "Llego a actualizar la variable" << endl;
-                // Convert data from EPICS to OPC UA
-                UaVariant variant = m_self->convertValueToVariant(value);
-                // Update value in server
-                UaStatus ret = m_self->m_pNodeManager->updateVariable(it->second.nodeId, variant);
-                if(ret.isBad())
-                    throw runtime_error("Error in monitored variable: Error updating value in server.");
+            pMapping = &m_self->m_mappings[update->pvId];
             }
 
+            // Keep the catalog snapshot up to date with the NT type and metadata
+            m_self->describePV(update->pvId, update->value);
+
+            // Only a change of the alarm is queued, the events are fired by the thread of the AlarmManager
+            if(m_self->m_pAlarmManager)
+                m_self->m_pAlarmManager->update(update->pvId, update->value);
+
+            //cout << "Llego a actualizar la variable" << endl;
+            // Convert data from EPICS to OPC UA
+            UaVariant variant;
+            OpcUa_StatusCode status;
+            if(StructureMapper::isStructured(update->value))
+                status = m_self->m_structureMapper.convert(update->pvId, pMapping->nodeId, update->value, variant);
+            else
+                status = m_self->convertValueToVariant(update->value, variant);
+
+            // An array equal to the last one forwarded: the node, the history and the recording keep the previous sample
+            if(status == OpcUa_GoodNoData)
+                return;
+
+            // A PV that keeps failing the same way does not touch the node again
+            if(OpcUa_IsBad(status) && m_self->inErrorState(update->pvId, status))
+                return;
+
+            // EPICS timestamp as OPC UA DateTime (100 ns intervals since 1601-01-01)
+            int64_t sourceTimestamp = 0;
+            int64_t seconds, nanoseconds;
+            if(update->value["timeStamp.secondsPastEpoch"].as(seconds) && update->value["timeStamp.nanoseconds"].as(nanoseconds))
+                sourceTimestamp = seconds * 10000000 + nanoseconds / 100 + 116444736000000000LL;
+
+            {
+            lock_guard<mutex> lock(m_self->m_valueMutex);
+            CachedValue & cached = m_self->m_values[update->pvId];
+            cached.value = variant;
+            cached.statusCode = status;
+            cached.sourceTimestamp = sourceTimestamp;
+            ++cached.version;
+            }
+
+            // Trend of the PV for the HistoryRead service, without allocations after the first sample
+            HistoryStore * pHistory = m_self->m_pNodeManager->historyStore();
+            UpdateRecorder * pRecorder = m_self->m_pRecorder.get();
+            if(pHistory != nullptr || pRecorder != nullptr){
+                int64_t timestamp = sourceTimestamp;
+                if(timestamp == 0)
+                    timestamp = chrono::duration_cast<chrono::nanoseconds>(
+                        chrono::system_clock::now().time_since_epoch()).count() / 100 + 116444736000000000LL;
+                if(pHistory != nullptr)
+                    pHistory->append(update->pvId, timestamp, variant, status);
+
+                // Exactly what is forwarded, for the post-mortem analysis
+                if(pRecorder != nullptr){
+                    int32_t severity = 0;
+                    Value severityField = update->value["alarm.severity"];
+                    if(severityField.valid())
+                        severityField.as(severity);
+                    pRecorder->record(update->pvId, timestamp, variant, status, static_cast<uint8_t>(severity));
+                }
+            }
+            // Update value in server. A conversion error is shown as a Bad StatusCode on the node.
+            UaStatus ret = m_self->m_pNodeManager->updateVariable(pMapping->nodeId, variant, status, sourceTimestamp);
+            if(OpcUa_IsBad(status))
+                m_self->setErrorState(update->pvId, status, "Conversion to OPC UA");
+            else
+                m_self->setErrorState(update->pvId, ret.statusCode(), "Update of the OPC UA node");
 
         } catch (const exception & e) {
-            cerr << "Error: " << e.what() << endl;
+            Logger::instance().logPV(LogLevel::Error, update->pvId, "Error: %s", e.what());
         }
-        m_self->m_workQueue.push(make_shared<GatewayEvent>(subscription));
     }
 }
 
 void EPICStoOPCUAGateway::GatewayHandler::operator()(shared_ptr<PutRequest> & putRequest) const {
-    if(putRequest->variable != nullptr){
+    if(putRequest->pvId != PVNameTable::InvalidId){
         //cout << "Procesando put request" << endl;
-        auto it = m_self->m_pvMapUaNode.find(putRequest->variable->nodeId().toXmlString().toUtf8());
-        // Conver tdata from OPC UA to EPICS
-        Value value = m_self->convertUaDataValueToPvxsValue(putRequest->dataValue);
-        // Update value in IOC
-        try{
-            if(value["value"].valid()){
-                if(value.id() == "epics:nt/NTScalar:1.0")
-                    m_self->m_pvxsContext.put(it->second.epicsName)
-                    .set("value", value["value"])
-                    .exec()->wait(1);
-
-                if(value.id() == "epics:nt/NTEnum:1.0")
-                    m_self->m_pvxsContext.put(it->second.epicsName)
-                    .set("value.index", value["value.index"])
-                    .exec()->wait(1);
-                // Success
+        string epicsName;
+        Value prototype;
+        {
+        shared_lock<shared_mutex> lock(m_self->m_mapMutex);
+        if(putRequest->pvId >= m_self->m_pvNames.size())
+            return;
+        epicsName = m_self->m_pvNames.name(putRequest->pvId);
+        prototype = m_self->m_mappings[putRequest->pvId].putPrototype;
+        }
+        double timeout = m_self->putTimeout().count() / 1000.0;
+
+        // No update received yet from the PV: its type is fetched once to seed the prototype
+        if(!prototype){
+            try{
+                prototype = m_self->m_pvxsContext.get(epicsName).exec()->wait(timeout).cloneEmpty();
+            }
+            catch (const exception & e) {
+                Logger::instance().logPV(LogLevel::Error, putRequest->pvId, "Put request to %s rejected: the type of the PV is not known: %s",
+                                         epicsName.c_str(), e.what());
+                return;
             }
+            unique_lock<shared_mutex> lock(m_self->m_mapMutex);
+            if(!m_self->m_mappings[putRequest->pvId].putPrototype)
+                m_self->m_mappings[putRequest->pvId].putPrototype = prototype;
+        }
+
+        // Payload of the put: an empty clone of the prototype of the PV with only the written field
+        // assigned and marked, so no NT type is built per write
+        Value payload = prototype.cloneEmpty();
+        OpcUa_StatusCode status;
+        const UaVariant variant(*putRequest->dataValue.value());
+
+        // Array PV: the elements are merged here, with the last array received, so the put is built
+        // from the freshest array when several writes of ranges are queued
+        if(m_self->m_structureMapper.isScalarArray(putRequest->pvId)){
+            shared_array<const void> array;
+            status = m_self->m_structureMapper.mergeRange(putRequest->pvId, putRequest->range, variant, array);
+            if(OpcUa_IsGood(status) && !payload["value"].tryFrom(array))
+                status = OpcUa_BadTypeMismatch;
+        }
+        else{
+            Value field = payload[prototype.id() == "epics:nt/NTEnum:1.0" ? "value.index" : "value"];
+            status = field.valid() ? TypeMap::fromVariant(variant, field) : OpcUa_BadTypeMismatch;
+        }
+        if(OpcUa_IsBad(status)){
+            Logger::instance().logPV(LogLevel::Error, putRequest->pvId, "Put request to %s rejected: %s",
+                                     epicsName.c_str(), UaStatus(status).toString().toUtf8());
+            return;
+        }
+
+        // Update value in IOC without waiting, the result is logged by the completion callback
+        uint64_t putId;
+        {
+        lock_guard<mutex> lock(m_self->m_putsMutex);
+        putId = m_self->m_nextPutId++;
         }
-        catch (const exception & e) {
-            cerr << "Error in put request hadler: Error in pvxs put operation" << endl;
-            cerr << e.what() << endl;
-            // Notify NodeManager???
-            // Volver al valor anterior en el nodemanager
+        EPICStoOPCUAGateway * self = m_self;
+        uint32_t pvId = putRequest->pvId;
+        auto operation = m_self->m_pvxsContext.put(epicsName)
+            .build(PutPayload{payload})
+            .result([self, putId, pvId, epicsName](Result && result) {
+                try{
+                    result();
+                }
+                catch (const exception & e) {
+                    Logger::instance().logPV(LogLevel::Error, pvId, "Error in put request handler: Error in pvxs put operation to %s: %s",
+                                             epicsName.c_str(), e.what());
+                }
+                self->finishPut(putId);
+            })
+            .exec();
+        m_self->trackPut(putId, pvId, epicsName, std::move(operation));
+    }
+}
+
+void EPICStoOPCUAGateway::trackPut(uint64_t putId, uint32_t pvId, const string & epicsName, shared_ptr<Operation> operation) {
+
+    auto now = chrono::steady_clock::now();
+    vector<PendingPut> finished;
+    {
+    lock_guard<mutex> lock(m_putsMutex);
+    // The operation can complete before it is tracked
+    auto it = m_pendingPuts.find(putId);
+    if(it != m_pendingPuts.end())
+        m_pendingPuts.erase(it);
+    else
+        m_pendingPuts.emplace(putId, PendingPut{pvId, epicsName, std::move(operation), now + putTimeout(), false});
+
+    for(auto it = m_pendingPuts.begin(); it != m_pendingPuts.end(); ){
+        if(it->second.done || it->second.deadline <= now){
+            finished.push_back(std::move(it->second));
+            it = m_pendingPuts.erase(it);
+        } else {
+            ++it;
         }
     }
+    }
+
+    // Outside the lock: the cancellation waits for a callback in progress, which takes it
+    for(PendingPut & put : finished){
+        if(put.done)
+            continue;
+        put.operation->cancel();
+        Logger::instance().logPV(LogLevel::Error, put.pvId, "Error in put request handler: pvxs put operation to %s timed out",
+                                 put.epicsName.c_str());
+    }
+}
+
+void EPICStoOPCUAGateway::finishPut(uint64_t putId) {
+    {
+    lock_guard<mutex> lock(m_putsMutex);
+    m_pendingPuts[putId].done = true;
+    }
+    m_putsCv.notify_all();
 }
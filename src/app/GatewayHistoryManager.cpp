@@ -0,0 +1,290 @@
+#include "GatewayHistoryManager.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace {
+
+/**
+ * @brief Continuation point of a raw read: the time of the last returned value, and the number of values
+ * at that time that were already returned. The next call reads the range again and skips them.
+ *
+ */
+class HistoryReadCP : public HistoryReadCPUserDataBase {
+public:
+    int64_t lastTime = 0;
+    size_t returnedAtLast = 0;
+};
+
+// Limit of the intervals of a processed read, a tiny resampleInterval must not exhaust the memory
+constexpr int64_t MaxIntervals = 1 << 20;
+
+int64_t toTicks(const OpcUa_DateTime & dateTime) {
+    return (static_cast<int64_t>(dateTime.dwHighDateTime) << 32) | dateTime.dwLowDateTime;
+}
+
+UaDateTime fromTicks(int64_t ticks) {
+    OpcUa_DateTime dateTime;
+    dateTime.dwLowDateTime = static_cast<OpcUa_UInt32>(ticks & 0xFFFFFFFF);
+    dateTime.dwHighDateTime = static_cast<OpcUa_UInt32>(static_cast<uint64_t>(ticks) >> 32);
+    return UaDateTime(dateTime);
+}
+
+bool hasValue(const HistorySample & sample) {
+    return OpcUa_IsNotBad(sample.statusCode) && sample.type != OpcUaType_Null;
+}
+
+}
+
+GatewayHistoryManager::GatewayHistoryManager(const HistoryStore * pHistory) : m_pHistory(pHistory) {}
+
+bool GatewayHistoryManager::rawValues(uint32_t pvId, int64_t startTime, int64_t endTime, bool returnBounds,
+                                     std::vector<HistorySample> & samples, std::vector<RawValue> & values) const {
+
+    // The samples are stored in arrival order, an IOC can send a source timestamp older than the previous one
+    m_pHistory->read(pvId, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), samples);
+    std::stable_sort(samples.begin(), samples.end(), [](const HistorySample & a, const HistorySample & b) {
+        return a.timestamp < b.timestamp;
+    });
+    auto before = [](const HistorySample & sample, int64_t time) { return sample.timestamp < time; };
+    auto after = [](int64_t time, const HistorySample & sample) { return time < sample.timestamp; };
+
+    // Samples [first, last) of the range. A bound is the sample at the time, or the nearest one outside the range.
+    bool reverse = (startTime == 0) || (endTime != 0 && startTime > endTime);
+    size_t first, last;
+    const HistorySample * pStartBound = nullptr;
+    const HistorySample * pEndBound = nullptr;
+    bool endBound = returnBounds && startTime != 0 && endTime != 0;
+    if (!reverse) {
+        first = std::lower_bound(samples.begin(), samples.end(), startTime, before) - samples.begin();
+        last = endTime == 0 ? samples.size() : std::lower_bound(samples.begin(), samples.end(), endTime, before) - samples.begin();
+        if (first < samples.size() && samples[first].timestamp == startTime)
+            returnBounds = false;       // The first value of the range is the bound
+        else if (first > 0)
+            pStartBound = &samples[first - 1];
+        if (last < samples.size())
+            pEndBound = &samples[last];
+    } else {
+        int64_t top = startTime == 0 ? endTime : startTime;
+        first = startTime == 0 ? 0 : std::upper_bound(samples.begin(), samples.end(), endTime, after) - samples.begin();
+        last = std::upper_bound(samples.begin(), samples.end(), top, after) - samples.begin();
+        if (last > first && samples[last - 1].timestamp == top)
+            returnBounds = false;
+        else if (last < samples.size())
+            pStartBound = &samples[last];
+        if (first > 0)
+            pEndBound = &samples[first - 1];
+    }
+    first = std::min(first, last);
+
+    int64_t startBoundTime = startTime == 0 ? endTime : startTime;
+    if (returnBounds)
+        values.push_back(RawValue{pStartBound, pStartBound != nullptr ? pStartBound->timestamp : startBoundTime});
+    if (reverse) {
+        for (size_t i = last; i > first; --i)
+            values.push_back(RawValue{&samples[i - 1], samples[i - 1].timestamp});
+    } else {
+        for (size_t i = first; i < last; ++i)
+            values.push_back(RawValue{&samples[i], samples[i].timestamp});
+    }
+    if (endBound)
+        values.push_back(RawValue{pEndBound, pEndBound != nullptr ? pEndBound->timestamp : endTime});
+    return reverse;
+}
+
+void GatewayHistoryManager::setDataValue(OpcUa_DataValue & dataValue, const UaVariant & value, OpcUa_StatusCode statusCode,
+                                         int64_t timestamp, OpcUa_TimestampsToReturn timestampsToReturn) {
+
+    // The history only has the source timestamp, it is returned as server timestamp as well
+    bool source = timestampsToReturn == OpcUa_TimestampsToReturn_Source || timestampsToReturn == OpcUa_TimestampsToReturn_Both;
+    bool server = timestampsToReturn == OpcUa_TimestampsToReturn_Server || timestampsToReturn == OpcUa_TimestampsToReturn_Both;
+
+    UaDataValue uaDataValue(value, statusCode,
+                            source ? fromTicks(timestamp) : UaDateTime(),
+                            server ? fromTicks(timestamp) : UaDateTime());
+    uaDataValue.copyTo(&dataValue);
+}
+
+UaStatus GatewayHistoryManager::readRaw(
+    const ServiceContext & serviceContext,
+    HistoryVariableHandle * pVariableHandle,
+    HistoryReadCPUserDataBase ** ppContinuationPoint,
+    OpcUa_TimestampsToReturn timestampsToReturn,
+    OpcUa_UInt32 maxValues,
+    OpcUa_DateTime & startTime,
+    OpcUa_DateTime & endTime,
+    OpcUa_Boolean returnBounds,
+    OpcUa_HistoryReadValueId * pReadValueId,
+    UaDataValues & dataValues
+) {
+    OpcUa_ReferenceParameter(serviceContext);
+    OpcUa_ReferenceParameter(pReadValueId);
+
+    int64_t start = toTicks(startTime);
+    int64_t end = toTicks(endTime);
+
+    // A continuation point gives the time of the last returned value and how many values at that time were returned
+    HistoryReadCP * pPrevious = static_cast<HistoryReadCP*>(*ppContinuationPoint);
+    *ppContinuationPoint = NULL;
+    std::unique_ptr<HistoryReadCP> previous(pPrevious);
+
+    if ((start == 0 && end == 0) || ((start == 0 || end == 0) && maxValues == 0))
+        return OpcUa_BadInvalidTimestampArgument;
+
+    uint32_t pvId = static_cast<PVHistoryVariableHandle*>(pVariableHandle)->m_pvId;
+    std::vector<HistorySample> samples;
+    std::vector<RawValue> values;
+    bool reverse = rawValues(pvId, start, end, returnBounds != OpcUa_False, samples, values);
+
+    // The timestamps of the values never go back, so the values already returned are a prefix of them
+    auto returned = [reverse](const RawValue & value, int64_t time) {
+        return reverse ? value.timestamp > time : value.timestamp < time;
+    };
+    size_t first = 0;
+    if (previous) {
+        first = std::lower_bound(values.begin(), values.end(), previous->lastTime, returned) - values.begin();
+        first = std::min(first + previous->returnedAtLast, values.size());
+    }
+
+    size_t count = values.size() - first;
+    if (maxValues > 0 && count > maxValues) {
+        count = maxValues;
+
+        // Several values can share the time of the last returned one
+        HistoryReadCP * pContinuationPoint = new HistoryReadCP;
+        pContinuationPoint->lastTime = values[first + count - 1].timestamp;
+        size_t atLast = std::lower_bound(values.begin(), values.end(), pContinuationPoint->lastTime, returned) - values.begin();
+        pContinuationPoint->returnedAtLast = first + count - atLast;
+        *ppContinuationPoint = pContinuationPoint;
+    }
+
+    dataValues.create(static_cast<OpcUa_UInt32>(count));
+    UaVariant value;
+    for (size_t i = 0; i < count; ++i) {
+        const RawValue & rawValue = values[first + i];
+        OpcUa_StatusCode statusCode = OpcUa_BadBoundNotFound;
+        value.clear();
+        if (rawValue.pSample != nullptr) {
+            rawValue.pSample->toVariant(value);
+            statusCode = rawValue.pSample->statusCode;
+        }
+        setDataValue(dataValues[static_cast<OpcUa_UInt32>(i)], value, statusCode, rawValue.timestamp, timestampsToReturn);
+    }
+
+    if (count == 0)
+        return OpcUa_GoodNoData;
+    return OpcUa_Good;
+}
+
+UaStatus GatewayHistoryManager::readProcessed(
+    const ServiceContext & serviceContext,
+    HistoryVariableHandle * pVariableHandle,
+    HistoryReadCPUserDataBase ** ppContinuationPoint,
+    OpcUa_TimestampsToReturn timestampsToReturn,
+    OpcUa_DateTime & startTime,
+    OpcUa_DateTime & endTime,
+    OpcUa_Double resampleInterval,
+    OpcUa_NodeId & aggregateType,
+    OpcUa_AggregateConfiguration & aggregateConfiguration,
+    OpcUa_HistoryReadValueId * pReadValueId,
+    UaDataValues & dataValues
+) {
+    OpcUa_ReferenceParameter(serviceContext);
+    OpcUa_ReferenceParameter(aggregateConfiguration);
+    OpcUa_ReferenceParameter(pReadValueId);
+
+    // Every interval is returned at once, there are no continuation points
+    if (*ppContinuationPoint != NULL) {
+        delete *ppContinuationPoint;
+        *ppContinuationPoint = NULL;
+    }
+
+    UaNodeId aggregate(aggregateType);
+    if (aggregate.namespaceIndex() != 0 || aggregate.identifierType() != OpcUa_IdentifierType_Numeric)
+        return OpcUa_BadAggregateNotSupported;
+
+    OpcUa_UInt32 aggregateId = aggregate.identifierNumeric();
+    if (aggregateId != OpcUaId_AggregateFunction_Average && aggregateId != OpcUaId_AggregateFunction_Minimum
+        && aggregateId != OpcUaId_AggregateFunction_Maximum && aggregateId != OpcUaId_AggregateFunction_Count
+        && aggregateId != OpcUaId_AggregateFunction_Start && aggregateId != OpcUaId_AggregateFunction_End)
+        return OpcUa_BadAggregateNotSupported;
+
+    int64_t start = toTicks(startTime);
+    int64_t end = toTicks(endTime);
+    if (start == 0 || end == 0 || start == end)
+        return OpcUa_BadInvalidTimestampArgument;
+
+    // The intervals go from startTime to endTime, the last one can be shorter.
+    // Backwards, an interval holds the samples of (intervalStart - interval, intervalStart]
+    bool reverse = start > end;
+    int64_t low = reverse ? end : start;
+    int64_t high = reverse ? start : end;
+    int64_t interval = static_cast<int64_t>(resampleInterval * 10000.0);      // ms to 100 ns
+    if (interval <= 0)
+        interval = high - low;
+    int64_t intervals = (high - low + interval - 1) / interval;
+    if (intervals > MaxIntervals)
+        return OpcUa_BadTooManyOperations;
+
+    uint32_t pvId = static_cast<PVHistoryVariableHandle*>(pVariableHandle)->m_pvId;
+    std::vector<HistorySample> samples;
+    if (reverse)
+        m_pHistory->read(pvId, low + 1, high, samples);
+    else
+        m_pHistory->read(pvId, low, high - 1, samples);
+    std::sort(samples.begin(), samples.end(), [reverse](const HistorySample & a, const HistorySample & b) {
+        return reverse ? a.timestamp > b.timestamp : a.timestamp < b.timestamp;
+    });
+
+    dataValues.create(static_cast<OpcUa_UInt32>(intervals));
+    UaVariant value;
+    size_t next = 0;
+    for (int64_t i = 0; i < intervals; ++i) {
+        int64_t intervalStart = reverse ? start - i * interval : start + i * interval;
+        int64_t intervalEnd = reverse ? std::max(intervalStart - interval, end) : std::min(intervalStart + interval, end);
+
+        // Good samples of the interval
+        const HistorySample * pFirst = nullptr;
+        const HistorySample * pLast = nullptr;
+        const HistorySample * pMin = nullptr;
+        const HistorySample * pMax = nullptr;
+        double sum = 0.0;
+        OpcUa_UInt32 count = 0;
+        for (; next < samples.size()
+               && (reverse ? samples[next].timestamp > intervalEnd : samples[next].timestamp < intervalEnd); ++next) {
+            const HistorySample & sample = samples[next];
+            if (!hasValue(sample))
+                continue;
+            double number = sample.toDouble();
+            if (pFirst == nullptr)
+                pFirst = &sample;
+            pLast = &sample;
+            if (pMin == nullptr || number < pMin->toDouble())
+                pMin = &sample;
+            if (pMax == nullptr || number > pMax->toDouble())
+                pMax = &sample;
+            sum += number;
+            ++count;
+        }
+        // Start and End are the earliest and the latest samples in time
+        if (reverse)
+            std::swap(pFirst, pLast);
+
+        OpcUa_StatusCode statusCode = OpcUa_Good;
+        value.clear();
+        switch (aggregateId) {
+            case OpcUaId_AggregateFunction_Count:   value.setUInt32(count); break;
+            case OpcUaId_AggregateFunction_Average: if (count > 0) value.setDouble(sum / count); break;
+            case OpcUaId_AggregateFunction_Minimum: if (pMin) pMin->toVariant(value); break;
+            case OpcUaId_AggregateFunction_Maximum: if (pMax) pMax->toVariant(value); break;
+            case OpcUaId_AggregateFunction_Start:   if (pFirst) pFirst->toVariant(value); break;
+            case OpcUaId_AggregateFunction_End:     if (pLast) pLast->toVariant(value); break;
+        }
+        if (count == 0 && aggregateId != OpcUaId_AggregateFunction_Count)
+            statusCode = OpcUa_BadNoData;
+
+        setDataValue(dataValues[static_cast<OpcUa_UInt32>(i)], value, statusCode, intervalStart, timestampsToReturn);
+    }
+
+    return OpcUa_Good;
+}
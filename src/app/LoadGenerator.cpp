@@ -0,0 +1,395 @@
+#include "LoadGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <logger.h>
+#include <pvxs/nt.h>
+
+using pvxs::TypeCode;
+using pvxs::Value;
+using pvxs::shared_array;
+
+namespace {
+
+// EPICS alarm severities
+constexpr int32_t SeverityNoAlarm = 0;
+constexpr int32_t SeverityMinor = 1;
+constexpr int32_t SeverityMajor = 2;
+
+// Names of the states of a mbbi/mbbo record, in order
+const char * const StateFields[] = {"ZRST", "ONST", "TWST", "THST", "FRST", "FVST", "SXST", "SVST",
+                                    "EIST", "NIST", "TEST", "ELST", "TVST", "TTST", "FTST", "FFST"};
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+bool isOutput(const std::string & type) {
+    return type == "ao" || type == "bo" || type == "longout" || type == "int64out" || type == "mbbo";
+}
+
+}
+
+LoadGenerator::LoadGenerator(const LoadConfig & config) : m_config(config) {
+    m_server = pvxs::server::Config::from_env().build();
+}
+
+LoadGenerator::~LoadGenerator() {
+    stop();
+}
+
+std::chrono::nanoseconds LoadGenerator::scanPeriod(const std::string & scan) {
+
+    // "1 second", ".5 second", "1 minute". Passive, Event and I/O Intr are not periodic.
+    const char * pStart = scan.c_str();
+    char * pEnd = nullptr;
+    double number = strtod(pStart, &pEnd);
+    if (pEnd == pStart || number <= 0.0)
+        return std::chrono::nanoseconds(0);
+
+    std::string unit = trim(pEnd);
+    double seconds;
+    if (unit.rfind("second", 0) == 0)
+        seconds = number;
+    else if (unit.rfind("minute", 0) == 0)
+        seconds = number * 60.0;
+    else if (unit.rfind("hour", 0) == 0)
+        seconds = number * 3600.0;
+    else
+        return std::chrono::nanoseconds(0);
+    return std::chrono::nanoseconds(static_cast<int64_t>(seconds * 1e9));
+}
+
+bool LoadGenerator::addRecord(const DbRecord & record, const std::string & pvName) {
+
+    const std::string & type = record.type;
+    bool output = isOutput(type);
+    SimulatedPV simulated;
+    Value initial;
+    shared_array<std::string> choices;
+
+    if (type == "ai" || type == "ao") {
+        simulated.kind = Kind::Double;
+        initial = pvxs::nt::NTScalar{TypeCode::Float64, true}.create();
+    } else if (type == "longin" || type == "longout") {
+        simulated.kind = Kind::Int32;
+        initial = pvxs::nt::NTScalar{TypeCode::Int32, true}.create();
+    } else if (type == "int64in" || type == "int64out") {
+        simulated.kind = Kind::Int64;
+        initial = pvxs::nt::NTScalar{TypeCode::Int64, true}.create();
+    } else if (type == "bi" || type == "bo") {
+        simulated.kind = Kind::Enum;
+        initial = pvxs::nt::NTEnum{}.create();
+        choices = shared_array<std::string>(2);
+        choices[0] = record.field("ZNAM", "");
+        choices[1] = record.field("ONAM", "");
+    } else if (type == "mbbi" || type == "mbbo") {
+        // The states up to the last one with a name, as the IOC does
+        size_t states = 0;
+        for (size_t i = 0; i < 16; ++i)
+            if (!record.field(StateFields[i], "").empty())
+                states = i + 1;
+        simulated.kind = Kind::Enum;
+        initial = pvxs::nt::NTEnum{}.create();
+        choices = shared_array<std::string>(std::max<size_t>(states, 1));
+        for (size_t i = 0; i < states; ++i)
+            choices[i] = record.field(StateFields[i], "");
+    } else {
+        return false;
+    }
+
+    if (simulated.kind == Kind::Enum) {
+        simulated.states = static_cast<uint32_t>(choices.size());
+        simulated.low = 0.0;
+        simulated.high = simulated.states - 1.0;
+        initial["value.choices"] = choices.freeze();
+    } else {
+        // Outputs walk inside their drive limits, inputs inside their display limits
+        simulated.states = 0;
+        simulated.low = record.number(output ? "DRVL" : "LOPR", 0.0);
+        simulated.high = record.number(output ? "DRVH" : "HOPR", 0.0);
+        if (simulated.high <= simulated.low) {
+            simulated.low = record.number("LOPR", 0.0);
+            simulated.high = record.number("HOPR", 0.0);
+        }
+        if (simulated.high <= simulated.low) {
+            simulated.low = 0.0;
+            simulated.high = 100.0;
+        }
+        initial["display.limitLow"] = simulated.low;
+        initial["display.limitHigh"] = simulated.high;
+        initial["display.units"] = record.field("EGU", "");
+        initial["display.description"] = record.field("DESC", "");
+    }
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    simulated.hihi = record.number("HIHI", nan);
+    simulated.highAlarm = record.number("HIGH", nan);
+    simulated.lowAlarm = record.number("LOW", nan);
+    simulated.lolo = record.number("LOLO", nan);
+    simulated.value = std::min(std::max(record.number("VAL", simulated.low), simulated.low), simulated.high);
+    simulated.prototype = initial;
+
+    size_t index = m_pvs.size();
+    if (output) {
+        simulated.pv = pvxs::server::SharedPV::buildMailbox();
+        simulated.pv.onPut([this, index](pvxs::server::SharedPV &, std::unique_ptr<pvxs::server::ExecOp> && op, Value && value) {
+            Value field = value["value.index"];
+            if (!field.valid() || !field.isMarked())
+                field = value["value"];
+            if (!field.valid() || !field.isMarked()) {
+                op->error("No value");
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_pvMutexes[index % MutexStripes]);
+            SimulatedPV & put = m_pvs[index];
+            double newValue = field.as<double>();
+            if (put.kind == Kind::Enum && (newValue < 0.0 || newValue >= put.states)) {
+                op->error("Invalid state");
+                return;
+            }
+            put.value = newValue;
+            post(put);
+            op->reply();
+        });
+    } else {
+        simulated.pv = pvxs::server::SharedPV::buildReadonly();
+    }
+
+    m_pvs.push_back(std::move(simulated));
+    SimulatedPV & added = m_pvs.back();
+    post(added);
+    m_server.addPV(pvName, added.pv);
+    return true;
+}
+
+size_t LoadGenerator::load(const std::vector<DbRecord> & records) {
+
+    size_t ignored = 0;
+    for (const auto & record : records) {
+        std::chrono::nanoseconds period = scanPeriod(record.field("SCAN", "Passive"));
+        if (period.count() == 0 && !isOutput(record.type))
+            period = m_config.passivePeriod;
+        if (period.count() > 0 && m_config.rateScale > 0.0)
+            period = std::chrono::nanoseconds(static_cast<int64_t>(period.count() / m_config.rateScale));
+
+        for (size_t copy = 0; copy < m_config.multiplier; ++copy) {
+            std::string pvName = (m_config.multiplier == 1) ? record.name : record.name + "_" + std::to_string(copy);
+            size_t index = m_pvs.size();
+            if (!addRecord(record, pvName)) {
+                ++ignored;
+                break;
+            }
+            if (period.count() > 0) {
+                ScanList & list = m_scanLists[period.count()];
+                list.period = period;
+                list.pvs.push_back(index);
+            }
+        }
+    }
+
+    if (ignored > 0)
+        LOG_WARNING("Load generator: %zu records of unsupported types ignored", ignored);
+    return m_pvs.size();
+}
+
+void LoadGenerator::post(SimulatedPV & simulated) {
+
+    // The first post opens the PV with the metadata of the record, the prototype until then
+    Value update = simulated.pv.isOpen() ? simulated.prototype.cloneEmpty() : simulated.prototype;
+    switch (simulated.kind) {
+        case Kind::Double: update["value"] = simulated.value; break;
+        case Kind::Int32:  update["value"] = static_cast<int32_t>(std::llround(simulated.value)); break;
+        case Kind::Int64:  update["value"] = static_cast<int64_t>(std::llround(simulated.value)); break;
+        case Kind::Enum:   update["value.index"] = static_cast<int32_t>(simulated.value); break;
+    }
+
+    // Comparisons with the NaN of an unset limit are false
+    int32_t severity = SeverityNoAlarm;
+    const char * message = "";
+    if (simulated.value >= simulated.hihi) {
+        severity = SeverityMajor;
+        message = "HIHI";
+    } else if (simulated.value <= simulated.lolo) {
+        severity = SeverityMajor;
+        message = "LOLO";
+    } else if (simulated.value >= simulated.highAlarm) {
+        severity = SeverityMinor;
+        message = "HIGH";
+    } else if (simulated.value <= simulated.lowAlarm) {
+        severity = SeverityMinor;
+        message = "LOW";
+    }
+    update["alarm.severity"] = severity;
+    update["alarm.message"] = std::string(message);
+
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(now);
+    update["timeStamp.secondsPastEpoch"] = static_cast<int64_t>(seconds.count());
+    update["timeStamp.nanoseconds"] = static_cast<int32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - seconds).count());
+
+    if (simulated.pv.isOpen()) {
+        simulated.pv.post(update);
+    } else {
+        simulated.pv.open(update);
+        simulated.prototype = update.cloneEmpty();
+    }
+    m_posted.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadGenerator::step(size_t index, double scale, std::mt19937_64 & random) {
+
+    SimulatedPV & simulated = m_pvs[index];
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    if (simulated.kind == Kind::Enum) {
+        // Another state, with a probability per scan
+        if (simulated.states > 1 && uniform(random) < m_config.stateChange * scale) {
+            uint32_t offset = 1 + static_cast<uint32_t>(random() % (simulated.states - 1));
+            simulated.value = static_cast<double>((static_cast<uint32_t>(simulated.value) + offset) % simulated.states);
+        }
+    } else {
+        // Random walk, reflected at the limits of the range
+        double range = simulated.high - simulated.low;
+        double value = simulated.value + (2.0 * uniform(random) - 1.0) * m_config.walkStep * scale * range;
+        if (value > simulated.high)
+            value = simulated.high - (value - simulated.high);
+        if (value < simulated.low)
+            value = simulated.low + (simulated.low - value);
+        simulated.value = std::min(std::max(value, simulated.low), simulated.high);
+    }
+
+    post(simulated);
+}
+
+bool LoadGenerator::waitUntil(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+    return !m_stopCv.wait_until(lock, deadline, [this]() { return m_stopping; });
+}
+
+void LoadGenerator::scan(const ScanList & list, uint64_t seed) {
+
+    std::mt19937_64 random(seed);
+    auto next = std::chrono::steady_clock::now();
+    while (true) {
+        // A late scan is not repeated, as in the scan threads of an IOC
+        next += list.period;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now)
+            next = now;
+        if (!waitUntil(next))
+            return;
+
+        for (size_t index : list.pvs) {
+            std::lock_guard<std::mutex> lock(m_pvMutexes[index % MutexStripes]);
+            step(index, 1.0, random);
+        }
+    }
+}
+
+void LoadGenerator::burst(uint64_t seed) {
+
+    std::mt19937_64 random(seed);
+    size_t count = static_cast<size_t>(m_pvs.size() * m_config.burstFraction);
+    auto next = std::chrono::steady_clock::now();
+    while (true) {
+        next += m_config.burstInterval;
+        if (!waitUntil(next))
+            return;
+
+        for (size_t i = 0; i < count; ++i) {
+            size_t index = random() % m_pvs.size();
+            std::lock_guard<std::mutex> lock(m_pvMutexes[index % MutexStripes]);
+            for (size_t update = 0; update < m_config.burstUpdates; ++update)
+                step(index, 10.0, random);
+        }
+    }
+}
+
+void LoadGenerator::start() {
+
+    if (m_running)
+        return;
+    m_running = true;
+    m_server.start();
+
+    // A thread per scan period, every one with its own random generator
+    uint64_t seed = m_config.seed;
+    for (const auto & [period, list] : m_scanLists)
+        m_threads.emplace_back([this, &list = list, seed = seed++]() { scan(list, seed); });
+    if (m_config.burstInterval.count() > 0 && !m_pvs.empty())
+        m_threads.emplace_back([this, seed]() { burst(seed); });
+
+    LOG_INFO("Load generator: serving %zu PVs, %zu scan lists", m_pvs.size(), m_scanLists.size());
+}
+
+void LoadGenerator::stop() {
+
+    if (!m_running)
+        return;
+    m_running = false;
+
+    {
+    std::lock_guard<std::mutex> lock(m_stopMutex);
+    m_stopping = true;
+    }
+    m_stopCv.notify_all();
+    for (auto & thread : m_threads)
+        if (thread.joinable())
+            thread.join();
+    m_threads.clear();
+
+    for (auto & simulated : m_pvs)
+        simulated.pv.close();
+    m_server.stop();
+}
+
+bool LoadGenerator::loadConfig(const std::string & path, LoadConfig & config) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        try {
+            if (key == "multiplier")
+                config.multiplier = static_cast<size_t>(std::stoul(value));
+            else if (key == "rateScale")
+                config.rateScale = std::stod(value);
+            else if (key == "passivePeriod")
+                config.passivePeriod = std::chrono::milliseconds(std::stoul(value));
+            else if (key == "walkStep")
+                config.walkStep = std::stod(value);
+            else if (key == "stateChange")
+                config.stateChange = std::stod(value);
+            else if (key == "burstInterval")
+                config.burstInterval = std::chrono::milliseconds(std::stoul(value));
+            else if (key == "burstFraction")
+                config.burstFraction = std::stod(value);
+            else if (key == "burstUpdates")
+                config.burstUpdates = static_cast<size_t>(std::stoul(value));
+            else if (key == "seed")
+                config.seed = std::stoull(value);
+            else
+                LOG_WARNING("Load generator: unknown key %s in %s", key.c_str(), path.c_str());
+        } catch (const std::exception &) {
+            LOG_WARNING("Load generator: invalid value for %s in %s", key.c_str(), path.c_str());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#include "NodeBatch.h"
+
+NodeBatch::NodeBatch(MyNodeIOEventManager * pNodeManager) : m_pNodeManager(pNodeManager) {}
+
+NodeBatch::~NodeBatch() {
+    for (PendingObject & pending : m_objects)
+        pending.pObject->releaseReference();
+    for (PendingNode & pending : m_nodes)
+        pending.pNode->releaseReference();
+}
+
+void NodeBatch::reserve(size_t objects) {
+    m_objects.reserve(objects);
+}
+
+void NodeBatch::addObject(const UaString & objectName, int typeId, const UaNodeId & objectId, const UaNodeId & parentNodeId) {
+
+    // Resolved once per type, outside of the node lock
+    PendingObject pending;
+    pending.pTemplate = m_pNodeManager->getObjectTypeTemplate(typeId);
+    pending.pObject = new IocBasicObject(objectName, objectId, m_pNodeManager->defaultLocaleId(), m_pNodeManager, typeId);
+    pending.parentNodeId = parentNodeId;
+    m_objects.push_back(std::move(pending));
+}
+
+void NodeBatch::addNode(UaNode * pNode, const UaNodeId & parentNodeId, const UaNodeId & referenceTypeId) {
+    m_nodes.push_back(PendingNode{pNode, parentNodeId, referenceTypeId});
+}
+
+void NodeBatch::addReference(const UaNodeId & sourceNodeId, const UaNodeId & targetNodeId, const UaNodeId & referenceTypeId) {
+    m_references.push_back(PendingReference{sourceNodeId, targetNodeId, referenceTypeId});
+}
+
+UaStatus NodeBatch::commit() {
+    UaStatus result = m_pNodeManager->commitBatch(*this);
+
+    // The node manager owns the nodes now
+    m_objects.clear();
+    m_nodes.clear();
+    m_references.clear();
+    return result;
+}
@@ -0,0 +1,329 @@
+#include "OPCUAtoEPICSServer.h"
+#include <logger.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <pvxs/nt.h>
+#include <propertyStore.h>
+
+namespace {
+
+// 100 ns intervals between 1601-01-01 (OPC UA) and 1970-01-01 (EPICS Normative Types)
+const int64_t UnixEpochTicks = 116444736000000000LL;
+
+// EPICS alarm severities
+const int32_t SeverityNoAlarm = 0;
+const int32_t SeverityMinor = 1;
+const int32_t SeverityInvalid = 3;
+
+int64_t toTicks(const OpcUa_DateTime & dateTime) {
+    return static_cast<int64_t>((static_cast<uint64_t>(dateTime.dwHighDateTime) << 32) | dateTime.dwLowDateTime);
+}
+
+}
+
+OPCUAtoEPICSServer::OPCUAtoEPICSServer(MyNodeIOEventManager * pNodeManager)
+    : m_pNodeManager(pNodeManager) {
+
+    m_server = pvxs::server::Config::from_env().build();
+}
+
+OPCUAtoEPICSServer::~OPCUAtoEPICSServer() {
+    stop();
+}
+
+pvxs::Value OPCUAtoEPICSServer::createValue(UaVariable * pVariable, bool & isEnum) const {
+
+    UaDataValue dataValue = pVariable->value(NULL);
+    UaVariant variant(*dataValue.value());
+    pvxs::Value value;
+    isEnum = false;
+
+    switch (variant.type()) {
+
+        // Boolean -> NTEnum with the false and true states
+        case OpcUaType_Boolean: {
+            // The instances of the IOC variables share their property nodes, so they are read by name
+            pvxs::shared_array<std::string> choices(2);
+            UaVariant falseState, trueState;
+            UaLocalizedText text;
+            choices[0] = "False";
+            choices[1] = "True";
+            if (PropertyStore::readProperty(pVariable, "FalseState", falseState) && falseState.toLocalizedText(text) == OpcUa_Good)
+                choices[0] = text.toString().toUtf8();
+            if (PropertyStore::readProperty(pVariable, "TrueState", trueState) && trueState.toLocalizedText(text) == OpcUa_Good)
+                choices[1] = text.toString().toUtf8();
+            value = pvxs::nt::NTEnum{}.create();
+            value["value.choices"] = choices.freeze();
+            isEnum = true;
+            break;
+        }
+
+        // Int16 -> NTEnum with the enum strings
+        case OpcUaType_Int16: {
+            UaLocalizedTextArray enumStrings;
+            UaVariant property;
+            if (PropertyStore::readProperty(pVariable, "EnumStrings", property))
+                property.toLocalizedTextArray(enumStrings);
+
+            pvxs::shared_array<std::string> choices(enumStrings.length());
+            for (OpcUa_UInt32 i = 0; i < enumStrings.length(); ++i)
+                choices[i] = UaLocalizedText(enumStrings[i]).toString().toUtf8();
+
+            value = pvxs::nt::NTEnum{}.create();
+            value["value.choices"] = choices.freeze();
+            isEnum = true;
+            break;
+        }
+
+        // Double, Int32 and Int64 -> NTScalar with display metadata
+        case OpcUaType_Double:
+        case OpcUaType_Int32:
+        case OpcUaType_Int64: {
+            pvxs::TypeCode code = pvxs::TypeCode::Float64;
+            if (variant.type() == OpcUaType_Int32)
+                code = pvxs::TypeCode::Int32;
+            else if (variant.type() == OpcUaType_Int64)
+                code = pvxs::TypeCode::Int64;
+
+            value = pvxs::nt::NTScalar{code, true}.create();
+            UaVariant property;
+            if (PropertyStore::readProperty(pVariable, "EURange", property)) {
+                UaRange range(property);
+                value["display.limitLow"] = range.getLow();
+                value["display.limitHigh"] = range.getHigh();
+            }
+            if (PropertyStore::readProperty(pVariable, "EngineeringUnits", property)) {
+                UaEUInformation engineeringUnits(property);
+                value["display.units"] = std::string(engineeringUnits.getDisplayName().toString().toUtf8());
+            }
+            break;
+        }
+
+        default:
+            return pvxs::Value();
+    }
+
+    fillValue(value, dataValue, isEnum);
+    return value;
+}
+
+bool OPCUAtoEPICSServer::fillValue(pvxs::Value & value, const UaDataValue & dataValue, bool isEnum) {
+
+    UaVariant variant(*dataValue.value());
+    pvxs::Value field = isEnum ? value["value.index"] : value["value"];
+
+    switch (variant.type()) {
+        case OpcUaType_Boolean: {
+            OpcUa_Boolean boolValue;
+            variant.toBool(boolValue);
+            field = boolValue ? 1 : 0;
+            break;
+        }
+        case OpcUaType_Int16: {
+            OpcUa_Int16 intValue;
+            variant.toInt16(intValue);
+            field = intValue;
+            break;
+        }
+        case OpcUaType_Int32: {
+            OpcUa_Int32 intValue;
+            variant.toInt32(intValue);
+            field = intValue;
+            break;
+        }
+        case OpcUaType_Int64: {
+            OpcUa_Int64 intValue;
+            variant.toInt64(intValue);
+            field = static_cast<int64_t>(intValue);
+            break;
+        }
+        case OpcUaType_Double: {
+            OpcUa_Double doubleValue;
+            variant.toDouble(doubleValue);
+            field = doubleValue;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    // Source timestamp, or server timestamp if the source did not set it
+    int64_t ticks = toTicks(dataValue.sourceTimestamp());
+    if (ticks == 0)
+        ticks = toTicks(dataValue.serverTimestamp());
+    if (ticks == 0)
+        ticks = toTicks(UaDateTime::now());
+    ticks -= UnixEpochTicks;
+    value["timeStamp.secondsPastEpoch"] = ticks / 10000000;
+    value["timeStamp.nanoseconds"] = static_cast<int32_t>((ticks % 10000000) * 100);
+
+    OpcUa_StatusCode status = dataValue.statusCode();
+    if (OpcUa_IsGood(status)) {
+        value["alarm.severity"] = SeverityNoAlarm;
+        value["alarm.message"] = std::string();
+    } else {
+        value["alarm.severity"] = OpcUa_IsUncertain(status) ? SeverityMinor : SeverityInvalid;
+        value["alarm.message"] = std::string(UaStatus(status).toString().toUtf8());
+    }
+    return true;
+}
+
+bool OPCUAtoEPICSServer::convertPut(const pvxs::Value & value, const UaVariant & current, UaVariant & variant) {
+    try {
+        pvxs::Value index = value["value.index"];
+        pvxs::Value field = (index.valid() && index.isMarked()) ? index : value["value"];
+        if (!field.valid() || !field.isMarked())
+            return false;
+
+        switch (current.type()) {
+            case OpcUaType_Boolean:
+                variant.setBool(field.as<int32_t>() != 0);
+                break;
+            case OpcUaType_Int16:
+                variant.setInt16(field.as<int16_t>());
+                break;
+            case OpcUaType_Int32:
+                variant.setInt32(field.as<int32_t>());
+                break;
+            case OpcUaType_Int64:
+                variant.setInt64(field.as<int64_t>());
+                break;
+            case OpcUaType_Double:
+                variant.setDouble(field.as<double>());
+                break;
+            default:
+                return false;
+        }
+    } catch (const std::exception & e) {
+        LOG_ERROR("Error converting EPICS Value to OPCUA Variant: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool OPCUAtoEPICSServer::publish(const UaNodeId & nodeId, const std::string & pvName) {
+
+    UaNode * pNode = m_pNodeManager->findNode(nodeId);
+    if (pNode == NULL || pNode->nodeClass() != OpcUa_NodeClass_Variable) {
+        LOG_ERROR("Can not publish %s: it is not a variable", nodeId.toXmlString().toUtf8());
+        return false;
+    }
+    UaVariable * pVariable = static_cast<UaVariable*>(pNode);
+
+    PublishedPV published;
+    published.pvName = pvName;
+    published.nodeId = nodeId;
+
+    pvxs::Value initial = createValue(pVariable, published.isEnum);
+    if (!initial.valid()) {
+        LOG_ERROR("Can not publish %s: unsupported data type", nodeId.toXmlString().toUtf8());
+        return false;
+    }
+    published.prototype = initial.cloneEmpty();
+
+    // Puts from PVA clients are written to the node, whose value change posts the new value
+    if (pVariable->accessLevel() & Ua_AccessLevel_CurrentWrite) {
+        published.pv = pvxs::server::SharedPV::buildMailbox();
+        published.pv.onPut([this, nodeId](pvxs::server::SharedPV &, std::unique_ptr<pvxs::server::ExecOp> && op, pvxs::Value && value) {
+            UaNode * pNode = m_pNodeManager->findNode(nodeId);
+            if (pNode == NULL) {
+                op->error("Variable not found");
+                return;
+            }
+            UaVariant current(*static_cast<UaVariable*>(pNode)->value(NULL).value());
+            UaVariant variant;
+            if (!convertPut(value, current, variant)) {
+                op->error("Unsupported value");
+                return;
+            }
+            UaStatus ret = m_pNodeManager->updateVariable(nodeId, variant);
+            if (ret.isBad())
+                op->error(ret.toString().toUtf8());
+            else
+                op->reply();
+        });
+    } else {
+        published.pv = pvxs::server::SharedPV::buildReadonly();
+    }
+
+    {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (m_pvs.find(pNode) != m_pvs.end())
+        return false;
+    for (const auto & [pPublished, other] : m_pvs)
+        if (other.pvName == pvName)
+            return false;
+
+    published.pv.open(initial);
+    m_server.addPV(pvName, published.pv);
+    m_pvs.emplace(pNode, std::move(published));
+    }
+    return true;
+}
+
+size_t OPCUAtoEPICSServer::publishFromFile(const std::string & path) {
+
+    std::ifstream file(path);
+    size_t published = 0;
+    std::string line;
+
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string nodeName, pvName;
+        if (!(fields >> nodeName) || nodeName[0] == '#')
+            continue;
+        if (!(fields >> pvName)) {
+            pvName = nodeName;
+            std::replace(pvName.begin(), pvName.end(), '.', ':');
+        }
+        if (publish(UaNodeId(nodeName.c_str(), m_pNodeManager->getNameSpaceIndex()), pvName))
+            ++published;
+    }
+    return published;
+}
+
+void OPCUAtoEPICSServer::start() {
+    if (m_running.exchange(true))
+        return;
+    m_server.start();
+    LOG_INFO("Serving %zu OPC UA variables as PVA PVs", size());
+}
+
+void OPCUAtoEPICSServer::stop() {
+    if (!m_running.exchange(false))
+        return;
+
+    {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    for (auto & [pNode, published] : m_pvs)
+        published.pv.close();
+    }
+    m_server.stop();
+}
+
+size_t OPCUAtoEPICSServer::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_pvs.size();
+}
+
+void OPCUAtoEPICSServer::valueChanged(const UaNode * pNode, const UaDataValue & dataValue) {
+
+    pvxs::server::SharedPV pv;
+    pvxs::Value update;
+    {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto it = m_pvs.find(pNode);
+    if (it == m_pvs.end())
+        return;
+
+    update = it->second.prototype.cloneEmpty();
+    if (!fillValue(update, dataValue, it->second.isEnum))
+        return;
+    pv = it->second.pv;
+    }
+
+    // Post outside the lock, the subscribers are notified from here
+    if (pv.isOpen())
+        pv.post(update);
+}
@@ -0,0 +1,261 @@
+#include "PubSubPublisher.h"
+#include <logger.h>
+#include <typeMap.h>
+#include <arpa/inet.h>
+#include <fstream>
+#include <netinet/in.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// 100 ns intervals between 1601-01-01 (OPC UA DateTime) and 1970-01-01
+const int64_t UnixEpochTicks = 116444736000000000LL;
+
+int64_t nowTicks() {
+    auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count() / 100 + UnixEpochTicks;
+}
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+// UTF-8 bytes of a string of a variant, without copying them
+std::string_view stringView(const OpcUa_String * pString) {
+    const char * pData = OpcUa_String_GetRawString(pString);
+    return pData == nullptr ? std::string_view() : std::string_view(pData, OpcUa_String_StrSize(pString));
+}
+
+}
+
+PubSubPublisher::PubSubPublisher(EPICStoOPCUAGateway * pGateway, const PubSubConfig & config)
+    : m_pGateway(pGateway), m_config(config) {
+
+    if (m_config.keyFrameCount == 0)
+        m_config.keyFrameCount = 1;
+}
+
+PubSubPublisher::~PubSubPublisher() {
+    stop();
+}
+
+bool PubSubPublisher::openSocket() {
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket < 0)
+        return false;
+
+    unsigned char ttl = static_cast<unsigned char>(m_config.ttl);
+    unsigned char loop = 1;         // Subscribers in this host receive the messages too
+    bool ok = setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == 0
+        && setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == 0;
+
+    if (ok && !m_config.interfaceAddress.empty()) {
+        in_addr interface;
+        ok = inet_pton(AF_INET, m_config.interfaceAddress.c_str(), &interface) == 1
+            && setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) == 0;
+    }
+
+    sockaddr_in destination{};
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(m_config.port);
+    ok = ok && inet_pton(AF_INET, m_config.address.c_str(), &destination.sin_addr) == 1;
+
+    // Connected UDP socket, every send goes to the group
+    ok = ok && connect(m_socket, reinterpret_cast<sockaddr*>(&destination), sizeof(destination)) == 0;
+
+    if (!ok) {
+        close(m_socket);
+        m_socket = -1;
+    }
+    return ok;
+}
+
+bool PubSubPublisher::start() {
+
+    if (m_thread.joinable())
+        return true;
+
+    m_pvIds.clear();
+    for (const std::string & pvName : m_config.pvNames) {
+        uint32_t pvId = m_pGateway->pvId(pvName);
+        if (pvId == PVNameTable::InvalidId)
+            LOG_WARNING("PubSub: %s is not mapped by the gateway", pvName.c_str());
+        m_pvIds.push_back(pvId);
+    }
+    m_sentVersions.assign(m_pvIds.size(), 0);
+
+    if (!openSocket()) {
+        LOG_ERROR("PubSub: error opening the socket for %s:%u", m_config.address.c_str(), static_cast<unsigned>(m_config.port));
+        return false;
+    }
+
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = false;
+    }
+    m_thread = std::thread([this](){ run(); });
+
+    LOG_INFO("PubSub: publishing %zu PVs to opc.udp://%s:%u every %lld ms", m_pvIds.size(), m_config.address.c_str(),
+             static_cast<unsigned>(m_config.port), static_cast<long long>(m_config.publishingInterval.count()));
+    return true;
+}
+
+void PubSubPublisher::stop() {
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    }
+    m_cv.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_socket >= 0) {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
+
+void PubSubPublisher::run() {
+
+    auto next = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_stopping) {
+        lock.unlock();
+        publish();
+        lock.lock();
+
+        // Fixed rate: a slow cycle does not shift the following ones
+        next += m_config.publishingInterval;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now)
+            next = now;
+        m_cv.wait_until(lock, next, [this]() { return m_stopping; });
+    }
+}
+
+void PubSubPublisher::publish() {
+
+    m_pGateway->readValues(m_pvIds, m_values);
+
+    bool keyFrame = (m_sequenceNumber % m_config.keyFrameCount) == 0;
+    size_t changed = 0;
+    for (size_t i = 0; i < m_values.size(); ++i)
+        if (m_values[i].version != m_sentVersions[i])
+            ++changed;
+
+    UadpEncoder::MessageType type = UadpEncoder::MessageType::KeyFrame;
+    if (!keyFrame)
+        type = (changed > 0) ? UadpEncoder::MessageType::DeltaFrame : UadpEncoder::MessageType::KeepAlive;
+
+    m_encoder.beginNetworkMessage(m_config.publisherId, m_config.writerGroupId, m_config.majorVersion,
+                                  m_sequenceNumber, m_config.dataSetWriterId, nowTicks());
+    m_encoder.beginDataSetMessage(type, m_sequenceNumber, m_config.majorVersion, m_config.minorVersion);
+
+    for (size_t i = 0; i < m_values.size() && type != UadpEncoder::MessageType::KeepAlive; ++i) {
+        if (type == UadpEncoder::MessageType::DeltaFrame) {
+            if (m_values[i].version == m_sentVersions[i])
+                continue;
+            m_encoder.fieldIndex(static_cast<uint16_t>(i));
+        }
+        writeField(m_values[i]);
+        m_sentVersions[i] = m_values[i].version;
+    }
+    m_encoder.endDataSetMessage();
+
+    ++m_sequenceNumber;
+    if (send(m_socket, m_encoder.data(), m_encoder.size(), 0) < 0)
+        LOG_ERROR("PubSub: error sending a message of %zu bytes", m_encoder.size());
+}
+
+void PubSubPublisher::writeField(const CachedValue & cached) {
+
+    const OpcUa_Variant * pVariant = cached.value;
+    const TypeMap::Entry * pEntry = TypeMap::find(static_cast<OpcUa_BuiltInType>(pVariant->Datatype));
+    if (pEntry == nullptr || pVariant->ArrayType == OpcUa_VariantArrayType_Matrix) {
+        // No value yet, or a PV not mapped by the gateway
+        m_encoder.writeEmpty(OpcUa_IsGood(cached.statusCode) ? OpcUa_BadNoData : cached.statusCode);
+        return;
+    }
+
+    uint8_t builtInType = static_cast<uint8_t>(pEntry->builtInType);
+    bool array = pVariant->ArrayType == OpcUa_VariantArrayType_Array;
+    uint32_t count = array && pVariant->Value.Array.Length > 0 ? static_cast<uint32_t>(pVariant->Value.Array.Length) : 0;
+
+    if (pEntry->builtInType != OpcUaType_String) {
+        // Booleans and numbers are encoded as they are laid out in the variant
+        if (array)
+            m_encoder.writeArray(builtInType, pVariant->Value.Array.Value.Array, count, cached.statusCode, cached.sourceTimestamp);
+        else
+            m_encoder.writeScalar(builtInType, &pVariant->Value, cached.statusCode, cached.sourceTimestamp);
+        return;
+    }
+
+    if (!array) {
+        m_encoder.writeString(stringView(&pVariant->Value.String), cached.statusCode, cached.sourceTimestamp);
+        return;
+    }
+
+    m_strings.clear();
+    for (uint32_t i = 0; i < count; ++i)
+        m_strings.push_back(stringView(&pVariant->Value.Array.Value.StringArray[i]));
+    m_encoder.writeStringArray(m_strings.data(), count, cached.statusCode, cached.sourceTimestamp);
+}
+
+bool PubSubPublisher::loadConfig(const std::string & path, PubSubConfig & config) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        try {
+            if (key == "address")
+                config.address = value;
+            else if (key == "port")
+                config.port = static_cast<uint16_t>(std::stoul(value));
+            else if (key == "interface")
+                config.interfaceAddress = value;
+            else if (key == "ttl")
+                config.ttl = std::stoi(value);
+            else if (key == "publisherId")
+                config.publisherId = static_cast<uint16_t>(std::stoul(value));
+            else if (key == "writerGroupId")
+                config.writerGroupId = static_cast<uint16_t>(std::stoul(value));
+            else if (key == "dataSetWriterId")
+                config.dataSetWriterId = static_cast<uint16_t>(std::stoul(value));
+            else if (key == "majorVersion")
+                config.majorVersion = static_cast<uint32_t>(std::stoul(value));
+            else if (key == "minorVersion")
+                config.minorVersion = static_cast<uint32_t>(std::stoul(value));
+            else if (key == "interval")
+                config.publishingInterval = std::chrono::milliseconds(std::stoul(value));
+            else if (key == "keyFrameCount")
+                config.keyFrameCount = static_cast<unsigned>(std::stoul(value));
+            else if (key == "pv")
+                config.pvNames.push_back(value);
+            else
+                LOG_WARNING("PubSub: unknown key %s in %s", key.c_str(), path.c_str());
+        } catch (const std::exception &) {
+            LOG_WARNING("PubSub: invalid value for %s in %s", key.c_str(), path.c_str());
+        }
+    }
+
+    return !config.pvNames.empty();
+}
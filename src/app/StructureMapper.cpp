@@ -0,0 +1,571 @@
+#include "StructureMapper.h"
+#include <arrayKernels.h>
+#include <logger.h>
+#include <typeMap.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <uagenericstructurevalue.h>
+#include <uaarraytemplates.h>
+
+using pvxs::ArrayType;
+using pvxs::TypeCode;
+using pvxs::Value;
+using pvxs::shared_array;
+
+namespace {
+
+const char * const NTTableId = "epics:nt/NTTable:1.0";
+const char * const NTNDArrayId = "epics:nt/NTNDArray:1.0";
+const char * const NTScalarArrayId = "epics:nt/NTScalarArray:1.0";
+
+// OPC UA DataType of a scalar TypeCode, or a null NodeId if it is not supported
+UaNodeId dataTypeOf(TypeCode::code_t code) {
+    const TypeMap::Entry * pEntry = TypeMap::find(code);
+    return pEntry != nullptr ? UaNodeId(pEntry->dataTypeId) : UaNodeId();
+}
+
+// Name of a generated DataType from a type id: "epics:nt/NTHistogram:1.0" -> "NTHistogram"
+std::string typeNameOf(const std::string & id) {
+    size_t first = id.rfind('/');
+    first = (first == std::string::npos) ? 0 : first + 1;
+    std::string name;
+    for (size_t i = first; i < id.size() && id[i] != ':'; ++i)
+        name += isalnum(static_cast<unsigned char>(id[i])) ? id[i] : '_';
+    return name.empty() ? std::string("Struct") : name;
+}
+
+UaStructureField makeField(const std::string & name, const UaNodeId & dataTypeId, OpcUa_Int32 valueRank) {
+    UaStructureField field;
+    field.setName(name.c_str());
+    field.setDataTypeId(dataTypeId);
+    field.setValueRank(valueRank);
+    return field;
+}
+
+// Copy elements of an array, converted to the element type of the OPC UA array, with the vectorized kernels
+template<typename UaArray>
+void copyArray(const void * pData, ArrayType from, size_t count, ArrayType to, UaArray & out) {
+    out.create(static_cast<OpcUa_UInt32>(count));
+    if (count > 0)
+        ArrayKernels::convert(pData, from, &out[0], to, count);
+}
+
+// Convert count elements of an array of numbers or booleans to an OPC UA array of another element type
+bool elementsToVariant(const void * pData, ArrayType from, size_t count, ArrayType to, UaVariant & variant) {
+    // An empty array may not have a type, it converts to any type
+    if (count > 0 && !ArrayKernels::canConvert(from, to))
+        return false;
+    switch (to) {
+        case ArrayType::Bool:    { UaBooleanArray a; copyArray(pData, from, count, to, a); variant.setBoolArray(a, OpcUa_True); break; }
+        case ArrayType::Int8:    { UaSByteArray a;   copyArray(pData, from, count, to, a); variant.setSByteArray(a, OpcUa_True); break; }
+        case ArrayType::UInt8:   { UaByteArray a;    copyArray(pData, from, count, to, a); variant.setByteArray(a, OpcUa_True); break; }
+        case ArrayType::Int16:   { UaInt16Array a;   copyArray(pData, from, count, to, a); variant.setInt16Array(a, OpcUa_True); break; }
+        case ArrayType::UInt16:  { UaUInt16Array a;  copyArray(pData, from, count, to, a); variant.setUInt16Array(a, OpcUa_True); break; }
+        case ArrayType::Int32:   { UaInt32Array a;   copyArray(pData, from, count, to, a); variant.setInt32Array(a, OpcUa_True); break; }
+        case ArrayType::UInt32:  { UaUInt32Array a;  copyArray(pData, from, count, to, a); variant.setUInt32Array(a, OpcUa_True); break; }
+        case ArrayType::Int64:   { UaInt64Array a;   copyArray(pData, from, count, to, a); variant.setInt64Array(a, OpcUa_True); break; }
+        case ArrayType::UInt64:  { UaUInt64Array a;  copyArray(pData, from, count, to, a); variant.setUInt64Array(a, OpcUa_True); break; }
+        case ArrayType::Float32: { UaFloatArray a;   copyArray(pData, from, count, to, a); variant.setFloatArray(a, OpcUa_True); break; }
+        case ArrayType::Float64: { UaDoubleArray a;  copyArray(pData, from, count, to, a); variant.setDoubleArray(a, OpcUa_True); break; }
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Element type and elements of an OPC UA array of numbers or booleans, without copying them
+bool variantElements(const UaVariant & variant, ArrayType & type, const void *& pData, size_t & count) {
+    const OpcUa_Variant * pVariant = variant;
+    if (pVariant->ArrayType != OpcUa_VariantArrayType_Array)
+        return false;
+    switch (pVariant->Datatype) {
+        case OpcUaType_Boolean: type = ArrayType::Bool; break;
+        case OpcUaType_SByte:   type = ArrayType::Int8; break;
+        case OpcUaType_Byte:    type = ArrayType::UInt8; break;
+        case OpcUaType_Int16:   type = ArrayType::Int16; break;
+        case OpcUaType_UInt16:  type = ArrayType::UInt16; break;
+        case OpcUaType_Int32:   type = ArrayType::Int32; break;
+        case OpcUaType_UInt32:  type = ArrayType::UInt32; break;
+        case OpcUaType_Int64:   type = ArrayType::Int64; break;
+        case OpcUaType_UInt64:  type = ArrayType::UInt64; break;
+        case OpcUaType_Float:   type = ArrayType::Float32; break;
+        case OpcUaType_Double:  type = ArrayType::Float64; break;
+        default:                return false;
+    }
+    count = pVariant->Value.Array.Length > 0 ? static_cast<size_t>(pVariant->Value.Array.Length) : 0;
+    pData = pVariant->Value.Array.Value.Array;
+    return true;
+}
+
+// Convert an array of scalars to an OPC UA array of another element type
+bool arrayToVariant(const shared_array<const void> & array, ArrayType to, UaVariant & variant) {
+    if (to != ArrayType::String)
+        return elementsToVariant(array.data(), array.original_type(), array.size(), to, variant);
+
+    if (!array.empty() && array.original_type() != ArrayType::String)
+        return false;
+    auto typed = pvxs::shared_array_static_cast<const std::string>(array);
+    UaStringArray a;
+    a.create(static_cast<OpcUa_UInt32>(typed.size()));
+    for (size_t i = 0; i < typed.size(); ++i)
+        UaString(typed[i].c_str()).copyTo(&a[i]);
+    variant.setStringArray(a, OpcUa_True);
+    return true;
+}
+
+// Convert an array of scalars to an OPC UA array of the same element type
+bool arrayToVariant(const shared_array<const void> & array, UaVariant & variant) {
+    return arrayToVariant(array, array.original_type(), variant);
+}
+
+// Convert one element of an array of scalars to an OPC UA scalar
+bool elementToVariant(const shared_array<const void> & array, size_t index, UaVariant & variant) {
+    switch (array.original_type()) {
+        case ArrayType::Bool:    variant.setBool(pvxs::shared_array_static_cast<const bool>(array)[index]); break;
+        case ArrayType::Int8:    variant.setSByte(pvxs::shared_array_static_cast<const int8_t>(array)[index]); break;
+        case ArrayType::UInt8:   variant.setByte(pvxs::shared_array_static_cast<const uint8_t>(array)[index]); break;
+        case ArrayType::Int16:   variant.setInt16(pvxs::shared_array_static_cast<const int16_t>(array)[index]); break;
+        case ArrayType::UInt16:  variant.setUInt16(pvxs::shared_array_static_cast<const uint16_t>(array)[index]); break;
+        case ArrayType::Int32:   variant.setInt32(pvxs::shared_array_static_cast<const int32_t>(array)[index]); break;
+        case ArrayType::UInt32:  variant.setUInt32(pvxs::shared_array_static_cast<const uint32_t>(array)[index]); break;
+        case ArrayType::Int64:   variant.setInt64(pvxs::shared_array_static_cast<const int64_t>(array)[index]); break;
+        case ArrayType::UInt64:  variant.setUInt64(pvxs::shared_array_static_cast<const uint64_t>(array)[index]); break;
+        case ArrayType::Float32: variant.setFloat(pvxs::shared_array_static_cast<const float>(array)[index]); break;
+        case ArrayType::Float64: variant.setDouble(pvxs::shared_array_static_cast<const double>(array)[index]); break;
+        case ArrayType::String:
+            variant.setString(UaString(pvxs::shared_array_static_cast<const std::string>(array)[index].c_str()));
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+}
+
+StructureMapper::StructureMapper(MyNodeIOEventManager * pNodeManager)
+    : m_pNodeManager(pNodeManager) {
+
+    OpcUa_UInt16 ns = m_pNodeManager->getNameSpaceIndex();
+    m_ndArrayDefinition.setName("NDArrayImage");
+    m_ndArrayDefinition.setDataTypeId(UaNodeId("DataType.NDArrayImage", ns));
+    m_ndArrayDefinition.setBinaryEncodingId(UaNodeId("DataType.NDArrayImage.Binary", ns));
+    m_ndArrayDefinition.addChild(makeField("uniqueId", UaNodeId(OpcUaId_Int32), OpcUa_ValueRanks_Scalar));
+    m_ndArrayDefinition.addChild(makeField("dimensions", UaNodeId(OpcUaId_UInt32), OpcUa_ValueRanks_OneDimension));
+    m_ndArrayDefinition.addChild(makeField("dataType", UaNodeId(OpcUaId_String), OpcUa_ValueRanks_Scalar));
+    m_ndArrayDefinition.addChild(makeField("data", UaNodeId(OpcUaId_ByteString), OpcUa_ValueRanks_Scalar));
+    m_pNodeManager->registerStructure(m_ndArrayDefinition);
+}
+
+bool StructureMapper::isStructured(const Value & value) {
+    if (value.type() != TypeCode::Struct)
+        return false;
+    std::string id = value.id();
+    return id != "epics:nt/NTScalar:1.0" && id != "epics:nt/NTEnum:1.0";
+}
+
+bool StructureMapper::fieldToVariant(const Value & value, UaVariant & variant) {
+
+    TypeCode type = value.type();
+    if (type.isarray())
+        return type.kind() != pvxs::Kind::Compound && arrayToVariant(value.as<shared_array<const void>>(), variant);
+
+    const TypeMap::Entry * pEntry = TypeMap::find(type.code);
+    return pEntry != nullptr && pEntry->toVariant(value, variant);
+}
+
+std::string StructureMapper::signature(const Value & value) {
+    std::ostringstream sig;
+    sig << value.id() << '{';
+    for (auto member : value.ichildren()) {
+        sig << value.nameOf(member) << ':' << static_cast<int>(member.type().code);
+        if (member.type() == TypeCode::Struct)
+            sig << signature(member);
+        sig << ';';
+    }
+    sig << '}';
+    return sig.str();
+}
+
+std::shared_ptr<const StructureMapper::StructEncoder> StructureMapper::compile(const Value & value, const std::string & name, bool row) {
+
+    // A row of a table and a structure with the same members are different DataTypes
+    std::string sig = (row ? "row:" : "") + signature(value);
+    auto it = m_encoders.find(sig);
+    if (it != m_encoders.end())
+        return it->second;
+
+    // Name of the DataType: the given name and a hash of the signature, so two types never share a DataType
+    std::ostringstream typeName;
+    typeName << name << '_' << std::hex << (std::hash<std::string>()(sig) & 0xFFFFFFFF);
+    OpcUa_UInt16 ns = m_pNodeManager->getNameSpaceIndex();
+
+    auto encoder = std::make_shared<StructEncoder>();
+    encoder->definition.setName(typeName.str().c_str());
+    encoder->definition.setDataTypeId(UaNodeId(("DataType." + typeName.str()).c_str(), ns));
+    encoder->definition.setBinaryEncodingId(UaNodeId(("DataType." + typeName.str() + ".Binary").c_str(), ns));
+
+    size_t position = 0;
+    for (auto member : value.ichildren()) {
+        std::string memberName = value.nameOf(member);
+        TypeCode type = member.type();
+
+        if (row && !type.isarray()) {
+            // Only the columns are in the rows
+            ++position;
+            continue;
+        }
+
+        if (type == TypeCode::Struct) {
+            auto nested = compile(member, memberName);
+            encoder->definition.addChild(makeField(memberName, nested->definition.dataTypeId(), OpcUa_ValueRanks_Scalar));
+            encoder->members.push_back(position);
+            encoder->nested.push_back(nested);
+        } else {
+            UaNodeId dataTypeId = dataTypeOf(type.isarray() ? type.scalarOf().code : type.code);
+            if (!dataTypeId.isNull()) {
+                encoder->definition.addChild(makeField(memberName, dataTypeId,
+                                             type.isarray() && !row ? OpcUa_ValueRanks_OneDimension : OpcUa_ValueRanks_Scalar));
+                encoder->members.push_back(position);
+                encoder->nested.push_back(nullptr);
+            }
+        }
+        ++position;
+    }
+
+    m_pNodeManager->registerStructure(encoder->definition);
+    m_encoders.emplace(sig, encoder);
+    return encoder;
+}
+
+std::shared_ptr<const StructureMapper::PVEncoder> StructureMapper::encoderOf(uint32_t pvId, const UaNodeId & nodeId, const Value & value) {
+
+    std::string id = value.id();
+    size_t memberCount = value.nmembers();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (pvId < m_pvEncoders.size()) {
+        const auto & current = m_pvEncoders[pvId];
+        if (current && current->id == id && current->memberCount == memberCount)
+            return current;
+    } else {
+        m_pvEncoders.resize(pvId + 1);
+    }
+
+    auto pvEncoder = std::make_shared<PVEncoder>();
+    pvEncoder->id = id;
+    pvEncoder->memberCount = memberCount;
+    UaNodeId dataTypeId;
+    OpcUa_Int32 valueRank = OpcUa_ValueRanks_Scalar;
+
+    if (id == NTTableId) {
+        Value columns = value["value"];
+        if (!columns.valid() || columns.type() != TypeCode::Struct)
+            return nullptr;
+        pvEncoder->kind = Kind::Table;
+        pvEncoder->encoder = compile(columns, "TableRow", true);
+        dataTypeId = pvEncoder->encoder->definition.dataTypeId();
+        valueRank = OpcUa_ValueRanks_OneDimension;
+    } else if (id == NTNDArrayId) {
+        pvEncoder->kind = Kind::NDArray;
+        dataTypeId = m_ndArrayDefinition.dataTypeId();
+    } else if (id == NTScalarArrayId && value["value"].type().isarray()
+               && value["value"].type().kind() != pvxs::Kind::String && value["value"].type().kind() != pvxs::Kind::Compound) {
+        // The string arrays keep the generic structure, only the numbers go through the kernels
+        TypeCode type = value["value"].type();
+        pvEncoder->kind = Kind::ScalarArray;
+        pvEncoder->elementType = static_cast<ArrayType>(type.code);  // Same values as the array TypeCodes
+        dataTypeId = dataTypeOf(type.scalarOf().code);
+        valueRank = OpcUa_ValueRanks_OneDimension;
+    } else {
+        pvEncoder->kind = Kind::Struct;
+        pvEncoder->encoder = compile(value, typeNameOf(id));
+        dataTypeId = pvEncoder->encoder->definition.dataTypeId();
+    }
+
+    // The static address space only has the scalar variables of the IOC types
+    UaStatus ret = m_pNodeManager->createStructureVariable(nodeId, nodeId.toString(), dataTypeId, valueRank,
+                                                           pvEncoder->kind == Kind::ScalarArray);
+    if (ret.isBad())
+        Logger::instance().logPV(LogLevel::Error, pvId, "Error creating the variable %s for a structured PV", nodeId.toString().toUtf8());
+
+    m_pvEncoders[pvId] = pvEncoder;
+    return pvEncoder;
+}
+
+void StructureMapper::encodeStruct(const StructEncoder & encoder, const Value & value, UaVariant & variant) {
+
+    UaGenericStructureValue structure(encoder.definition);
+    size_t position = 0, field = 0;
+
+    for (auto member : value.ichildren()) {
+        if (field == encoder.members.size())
+            break;
+        if (position++ != encoder.members[field])
+            continue;
+
+        UaVariant fieldValue;
+        if (encoder.nested[field])
+            encodeStruct(*encoder.nested[field], member, fieldValue);
+        else
+            fieldToVariant(member, fieldValue);
+        structure.setField(static_cast<int>(field), fieldValue);
+        ++field;
+    }
+
+    UaExtensionObject extensionObject;
+    structure.toExtensionObject(extensionObject);
+    variant.setExtensionObject(extensionObject, OpcUa_True);
+}
+
+void StructureMapper::encodeTable(const StructEncoder & encoder, const Value & value, UaVariant & variant) {
+
+    // Columns of the rows, and number of rows: the length of the shortest column
+    std::vector<shared_array<const void>> columns;
+    size_t rows = SIZE_MAX;
+    size_t position = 0, field = 0;
+    for (auto member : value["value"].ichildren()) {
+        if (field == encoder.members.size())
+            break;
+        if (position++ != encoder.members[field])
+            continue;
+        columns.push_back(member.as<shared_array<const void>>());
+        rows = std::min(rows, columns.back().size());
+        ++field;
+    }
+    if (columns.empty())
+        rows = 0;
+
+    UaExtensionObjectArray array;
+    array.create(static_cast<OpcUa_UInt32>(rows));
+    for (size_t row = 0; row < rows; ++row) {
+        UaGenericStructureValue structure(encoder.definition);
+        for (size_t column = 0; column < columns.size(); ++column) {
+            UaVariant fieldValue;
+            elementToVariant(columns[column], row, fieldValue);
+            structure.setField(static_cast<int>(column), fieldValue);
+        }
+        UaExtensionObject extensionObject;
+        structure.toExtensionObject(extensionObject);
+        extensionObject.copyTo(&array[static_cast<OpcUa_UInt32>(row)]);
+    }
+    variant.setExtensionObjectArray(array, OpcUa_True);
+}
+
+void StructureMapper::encodeNDArray(const Value & value, UaVariant & variant) const {
+
+    UaGenericStructureValue structure(m_ndArrayDefinition);
+
+    UaVariant uniqueId;
+    uniqueId.setInt32(value["uniqueId"].as<int32_t>());
+    structure.setField(0, uniqueId);
+
+    // Size of every dimension, the first one is the fastest varying
+    auto dimension = value["dimension"].as<shared_array<const Value>>();
+    UaUInt32Array sizes;
+    sizes.create(static_cast<OpcUa_UInt32>(dimension.size()));
+    for (size_t i = 0; i < dimension.size(); ++i)
+        sizes[static_cast<OpcUa_UInt32>(i)] = dimension[i]["size"].as<uint32_t>();
+    UaVariant dimensions;
+    dimensions.setUInt32Array(sizes, OpcUa_True);
+    structure.setField(1, dimensions);
+
+    // The value is a union of arrays, the selected member gives the data type (e.g. "ushortValue")
+    Value union_ = value["value"];
+    Value selected = union_["->"];
+    UaVariant dataType, data;
+    if (selected.valid()) {
+        dataType.setString(UaString(union_.nameOf(selected).c_str()));
+        auto array = selected.as<shared_array<const void>>();
+        UaByteString bytes(static_cast<OpcUa_Int32>(array.size() * pvxs::elementSize(array.original_type())),
+                           reinterpret_cast<OpcUa_Byte*>(const_cast<void*>(array.data())));
+        data.setByteString(bytes, OpcUa_True);
+    }
+    structure.setField(2, dataType);
+    structure.setField(3, data);
+
+    UaExtensionObject extensionObject;
+    structure.toExtensionObject(extensionObject);
+    variant.setExtensionObject(extensionObject, OpcUa_True);
+}
+
+StructureMapper::ArrayState & StructureMapper::arrayStateOf(uint32_t pvId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return arrayStateLocked(pvId);
+}
+
+StructureMapper::ArrayState & StructureMapper::arrayStateLocked(uint32_t pvId) {
+    if (pvId >= m_arrayStates.size())
+        m_arrayStates.resize(pvId + 1);
+    if (!m_arrayStates[pvId])
+        m_arrayStates[pvId].reset(new ArrayState());
+    return *m_arrayStates[pvId];
+}
+
+StructureMapper::ArrayState * StructureMapper::scalarArrayOf(uint32_t pvId, ArrayType & elementType) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (pvId >= m_pvEncoders.size() || !m_pvEncoders[pvId] || m_pvEncoders[pvId]->kind != Kind::ScalarArray)
+        return nullptr;
+    elementType = m_pvEncoders[pvId]->elementType;
+    return &arrayStateLocked(pvId);
+}
+
+OpcUa_StatusCode StructureMapper::encodeScalarArray(uint32_t pvId, const PVEncoder & encoder, const Value & value, UaVariant & variant) {
+
+    auto array = value["value"].as<shared_array<const void>>();
+    ArrayState & state = arrayStateOf(pvId);
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    // Only an array of the same type and size can be compared, an equal one is not forwarded.
+    // The range that changed is not needed: the SDK filters the IndexRange of every monitored item itself.
+    size_t first = 0, end = array.size();
+    if (state.forwarded && state.last.original_type() == array.original_type() && state.last.size() == array.size()) {
+        if (!ArrayKernels::dirtyRange(state.last.data(), array.data(), array.size(),
+                                      pvxs::elementSize(array.original_type()), first, end))
+            return OpcUa_GoodNoData;
+    }
+
+    if (!arrayToVariant(array, encoder.elementType, variant))
+        return OpcUa_BadTypeMismatch;
+
+    state.last = array;
+    state.forwarded = true;
+    return OpcUa_Good;
+}
+
+bool StructureMapper::isScalarArray(uint32_t pvId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return pvId < m_pvEncoders.size() && m_pvEncoders[pvId] && m_pvEncoders[pvId]->kind == Kind::ScalarArray;
+}
+
+OpcUa_StatusCode StructureMapper::readRange(uint32_t pvId, const IndexRange & range, UaVariant & variant) {
+
+    ArrayType elementType;
+    ArrayState * pState = scalarArrayOf(pvId, elementType);
+    if (pState == nullptr)
+        return OpcUa_BadNotSupported;
+
+    std::lock_guard<std::mutex> lock(pState->mutex);
+    if (!pState->forwarded)
+        return OpcUa_BadWaitingForInitialData;
+
+    // Only the elements of the range are converted, straight from the PVXS buffer
+    size_t size = pState->last.size();
+    size_t first = range.first, end = std::min(range.end, size);
+    if (!range.isAll() && first >= size)
+        return OpcUa_BadIndexRangeNoData;
+    ArrayType type = pState->last.original_type();
+    const uint8_t * pData = static_cast<const uint8_t*>(pState->last.data());
+    if (pData != nullptr)
+        pData += first * pvxs::elementSize(type);
+    if (!elementsToVariant(pData, type, end - first, elementType, variant))
+        return OpcUa_BadTypeMismatch;
+    return OpcUa_Good;
+}
+
+OpcUa_StatusCode StructureMapper::checkWrite(const ArrayState & state, ArrayType elementType, const IndexRange & range,
+                                             ArrayType from, size_t count, ArrayType & to) {
+
+    // The put has the type of the array of the IOC, the type of the variable until one is received
+    to = (state.forwarded && !state.last.empty()) ? state.last.original_type() : elementType;
+    if (count > 0 && !ArrayKernels::canConvert(from, to))
+        return OpcUa_BadTypeMismatch;
+    if (range.isAll())
+        return OpcUa_Good;
+
+    if (!state.forwarded)
+        return OpcUa_BadWaitingForInitialData;
+    size_t size = state.last.size();
+    if (range.first >= size || range.end > size)
+        return OpcUa_BadIndexRangeNoData;
+    if (count != range.end - range.first)
+        return OpcUa_BadIndexRangeInvalid;
+    return OpcUa_Good;
+}
+
+OpcUa_StatusCode StructureMapper::checkRange(uint32_t pvId, const IndexRange & range, const UaVariant & value) {
+
+    ArrayType elementType;
+    ArrayState * pState = scalarArrayOf(pvId, elementType);
+    if (pState == nullptr)
+        return OpcUa_BadNotSupported;
+
+    ArrayType from, to;
+    const void * pData;
+    size_t count;
+    if (!variantElements(value, from, pData, count))
+        return OpcUa_BadTypeMismatch;
+
+    std::lock_guard<std::mutex> lock(pState->mutex);
+    return checkWrite(*pState, elementType, range, from, count, to);
+}
+
+OpcUa_StatusCode StructureMapper::mergeRange(uint32_t pvId, const IndexRange & range, const UaVariant & value,
+                                             shared_array<const void> & array) {
+
+    ArrayType elementType;
+    ArrayState * pState = scalarArrayOf(pvId, elementType);
+    if (pState == nullptr)
+        return OpcUa_BadNotSupported;
+
+    ArrayType from, to;
+    const void * pData;
+    size_t count;
+    if (!variantElements(value, from, pData, count))
+        return OpcUa_BadTypeMismatch;
+
+    // Checked again: the array can have changed since the write was queued
+    std::lock_guard<std::mutex> lock(pState->mutex);
+    OpcUa_StatusCode status = checkWrite(*pState, elementType, range, from, count, to);
+    if (OpcUa_IsBad(status))
+        return status;
+    size_t elementSize = pvxs::elementSize(to);
+
+    if (range.isAll()) {
+        auto out = pvxs::allocArray(to, count);
+        if (count > 0)
+            ArrayKernels::convert(pData, from, out.data(), to, count);
+        array = out.freeze();
+        return OpcUa_Good;
+    }
+
+    // Copy on write: the cached array is shared with the readers and the other encoders, so the
+    // elements of the range are written over a copy of it
+    size_t size = pState->last.size();
+    auto out = pvxs::allocArray(to, size);
+    memcpy(out.data(), pState->last.data(), size * elementSize);
+    ArrayKernels::convert(pData, from, static_cast<uint8_t*>(out.data()) + range.first * elementSize, to, count);
+    array = out.freeze();
+    return OpcUa_Good;
+}
+
+OpcUa_StatusCode StructureMapper::convert(uint32_t pvId, const UaNodeId & nodeId, const Value & value, UaVariant & variant) {
+    // The gateway reports the status once per PV, so nothing is logged here
+    try {
+        auto pvEncoder = encoderOf(pvId, nodeId, value);
+        if (!pvEncoder)
+            return OpcUa_BadNotSupported;
+
+        switch (pvEncoder->kind) {
+            case Kind::Table:
+                encodeTable(*pvEncoder->encoder, value, variant);
+                break;
+            case Kind::NDArray:
+                encodeNDArray(value, variant);
+                break;
+            case Kind::ScalarArray:
+                return encodeScalarArray(pvId, *pvEncoder, value, variant);
+            case Kind::Struct:
+                encodeStruct(*pvEncoder->encoder, value, variant);
+                break;
+        }
+    } catch (const std::exception &) {
+        variant.clear();
+        return OpcUa_BadTypeMismatch;
+    }
+    return OpcUa_Good;
+}
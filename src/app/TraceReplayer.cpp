@@ -0,0 +1,81 @@
+#include "TraceReplayer.h"
+#include <thread>
+#include <logger.h>
+#include <pvTrace.h>
+
+TraceReplayer::TraceReplayer(const std::string & path) : m_path(path) {
+    m_server = pvxs::server::Config::from_env().build();
+}
+
+TraceReplayer::~TraceReplayer() {
+    for (auto & pv : m_pvs)
+        if (pv.isOpen())
+            pv.close();
+    m_server.stop();
+}
+
+ReplayStats TraceReplayer::replay(double speed) {
+
+    ReplayStats stats;
+    TraceReader reader(m_path);
+    if (!reader.isOpen()) {
+        LOG_ERROR("The trace %s could not be opened", m_path.c_str());
+        return stats;
+    }
+
+    if (m_pvs.empty())
+        m_server.start();
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point start = clock::now();
+    TraceEvent event;
+    while (!m_stopping.load() && reader.next(event)) {
+        if (event.pvId >= m_pvs.size()) {
+            m_pvs.resize(event.pvId + 1);
+            m_typeChanged.resize(event.pvId + 1, false);
+        }
+        pvxs::server::SharedPV & pv = m_pvs[event.pvId];
+
+        switch (event.kind) {
+            case TraceEvent::Kind::Name:
+                // A looped trace names its PVs again
+                if (!pv) {
+                    pv = pvxs::server::SharedPV::buildReadonly();
+                    m_server.addPV(event.name, pv);
+                }
+                break;
+            case TraceEvent::Kind::Type:
+                m_typeChanged[event.pvId] = true;
+                break;
+            case TraceEvent::Kind::Update: {
+                if (!pv)
+                    break;
+
+                if (speed > 0.0) {
+                    auto scheduled = start + std::chrono::nanoseconds(static_cast<int64_t>(event.arrival / speed));
+                    auto now = clock::now();
+                    if (scheduled > now)
+                        std::this_thread::sleep_until(scheduled);
+                    else if (now - scheduled > stats.maxLag)
+                        stats.maxLag = std::chrono::duration_cast<std::chrono::nanoseconds>(now - scheduled);
+                }
+
+                // The clients see a new type as a disconnection, as with a real IOC
+                if (!pv.isOpen()) {
+                    pv.open(event.value);
+                } else if (m_typeChanged[event.pvId]) {
+                    pv.close();
+                    pv.open(event.value);
+                } else {
+                    pv.post(event.value);
+                }
+                m_typeChanged[event.pvId] = false;
+                ++stats.updates;
+                break;
+            }
+        }
+    }
+
+    stats.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+    return stats;
+}
@@ -3,20 +3,71 @@
 #include <opcua_analogitemtype.h>
 #include <opcua_twostatediscretetype.h>
 #include <opcua_multistatediscretetype.h>
-#include <iostream>
+#include <opcua_basedatavariabletype.h>
+#include <logger.h>
 #include <typeIDs.h>
+#include <typeMap.h>
 #include <iocBasicObject.h>
+#include <NodeBatch.h>
+#include <GatewayHistoryManager.h>
+#include <ArrayIOManager.h>
 #include <EPICStoOPCUAGateway.h>
+#include <OPCUAtoEPICSServer.h>
+#include <pvCatalog.h>
+#include <pvxs/data.h>
+
+namespace {
+
+// Continuation point of a browse of the lazy folder
+struct LazyBrowseCP : public ContinuationPointUserDataBase {
+    uint32_t nextPvId = 0;
+};
+
+// Whether the reference type filter of a browse accepts Organizes
+bool acceptsOrganizes(const BrowseContext & browseContext) {
+    const OpcUa_NodeId * pReferenceTypeId = browseContext.pReferenceTypeId();
+    if(pReferenceTypeId == NULL || UaNodeId(*pReferenceTypeId).isNull())
+        return true;
+
+    UaNodeId referenceTypeId(*pReferenceTypeId);
+    if(referenceTypeId == UaNodeId(OpcUaId_Organizes))
+        return true;
+    // The supertypes of Organizes
+    return browseContext.bIncludeSubtype()
+        && (referenceTypeId == UaNodeId(OpcUaId_HierarchicalReferences) || referenceTypeId == UaNodeId(OpcUaId_References));
+}
+
+}
 
-MyNodeIOEventManager::MyNodeIOEventManager()
-    : NodeManagerBase("TFG:OPCUA_EPICS", OpcUa_False) {
+MyNodeIOEventManager::MyNodeIOEventManager(OpcUa_Int32 hashTableSize)
+    : NodeManagerBase("TFG:OPCUA_EPICS", OpcUa_True, hashTableSize), m_propertyStore(this) {
 
-    std::cout << "Constructor del servidor..." << std::endl;
+    LOG_DEBUG("Constructor del servidor...");
 
 }
 
 MyNodeIOEventManager::~MyNodeIOEventManager(){}
 
+OpcUa_Int32 MyNodeIOEventManager::hashTableSizeFor(size_t expectedNodes) {
+
+    size_t size = expectedNodes + expectedNodes / 3;
+    if(size <= static_cast<size_t>(DefaultHashTableSize))
+        return DefaultHashTableSize;
+
+    // Prime size, the node ids of a catalog are far from random
+    size |= 1;
+    auto isPrime = [](size_t n) {
+        for(size_t d = 3; d * d <= n; d += 2)
+            if(n % d == 0)
+                return false;
+        return true;
+    };
+    while(!isPrime(size))
+        size += 2;
+
+    return static_cast<OpcUa_Int32>(size);
+}
+
 UaStatus MyNodeIOEventManager::createObjectType(
     const UaString & name, 
     const int typeId, 
@@ -69,6 +120,7 @@ UaStatus MyNodeIOEventManager::createTwoStateVariableType(
     pTwoStateDiscreteType->setTrueState(trueText);
 
     result = addNodeAndReference(sourceNode, pTwoStateDiscreteType, OpcUaId_HasComponent);
+    invalidateObjectTypeTemplate(sourceNode);
     
     return result;
     
@@ -100,6 +152,7 @@ UaStatus MyNodeIOEventManager::createMultiStatateVariableType(
     pMultiStateDiscreteType->setModellingRuleId( mandatory ? OpcUaId_ModellingRule_Mandatory : OpcUaId_ModellingRule_Optional);
     pMultiStateDiscreteType->setEnumStrings(enumStrings);
     result = addNodeAndReference(sourceNode, pMultiStateDiscreteType, OpcUaId_HasComponent);
+    invalidateObjectTypeTemplate(sourceNode);
     
     return result;
 }
@@ -110,26 +163,85 @@ UaStatus MyNodeIOEventManager::createObject(
     const UaNodeId & objectId,           // NodeId of the new object
     const UaNodeId & sourceNodeId        // Node of the parent
 ) {
+    // A batch of one object
+    NodeBatch batch(this);
+    batch.addObject(objectName, typeId, objectId, sourceNodeId);
+    return batch.commit();
+}
+
+UaStatus MyNodeIOEventManager::commitBatch(NodeBatch & batch) {
+
     UaStatus result;
+    auto keep = [&result](const UaStatus & status) {
+        if(result.isGood() && status.isBad())
+            result = status;
+    };
+
+    UaMutexLocker lock(&m_mutexNodes);
+
+    // The variables first, the object is reachable once it is referenced by its parent
+    for(NodeBatch::PendingObject & pending : batch.m_objects){
+        for(const IocVariableTemplate & variableTemplate : *pending.pTemplate)
+            keep(pending.pObject->addVariable(variableTemplate));
+        keep(addNodeAndReference(pending.parentNodeId, pending.pObject, OpcUaId_Organizes));
+    }
+
+    for(NodeBatch::PendingNode & pending : batch.m_nodes)
+        keep(addNodeAndReference(pending.parentNodeId, pending.pNode, pending.referenceTypeId));
+
+    for(NodeBatch::PendingReference & pending : batch.m_references)
+        keep(addUaReference(pending.sourceNodeId, pending.targetNodeId, pending.referenceTypeId));
+
+    return result;
+}
 
-    IocBasicObject * pObject = new IocBasicObject(objectName, objectId, m_defaultLocaleId, this, typeId);
+std::shared_ptr<const std::vector<IocVariableTemplate>> MyNodeIOEventManager::getObjectTypeTemplate(int typeId) {
+
+    std::lock_guard<std::mutex> lock(m_templatesMutex);
+    auto it = m_objectTypeTemplates.find(typeId);
+    if(it != m_objectTypeTemplates.end())
+        return it->second;
+
+    auto pTemplate = std::make_shared<std::vector<IocVariableTemplate>>();
 
     m_mutexNodes.lock();
     std::vector<UaVariable*> variables = getVariablesFromObjectType(typeId);
-    for(auto it : variables){
-        pObject->addVariable(it);
+    pTemplate->reserve(variables.size());
+    for(UaVariable * pVariable : variables){
+        IocVariableTemplate variableTemplate;
+        if(IocVariableTemplate::resolve(pVariable, m_propertyStore, variableTemplate))
+            pTemplate->push_back(std::move(variableTemplate));
+        else
+            LOG_ERROR("Error: Unknown variable type of %s", pVariable->browseName().toString().toUtf8());
     }
-
     m_mutexNodes.unlock();
-    result = addNodeAndReference(sourceNodeId, pObject, OpcUaId_Organizes); 
-    
-    return result;
+
+    m_objectTypeTemplates[typeId] = pTemplate;
+    return pTemplate;
+}
+
+void MyNodeIOEventManager::invalidateObjectTypeTemplate(const UaNodeId & typeNodeId) {
+    if(typeNodeId.identifierType() != OpcUa_IdentifierType_Numeric || typeNodeId.namespaceIndex() != getNameSpaceIndex())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_templatesMutex);
+    m_objectTypeTemplates.erase(static_cast<int>(typeNodeId.identifierNumeric()));
 }
 
-UaStatus MyNodeIOEventManager::updateVariable(UaNodeId &nodeId, UaVariant &variant) {
+UaStatus MyNodeIOEventManager::updateVariable(const UaNodeId &nodeId, const UaVariant &variant, OpcUa_StatusCode statusCode,
+                                              int64_t sourceTimestamp) {
+
+    // A materialized PV is not evicted while it is updated
+    std::shared_lock<std::shared_mutex> lazyLock(m_lazyMutex, std::defer_lock);
+    bool lazy = m_lazyCapacity.load() > 0;
+    if(lazy)
+        lazyLock.lock();
 
     UaNode * pNode = getNode(nodeId);
     if(!pNode){
+        // A PV that no client has touched only lives in the value cache of the gateway
+        if(lazy && m_pEPICSGateway != nullptr && m_pEPICSGateway->isMapped(nodeId))
+            return UaStatus(OpcUa_Good);
         return UaStatus(OpcUa_BadNodeIdUnknown);
     }
 
@@ -138,19 +250,395 @@ UaStatus MyNodeIOEventManager::updateVariable(UaNodeId &nodeId, UaVariant &varia
         return UaStatus(OpcUa_BadNodeIdRejected);
     }
 
-    UaDateTime sourceTimestamp = UaDateTime::now();
-    UaDateTime serverTimestamp = UaDateTime::now();    
+    // The timestamp of the IOC, the same one as the history and the PubSub fields
+    UaDateTime serverTimestamp = UaDateTime::now();
+    UaDateTime source = serverTimestamp;
+    if(sourceTimestamp != 0){
+        OpcUa_DateTime dateTime;
+        dateTime.dwLowDateTime = static_cast<OpcUa_UInt32>(sourceTimestamp & 0xFFFFFFFF);
+        dateTime.dwHighDateTime = static_cast<OpcUa_UInt32>(static_cast<uint64_t>(sourceTimestamp) >> 32);
+        source = UaDateTime(dateTime);
+    }
+
+    UaDataValue dataValue(variant, statusCode, source, serverTimestamp);
+    UaStatus result = pVariable->setValue( NULL /*this->m_pServerManager->getInternalSession()*/, dataValue, OpcUa_False );
+
+    // Internal updates do not call afterSetAttributeValue()
+    if(result.isGood() && m_pEPICSServer != nullptr)
+        m_pEPICSServer->valueChanged(pVariable, dataValue);
+
+    return result;
+}
+
+void MyNodeIOEventManager::enableHistory(size_t samplesPerPV, size_t maxPVs) {
+
+    m_pHistoryStore = std::make_unique<HistoryStore>(samplesPerPV, maxPVs);
+    m_pHistoryManager = std::make_unique<GatewayHistoryManager>(m_pHistoryStore.get());
+    LOG_INFO("History of %zu samples for up to %zu PVs: %zu bytes per PV, %zu MB at most",
+             samplesPerPV, maxPVs, m_pHistoryStore->bytesPerPV(), m_pHistoryStore->memoryBudget() >> 20);
+}
+
+void MyNodeIOEventManager::setHistorizing(OpcUa::BaseDataVariableType * pVariable) const {
+    if(m_pHistoryStore){
+        pVariable->setAccessLevel(pVariable->accessLevel() | Ua_AccessLevel_HistoryRead);
+        pVariable->setHistorizing(OpcUa_True);
+    }
+}
+
+HistoryVariableHandle * MyNodeIOEventManager::getHistoryVariableHandle(
+    Session * pSession,
+    HistoryVariableHandle::ServiceType serviceType,
+    OpcUa_NodeId * pNodeId,
+    UaStatus & result
+) const {
+    if(!m_pHistoryManager || m_pEPICSGateway == nullptr)
+        return NodeManagerBase::getHistoryVariableHandle(pSession, serviceType, pNodeId, result);
+
+    uint32_t pvId = m_pEPICSGateway->pvId(UaNodeId(*pNodeId));
+    if(pvId == PVNameTable::InvalidId){
+        result = OpcUa_BadHistoryOperationUnsupported;
+        return NULL;
+    }
+
+    PVHistoryVariableHandle * pHandle = new PVHistoryVariableHandle;
+    pHandle->m_pHistoryManager = m_pHistoryManager.get();
+    pHandle->m_OriginNodeId = *pNodeId;
+    pHandle->m_pvId = pvId;
+    result = OpcUa_Good;
+    return pHandle;
+}
+
+UaStatus MyNodeIOEventManager::enableLazyNodes(size_t capacity) {
+
+    if(m_lazyCapacity.load() > 0){
+        m_lazyCapacity = capacity;
+        return UaStatus();
+    }
+
+    m_lazyFolderId = UaNodeId("PVs", getNameSpaceIndex());
+    UaFolder * pFolder = new UaFolder("PVs", m_lazyFolderId, m_defaultLocaleId);
+    UaStatus result = addNodeAndReference(OpcUaId_ObjectsFolder, pFolder, OpcUaId_Organizes);
+    if(result.isGood())
+        m_lazyCapacity = capacity;
+    return result;
+}
+
+size_t MyNodeIOEventManager::lazyNodeCount() {
+    std::shared_lock<std::shared_mutex> lock(m_lazyMutex);
+    return m_lazyNodes.size();
+}
+
+bool MyNodeIOEventManager::lazyTypesOf(const PVCatalogEntry & entry, OpcUa_UInt32 & dataTypeId, OpcUa_UInt32 & typeDefinitionId) {
+
+    // Same mapping as the conversions of the gateway
+    if(entry.ntId == "epics:nt/NTEnum:1.0"){
+        bool twoStates = entry.choices.size() == 2;
+        dataTypeId = twoStates ? OpcUaId_Boolean : OpcUaId_Int16;
+        typeDefinitionId = twoStates ? OpcUaId_TwoStateDiscreteType : OpcUaId_MultiStateDiscreteType;
+        return true;
+    }
+    if(entry.ntId != "epics:nt/NTScalar:1.0")
+        return false;
+
+    const TypeMap::Entry * pEntry = TypeMap::find(static_cast<pvxs::TypeCode::code_t>(entry.valueType));
+    if(pEntry == nullptr)
+        return false;
+    dataTypeId = pEntry->dataTypeId;
+    typeDefinitionId = pEntry->analog ? OpcUaId_AnalogItemType : OpcUaId_BaseDataVariableType;
+    return true;
+}
+
+OpcUa_Byte MyNodeIOEventManager::accessLevelOf(const PVCatalogEntry & entry) {
+
+    static const char * const OutputRecords[] = {"ao", "bo", "longout", "int64out", "mbbo", "mbboDirect", "stringout", "lso", "aao"};
+    for(const char * recordType : OutputRecords)
+        if(entry.recordType == recordType)
+            return Ua_AccessLevel_CurrentRead | Ua_AccessLevel_CurrentWrite;
+    return Ua_AccessLevel_CurrentRead;
+}
+
+UaVariable * MyNodeIOEventManager::createLazyVariable(uint32_t pvId, const UaNodeId & nodeId) {
+
+    PVCatalogEntry entry;
+    OpcUa_UInt32 dataTypeId, typeDefinitionId;
+    if(!m_pEPICSGateway->catalogEntry(pvId, entry) || !lazyTypesOf(entry, dataTypeId, typeDefinitionId))
+        return NULL;
+
+    // Initial value from the value cache of the gateway
+    std::vector<CachedValue> cached;
+    m_pEPICSGateway->readValues({pvId}, cached);
+
+    IocSharedVariable * pVariable = new IocSharedVariable(
+        nodeId, UaString(entry.epicsName.c_str()), getNameSpaceIndex(), cached[0].value,
+        accessLevelOf(entry), this, UaNodeId(typeDefinitionId));
+    pVariable->setDataType(UaNodeId(dataTypeId));
+    setHistorizing(pVariable);
+    pVariable->setValue(NULL, UaDataValue(cached[0].value, cached[0].statusCode, UaDateTime::now(), UaDateTime::now()), OpcUa_False);
+
+    UaStatus result = addNodeAndReference(m_lazyFolderId, pVariable, OpcUaId_Organizes);
+    if(result.isBad())
+        return NULL;
+
+    // Properties from the metadata of the catalog, with values shared with the rest of the PVs
+    std::vector<PropertyHandle> properties;
+    if(typeDefinitionId == OpcUaId_AnalogItemType){
+        UaLocalizedText units("", entry.units.c_str());
+        properties.push_back(m_propertyStore.engineeringUnits(UaEUInformation("", -1, units, units)));
+        properties.push_back(m_propertyStore.euRange(UaRange(entry.limitLow, entry.limitHigh)));
+    }
+    else if(typeDefinitionId == OpcUaId_TwoStateDiscreteType){
+        properties.push_back(m_propertyStore.falseState(UaLocalizedText("", entry.choices[0].c_str())));
+        properties.push_back(m_propertyStore.trueState(UaLocalizedText("", entry.choices[1].c_str())));
+    }
+    else if(typeDefinitionId == OpcUaId_MultiStateDiscreteType){
+        UaLocalizedTextArray enumStrings;
+        enumStrings.create(static_cast<OpcUa_UInt32>(entry.choices.size()));
+        for(OpcUa_UInt32 i = 0; i < enumStrings.length(); ++i)
+            UaLocalizedText("", entry.choices[i].c_str()).copyTo(&enumStrings[i]);
+        properties.push_back(m_propertyStore.enumStrings(enumStrings));
+    }
+    for(const PropertyHandle & pProperty : properties)
+        m_propertyStore.addProperty(pVariable, pProperty);
+
+    return pVariable;
+}
+
+UaVariable * MyNodeIOEventManager::materialize(const UaNodeId & nodeId) {
+
+    if(m_lazyCapacity.load() == 0 || m_pEPICSGateway == nullptr)
+        return NULL;
+
+    uint32_t pvId = m_pEPICSGateway->pvId(nodeId);
+    if(pvId == PVNameTable::InvalidId)
+        return NULL;
+
+    std::unique_lock<std::shared_mutex> lock(m_lazyMutex);
+    auto it = m_lazyNodes.find(pvId);
+    if(it != m_lazyNodes.end()){
+        m_lazyLru.splice(m_lazyLru.begin(), m_lazyLru, it->second.lru);
+        return it->second.pVariable;
+    }
+
+    // The PVs of the static objects and the structured PVs have their own nodes
+    if(findNode(nodeId) != NULL)
+        return NULL;
+
+    UaVariable * pVariable = createLazyVariable(pvId, nodeId);
+    if(pVariable == NULL)
+        return NULL;
+
+    m_lazyLru.push_front(pvId);
+    m_lazyNodes.emplace(pvId, LazyNode{pVariable, m_lazyLru.begin()});
+    evictLazyNodes();
+    return pVariable;
+}
+
+void MyNodeIOEventManager::evictLazyNodes() {
+
+    // From the least recently used, skipping the variables that are monitored
+    auto it = m_lazyLru.end();
+    while(m_lazyNodes.size() > m_lazyCapacity.load() && it != m_lazyLru.begin()){
+        --it;
+        auto node = m_lazyNodes.find(*it);
+        UaVariableCache * pCache = dynamic_cast<UaVariableCache*>(node->second.pVariable);
+        if(pCache != NULL && pCache->signalCount() > 0)
+            continue;
+
+        // With its own property nodes, the interned values stay in the store
+        deleteUaNode(node->second.pVariable, OpcUa_True, OpcUa_True, OpcUa_True);
+        m_lazyNodes.erase(node);
+        it = m_lazyLru.erase(it);
+    }
+}
+
+UaStatus MyNodeIOEventManager::browseLazyFolder(BrowseContext & browseContext, UaReferenceDescriptions & references) {
+
+    // Only the forward Organizes references to the PVs, the rest of the references are the ones of the folder node
+    if(browseContext.browseDirection() == OpcUa_BrowseDirection_Inverse
+        || (browseContext.uNodeClassMask() != 0 && (browseContext.uNodeClassMask() & OpcUa_NodeClass_Variable) == 0)
+        || !acceptsOrganizes(browseContext))
+        return NodeManagerBase::browse(ServiceContext(), browseContext, references);
+
+    // A continuation point keeps the next PV to browse
+    uint32_t nextId = 0;
+    LazyBrowseCP * pContinuationPoint = static_cast<LazyBrowseCP*>(browseContext.detachContinuationPoint());
+    if(pContinuationPoint != NULL){
+        nextId = pContinuationPoint->nextPvId;
+        delete pContinuationPoint;
+    }
+    OpcUa_UInt32 maxReferences = browseContext.uMaxResultReferences();
+
+    struct Candidate {
+        uint32_t pvId;
+        std::string name;
+        std::string nodeName;
+        OpcUa_UInt32 typeDefinitionId;
+    };
+    std::vector<Candidate> candidates;
+    std::vector<OpcUa_ReferenceDescription> found;
+    bool full = false;
+
+    std::shared_lock<std::shared_mutex> lock(m_lazyMutex);
+    while(!full){
+        // A chunk of the catalog, only the names of the PVs with a supported type are copied
+        candidates.clear();
+        uint32_t visitedId = nextId;
+        m_pEPICSGateway->visitCatalog(nextId,
+            [&](uint32_t pvId, std::string_view name, std::string_view nodeName, const PVCatalogEntry & entry){
+                visitedId = pvId + 1;
+                OpcUa_UInt32 dataTypeId, typeDefinitionId;
+                if(lazyTypesOf(entry, dataTypeId, typeDefinitionId))
+                    candidates.push_back({pvId, std::string(name), std::string(nodeName), typeDefinitionId});
+                return candidates.size() < LazyBrowseChunk;
+            });
+        if(visitedId == nextId)
+            break;
+        nextId = visitedId;
+
+        // Without the catalog lock, findNode takes the lock of the nodes
+        for(const Candidate & candidate : candidates){
+            if(maxReferences != 0 && found.size() == maxReferences){
+                nextId = candidate.pvId;
+                full = true;
+                break;
+            }
+
+            UaNodeId nodeId(candidate.nodeName.c_str(), getNameSpaceIndex());
+            // The PVs of the static objects are organized by their objects
+            if(m_lazyNodes.count(candidate.pvId) == 0 && findNode(nodeId) != NULL)
+                continue;
+
+            OpcUa_ReferenceDescription description;
+            OpcUa_ReferenceDescription_Initialize(&description);
+            UaNodeId(OpcUaId_Organizes).copyTo(&description.ReferenceTypeId);
+            description.IsForward = OpcUa_True;
+            nodeId.copyTo(&description.NodeId.NodeId);
+            UaQualifiedName(candidate.name.c_str(), getNameSpaceIndex()).copyTo(&description.BrowseName);
+            UaLocalizedText("", candidate.name.c_str()).copyTo(&description.DisplayName);
+            description.NodeClass = OpcUa_NodeClass_Variable;
+            UaNodeId(candidate.typeDefinitionId).copyTo(&description.TypeDefinition.NodeId);
+            found.push_back(description);
+        }
+    }
+    lock.unlock();
+
+    if(full && nextId < m_pEPICSGateway->pvCount()){
+        pContinuationPoint = new LazyBrowseCP;
+        pContinuationPoint->nextPvId = nextId;
+        browseContext.setContinuationPoint(pContinuationPoint);
+    }
+
+    references.create(static_cast<OpcUa_UInt32>(found.size()));
+    for(OpcUa_UInt32 i = 0; i < references.length(); ++i)
+        references[i] = found[i];       // The array takes the contents of the descriptions
+
+    return UaStatus();
+}
+
+VariableHandle * MyNodeIOEventManager::getVariableHandle(
+    Session * pSession,
+    VariableHandle::ServiceType serviceType,
+    OpcUa_NodeId * pNodeId,
+    OpcUa_Int32 attributeId
+) {
+    if(m_lazyCapacity.load() > 0 && pNodeId != NULL)
+        materialize(UaNodeId(*pNodeId));
+
+    // The monitored items stay on the node, the SDK applies their IndexRange to the samples
+    if(m_pArrayIOManager && pNodeId != NULL && attributeId == OpcUa_Attributes_Value
+       && (serviceType == VariableHandle::ServiceRead || serviceType == VariableHandle::ServiceWrite)){
+        uint32_t pvId = m_pEPICSGateway->pvId(UaNodeId(*pNodeId));
+        // The IOManager of the node checks the access level of a write that is not routed here
+        UaNode * pNode = serviceType == VariableHandle::ServiceWrite ? findNode(UaNodeId(*pNodeId)) : NULL;
+        bool writable = pNode != NULL && pNode->nodeClass() == OpcUa_NodeClass_Variable
+                        && (static_cast<UaVariable*>(pNode)->accessLevel() & Ua_AccessLevel_CurrentWrite) != 0;
+        if(pvId != PVNameTable::InvalidId && m_pEPICSGateway->isArrayPV(pvId)
+           && (serviceType == VariableHandle::ServiceRead || writable)){
+            PVVariableHandle * pHandle = new PVVariableHandle;
+            pHandle->m_pIOManager = m_pArrayIOManager.get();
+            pHandle->m_AttributeID = attributeId;
+            pHandle->m_pvId = pvId;
+            return pHandle;
+        }
+    }
+
+    return NodeManagerBase::getVariableHandle(pSession, serviceType, pNodeId, attributeId);
+}
+
+UaStatus MyNodeIOEventManager::browse(
+    const ServiceContext & serviceContext,
+    BrowseContext & browseContext,
+    UaReferenceDescriptions & references
+) {
+    if(m_lazyCapacity.load() > 0 && browseContext.pNodeToBrowse() != NULL){
+        UaNodeId nodeToBrowse(*browseContext.pNodeToBrowse());
+        if(nodeToBrowse == m_lazyFolderId)
+            return browseLazyFolder(browseContext, references);
+        materialize(nodeToBrowse);
+    }
+
+    return NodeManagerBase::browse(serviceContext, browseContext, references);
+}
+
+void MyNodeIOEventManager::variableCacheMonitoringChanged(UaVariableCache * pVariable, TransactionType transactionType) {
+
+    NodeManagerBase::variableCacheMonitoringChanged(pVariable, transactionType);
+
+    if(m_lazyCapacity.load() == 0 || m_pEPICSGateway == nullptr || pVariable == NULL)
+        return;
+
+    // The SDK can call this with the node lock held, which is taken after m_lazyMutex elsewhere.
+    // The LRU is only a hint, so it is not refreshed when the lock is busy
+    uint32_t pvId = m_pEPICSGateway->pvId(pVariable->nodeId());
+    std::unique_lock<std::shared_mutex> lock(m_lazyMutex, std::try_to_lock);
+    if(!lock.owns_lock())
+        return;
+    auto it = m_lazyNodes.find(pvId);
+    if(it != m_lazyNodes.end())
+        m_lazyLru.splice(m_lazyLru.begin(), m_lazyLru, it->second.lru);
+}
+
+UaStatus MyNodeIOEventManager::registerStructure(const UaStructureDefinition & definition) {
+    // Creates the DataType and encoding nodes and adds the structure to the type dictionary of the namespace
+    return addStructuredTypeDefinition(definition);
+}
+
+UaStatus MyNodeIOEventManager::createStructureVariable(
+    const UaNodeId & nodeId,
+    const UaString & name,
+    const UaNodeId & dataTypeId,
+    OpcUa_Int32 valueRank,
+    bool writable
+) {
+    if(findNode(nodeId) != NULL)
+        return UaStatus();
+
+    // Same rule as the variables of the scalar PVs: only the output records are writable
+    OpcUa_Byte accessLevel = Ua_AccessLevel_CurrentRead;
+    PVCatalogEntry entry;
+    if(writable && m_pEPICSGateway != nullptr && m_pEPICSGateway->catalogEntry(m_pEPICSGateway->pvId(nodeId), entry))
+        accessLevel = accessLevelOf(entry);
 
-    OpcUa_Double val;
-    variant.toDouble(val);
-    //std::cout << "Variant: " << val << std::endl;
+    OpcUa::BaseDataVariableType * pVariable = new OpcUa::BaseDataVariableType(
+        nodeId,
+        name,
+        getNameSpaceIndex(),
+        UaVariant(),
+        accessLevel,
+        this);
+    pVariable->setDataType(dataTypeId);
+    pVariable->setValueRank(valueRank);
 
-    UaDataValue dataValue(variant, OpcUa_Good, sourceTimestamp, serverTimestamp);
-    return pVariable->setValue( NULL /*this->m_pServerManager->getInternalSession()*/, dataValue, OpcUa_False );
+    return addNodeAndReference(OpcUaId_ObjectsFolder, pVariable, OpcUaId_Organizes);
 }
 
 void MyNodeIOEventManager::setEPICSGateway(EPICStoOPCUAGateway* pEPICSGateway) {
     m_pEPICSGateway = pEPICSGateway;
+    m_pArrayIOManager.reset(pEPICSGateway != nullptr ? new ArrayIOManager(pEPICSGateway) : nullptr);
+}
+
+void MyNodeIOEventManager::setEPICSServer(OPCUAtoEPICSServer* pEPICSServer) {
+    m_pEPICSServer = pEPICSServer;
 }
 
 UaStatus MyNodeIOEventManager::afterStartUp(){
@@ -261,9 +749,16 @@ UaStatus MyNodeIOEventManager::afterStartUp(){
                                     true, true, states);
 
     
-    createObject("ejemplo1", TFG_IOC_Ejemplo1, UaNodeId("ejemplo1", getNameSpaceIndex()), OpcUaId_ObjectsFolder);
-    createObject("ejemplo2", TFG_IOC_Ejemplo2, UaNodeId("ejemplo2", getNameSpaceIndex()), OpcUaId_ObjectsFolder);
-    createObject("ejemplo3", TFG_IOC_Ejemplo3, UaNodeId("ejemplo3", getNameSpaceIndex()), OpcUaId_ObjectsFolder);
+    NodeBatch objects(this);
+    objects.reserve(3);
+    objects.addObject("ejemplo1", TFG_IOC_Ejemplo1, UaNodeId("ejemplo1", getNameSpaceIndex()), OpcUaId_ObjectsFolder);
+    objects.addObject("ejemplo2", TFG_IOC_Ejemplo2, UaNodeId("ejemplo2", getNameSpaceIndex()), OpcUaId_ObjectsFolder);
+    objects.addObject("ejemplo3", TFG_IOC_Ejemplo3, UaNodeId("ejemplo3", getNameSpaceIndex()), OpcUaId_ObjectsFolder);
+    objects.commit();
+
+    PropertyStore::Statistics properties = m_propertyStore.statistics();
+    LOG_INFO("%zu property nodes read %zu interned values: %zu bytes of values instead of %zu",
+             properties.nodes, properties.values, properties.valueBytes, properties.copiedBytes);
        
     return UaStatus();  
 }
@@ -271,10 +766,24 @@ UaStatus MyNodeIOEventManager::afterStartUp(){
 // Se llama cuando se cierra. Los nodos se limpian automaticamente pero podemos poner otro tipo de código.
 UaStatus MyNodeIOEventManager::beforeShutDown()
 {
-    std::cout << "Se cierra el servidor" << std::endl;
+    LOG_INFO("Se cierra el servidor");
     return UaStatus();
 }
 
+UaStatus MyNodeIOEventManager::OnAcknowledge(
+    const ServiceContext & serviceContext,
+    OpcUa::AcknowledgeableConditionType * pCondition,
+    const UaByteString & EventId,
+    const UaLocalizedText & Comment
+) {
+    OpcUa_ReferenceParameter(serviceContext);
+
+    AlarmManager * pAlarmManager = m_pEPICSGateway != nullptr ? m_pEPICSGateway->alarmManager() : nullptr;
+    if(pAlarmManager == nullptr)
+        return OpcUa_BadNodeIdUnknown;
+    return pAlarmManager->acknowledge(pCondition, EventId, Comment);
+}
+
 OpcUa_Boolean MyNodeIOEventManager::beforeSetAttributeValue(
     Session *pSession, 
     UaNode *pNode, 
@@ -306,6 +815,16 @@ OpcUa_Boolean MyNodeIOEventManager::beforeSetAttributeValue(
     
 }
 
+void MyNodeIOEventManager::afterSetAttributeValue(
+    Session *, 
+    UaNode *pNode, 
+    OpcUa_Int32 attributeId,
+    const UaDataValue &dataValue
+) {
+    if(m_pEPICSServer != nullptr && attributeId == OpcUa_Attributes_Value)
+        m_pEPICSServer->valueChanged(pNode, dataValue);
+}
+
 UaVariable * MyNodeIOEventManager::getInstanceDeclarationVariable(OpcUa_UInt32 numericIdentifier)
 {
     // Try to find the instance declaration node with the numeric identifier 
@@ -323,8 +842,11 @@ UaVariable * MyNodeIOEventManager::getInstanceDeclarationVariable(OpcUa_UInt32 n
 std::vector<UaVariable*> MyNodeIOEventManager::getVariablesFromObjectType(OpcUa_UInt32 numericIdentifier){
     
     UaNode* pNode = findNode(UaNodeId(numericIdentifier, getNameSpaceIndex()));
-    UaReference * pReference = const_cast<UaReference *>(pNode->getUaReferenceLists()->pTargetNodes());
     std::vector<UaVariable*> variables;
+    if(pNode == NULL)
+        return variables;
+
+    UaReference * pReference = const_cast<UaReference *>(pNode->getUaReferenceLists()->pTargetNodes());
 
     while(pReference != nullptr){
         UaNode * pNode = pReference->pTargetNode();
@@ -15,6 +15,7 @@
 #include "opcServer.h"
 #include "uamodule.h"
 #include "uasession.h"
+#include "logger.h"
 
 #ifndef UA_BUILD_DATE_ZONE
 #define UA_BUILD_DATE_ZONE 1 // Must match UTC offset and daylight saving time at build date
@@ -27,8 +28,15 @@ OpcServer::OpcServer()
 /** Destruction. */
 OpcServer::~OpcServer()
 {
+    // The publisher reads the value cache of the gateway
+    if(m_pPublisher != nullptr)
+        delete m_pPublisher;
+
     if(m_pGateway != nullptr)
         delete m_pGateway;
+
+    if(m_pEPICSServer != nullptr)
+        delete m_pEPICSServer;
     
     if ( isStarted() != OpcUa_False )
     {
@@ -51,43 +59,42 @@ UaStatus OpcServer::afterStartUp()
             uaEndpointArray);
         if ( uaEndpointArray.length() > 0 )
         {
-            printf("***************************************************\n");
-            printf(" Server opened endpoints for following URLs:\n");
-            OpcUa_UInt32 idx;
-            bool bError = false;
-            for ( idx=0; idx<uaEndpointArray.length(); idx++ )
+            // Through the logger, so the endpoints are in the same log as the rest of the server
+            for ( OpcUa_UInt32 idx=0; idx<uaEndpointArray.length(); idx++ )
             {
                 if ( uaEndpointArray[idx]->isOpened() )
                 {
-                    printf("     %s\n", uaEndpointArray[idx]->sEndpointUrl().toUtf8());
+                    LOG_INFO("Server opened endpoint %s", uaEndpointArray[idx]->sEndpointUrl().toUtf8());
                 }
                 else
                 {
-                    bError = true;
+                    LOG_ERROR("Server endpoint %s failed", uaEndpointArray[idx]->sEndpointUrl().toUtf8());
                 }
             }
-            if ( bError )
-            {
-                printf("\n");
-                printf("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");
-                printf("!!!! The following endpoints URLs failed:\n");
-                for ( idx=0; idx<uaEndpointArray.length(); idx++ )
-                {
-                    if ( uaEndpointArray[idx]->isOpened() == false )
-                    {
-                        printf("!!!! %s\n", uaEndpointArray[idx]->sEndpointUrl().toUtf8());
-                    }
-                }
-                printf("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");
-                printf("\n");
-            }
-            printf("***************************************************\n");
         }
     }
 
     return ret;
 }
 
+UaStatus OpcServer::beforeShutdown()
+{
+    if(m_pPublisher != nullptr)
+        m_pPublisher->stop();
+
+    // Flush pending puts and cancel the PVXS operations before the nodes disappear
+    if(m_pGateway != nullptr)
+        m_pGateway->stop();
+
+    // Stop posting value changes and disconnect the PVA clients
+    if(m_pEPICSServer != nullptr){
+        m_pMyNodeManager->setEPICSServer(nullptr);
+        m_pEPICSServer->stop();
+    }
+
+    return UaServerApplication::beforeShutdown();
+}
+
 OpcUa_DateTime OpcServer::getBuildDate() const
 {
     static OpcUa_DateTime date;
@@ -143,3 +150,14 @@ void OpcServer::addEPICSGateway(EPICStoOPCUAGateway * gate) {
     getMyNodeIOEventManager()->setEPICSGateway(m_pGateway);
     m_pGateway->start();
 }
+
+void OpcServer::addEPICSServer(OPCUAtoEPICSServer * pEPICSServer) {
+    m_pEPICSServer = pEPICSServer;
+    getMyNodeIOEventManager()->setEPICSServer(m_pEPICSServer);
+    m_pEPICSServer->start();
+}
+
+void OpcServer::addPubSubPublisher(PubSubPublisher * pPublisher) {
+    m_pPublisher = pPublisher;
+    m_pPublisher->start();
+}
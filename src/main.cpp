@@ -7,6 +7,8 @@
 #include <string.h>
 #include <myNodeIOEventManager.h>
 #include <typeIDs.h>
+#include <logger.h>
+#include <pvCatalog.h>
 #include <thread>
 
 
@@ -25,6 +27,12 @@ int OpcServerMain(const char* szAppPath)
 
     //-------------------------------------------
 
+    // Start the logger before any other component, logger.conf next to the executable is optional
+    UaString sLoggerFileName(szAppPath);
+    sLoggerFileName += "/logger.conf";
+    Logger::instance().loadConfig(sLoggerFileName.toUtf8());
+    Logger::instance().start();
+
     if ( ret == 0 ){
         // Create configuration file name
         UaString sConfigFileName(szAppPath);
@@ -36,34 +44,82 @@ int OpcServerMain(const char* szAppPath)
         unique_ptr<OpcServer> pServer = make_unique<OpcServer>();
         ret = pServer->setServerConfig(sConfigFileName, szAppPath);
 
-        // Add NodeManager for the server specific nodes
-        MyNodeIOEventManager *pMyNodeIOEventManager = new MyNodeIOEventManager();
+        // The PV catalog snapshot next to the executable allows a warm start without waiting for the discovery
+        UaString sSnapshotFileName(szAppPath);
+        sSnapshotFileName += "/pvcatalog.bin";
+
+        // Add NodeManager for the server specific nodes. Its node table is sized for the catalog,
+        // every PV needs a variable and its properties (about four nodes).
+        size_t expectedNodes = static_cast<size_t>(PVCatalog::count(sSnapshotFileName.toUtf8())) * 4;
+        MyNodeIOEventManager *pMyNodeIOEventManager = new MyNodeIOEventManager(MyNodeIOEventManager::hashTableSizeFor(expectedNodes));
+        // The last samples of every PV for the HistoryRead service if history.conf is next to the executable
+        UaString sHistoryFileName(szAppPath);
+        sHistoryFileName += "/history.conf";
+        HistoryConfig historyConfig;
+        if(HistoryStore::loadConfig(sHistoryFileName.toUtf8(), historyConfig))
+            pMyNodeIOEventManager->enableHistory(historyConfig.samplesPerPV, historyConfig.maxPVs);
         ret = pServer->setMyNodeManager(pMyNodeIOEventManager);
         
 
         // Start server object
         ret = pServer->start();
         if ( ret != 0 ){
-            std::cout << "Error starting the server: " << ret << std::endl;
+            LOG_ERROR("Error starting the server: %d", ret);
         }
 
         if ( ret == 0 ){
             // Add Gateway to the server
-            EPICStoOPCUAGateway * pGateway = new EPICStoOPCUAGateway (pMyNodeIOEventManager, 1);
+            EPICStoOPCUAGateway * pGateway = new EPICStoOPCUAGateway (pMyNodeIOEventManager, 1, OverflowPolicy::Coalesce,
+                                                                      8, sSnapshotFileName.toUtf8());
+
+            // Record the forwarded updates if recorder.conf is next to the executable
+            UaString sRecorderFileName(szAppPath);
+            sRecorderFileName += "/recorder.conf";
+            RecorderConfig recorderConfig;
+            if(UpdateRecorder::loadConfig(sRecorderFileName.toUtf8(), recorderConfig) && !pGateway->enableRecorder(recorderConfig))
+                LOG_ERROR("The recorder could not be started in %s", recorderConfig.directory.c_str());
+
+            // Capture the monitor updates for pvtrace_replay if capture.conf is next to the executable
+            UaString sCaptureFileName(szAppPath);
+            sCaptureFileName += "/capture.conf";
+            std::string tracePath;
+            if(TraceWriter::loadConfig(sCaptureFileName.toUtf8(), tracePath) && !pGateway->enableCapture(tracePath))
+                LOG_ERROR("The trace %s could not be created", tracePath.c_str());
+
+            // The EPICS alarms of the PVs as OPC UA Alarms & Conditions, notified by the Server object,
+            // if alarms.conf is next to the executable
+            UaString sAlarmsFileName(szAppPath);
+            sAlarmsFileName += "/alarms.conf";
+            if(AlarmManager::loadConfig(sAlarmsFileName.toUtf8()) && !pGateway->enableAlarms())
+                LOG_ERROR("The alarms of the PVs could not be enabled");
+
             pServer->addEPICSGateway(pGateway);
 
+            // The PVs without a static object are materialized when a client touches them
+            pMyNodeIOEventManager->enableLazyNodes(MyNodeIOEventManager::DefaultLazyCapacity);
+
+            // Serve the OPC UA variables listed in pvexport.txt as PVA PVs
+            UaString sExportFileName(szAppPath);
+            sExportFileName += "/pvexport.txt";
+            OPCUAtoEPICSServer * pEPICSServer = new OPCUAtoEPICSServer(pMyNodeIOEventManager);
+            if(pEPICSServer->publishFromFile(sExportFileName.toUtf8()) > 0)
+                pServer->addEPICSServer(pEPICSServer);
+            else
+                delete pEPICSServer;
+
+            // Publish the PVs listed in pubsub.conf as a UADP PubSub stream
+            UaString sPubSubFileName(szAppPath);
+            sPubSubFileName += "/pubsub.conf";
+            PubSubConfig pubSubConfig;
+            if(PubSubPublisher::loadConfig(sPubSubFileName.toUtf8(), pubSubConfig))
+                pServer->addPubSubPublisher(new PubSubPublisher(pGateway, pubSubConfig));
+
             printf("***************************************************\n");
             printf(" Press %s to shut down server\n", SHUTDOWN_SEQUENCE);
             printf("***************************************************\n");
             // Wait for user command to terminate the server thread.
-            const char animation[] = { '#', '#', '#', ' '}; 
-            int index = 0;
-            while (ShutDownFlag() == 0)
-            {
-                std::cout << "\r" << animation[index % 4] << animation[(index + 1) % 4] << animation[(index + 2) % 4] << std::flush;
-                UaThread::msleep(500);
-                index++;
-            }
+            // The signal handler wakes up this thread, there is no need to poll the shutdown flag.
+            WaitForShutDown();
             printf("***************************************************\n");
             printf(" Shutting down server\n");
             printf("***************************************************\n");
@@ -83,6 +139,9 @@ int OpcServerMain(const char* szAppPath)
     
         // Clean up the XML Parser
     UaXmlDocument::cleanupParser();
+
+        // Write the pending messages
+    Logger::instance().stop();
     //-------------------------------------------
     return ret;
 }
@@ -0,0 +1,56 @@
+#include "uaplatformlayer.h"
+#include "shutdown.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <logger.h>
+#include <ClientLoadGenerator.h>
+
+// Northbound load of the server: many OPC UA sessions with monitored items and Read/Write storms.
+//   opcua_client_load <config>
+// The config file has "key = value" lines (see ClientLoadConfig), "nodes" is required.
+int main(int argc, char* argv[])
+{
+    if(argc < 2){
+        fprintf(stderr, "Usage: %s <config>\n", argv[0]);
+        return 1;
+    }
+
+    ClientLoadConfig config;
+    if(!ClientLoadGenerator::loadConfig(argv[1], config)){
+        fprintf(stderr, "The configuration %s could not be read\n", argv[1]);
+        return 1;
+    }
+
+    RegisterSignalHandler();
+    Logger::instance().start();
+    UaPlatformLayer::init();
+
+    int ret = 0;
+    {
+    ClientLoadGenerator generator(config);
+    if(generator.start() == 0){
+        ret = 1;
+    } else {
+        printf(" Press %s to stop\n", SHUTDOWN_SEQUENCE);
+        auto start = std::chrono::steady_clock::now();
+        auto lastReport = start;
+        while(!ShutDownFlag()){
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto now = std::chrono::steady_clock::now();
+            if(now - lastReport >= config.reportInterval){
+                generator.report(std::chrono::duration<double>(now - lastReport).count());
+                lastReport = now;
+            }
+            if(config.duration.count() > 0 && now - start >= config.duration)
+                break;
+        }
+        generator.report(std::chrono::duration<double>(std::chrono::steady_clock::now() - lastReport).count());
+    }
+    generator.stop();
+    }
+
+    UaPlatformLayer::cleanup();
+    Logger::instance().stop();
+    return ret;
+}
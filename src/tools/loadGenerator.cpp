@@ -0,0 +1,62 @@
+#include "shutdown.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dbFile.h>
+#include <logger.h>
+#include <LoadGenerator.h>
+
+// Serves N simulated copies of the records of the IOC databases, without building the IOCs:
+//   pvload_generator <db directory or file> [multiplier] [config]
+// The config file has "key = value" lines (see LoadConfig).
+int main(int argc, char* argv[])
+{
+    if(argc < 2){
+        fprintf(stderr, "Usage: %s <db directory or file> [multiplier] [config]\n", argv[0]);
+        return 1;
+    }
+
+    RegisterSignalHandler();
+    Logger::instance().start();
+
+    LoadConfig config;
+    if(argc > 3 && !LoadGenerator::loadConfig(argv[3], config))
+        LOG_WARNING("The configuration %s could not be read", argv[3]);
+    if(argc > 2)
+        config.multiplier = static_cast<size_t>(strtoul(argv[2], nullptr, 10));
+
+    std::vector<DbRecord> records;
+    size_t files = DbFile::parseAll(argv[1], records);
+    printf("%zu records read from %zu database files\n", records.size(), files);
+
+    LoadGenerator generator(config);
+    if(generator.load(records) == 0){
+        fprintf(stderr, "No PVs to serve\n");
+        Logger::instance().stop();
+        return 1;
+    }
+    generator.start();
+    printf(" Serving %zu PVs. Press %s to shut down the generator\n", generator.size(), SHUTDOWN_SEQUENCE);
+
+    // Update rate every 10 seconds
+    uint64_t lastPosted = generator.posted();
+    auto last = std::chrono::steady_clock::now();
+    while(!ShutDownFlag()){
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        auto now = std::chrono::steady_clock::now();
+        if(now - last < std::chrono::seconds(10))
+            continue;
+        uint64_t posted = generator.posted();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        printf("%.0f updates/s\n", (posted - lastPosted) / seconds);
+        lastPosted = posted;
+        last = now;
+    }
+
+    generator.stop();
+    Logger::instance().stop();
+    return 0;
+}
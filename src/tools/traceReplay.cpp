@@ -0,0 +1,53 @@
+#include "shutdown.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <logger.h>
+#include <TraceReplayer.h>
+
+// Replays a trace captured by the gateway (capture.conf) through a PVA server:
+//   pvtrace_replay <trace> [speed|max] [loop]
+// The server keeps serving the last values after the replay, until CTRL-C.
+int main(int argc, char* argv[])
+{
+    if(argc < 2){
+        fprintf(stderr, "Usage: %s <trace> [speed|max] [loop]\n", argv[0]);
+        return 1;
+    }
+
+    double speed = 1.0;
+    if(argc > 2)
+        speed = (strcmp(argv[2], "max") == 0) ? 0.0 : atof(argv[2]);
+    bool loop = argc > 3 && strcmp(argv[3], "loop") == 0;
+    if(speed < 0.0){
+        fprintf(stderr, "The speed must be positive or max\n");
+        return 1;
+    }
+
+    RegisterSignalHandler();
+    Logger::instance().start();
+
+    TraceReplayer replayer(argv[1]);
+    std::thread watcher([&replayer](){
+        WaitForShutDown();
+        replayer.stop();
+    });
+
+    do{
+        ReplayStats stats = replayer.replay(speed);
+        double seconds = stats.duration.count() / 1e9;
+        printf("Replayed %llu updates in %.3f s (%.0f updates/s), max lag %.3f ms\n",
+               static_cast<unsigned long long>(stats.updates), seconds,
+               seconds > 0.0 ? stats.updates / seconds : 0.0, stats.maxLag.count() / 1e6);
+        if(stats.updates == 0)
+            break;
+    } while(loop && !replayer.stopped());
+
+    printf(" Press %s to shut down the replayer\n", SHUTDOWN_SEQUENCE);
+    watcher.join();
+
+    Logger::instance().stop();
+    return 0;
+}
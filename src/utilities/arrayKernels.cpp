@@ -0,0 +1,348 @@
+#include <arrayKernels.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ARRAYKERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+using pvxs::ArrayType;
+
+namespace {
+
+// Portable kernels, also the tails of the vectorized ones
+
+size_t firstDifferenceScalar(const uint8_t * pOld, const uint8_t * pNew, size_t bytes, size_t start) {
+    // Word by word, then the byte that differs
+    size_t i = start;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, pOld + i, 8);
+        memcpy(&b, pNew + i, 8);
+        if (a != b)
+            break;
+    }
+    for (; i < bytes; ++i)
+        if (pOld[i] != pNew[i])
+            return i;
+    return bytes;
+}
+
+size_t lastDifferenceScalar(const uint8_t * pOld, const uint8_t * pNew, size_t end) {
+    size_t i = end;
+    for (; i >= 8; i -= 8) {
+        uint64_t a, b;
+        memcpy(&a, pOld + i - 8, 8);
+        memcpy(&b, pNew + i - 8, 8);
+        if (a != b)
+            break;
+    }
+    for (; i > 0; --i)
+        if (pOld[i - 1] != pNew[i - 1])
+            return i;
+    return 0;
+}
+
+#ifndef ARRAYKERNELS_X86
+size_t firstDifferencePortable(const uint8_t * pOld, const uint8_t * pNew, size_t bytes) {
+    return firstDifferenceScalar(pOld, pNew, bytes, 0);
+}
+#endif
+
+template<typename In, typename Out>
+void convertScalar(const In * pIn, Out * pOut, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        pOut[i] = static_cast<Out>(pIn[i]);
+}
+
+#ifdef ARRAYKERNELS_X86
+
+size_t firstDifferenceSse2(const uint8_t * pOld, const uint8_t * pNew, size_t bytes) {
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pOld + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pNew + i));
+        unsigned equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+        if (equal != 0xFFFF)
+            return i + __builtin_ctz(~equal & 0xFFFF);
+    }
+    return firstDifferenceScalar(pOld, pNew, bytes, i);
+}
+
+size_t lastDifferenceSse2(const uint8_t * pOld, const uint8_t * pNew, size_t end) {
+    size_t i = end;
+    for (; i >= 16; i -= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pOld + i - 16));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pNew + i - 16));
+        unsigned equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+        if (equal != 0xFFFF)
+            return i - 16 + (32 - __builtin_clz(~equal & 0xFFFF));
+    }
+    return lastDifferenceScalar(pOld, pNew, i);
+}
+
+void int16ToInt32Sse2(const int16_t * pIn, int32_t * pOut, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i));
+        // The value in the high half of every 32-bit lane, then an arithmetic shift extends the sign
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+void uint16ToInt32Sse2(const uint16_t * pIn, int32_t * pOut, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm_unpacklo_epi16(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i + 4), _mm_unpackhi_epi16(v, zero));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+void floatToDoubleSse2(const float * pIn, double * pOut, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(pIn + i);
+        _mm_storeu_pd(pOut + i, _mm_cvtps_pd(v));
+        _mm_storeu_pd(pOut + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+void int32ToDoubleSse2(const int32_t * pIn, double * pOut, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i));
+        _mm_storeu_pd(pOut + i, _mm_cvtepi32_pd(v));
+        _mm_storeu_pd(pOut + i + 2, _mm_cvtepi32_pd(_mm_srli_si128(v, 8)));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+__attribute__((target("avx2")))
+size_t firstDifferenceAvx2(const uint8_t * pOld, const uint8_t * pNew, size_t bytes) {
+    size_t i = 0;
+    // 64 bytes per iteration, the position is looked for only in the block that differs
+    for (; i + 64 <= bytes; i += 64) {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pOld + i));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pNew + i));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pOld + i + 32));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pNew + i + 32));
+        __m256i equal0 = _mm256_cmpeq_epi8(a0, b0);
+        __m256i equal1 = _mm256_cmpeq_epi8(a1, b1);
+        if (static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(equal0, equal1))) != 0xFFFFFFFFu) {
+            unsigned mask0 = static_cast<unsigned>(_mm256_movemask_epi8(equal0));
+            if (mask0 != 0xFFFFFFFFu)
+                return i + __builtin_ctz(~mask0);
+            return i + 32 + __builtin_ctz(~static_cast<unsigned>(_mm256_movemask_epi8(equal1)));
+        }
+    }
+    return i + firstDifferenceSse2(pOld + i, pNew + i, bytes - i);
+}
+
+__attribute__((target("avx2")))
+size_t lastDifferenceAvx2(const uint8_t * pOld, const uint8_t * pNew, size_t end) {
+    size_t i = end;
+    for (; i >= 32; i -= 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pOld + i - 32));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pNew + i - 32));
+        unsigned equal = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+        if (equal != 0xFFFFFFFFu)
+            return i - 32 + (32 - __builtin_clz(~equal));
+    }
+    return lastDifferenceSse2(pOld, pNew, i);
+}
+
+__attribute__((target("avx2")))
+void int16ToInt32Avx2(const int16_t * pIn, int32_t * pOut, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut + i), _mm256_cvtepi16_epi32(v));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void uint16ToInt32Avx2(const uint16_t * pIn, int32_t * pOut, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut + i), _mm256_cvtepu16_epi32(v));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void floatToDoubleAvx2(const float * pIn, double * pOut, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(pIn + i);
+        _mm256_storeu_pd(pOut + i, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+        _mm256_storeu_pd(pOut + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void int32ToDoubleAvx2(const int32_t * pIn, double * pOut, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn + i));
+        _mm256_storeu_pd(pOut + i, _mm256_cvtepi32_pd(_mm256_castsi256_si128(v)));
+        _mm256_storeu_pd(pOut + i + 4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)));
+    }
+    convertScalar(pIn + i, pOut + i, count - i);
+}
+
+#endif  // ARRAYKERNELS_X86
+
+/**
+ * @brief Kernels of an instruction set.
+ *
+ */
+struct Kernels {
+    const char * name;
+    size_t (*firstDifference)(const uint8_t *, const uint8_t *, size_t);
+    size_t (*lastDifference)(const uint8_t *, const uint8_t *, size_t);
+    void (*int16ToInt32)(const int16_t *, int32_t *, size_t);
+    void (*uint16ToInt32)(const uint16_t *, int32_t *, size_t);
+    void (*floatToDouble)(const float *, double *, size_t);
+    void (*int32ToDouble)(const int32_t *, double *, size_t);
+};
+
+Kernels select() {
+#ifdef ARRAYKERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {"avx2", firstDifferenceAvx2, lastDifferenceAvx2, int16ToInt32Avx2, uint16ToInt32Avx2,
+                floatToDoubleAvx2, int32ToDoubleAvx2};
+    return {"sse2", firstDifferenceSse2, lastDifferenceSse2, int16ToInt32Sse2, uint16ToInt32Sse2,
+            floatToDoubleSse2, int32ToDoubleSse2};
+#else
+    return {"scalar", firstDifferencePortable, lastDifferenceScalar, convertScalar<int16_t, int32_t>,
+            convertScalar<uint16_t, int32_t>, convertScalar<float, double>, convertScalar<int32_t, double>};
+#endif
+}
+
+const Kernels & kernels() {
+    static const Kernels selected = select();
+    return selected;
+}
+
+// Whether every value of In is exactly representable as Out
+template<typename In, typename Out>
+constexpr bool isLossless() {
+    if (std::is_same<In, Out>::value)
+        return true;
+    if (std::is_same<In, bool>::value || std::is_same<Out, bool>::value)
+        return false;
+    if (std::is_floating_point<In>::value && !std::is_floating_point<Out>::value)
+        return false;
+    return std::numeric_limits<Out>::digits >= std::numeric_limits<In>::digits
+           && (!std::is_signed<In>::value || std::is_signed<Out>::value);
+}
+
+// Call a generic function with a null pointer of the C type of a numeric ArrayType
+template<typename Function>
+bool visit(ArrayType type, Function && function) {
+    switch (type) {
+        case ArrayType::Bool:    return function(static_cast<bool*>(nullptr));
+        case ArrayType::Int8:    return function(static_cast<int8_t*>(nullptr));
+        case ArrayType::Int16:   return function(static_cast<int16_t*>(nullptr));
+        case ArrayType::Int32:   return function(static_cast<int32_t*>(nullptr));
+        case ArrayType::Int64:   return function(static_cast<int64_t*>(nullptr));
+        case ArrayType::UInt8:   return function(static_cast<uint8_t*>(nullptr));
+        case ArrayType::UInt16:  return function(static_cast<uint16_t*>(nullptr));
+        case ArrayType::UInt32:  return function(static_cast<uint32_t*>(nullptr));
+        case ArrayType::UInt64:  return function(static_cast<uint64_t*>(nullptr));
+        case ArrayType::Float32: return function(static_cast<float*>(nullptr));
+        case ArrayType::Float64: return function(static_cast<double*>(nullptr));
+        default:                 return false;
+    }
+}
+
+}
+
+const char * ArrayKernels::instructionSet() {
+    return kernels().name;
+}
+
+bool ArrayKernels::dirtyRange(const void * pOld, const void * pNew, size_t count, size_t elementSize, size_t & first, size_t & end) {
+
+    const uint8_t * pOldBytes = static_cast<const uint8_t*>(pOld);
+    const uint8_t * pNewBytes = static_cast<const uint8_t*>(pNew);
+    size_t bytes = count * elementSize;
+
+    // The same buffer (an update that did not touch the array) is not compared
+    if (pOld == pNew || bytes == 0)
+        return false;
+
+    const Kernels & k = kernels();
+    size_t firstByte = k.firstDifference(pOldBytes, pNewBytes, bytes);
+    if (firstByte == bytes)
+        return false;
+    size_t endByte = firstByte + k.lastDifference(pOldBytes + firstByte, pNewBytes + firstByte, bytes - firstByte);
+
+    first = firstByte / elementSize;
+    end = (endByte + elementSize - 1) / elementSize;
+    return true;
+}
+
+bool ArrayKernels::canConvert(ArrayType from, ArrayType to) {
+    return visit(from, [to](auto * pIn) {
+        using In = std::remove_pointer_t<decltype(pIn)>;
+        return visit(to, [](auto * pOut) {
+            using Out = std::remove_pointer_t<decltype(pOut)>;
+            return isLossless<In, Out>();
+        });
+    });
+}
+
+bool ArrayKernels::convert(const void * pIn, ArrayType from, void * pOut, ArrayType to, size_t count) {
+
+    if (from == to && from != ArrayType::String && from != ArrayType::Value) {
+        memcpy(pOut, pIn, count * pvxs::elementSize(from));
+        return true;
+    }
+
+    // The common widenings of the waveforms are vectorized
+    const Kernels & k = kernels();
+    if (from == ArrayType::Int16 && to == ArrayType::Int32) {
+        k.int16ToInt32(static_cast<const int16_t*>(pIn), static_cast<int32_t*>(pOut), count);
+        return true;
+    }
+    if (from == ArrayType::UInt16 && to == ArrayType::Int32) {
+        k.uint16ToInt32(static_cast<const uint16_t*>(pIn), static_cast<int32_t*>(pOut), count);
+        return true;
+    }
+    if (from == ArrayType::Float32 && to == ArrayType::Float64) {
+        k.floatToDouble(static_cast<const float*>(pIn), static_cast<double*>(pOut), count);
+        return true;
+    }
+    if (from == ArrayType::Int32 && to == ArrayType::Float64) {
+        k.int32ToDouble(static_cast<const int32_t*>(pIn), static_cast<double*>(pOut), count);
+        return true;
+    }
+
+    // The rest of the lossless conversions, left to the auto-vectorizer
+    return visit(from, [=](auto * pInTag) {
+        using In = std::remove_pointer_t<decltype(pInTag)>;
+        return visit(to, [=](auto * pOutTag) {
+            using Out = std::remove_pointer_t<decltype(pOutTag)>;
+            if constexpr (isLossless<In, Out>()) {
+                convertScalar(static_cast<const In*>(pIn), static_cast<Out*>(pOut), count);
+                return true;
+            } else {
+                return false;
+            }
+        });
+    });
+}
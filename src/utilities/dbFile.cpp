@@ -0,0 +1,233 @@
+#include <dbFile.h>
+#include <logger.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+/**
+ * @brief Token of a database file: a punctuation character, a quoted string or a bare word.
+ *
+ */
+struct Token {
+    char punct = 0;
+    std::string text;
+    int line = 0;
+};
+
+bool isPunct(char c) {
+    return c == '(' || c == ')' || c == '{' || c == '}' || c == ',';
+}
+
+void tokenize(const std::string & text, std::vector<Token> & tokens) {
+    int line = 1;
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == '\n') {
+            ++line;
+            ++i;
+        } else if (isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == '#') {
+            // Comment until the end of the line
+            while (i < text.size() && text[i] != '\n')
+                ++i;
+        } else if (isPunct(c)) {
+            Token token;
+            token.punct = c;
+            token.line = line;
+            tokens.push_back(token);
+            ++i;
+        } else if (c == '"') {
+            Token token;
+            token.line = line;
+            for (++i; i < text.size() && text[i] != '"'; ++i) {
+                if (text[i] == '\\' && i + 1 < text.size())
+                    ++i;
+                if (text[i] == '\n')
+                    ++line;
+                token.text += text[i];
+            }
+            ++i;
+            tokens.push_back(std::move(token));
+        } else {
+            Token token;
+            token.line = line;
+            while (i < text.size() && !isspace(static_cast<unsigned char>(text[i])) && !isPunct(text[i])
+                   && text[i] != '"' && text[i] != '#')
+                token.text += text[i++];
+            tokens.push_back(std::move(token));
+        }
+    }
+}
+
+/**
+ * @brief Recursive descent over the tokens of a database file.
+ *
+ */
+class Parser {
+public:
+    Parser(const std::vector<Token> & tokens, const std::string & path) : m_tokens(tokens), m_path(path) {}
+
+    bool parse(std::vector<DbRecord> & records) {
+        std::unordered_map<std::string, size_t> byName;
+        while (m_pos < m_tokens.size()) {
+            const Token & keyword = m_tokens[m_pos];
+            if (keyword.punct != 0)
+                return error("statement expected");
+            ++m_pos;
+
+            std::vector<std::string> args;
+            if (!arguments(args))
+                return false;
+
+            if (keyword.text != "record" && keyword.text != "grecord") {
+                // include, path, alias... and their blocks
+                if (peek('{') && !skipBlock())
+                    return false;
+                continue;
+            }
+            if (args.size() != 2)
+                return error("record(type, name) expected");
+
+            auto it = byName.find(args[1]);
+            if (it == byName.end()) {
+                it = byName.emplace(args[1], records.size()).first;
+                records.push_back(DbRecord{args[0], args[1], {}});
+            }
+            if (peek('{') && !body(records[it->second]))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    const std::vector<Token> & m_tokens;
+    const std::string & m_path;
+    size_t m_pos = 0;
+
+    bool error(const char * message) {
+        int line = m_tokens.empty() ? 0 : m_tokens[std::min(m_pos, m_tokens.size() - 1)].line;
+        LOG_WARNING("%s:%d: %s", m_path.c_str(), line, message);
+        return false;
+    }
+
+    bool peek(char punct) const {
+        return m_pos < m_tokens.size() && m_tokens[m_pos].punct == punct;
+    }
+
+    bool expect(char punct) {
+        if (!peek(punct)) {
+            char message[] = "'?' expected";
+            message[1] = punct;
+            return error(message);
+        }
+        ++m_pos;
+        return true;
+    }
+
+    // ( arg, arg, ... )
+    bool arguments(std::vector<std::string> & args) {
+        if (!expect('('))
+            return false;
+        while (!peek(')')) {
+            if (m_pos >= m_tokens.size() || m_tokens[m_pos].punct != 0)
+                return error("argument expected");
+            args.push_back(m_tokens[m_pos++].text);
+            if (peek(','))
+                ++m_pos;
+        }
+        return expect(')');
+    }
+
+    bool skipBlock() {
+        int depth = 0;
+        do {
+            if (m_pos >= m_tokens.size())
+                return error("'}' expected");
+            if (m_tokens[m_pos].punct == '{')
+                ++depth;
+            else if (m_tokens[m_pos].punct == '}')
+                --depth;
+            ++m_pos;
+        } while (depth > 0);
+        return true;
+    }
+
+    // { field(NAME, "value") info(...) ... }
+    bool body(DbRecord & record) {
+        ++m_pos;
+        while (!peek('}')) {
+            if (m_pos >= m_tokens.size() || m_tokens[m_pos].punct != 0)
+                return error("field expected");
+            const std::string & keyword = m_tokens[m_pos++].text;
+            std::vector<std::string> args;
+            if (!arguments(args))
+                return false;
+            if (keyword == "field") {
+                if (args.size() != 2)
+                    return error("field(name, value) expected");
+                record.fields[args[0]] = args[1];
+            }
+        }
+        ++m_pos;
+        return true;
+    }
+};
+
+}
+
+const std::string & DbRecord::field(const std::string & fieldName, const std::string & defaultValue) const {
+    auto it = fields.find(fieldName);
+    return (it == fields.end()) ? defaultValue : it->second;
+}
+
+double DbRecord::number(const std::string & fieldName, double defaultValue) const {
+    auto it = fields.find(fieldName);
+    if (it == fields.end() || it->second.empty())
+        return defaultValue;
+    char * pEnd = nullptr;
+    double value = strtod(it->second.c_str(), &pEnd);
+    return (pEnd == it->second.c_str()) ? defaultValue : value;
+}
+
+bool DbFile::parse(const std::string & path, std::vector<DbRecord> & records) {
+
+    std::ifstream file(path);
+    if (!file) {
+        LOG_WARNING("The database %s could not be opened", path.c_str());
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    std::vector<Token> tokens;
+    tokenize(text.str(), tokens);
+    return Parser(tokens, path).parse(records);
+}
+
+size_t DbFile::parseAll(const std::string & path, std::vector<DbRecord> & records) {
+
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error))
+        return parse(path, records) ? 1 : 0;
+
+    // Sorted, so the records are always in the same order
+    std::vector<std::string> paths;
+    for (const auto & entry : std::filesystem::recursive_directory_iterator(path, error))
+        if (entry.is_regular_file() && entry.path().extension() == ".db")
+            paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+
+    size_t parsed = 0;
+    for (const auto & dbPath : paths)
+        if (parse(dbPath, records))
+            ++parsed;
+    return parsed;
+}
@@ -0,0 +1,220 @@
+#include <historyStore.h>
+#include <logger.h>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace {
+
+bool isFloatingPoint(uint8_t type) {
+    return type == OpcUaType_Double || type == OpcUaType_Float;
+}
+
+double bitsToDouble(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+}
+
+double HistorySample::toDouble() const {
+    if (isFloatingPoint(type))
+        return bitsToDouble(bits);
+    if (type == OpcUaType_UInt64)
+        return static_cast<double>(bits);
+    return static_cast<double>(static_cast<int64_t>(bits));
+}
+
+void HistorySample::toVariant(UaVariant & variant) const {
+    int64_t integer = static_cast<int64_t>(bits);
+    switch (type) {
+        case OpcUaType_Boolean: variant.setBool(bits != 0 ? OpcUa_True : OpcUa_False); break;
+        case OpcUaType_SByte:   variant.setSByte(static_cast<OpcUa_SByte>(integer)); break;
+        case OpcUaType_Byte:    variant.setByte(static_cast<OpcUa_Byte>(integer)); break;
+        case OpcUaType_Int16:   variant.setInt16(static_cast<OpcUa_Int16>(integer)); break;
+        case OpcUaType_UInt16:  variant.setUInt16(static_cast<OpcUa_UInt16>(integer)); break;
+        case OpcUaType_Int32:   variant.setInt32(static_cast<OpcUa_Int32>(integer)); break;
+        case OpcUaType_UInt32:  variant.setUInt32(static_cast<OpcUa_UInt32>(integer)); break;
+        case OpcUaType_Int64:   variant.setInt64(integer); break;
+        case OpcUaType_UInt64:  variant.setUInt64(bits); break;
+        case OpcUaType_Float:   variant.setFloat(static_cast<OpcUa_Float>(bitsToDouble(bits))); break;
+        case OpcUaType_Double:  variant.setDouble(bitsToDouble(bits)); break;
+        default:                variant.clear(); break;
+    }
+}
+
+HistoryStore::HistoryStore(size_t samplesPerPV, size_t maxPVs)
+    // One block more than needed, so the window is complete while the newest block fills
+    : m_blocksPerPV(static_cast<uint32_t>((samplesPerPV + BlockSamples - 1) / BlockSamples + 1)),
+      m_maxPVs(maxPVs),
+      m_rings(new Ring[maxPVs]),
+      m_locks(new std::mutex[LockStripes]) {}
+
+bool HistoryStore::encode(const UaVariant & variant, uint8_t & type, uint64_t & bits) {
+
+    if (variant.isArray() || variant.isMatrix())
+        return false;
+
+    type = static_cast<uint8_t>(variant.type());
+    switch (type) {
+        case OpcUaType_Boolean: {
+            OpcUa_Boolean value;
+            if (variant.toBool(value) != OpcUa_Good)
+                return false;
+            bits = value ? 1 : 0;
+            return true;
+        }
+        case OpcUaType_SByte:
+        case OpcUaType_Byte:
+        case OpcUaType_Int16:
+        case OpcUaType_UInt16:
+        case OpcUaType_Int32:
+        case OpcUaType_UInt32:
+        case OpcUaType_Int64: {
+            OpcUa_Int64 value;
+            if (variant.toInt64(value) != OpcUa_Good)
+                return false;
+            bits = static_cast<uint64_t>(value);
+            return true;
+        }
+        case OpcUaType_UInt64: {
+            OpcUa_UInt64 value;
+            if (variant.toUInt64(value) != OpcUa_Good)
+                return false;
+            bits = value;
+            return true;
+        }
+        case OpcUaType_Float:
+        case OpcUaType_Double: {
+            OpcUa_Double value;
+            if (variant.toDouble(value) != OpcUa_Good)
+                return false;
+            memcpy(&bits, &value, sizeof(bits));
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+HistoryStore::Block & HistoryStore::nextBlock(Ring & ring) {
+    uint32_t index;
+    if (ring.used == m_blocksPerPV) {
+        // Full: the oldest block is reused
+        index = ring.first;
+        ring.first = (ring.first + 1) % m_blocksPerPV;
+    } else {
+        index = (ring.first + ring.used) % m_blocksPerPV;
+        ++ring.used;
+    }
+    return ring.blocks[index];
+}
+
+bool HistoryStore::append(uint32_t pvId, int64_t timestamp, const UaVariant & value, OpcUa_StatusCode statusCode) {
+
+    if (pvId >= m_maxPVs)
+        return false;
+
+    // The Bad samples only record the status
+    uint8_t type = OpcUaType_Null;
+    uint64_t bits = 0;
+    if (OpcUa_IsNotBad(statusCode) && !encode(value, type, bits))
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_locks[pvId % LockStripes]);
+    Ring & ring = m_rings[pvId];
+    if (!ring.blocks)
+        ring.blocks.reset(new Block[m_blocksPerPV]);
+
+    Block * pBlock = (ring.used > 0) ? &ring.blocks[(ring.first + ring.used - 1) % m_blocksPerPV] : nullptr;
+    int64_t timeDelta = timestamp - ring.lastTime;
+
+    if (pBlock == nullptr || pBlock->count == BlockSamples || pBlock->statusCode != statusCode || pBlock->type != type
+        || timeDelta < 0 || timeDelta > std::numeric_limits<uint32_t>::max()) {
+        // The first sample of a block is stored in full
+        Block & block = nextBlock(ring);
+        block.firstTime = timestamp;
+        block.firstBits = bits;
+        block.statusCode = statusCode;
+        block.type = type;
+        block.count = 1;
+        block.timeDeltas[0] = 0;
+        block.valueDeltas[0] = 0;
+    } else {
+        uint16_t i = pBlock->count++;
+        pBlock->timeDeltas[i] = static_cast<uint32_t>(timeDelta);
+        pBlock->valueDeltas[i] = isFloatingPoint(type) ? (bits ^ ring.lastBits) : (bits - ring.lastBits);
+    }
+
+    ring.lastTime = timestamp;
+    ring.lastBits = bits;
+    return true;
+}
+
+size_t HistoryStore::read(uint32_t pvId, int64_t startTime, int64_t endTime, std::vector<HistorySample> & samples) const {
+
+    if (pvId >= m_maxPVs)
+        return 0;
+
+    size_t initialSize = samples.size();
+    std::lock_guard<std::mutex> lock(m_locks[pvId % LockStripes]);
+    const Ring & ring = m_rings[pvId];
+
+    for (uint32_t b = 0; b < ring.used; ++b) {
+        const Block & block = ring.blocks[(ring.first + b) % m_blocksPerPV];
+        bool floatingPoint = isFloatingPoint(block.type);
+
+        int64_t time = block.firstTime;
+        uint64_t bits = block.firstBits;
+        for (uint16_t i = 0; i < block.count; ++i) {
+            if (i > 0) {
+                time += block.timeDeltas[i];
+                bits = floatingPoint ? (bits ^ block.valueDeltas[i]) : (bits + block.valueDeltas[i]);
+            }
+            if (time > endTime)
+                break;
+            if (time >= startTime)
+                samples.push_back(HistorySample{time, bits, block.type, block.statusCode});
+        }
+    }
+    return samples.size() - initialSize;
+}
+
+bool HistoryStore::loadConfig(const std::string & path, HistoryConfig & config) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        try {
+            if (key == "samplesPerPV")
+                config.samplesPerPV = static_cast<size_t>(std::stoul(value));
+            else if (key == "maxPVs")
+                config.maxPVs = static_cast<size_t>(std::stoul(value));
+            else
+                LOG_WARNING("History: unknown key %s in %s", key.c_str(), path.c_str());
+        } catch (const std::exception &) {
+            LOG_WARNING("History: invalid value for %s in %s", key.c_str(), path.c_str());
+        }
+    }
+
+    return config.samplesPerPV > 0 && config.maxPVs > 0;
+}
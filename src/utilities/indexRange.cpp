@@ -0,0 +1,44 @@
+#include <indexRange.h>
+
+namespace {
+
+// Parse a decimal index and advance the pointer. false if there are no digits or it overflows.
+bool parseIndex(const char *& p, size_t & index) {
+    if (*p < '0' || *p > '9')
+        return false;
+    index = 0;
+    for (; *p >= '0' && *p <= '9'; ++p) {
+        size_t digit = static_cast<size_t>(*p - '0');
+        if (index > (SIZE_MAX - 1 - digit) / 10)
+            return false;
+        index = index * 10 + digit;
+    }
+    return true;
+}
+
+}
+
+bool IndexRange::parse(const char * text, IndexRange & range) {
+
+    range = IndexRange();
+    if (text == nullptr || *text == '\0')
+        return true;
+
+    const char * p = text;
+    size_t first, last;
+    if (!parseIndex(p, first))
+        return false;
+    last = first;
+    if (*p == ':') {
+        ++p;
+        if (!parseIndex(p, last) || last <= first)
+            return false;
+    }
+    // Anything else, including the ',' of a second dimension, is not valid
+    if (*p != '\0')
+        return false;
+
+    range.first = first;
+    range.end = last + 1;
+    return true;
+}
@@ -1,6 +1,5 @@
 #include <iocBasicObject.h>
-#include <iostream>
-#include <opcua_analogitemtype.h>
+#include <logger.h>
 #include <opcua_twostatediscretetype.h>
 #include <opcua_multistatediscretetype.h>
 
@@ -13,73 +12,77 @@ IocBasicObject::IocBasicObject(
     UaObjectBase(name, newNodeId, defaultLocaleId),
     m_typeId(typeId), m_pNodeManager(pNodeManager) {
 
-    std::cout << "Objeto " << name << " creado" << std::endl;
+    LOG_DEBUG("Objeto %s creado", name.toUtf8());
     
 }
 
 IocBasicObject::~IocBasicObject(void) {}
 
-UaStatus IocBasicObject::addVariable(UaVariable * pInstanceDeclarationVar) { 
-    
+bool IocVariableTemplate::resolve(UaVariable * pInstanceDeclarationVar, PropertyStore & propertyStore, IocVariableTemplate & variableTemplate) {
+
     UA_ASSERT(pInstanceDeclarationVar!=NULL);
 
-    UaStatus result;
+    variableTemplate.pInstanceDeclaration = pInstanceDeclarationVar;
+    variableTemplate.properties.clear();
 
-    // Use dynamic cast to determine the variable type
+    // Use dynamic cast to determine the variable type, once per ObjectType
     // Analog Variable
     if (auto* pAnalogType = dynamic_cast<OpcUa::BaseAnalogType*>(pInstanceDeclarationVar)) {
-
-        OpcUa::AnalogItemType* pAnalogVar = new OpcUa::AnalogItemType(
-            this,
-            pInstanceDeclarationVar,
-            m_pNodeManager,
-            m_pSharedMutex
-        );
-        pAnalogVar->setEngineeringUnits(pAnalogType->getEngineeringUnits());
-        pAnalogVar->setEURange(pAnalogType->getEURange());
-        pAnalogVar->setInstrumentRange(pAnalogType->getInstrumentRange());
-
-        result = m_pNodeManager->addNodeAndReference(this, pAnalogVar, OpcUaId_HasComponent);
-        
+        variableTemplate.typeDefinitionId = UaNodeId(OpcUaId_AnalogItemType);
+        variableTemplate.properties.push_back(propertyStore.engineeringUnits(pAnalogType->getEngineeringUnits()));
+        variableTemplate.properties.push_back(propertyStore.euRange(pAnalogType->getEURange()));
+        variableTemplate.properties.push_back(propertyStore.instrumentRange(pAnalogType->getInstrumentRange()));
     }
     // Two State Variable
     else if (auto* pTwoStateType = dynamic_cast<OpcUa::TwoStateDiscreteType*>(pInstanceDeclarationVar)) {
-        
-        OpcUa::TwoStateDiscreteType* pTwoStateVar = new OpcUa::TwoStateDiscreteType(
-            this,
-            pInstanceDeclarationVar,
-            m_pNodeManager,
-            m_pSharedMutex
-        );
-        
-        pTwoStateVar->setFalseState(pTwoStateType->getFalseState(NULL));
-        pTwoStateVar->setTrueState(pTwoStateType->getTrueState(NULL));
-
-        result = m_pNodeManager->addNodeAndReference(this, pTwoStateVar, OpcUaId_HasComponent);
-
+        variableTemplate.typeDefinitionId = UaNodeId(OpcUaId_TwoStateDiscreteType);
+        variableTemplate.properties.push_back(propertyStore.falseState(pTwoStateType->getFalseState(NULL)));
+        variableTemplate.properties.push_back(propertyStore.trueState(pTwoStateType->getTrueState(NULL)));
     }
     // Multi State Variable
     else if (auto* pMultiStateType = dynamic_cast<OpcUa::MultiStateDiscreteType*>(pInstanceDeclarationVar)) {
-        
-        OpcUa::MultiStateDiscreteType * pMultiStateVar = new OpcUa::MultiStateDiscreteType(
-            this,
-            pInstanceDeclarationVar,
-            m_pNodeManager,
-            m_pSharedMutex
-        );
-
+        variableTemplate.typeDefinitionId = UaNodeId(OpcUaId_MultiStateDiscreteType);
         UaLocalizedTextArray enumStrings;
         pMultiStateType->getEnumStrings(enumStrings);
-        pMultiStateVar->setEnumStrings(enumStrings);
-
-        result = m_pNodeManager->addNodeAndReference(this, pMultiStateVar, OpcUaId_HasComponent);
+        variableTemplate.properties.push_back(propertyStore.enumStrings(enumStrings));
     }
     // Error, unknown type
     else {
+        return false;
+    }
+
+    return true;
+}
+
+UaStatus IocBasicObject::addVariable(UaVariable * pInstanceDeclarationVar) { 
+
+    IocVariableTemplate variableTemplate;
+    if (!IocVariableTemplate::resolve(pInstanceDeclarationVar, m_pNodeManager->propertyStore(), variableTemplate)) {
+        LOG_ERROR("Error: Unknown variable type of %s", pInstanceDeclarationVar->browseName().toString().toUtf8());
+        return OpcUa_BadInvalidArgument;
+    }
+
+    return addVariable(variableTemplate);
+}
+
+UaStatus IocBasicObject::addVariable(const IocVariableTemplate & variableTemplate) {
+
+    IocSharedVariable * pVariable = new IocSharedVariable(
+        this,
+        variableTemplate.pInstanceDeclaration,
+        m_pNodeManager,
+        m_pSharedMutex,
+        variableTemplate.typeDefinitionId
+    );
+    m_pNodeManager->setHistorizing(pVariable);
 
-        std::cerr << "Error: Unknown variable type" << std::endl;
-        result = OpcUa_BadInvalidArgument;
+    UaStatus result = m_pNodeManager->addNodeAndReference(this, pVariable, OpcUaId_HasComponent);
 
+    // Own property nodes, their values are shared by every instance with the same values
+    for (const PropertyHandle & pProperty : variableTemplate.properties) {
+        if (result.isBad())
+            break;
+        result = m_pNodeManager->propertyStore().addProperty(pVariable, pProperty);
     }
 
     return result;
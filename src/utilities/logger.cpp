@@ -0,0 +1,390 @@
+#include <logger.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+
+namespace {
+
+const char * levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug:   return "debug";
+        case LogLevel::Info:    return "info";
+        case LogLevel::Warning: return "warning";
+        case LogLevel::Error:   return "error";
+    }
+    return "unknown";
+}
+
+const char * levelTag(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug:   return "DEBUG";
+        case LogLevel::Info:    return "INFO ";
+        case LogLevel::Warning: return "WARN ";
+        case LogLevel::Error:   return "ERROR";
+    }
+    return "?????";
+}
+
+int64_t nowNanoseconds() {
+    auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count();
+}
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+void writeLittleEndian(FILE * file, uint64_t value, size_t bytes) {
+    uint8_t buffer[8];
+    for (size_t i = 0; i < bytes; ++i)
+        buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+    fwrite(buffer, 1, bytes, file);
+}
+
+}
+
+void ConsoleSink::write(const LogRecord & record) {
+    time_t seconds = static_cast<time_t>(record.timestamp / 1000000000);
+    int milliseconds = static_cast<int>((record.timestamp / 1000000) % 1000);
+    tm local;
+    localtime_r(&seconds, &local);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &local);
+
+    FILE * stream = (record.level >= LogLevel::Warning) ? stderr : stdout;
+    fprintf(stream, "%s.%03d %s %.*s\n", date, milliseconds, levelTag(record.level),
+            static_cast<int>(record.length), record.text);
+}
+
+void ConsoleSink::flush() {
+    fflush(stdout);
+    fflush(stderr);
+}
+
+JsonSink::JsonSink(const std::string & path) : m_file(fopen(path.c_str(), "a")) {}
+
+JsonSink::~JsonSink() {
+    if (m_file)
+        fclose(m_file);
+}
+
+void JsonSink::write(const LogRecord & record) {
+    if (!m_file)
+        return;
+
+    fprintf(m_file, "{\"ts\":%lld,\"level\":\"%s\",", static_cast<long long>(record.timestamp), levelName(record.level));
+    if (record.pvId != Logger::NoPV)
+        fprintf(m_file, "\"pv\":%u,", record.pvId);
+    fputs("\"msg\":\"", m_file);
+    for (uint16_t i = 0; i < record.length; ++i) {
+        char c = record.text[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', m_file);
+            fputc(c, m_file);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            fprintf(m_file, "\\u%04x", static_cast<unsigned>(c));
+        } else {
+            fputc(c, m_file);
+        }
+    }
+    fputs("\"}\n", m_file);
+}
+
+void JsonSink::flush() {
+    if (m_file)
+        fflush(m_file);
+}
+
+BinarySink::BinarySink(const std::string & path) : m_file(fopen(path.c_str(), "ab")) {}
+
+BinarySink::~BinarySink() {
+    if (m_file)
+        fclose(m_file);
+}
+
+void BinarySink::write(const LogRecord & record) {
+    if (!m_file)
+        return;
+
+    writeLittleEndian(m_file, static_cast<uint64_t>(record.timestamp), 8);
+    writeLittleEndian(m_file, record.pvId, 4);
+    writeLittleEndian(m_file, static_cast<uint8_t>(record.level), 1);
+    writeLittleEndian(m_file, record.length, 2);
+    fwrite(record.text, 1, record.length, m_file);
+}
+
+void BinarySink::flush() {
+    if (m_file)
+        fflush(m_file);
+}
+
+Logger::Logger()
+    : m_cells(new Cell[Capacity]), m_rates(new std::atomic<uint64_t>[RateSlots]) {
+
+    for (size_t i = 0; i < Capacity; ++i)
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    for (size_t i = 0; i < RateSlots; ++i)
+        m_rates[i].store(0, std::memory_order_relaxed);
+}
+
+Logger::~Logger() {
+    stop();
+}
+
+Logger & Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+void Logger::addSink(std::unique_ptr<LogSink> sink) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sinks.push_back(std::move(sink));
+}
+
+void Logger::start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable())
+        return;
+
+    if (m_sinks.empty())
+        m_sinks.push_back(std::make_unique<ConsoleSink>());
+
+    m_stopping = false;
+    m_stopped.store(false);
+    m_thread = std::thread([this]() { run(); });
+}
+
+void Logger::stop() {
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    }
+    m_cv.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // From now on the callers write their messages
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopped.store(true);
+    if (m_sinks.empty())
+        m_sinks.push_back(std::make_unique<ConsoleSink>());
+    drain();
+}
+
+bool Logger::allow(uint32_t pvId, uint32_t & suppressed) {
+    suppressed = 0;
+    uint32_t limit = m_pvRateLimit.load(std::memory_order_relaxed);
+    if (limit == 0 || pvId == NoPV)
+        return true;
+
+    uint64_t second = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count()) & 0xFFFFFFFF;
+    std::atomic<uint64_t> & slot = m_rates[pvId % RateSlots];
+
+    uint64_t current = slot.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t window = current >> 32;
+        uint32_t count = static_cast<uint32_t>(current);
+        uint64_t next = (window == second) ? current + 1 : (second << 32) | 1;
+        if (slot.compare_exchange_weak(current, next, std::memory_order_relaxed)) {
+            if (window != second) {
+                // First message of a new window: report what the previous one suppressed
+                suppressed = (count > limit) ? count - limit : 0;
+                return true;
+            }
+            return count < limit;
+        }
+    }
+}
+
+void Logger::push(LogLevel level, uint32_t pvId, const char * format, va_list args) {
+
+    LogRecord record;
+    record.timestamp = nowNanoseconds();
+    record.pvId = pvId;
+    record.level = level;
+    int length = vsnprintf(record.text, LogRecord::MaxText, format, args);
+    if (length < 0)
+        length = 0;
+    record.length = static_cast<uint16_t>(std::min<size_t>(static_cast<size_t>(length), LogRecord::MaxText - 1));
+
+    if (m_stopped.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto & sink : m_sinks) {
+            sink->write(record);
+            sink->flush();
+        }
+        return;
+    }
+
+    size_t pos = m_writePos.load(std::memory_order_relaxed);
+    Cell * cell;
+    while (true) {
+        cell = &m_cells[pos & (Capacity - 1)];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (m_writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Full: the record is dropped, the caller never waits
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = m_writePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    memcpy(&cell->record, &record, offsetof(LogRecord, text) + record.length);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    if (m_sleeping.load(std::memory_order_acquire))
+        m_cv.notify_one();
+}
+
+bool Logger::pop(LogRecord & record) {
+    Cell & cell = m_cells[m_readPos & (Capacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != m_readPos + 1)
+        return false;
+
+    memcpy(&record, &cell.record, offsetof(LogRecord, text) + cell.record.length);
+    cell.sequence.store(m_readPos + Capacity, std::memory_order_release);
+    ++m_readPos;
+    return true;
+}
+
+void Logger::drain() {
+    LogRecord record;
+    bool written = false;
+    while (pop(record)) {
+        for (auto & sink : m_sinks)
+            sink->write(record);
+        written = true;
+    }
+    if (written)
+        for (auto & sink : m_sinks)
+            sink->flush();
+}
+
+void Logger::run() {
+
+    uint64_t reportedDrops = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_stopping) {
+        lock.unlock();
+        drain();
+
+        uint64_t drops = dropped();
+        if (drops != reportedDrops) {
+            log(LogLevel::Warning, "Logger: %llu messages dropped, the ring buffer was full",
+                static_cast<unsigned long long>(drops - reportedDrops));
+            reportedDrops = drops;
+        }
+        lock.lock();
+
+        // The timeout covers a producer that pushed just before m_sleeping was set
+        m_sleeping.store(true, std::memory_order_release);
+        m_cv.wait_for(lock, std::chrono::milliseconds(50), [this]() {
+            return m_stopping || m_cells[m_readPos & (Capacity - 1)].sequence.load(std::memory_order_acquire) == m_readPos + 1;
+        });
+        m_sleeping.store(false, std::memory_order_release);
+    }
+}
+
+void Logger::log(LogLevel level, const char * format, ...) {
+    if (!enabled(level))
+        return;
+
+    va_list args;
+    va_start(args, format);
+    push(level, NoPV, format, args);
+    va_end(args);
+}
+
+void Logger::logPV(LogLevel level, uint32_t pvId, const char * format, ...) {
+    if (!enabled(level))
+        return;
+
+    uint32_t suppressed;
+    if (!allow(pvId, suppressed))
+        return;
+
+    if (suppressed > 0)
+        log(LogLevel::Warning, "Logger: %u messages of PV %u suppressed by the rate limit", suppressed, pvId);
+
+    va_list args;
+    va_start(args, format);
+    push(level, pvId, format, args);
+    va_end(args);
+}
+
+bool Logger::loadConfig(const std::string & path) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    bool console = true;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        if (key == "level") {
+            if (value == "debug")
+                setLevel(LogLevel::Debug);
+            else if (value == "info")
+                setLevel(LogLevel::Info);
+            else if (value == "warning")
+                setLevel(LogLevel::Warning);
+            else if (value == "error")
+                setLevel(LogLevel::Error);
+            else
+                log(LogLevel::Warning, "Logger: invalid level %s in %s", value.c_str(), path.c_str());
+        }
+        else if (key == "pvRate") {
+            try {
+                setPVRateLimit(static_cast<uint32_t>(std::stoul(value)));
+            } catch (const std::exception &) {
+                log(LogLevel::Warning, "Logger: invalid value for pvRate in %s", path.c_str());
+            }
+        }
+        else if (key == "console") {
+            console = (value == "true");
+        }
+        else if (key == "json") {
+            auto sink = std::make_unique<JsonSink>(value);
+            if (sink->isOpen())
+                addSink(std::move(sink));
+            else
+                log(LogLevel::Error, "Logger: can not open %s", value.c_str());
+        }
+        else if (key == "binary") {
+            auto sink = std::make_unique<BinarySink>(value);
+            if (sink->isOpen())
+                addSink(std::move(sink));
+            else
+                log(LogLevel::Error, "Logger: can not open %s", value.c_str());
+        }
+        else {
+            log(LogLevel::Warning, "Logger: unknown key %s in %s", key.c_str(), path.c_str());
+        }
+    }
+
+    if (console)
+        addSink(std::make_unique<ConsoleSink>());
+    return true;
+}
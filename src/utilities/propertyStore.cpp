@@ -0,0 +1,176 @@
+#include <propertyStore.h>
+#include <myNodeIOEventManager.h>
+#include <opcua_propertytype.h>
+#include <sstream>
+
+namespace {
+
+void appendText(std::ostringstream & key, const UaLocalizedText & text) {
+    // '\x1f' can not appear in the texts, so the keys are not ambiguous
+    key << UaLocalizedText(text).locale().toUtf8() << '\x1f' << UaLocalizedText(text).text().toUtf8() << '\x1f';
+}
+
+void appendRange(std::ostringstream & key, const UaRange & range) {
+    key.precision(17);
+    key << range.getLow() << '\x1f' << range.getHigh();
+}
+
+// Heap memory of the strings of a text, with their terminators
+size_t textBytes(const UaLocalizedText & text) {
+    UaLocalizedText copy(text);
+    return static_cast<size_t>(copy.locale().length()) + 1 + static_cast<size_t>(copy.text().length()) + 1;
+}
+
+}
+
+SharedValueProperty::SharedValueProperty(const UaNodeId & nodeId, const PropertyHandle & pValue, NodeManagerConfig * pNodeConfig)
+    : OpcUa::PropertyType(nodeId, UaString(pValue->browseName), 0, UaVariant(), Ua_AccessLevel_CurrentRead, pNodeConfig),
+      m_pValue(pValue) {
+    setDataType(UaNodeId(pValue->dataTypeId));
+    setValueRank(pValue->valueRank);
+}
+
+UaDataValue SharedValueProperty::value(Session * pSession) {
+    OpcUa_ReferenceParameter(pSession);
+    return m_pValue->value;
+}
+
+PropertyStore::PropertyStore(MyNodeIOEventManager * pNodeManager) : m_pNodeManager(pNodeManager) {}
+
+PropertyHandle PropertyStore::intern(const std::string & key, const char * browseName, const UaVariant & value,
+                                     OpcUa_UInt32 dataTypeId, OpcUa_Int32 valueRank, size_t bytes) {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_properties.find(key);
+    if (it != m_properties.end())
+        return it->second;
+
+    UaDateTime now = UaDateTime::now();
+    PropertyHandle pValue = std::make_shared<const PropertyValue>(
+        PropertyValue{browseName, UaDataValue(value, OpcUa_Good, now, now), dataTypeId, valueRank, bytes});
+    m_properties.emplace(key, pValue);
+    m_valueBytes += bytes;
+    return pValue;
+}
+
+UaStatus PropertyStore::addProperty(UaVariable * pVariable, const PropertyHandle & pValue) {
+
+    if (!pValue)
+        return OpcUa_Good;
+
+    // "<node of the variable>.<property>", as the SDK names the children of the instances
+    UaNodeId variableId = pVariable->nodeId();
+    UaString sVariableId = variableId.identifierType() == OpcUa_IdentifierType_String
+        ? UaString(variableId.identifierString()) : variableId.toString();
+    UaNodeId nodeId(UaString("%1.%2").arg(sVariableId).arg(pValue->browseName), variableId.namespaceIndex());
+
+    // Without the store mutex: the node manager takes its own lock
+    SharedValueProperty * pProperty = new SharedValueProperty(nodeId, pValue, m_pNodeManager);
+    UaStatus result = m_pNodeManager->addNodeAndReference(variableId, pProperty, OpcUaId_HasProperty);
+    if (result.isBad()) {
+        pProperty->releaseReference();
+        return result;
+    }
+    ++m_nodes;
+    m_copiedBytes += pValue->bytes;
+    return result;
+}
+
+PropertyHandle PropertyStore::engineeringUnits(const UaEUInformation & engineeringUnits) {
+    std::ostringstream key;
+    key << "EngineeringUnits\x1f" << engineeringUnits.getNamespaceUri().toUtf8() << '\x1f' << engineeringUnits.getUnitId() << '\x1f';
+    appendText(key, engineeringUnits.getDisplayName());
+    appendText(key, engineeringUnits.getDescription());
+
+    UaVariant value;
+    engineeringUnits.toVariant(value);
+    size_t bytes = sizeof(OpcUa_ExtensionObject) + sizeof(OpcUa_EUInformation) + static_cast<size_t>(engineeringUnits.getNamespaceUri().length()) + 1
+        + textBytes(engineeringUnits.getDisplayName()) + textBytes(engineeringUnits.getDescription());
+    return intern(key.str(), "EngineeringUnits", value, OpcUaId_EUInformation, OpcUa_ValueRanks_Scalar, bytes);
+}
+
+PropertyHandle PropertyStore::euRange(const UaRange & range) {
+    std::ostringstream key;
+    key << "EURange\x1f";
+    appendRange(key, range);
+
+    UaVariant value;
+    range.toVariant(value);
+    return intern(key.str(), "EURange", value, OpcUaId_Range, OpcUa_ValueRanks_Scalar,
+                  sizeof(OpcUa_ExtensionObject) + sizeof(OpcUa_Range));
+}
+
+PropertyHandle PropertyStore::instrumentRange(const UaRange & range) {
+    std::ostringstream key;
+    key << "InstrumentRange\x1f";
+    appendRange(key, range);
+
+    UaVariant value;
+    range.toVariant(value);
+    return intern(key.str(), "InstrumentRange", value, OpcUaId_Range, OpcUa_ValueRanks_Scalar,
+                  sizeof(OpcUa_ExtensionObject) + sizeof(OpcUa_Range));
+}
+
+PropertyHandle PropertyStore::falseState(const UaLocalizedText & text) {
+    std::ostringstream key;
+    key << "FalseState\x1f";
+    appendText(key, text);
+
+    UaVariant value;
+    value.setLocalizedText(text);
+    return intern(key.str(), "FalseState", value, OpcUaId_LocalizedText, OpcUa_ValueRanks_Scalar,
+                  sizeof(OpcUa_LocalizedText) + textBytes(text));
+}
+
+PropertyHandle PropertyStore::trueState(const UaLocalizedText & text) {
+    std::ostringstream key;
+    key << "TrueState\x1f";
+    appendText(key, text);
+
+    UaVariant value;
+    value.setLocalizedText(text);
+    return intern(key.str(), "TrueState", value, OpcUaId_LocalizedText, OpcUa_ValueRanks_Scalar,
+                  sizeof(OpcUa_LocalizedText) + textBytes(text));
+}
+
+PropertyHandle PropertyStore::enumStrings(const UaLocalizedTextArray & texts) {
+    std::ostringstream key;
+    key << "EnumStrings\x1f" << texts.length() << '\x1f';
+    size_t bytes = 0;
+    for (OpcUa_UInt32 i = 0; i < texts.length(); ++i) {
+        appendText(key, UaLocalizedText(texts[i]));
+        bytes += sizeof(OpcUa_LocalizedText) + textBytes(UaLocalizedText(texts[i]));
+    }
+
+    UaVariant value;
+    value.setLocalizedTextArray(texts);
+    return intern(key.str(), "EnumStrings", value, OpcUaId_LocalizedText, OpcUa_ValueRanks_OneDimension, bytes);
+}
+
+size_t PropertyStore::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_properties.size();
+}
+
+PropertyStore::Statistics PropertyStore::statistics() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return Statistics{m_properties.size(), m_valueBytes, m_nodes.load(), m_copiedBytes.load()};
+}
+
+bool PropertyStore::readProperty(UaVariable * pVariable, const char * browseName, UaVariant & value) {
+
+    UaString sBrowseName(browseName);
+    UaNodeId hasProperty(OpcUaId_HasProperty);
+    const UaReference * pReference = pVariable->getUaReferenceLists()->pTargetNodes();
+
+    while (pReference != nullptr) {
+        UaNode * pNode = pReference->pTargetNode();
+        if (pNode != NULL && pNode->nodeClass() == OpcUa_NodeClass_Variable
+            && pReference->referenceTypeId() == hasProperty && pNode->browseName().name() == sBrowseName) {
+            value = *static_cast<UaVariable*>(pNode)->value(NULL).value();
+            return true;
+        }
+        pReference = pReference->pNextForwardReference();
+    }
+    return false;
+}
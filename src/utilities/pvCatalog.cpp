@@ -0,0 +1,205 @@
+#include <pvCatalog.h>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Reference to a string (or a block of strings) in the string table
+struct StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+struct FileRecord {
+    StringRef epicsName;
+    StringRef nodeId;
+    StringRef ntId;
+    StringRef units;
+    StringRef choices;          // Choices separated by '\0'
+    StringRef recordType;
+    uint32_t choiceCount;
+    uint8_t valueType;
+    uint8_t reserved[3];
+    double limitLow;
+    double limitHigh;
+};
+
+static_assert(sizeof(FileHeader) == 32, "Unexpected padding in FileHeader");
+static_assert(sizeof(FileRecord) == 72, "Unexpected padding in FileRecord");
+
+const char Magic[8] = "PVCATLG";
+
+StringRef appendString(std::string & table, const std::string & str) {
+    StringRef ref{static_cast<uint32_t>(table.size()), static_cast<uint32_t>(str.size())};
+    table += str;
+    return ref;
+}
+
+bool readString(const char * table, uint64_t tableSize, const StringRef & ref, std::string & str) {
+    if(static_cast<uint64_t>(ref.offset) + ref.length > tableSize)
+        return false;
+    str.assign(table + ref.offset, ref.length);
+    return true;
+}
+
+}
+
+bool PVCatalog::save(const std::string & path, const std::vector<PVCatalogEntry> & entries) {
+
+    std::vector<FileRecord> records;
+    std::string strings;
+    records.reserve(entries.size());
+
+    for(const auto & entry : entries){
+        FileRecord record{};
+        record.epicsName = appendString(strings, entry.epicsName);
+        record.nodeId = appendString(strings, entry.nodeId);
+        record.ntId = appendString(strings, entry.ntId);
+        record.units = appendString(strings, entry.units);
+
+        record.choices.offset = static_cast<uint32_t>(strings.size());
+        for(const auto & choice : entry.choices){
+            strings += choice;
+            strings += '\0';
+        }
+        record.choices.length = static_cast<uint32_t>(strings.size()) - record.choices.offset;
+        record.choiceCount = static_cast<uint32_t>(entry.choices.size());
+        record.recordType = appendString(strings, entry.recordType);
+
+        record.valueType = entry.valueType;
+        record.limitLow = entry.limitLow;
+        record.limitHigh = entry.limitHigh;
+        records.push_back(record);
+    }
+
+    FileHeader header{};
+    memcpy(header.magic, Magic, sizeof(header.magic));
+    header.version = FormatVersion;
+    header.count = static_cast<uint32_t>(records.size());
+    header.stringsOffset = sizeof(FileHeader) + records.size() * sizeof(FileRecord);
+    header.stringsSize = strings.size();
+
+    // Write a temporary file and replace the snapshot at once
+    std::string tmpPath = path + ".tmp";
+    FILE * file = fopen(tmpPath.c_str(), "wb");
+    if(file == nullptr)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(ok && !records.empty())
+        ok = fwrite(records.data(), sizeof(FileRecord), records.size(), file) == records.size();
+    if(ok && !strings.empty())
+        ok = fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+    ok = (fclose(file) == 0) && ok;
+
+    if(!ok || rename(tmpPath.c_str(), path.c_str()) != 0){
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PVCatalog::load(const std::string & path, std::vector<PVCatalogEntry> & entries) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)){
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(st.st_size);
+    void * pMap = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(pMap == MAP_FAILED)
+        return false;
+
+    const char * pData = static_cast<const char *>(pMap);
+    FileHeader header;
+    memcpy(&header, pData, sizeof(header));
+
+    bool ok = memcmp(header.magic, Magic, sizeof(header.magic)) == 0
+        && header.version == FormatVersion
+        && header.stringsOffset == sizeof(FileHeader) + static_cast<uint64_t>(header.count) * sizeof(FileRecord)
+        && header.stringsOffset <= fileSize
+        && header.stringsSize == fileSize - header.stringsOffset;   // No overflow with a corrupt header
+
+    std::vector<PVCatalogEntry> result;
+    if(ok){
+        const char * pStrings = pData + header.stringsOffset;
+        result.resize(header.count);
+
+        for(uint32_t i = 0; ok && i < header.count; ++i){
+            FileRecord record;
+            memcpy(&record, pData + sizeof(FileHeader) + i * sizeof(FileRecord), sizeof(record));
+            PVCatalogEntry & entry = result[i];
+
+            std::string choices;
+            ok = readString(pStrings, header.stringsSize, record.epicsName, entry.epicsName)
+                && readString(pStrings, header.stringsSize, record.nodeId, entry.nodeId)
+                && readString(pStrings, header.stringsSize, record.ntId, entry.ntId)
+                && readString(pStrings, header.stringsSize, record.units, entry.units)
+                && readString(pStrings, header.stringsSize, record.choices, choices)
+                && readString(pStrings, header.stringsSize, record.recordType, entry.recordType);
+            if(!ok)
+                break;
+
+            // Every choice takes at least its '\0', so a larger count is a corrupt record
+            if(record.choiceCount > choices.size()){
+                ok = false;
+                break;
+            }
+            entry.choices.reserve(record.choiceCount);
+            size_t start = 0;
+            for(uint32_t c = 0; c < record.choiceCount; ++c){
+                size_t end = choices.find('\0', start);
+                if(end == std::string::npos){
+                    ok = false;
+                    break;
+                }
+                entry.choices.emplace_back(choices, start, end - start);
+                start = end + 1;
+            }
+
+            entry.valueType = record.valueType;
+            entry.limitLow = record.limitLow;
+            entry.limitHigh = record.limitHigh;
+        }
+    }
+
+    munmap(pMap, fileSize);
+
+    if(ok)
+        entries = std::move(result);
+    return ok;
+}
+
+uint32_t PVCatalog::count(const std::string & path) {
+
+    FILE * pFile = fopen(path.c_str(), "rb");
+    if(pFile == nullptr)
+        return 0;
+
+    FileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, pFile) == 1
+        && memcmp(header.magic, Magic, sizeof(header.magic)) == 0
+        && header.version == FormatVersion;
+    fclose(pFile);
+
+    return ok ? header.count : 0;
+}
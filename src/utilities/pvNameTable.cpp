@@ -0,0 +1,129 @@
+#include <pvNameTable.h>
+#include <cstring>
+
+uint64_t PVNameTable::hash(std::string_view str) {
+    uint64_t h = 14695981039346656037ull;
+    for (char c : str) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::string_view PVNameTable::store(std::string_view str, bool replaceColons) {
+
+    // Strings longer than a block get their own block
+    size_t needed = str.size() + 1;
+    if (m_blockUsed + needed > BlockSize) {
+        m_blocks.emplace_back(new char[needed > BlockSize ? needed : BlockSize]);
+        m_blockUsed = 0;
+    }
+
+    char * pDest = m_blocks.back().get() + m_blockUsed;
+    memcpy(pDest, str.data(), str.size());
+    pDest[str.size()] = '\0';
+    if (replaceColons) {
+        for (size_t i = 0; i < str.size(); ++i)
+            if (pDest[i] == ':')
+                pDest[i] = '.';
+    }
+
+    // A string that filled its own block closes it
+    m_blockUsed = (needed > BlockSize) ? BlockSize : m_blockUsed + needed;
+    return std::string_view(pDest, str.size());
+}
+
+void PVNameTable::insert(std::vector<Slot> & index, uint32_t id, uint64_t hash) {
+    const size_t mask = index.size() - 1;
+    Slot slot{id, 0};
+
+    for (size_t pos = hash & mask; ; pos = (pos + 1) & mask) {
+        if (index[pos].id == InvalidId) {
+            index[pos] = slot;
+            return;
+        }
+        // Robin Hood: the entry closer to its ideal slot gives way
+        if (index[pos].distance < slot.distance)
+            std::swap(index[pos], slot);
+        ++slot.distance;
+    }
+}
+
+uint32_t PVNameTable::lookup(const std::vector<Slot> & index, std::string_view str, uint64_t hash, bool byNode) const {
+    if (index.empty())
+        return InvalidId;
+
+    const size_t mask = index.size() - 1;
+    for (size_t pos = hash & mask, distance = 0; ; pos = (pos + 1) & mask, ++distance) {
+        const Slot & slot = index[pos];
+        // An empty slot or a richer entry means that the string is not in the index
+        if (slot.id == InvalidId || slot.distance < distance)
+            return InvalidId;
+
+        const Entry & entry = m_entries[slot.id];
+        if (byNode) {
+            if (entry.nodeHash == hash && entry.nodeName == str)
+                return slot.id;
+        } else {
+            if (entry.nameHash == hash && entry.name == str)
+                return slot.id;
+        }
+    }
+}
+
+void PVNameTable::grow(size_t count) {
+    size_t size = m_byName.empty() ? 16 : m_byName.size();
+    while (count * 4 > size * 3)
+        size *= 2;
+    if (size == m_byName.size())
+        return;
+
+    m_byName.assign(size, Slot{InvalidId, 0});
+    m_byNode.assign(size, Slot{InvalidId, 0});
+    for (uint32_t id = 0; id < m_entries.size(); ++id) {
+        insert(m_byName, id, m_entries[id].nameHash);
+        insert(m_byNode, id, m_entries[id].nodeHash);
+    }
+}
+
+void PVNameTable::reserve(size_t count) {
+    m_entries.reserve(count);
+    grow(count);
+}
+
+uint32_t PVNameTable::add(std::string_view name, std::string_view nodeName, bool replaceColons) {
+    uint64_t nameHash = hash(name);
+    uint32_t id = lookup(m_byName, name, nameHash, false);
+    if (id != InvalidId)
+        return id;
+
+    grow(m_entries.size() + 1);
+    id = static_cast<uint32_t>(m_entries.size());
+
+    Entry entry;
+    entry.name = store(name);
+    entry.nodeName = store(nodeName, replaceColons);
+    entry.nameHash = nameHash;
+    entry.nodeHash = hash(entry.nodeName);
+    m_entries.push_back(entry);
+
+    insert(m_byName, id, entry.nameHash);
+    insert(m_byNode, id, entry.nodeHash);
+    return id;
+}
+
+uint32_t PVNameTable::intern(std::string_view name) {
+    return add(name, name, true);
+}
+
+uint32_t PVNameTable::intern(std::string_view name, std::string_view nodeName) {
+    return add(name, nodeName, false);
+}
+
+uint32_t PVNameTable::find(std::string_view name) const {
+    return lookup(m_byName, name, hash(name), false);
+}
+
+uint32_t PVNameTable::findByNode(std::string_view nodeName) const {
+    return lookup(m_byNode, nodeName, hash(nodeName), true);
+}
@@ -0,0 +1,566 @@
+#include <pvTrace.h>
+#include <logger.h>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using pvxs::ArrayType;
+using pvxs::Member;
+using pvxs::TypeCode;
+using pvxs::TypeDef;
+using pvxs::Value;
+using pvxs::shared_array;
+
+namespace {
+
+constexpr char TraceMagic[8] = {'P', 'V', 'X', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t FormatVersion = 1;
+
+// Corrupted traces are reported by the reader, one record at a time
+[[noreturn]] void corrupted() {
+    throw std::runtime_error("corrupted trace");
+}
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void putVarint(std::vector<uint8_t> & buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void putBytes(std::vector<uint8_t> & buffer, const void * pData, size_t size) {
+    const uint8_t * pBytes = static_cast<const uint8_t*>(pData);
+    buffer.insert(buffer.end(), pBytes, pBytes + size);
+}
+
+void putString(std::vector<uint8_t> & buffer, const std::string & str) {
+    putVarint(buffer, str.size());
+    putBytes(buffer, str.data(), str.size());
+}
+
+uint64_t getVarint(const uint8_t *& pData, const uint8_t * pEnd) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && pData < pEnd; shift += 7) {
+        uint8_t byte = *pData++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    corrupted();
+}
+
+uint8_t getByte(const uint8_t *& pData, const uint8_t * pEnd) {
+    if (pData >= pEnd)
+        corrupted();
+    return *pData++;
+}
+
+void getBytes(const uint8_t *& pData, const uint8_t * pEnd, void * pOut, size_t size) {
+    if (static_cast<size_t>(pEnd - pData) < size)
+        corrupted();
+    memcpy(pOut, pData, size);
+    pData += size;
+}
+
+std::string getString(const uint8_t *& pData, const uint8_t * pEnd) {
+    uint64_t size = getVarint(pData, pEnd);
+    if (static_cast<uint64_t>(pEnd - pData) < size)
+        corrupted();
+    std::string str(reinterpret_cast<const char*>(pData), size);
+    pData += size;
+    return str;
+}
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+bool readVarint(FILE * file, uint64_t & value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Members of a structure: count, then name and type of every member
+void encodeMembers(const Value & value, std::vector<uint8_t> & buffer) {
+    uint64_t count = 0;
+    for (auto member : value.ichildren()) {
+        (void)member;
+        ++count;
+    }
+    putVarint(buffer, count);
+    for (auto member : value.ichildren()) {
+        putString(buffer, value.nameOf(member));
+        TraceWriter::encodeType(member, buffer);
+    }
+}
+
+// The value held by an element of an array of unions, or by a union or any field
+Value selectedOf(const Value & value) {
+    TypeCode::code_t code = value.type().code;
+    if (code == TypeCode::Union || code == TypeCode::Any)
+        return value["->"];
+    return value;
+}
+
+// Value of an any field, or of an element of an array of unions: presence, type and fields
+void encodeVariant(const Value & selected, std::vector<uint8_t> & buffer) {
+    buffer.push_back(selected.valid() ? 1 : 0);
+    if (selected.valid()) {
+        TraceWriter::encodeType(selected, buffer);
+        TraceWriter::encodeValue(selected, buffer);
+    }
+}
+
+Value decodeVariant(const uint8_t *& pData, const uint8_t * pEnd) {
+    if (getByte(pData, pEnd) == 0)
+        return Value();
+    Value selected = TraceReader::decodeType(pData, pEnd);
+    TraceReader::decodeValue(pData, pEnd, selected);
+    return selected;
+}
+
+Member decodeMember(const uint8_t *& pData, const uint8_t * pEnd, const std::string & name) {
+    TypeCode code(static_cast<TypeCode::code_t>(getByte(pData, pEnd)));
+    if (code != TypeCode::Struct && code != TypeCode::StructA && code != TypeCode::Union)
+        return Member(code, name);
+
+    std::string id = getString(pData, pEnd);
+    Member member(code, name, id, {});
+    uint64_t count = getVarint(pData, pEnd);
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string childName = getString(pData, pEnd);
+        member.addChild(decodeMember(pData, pEnd, childName));
+    }
+    return member;
+}
+
+}
+
+TraceWriter::TraceWriter(const std::string & path)
+    : m_file(fopen(path.c_str(), "wb")), m_start(std::chrono::steady_clock::now()) {
+
+    if (!m_file)
+        return;
+    setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+    fwrite(TraceMagic, 1, sizeof(TraceMagic), m_file);
+    fwrite(&FormatVersion, sizeof(FormatVersion), 1, m_file);
+}
+
+TraceWriter::~TraceWriter() {
+    if (m_file)
+        fclose(m_file);
+}
+
+void TraceWriter::encodeType(const Value & value, std::vector<uint8_t> & buffer) {
+
+    TypeCode::code_t code = value.type().code;
+    switch (code) {
+        case TypeCode::Struct:
+            buffer.push_back(code);
+            putString(buffer, value.id());
+            encodeMembers(value, buffer);
+            break;
+        case TypeCode::StructA: {
+            // Type of the elements, from an element or from a new one if the array is empty
+            auto elements = value.as<shared_array<const Value>>();
+            Value element = (!elements.empty() && elements[0].valid()) ? elements[0] : value.allocMember();
+            buffer.push_back(code);
+            putString(buffer, element.id());
+            encodeMembers(element, buffer);
+            break;
+        }
+        case TypeCode::Union: {
+            // Only the selected member
+            Value selected = value["->"];
+            buffer.push_back(code);
+            putString(buffer, value.id());
+            putVarint(buffer, selected.valid() ? 1 : 0);
+            if (selected.valid()) {
+                putString(buffer, value.nameOf(selected));
+                encodeType(selected, buffer);
+            }
+            break;
+        }
+        case TypeCode::UnionA:
+            buffer.push_back(TypeCode::AnyA);
+            break;
+        default:
+            buffer.push_back(code);
+            break;
+    }
+}
+
+void TraceWriter::encodeValue(const Value & value, std::vector<uint8_t> & buffer) {
+
+    TypeCode type = value.type();
+    switch (type.code) {
+        case TypeCode::Bool:
+            buffer.push_back(value.as<bool>() ? 1 : 0);
+            break;
+        case TypeCode::Int8:
+        case TypeCode::Int16:
+        case TypeCode::Int32:
+        case TypeCode::Int64:
+            putVarint(buffer, zigzag(value.as<int64_t>()));
+            break;
+        case TypeCode::UInt8:
+        case TypeCode::UInt16:
+        case TypeCode::UInt32:
+        case TypeCode::UInt64:
+            putVarint(buffer, value.as<uint64_t>());
+            break;
+        case TypeCode::Float32: {
+            float number = value.as<float>();
+            putBytes(buffer, &number, sizeof(number));
+            break;
+        }
+        case TypeCode::Float64: {
+            double number = value.as<double>();
+            putBytes(buffer, &number, sizeof(number));
+            break;
+        }
+        case TypeCode::String:
+            putString(buffer, value.as<std::string>());
+            break;
+        case TypeCode::Struct:
+            for (auto member : value.ichildren())
+                encodeValue(member, buffer);
+            break;
+        case TypeCode::StructA: {
+            auto elements = value.as<shared_array<const Value>>();
+            putVarint(buffer, elements.size());
+            for (const Value & element : elements) {
+                buffer.push_back(element.valid() ? 1 : 0);
+                if (element.valid())
+                    encodeValue(element, buffer);
+            }
+            break;
+        }
+        case TypeCode::Union: {
+            // The selection is part of the type, the name selects the member when decoding
+            Value selected = value["->"];
+            if (selected.valid()) {
+                putString(buffer, value.nameOf(selected));
+                encodeValue(selected, buffer);
+            }
+            break;
+        }
+        case TypeCode::Any:
+            encodeVariant(value["->"], buffer);
+            break;
+        case TypeCode::UnionA:
+        case TypeCode::AnyA: {
+            auto elements = value.as<shared_array<const Value>>();
+            putVarint(buffer, elements.size());
+            for (const Value & element : elements)
+                encodeVariant(element.valid() ? selectedOf(element) : Value(), buffer);
+            break;
+        }
+        case TypeCode::StringA: {
+            auto strings = value.as<shared_array<const std::string>>();
+            putVarint(buffer, strings.size());
+            for (const std::string & str : strings)
+                putString(buffer, str);
+            break;
+        }
+        default:
+            if (type.isarray()) {
+                // Raw elements, with the type they were stored with
+                auto array = value.as<shared_array<const void>>();
+                buffer.push_back(static_cast<uint8_t>(array.original_type()));
+                putVarint(buffer, array.size());
+                putBytes(buffer, array.data(), array.size() * pvxs::elementSize(array.original_type()));
+            }
+            break;
+    }
+}
+
+void TraceWriter::writeRecord(char tag, uint32_t pvId, const std::vector<uint8_t> & payload, const int64_t * pArrival) {
+    uint8_t header[32];
+    size_t size = 0;
+    auto putHeaderVarint = [&](uint64_t value) {
+        while (value >= 0x80) {
+            header[size++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        header[size++] = static_cast<uint8_t>(value);
+    };
+
+    header[size++] = static_cast<uint8_t>(tag);
+    putHeaderVarint(pvId);
+    if (pArrival != nullptr)
+        putHeaderVarint(static_cast<uint64_t>(*pArrival));
+    putHeaderVarint(payload.size());
+    fwrite(header, 1, size, m_file);
+    fwrite(payload.data(), 1, payload.size(), m_file);
+}
+
+void TraceWriter::write(uint32_t pvId, const std::string & name, const Value & value) {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    int64_t arrival = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    m_type.clear();
+    encodeType(value, m_type);
+    m_value.clear();
+    encodeValue(value, m_value);
+
+    if (pvId >= m_pvs.size())
+        m_pvs.resize(pvId + 1);
+    PVState & state = m_pvs[pvId];
+    if (!state.named) {
+        writeRecord('N', pvId, std::vector<uint8_t>(name.begin(), name.end()), nullptr);
+        state.named = true;
+    }
+    if (state.type != m_type) {
+        writeRecord('T', pvId, m_type, nullptr);
+        state.type = m_type;
+    }
+
+    // Serialized by the mutex, so the arrival times never go backwards
+    int64_t delta = arrival - m_lastArrival;
+    m_lastArrival = arrival;
+    writeRecord('U', pvId, m_value, &delta);
+    ++m_updates;
+}
+
+uint64_t TraceWriter::updates() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_updates;
+}
+
+bool TraceWriter::loadConfig(const std::string & path, std::string & tracePath) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        if (key == "trace")
+            tracePath = trim(line.substr(equal + 1));
+        else
+            LOG_WARNING("Capture: unknown key %s in %s", key.c_str(), path.c_str());
+    }
+
+    return !tracePath.empty();
+}
+
+TraceReader::TraceReader(const std::string & path) : m_file(fopen(path.c_str(), "rb")) {
+
+    if (!m_file)
+        return;
+
+    char magic[sizeof(TraceMagic)];
+    uint32_t version;
+    if (fread(magic, 1, sizeof(magic), m_file) != sizeof(magic) || memcmp(magic, TraceMagic, sizeof(magic)) != 0
+        || fread(&version, sizeof(version), 1, m_file) != 1 || version != FormatVersion) {
+        LOG_ERROR("%s is not a trace of version %u", path.c_str(), FormatVersion);
+        fclose(m_file);
+        m_file = nullptr;
+        return;
+    }
+    setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+}
+
+TraceReader::~TraceReader() {
+    if (m_file)
+        fclose(m_file);
+}
+
+Value TraceReader::decodeType(const uint8_t *& pData, const uint8_t * pEnd) {
+
+    TypeCode code(static_cast<TypeCode::code_t>(getByte(pData, pEnd)));
+    if (code != TypeCode::Struct && code != TypeCode::StructA && code != TypeCode::Union)
+        return TypeDef(code).create();
+
+    std::string id = getString(pData, pEnd);
+    TypeDef def(code, id, {});
+    uint64_t count = getVarint(pData, pEnd);
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string name = getString(pData, pEnd);
+        def += {decodeMember(pData, pEnd, name)};
+    }
+    return def.create();
+}
+
+void TraceReader::decodeValue(const uint8_t *& pData, const uint8_t * pEnd, Value & value) {
+
+    TypeCode type = value.type();
+    switch (type.code) {
+        case TypeCode::Bool:
+            value.from(getByte(pData, pEnd) != 0);
+            break;
+        case TypeCode::Int8:
+        case TypeCode::Int16:
+        case TypeCode::Int32:
+        case TypeCode::Int64:
+            value.from(unzigzag(getVarint(pData, pEnd)));
+            break;
+        case TypeCode::UInt8:
+        case TypeCode::UInt16:
+        case TypeCode::UInt32:
+        case TypeCode::UInt64:
+            value.from(getVarint(pData, pEnd));
+            break;
+        case TypeCode::Float32: {
+            float number;
+            getBytes(pData, pEnd, &number, sizeof(number));
+            value.from(number);
+            break;
+        }
+        case TypeCode::Float64: {
+            double number;
+            getBytes(pData, pEnd, &number, sizeof(number));
+            value.from(number);
+            break;
+        }
+        case TypeCode::String:
+            value.from(getString(pData, pEnd));
+            break;
+        case TypeCode::Struct:
+            for (auto member : value.ichildren())
+                decodeValue(pData, pEnd, member);
+            break;
+        case TypeCode::StructA: {
+            shared_array<Value> elements(getVarint(pData, pEnd));
+            for (Value & element : elements) {
+                if (getByte(pData, pEnd) == 0)
+                    continue;
+                element = value.allocMember();
+                decodeValue(pData, pEnd, element);
+            }
+            value.from(elements.freeze());
+            break;
+        }
+        case TypeCode::Union: {
+            // A union of the trace has a single member, the one that was selected
+            std::string name = getString(pData, pEnd);
+            Value selected = value["->" + name];
+            if (!selected.valid())
+                corrupted();
+            decodeValue(pData, pEnd, selected);
+            break;
+        }
+        case TypeCode::Any: {
+            Value selected = decodeVariant(pData, pEnd);
+            if (selected.valid())
+                value.from(selected);
+            break;
+        }
+        case TypeCode::AnyA: {
+            shared_array<Value> elements(getVarint(pData, pEnd));
+            for (Value & element : elements) {
+                Value selected = decodeVariant(pData, pEnd);
+                if (selected.valid()) {
+                    element = value.allocMember();
+                    element.from(selected);
+                }
+            }
+            value.from(elements.freeze());
+            break;
+        }
+        case TypeCode::StringA: {
+            shared_array<std::string> strings(getVarint(pData, pEnd));
+            for (std::string & str : strings)
+                str = getString(pData, pEnd);
+            value.from(strings.freeze());
+            break;
+        }
+        default:
+            if (type.isarray()) {
+                ArrayType original = static_cast<ArrayType>(getByte(pData, pEnd));
+                uint64_t count = getVarint(pData, pEnd);
+                size_t elementSize = pvxs::elementSize(original);
+                if (elementSize == 0 || count > static_cast<uint64_t>(pEnd - pData) / elementSize)
+                    corrupted();
+                auto array = pvxs::allocArray(original, count);
+                getBytes(pData, pEnd, array.data(), count * elementSize);
+                value.from(array.freeze());
+            }
+            break;
+    }
+}
+
+bool TraceReader::next(TraceEvent & event) {
+
+    if (!m_file)
+        return false;
+
+    int tag = fgetc(m_file);
+    if (tag == EOF)
+        return false;
+
+    uint64_t pvId, arrival = 0, size;
+    if (!readVarint(m_file, pvId) || (tag == 'U' && !readVarint(m_file, arrival)) || !readVarint(m_file, size)) {
+        LOG_ERROR("Trace: truncated record");
+        return false;
+    }
+    m_payload.resize(size);
+    if (fread(m_payload.data(), 1, size, m_file) != size) {
+        LOG_ERROR("Trace: truncated record");
+        return false;
+    }
+
+    event.pvId = static_cast<uint32_t>(pvId);
+    const uint8_t * pData = m_payload.data();
+    const uint8_t * pEnd = pData + m_payload.size();
+    try {
+        switch (tag) {
+            case 'N':
+                event.kind = TraceEvent::Kind::Name;
+                event.name.assign(reinterpret_cast<const char*>(pData), size);
+                return true;
+            case 'T':
+                event.kind = TraceEvent::Kind::Type;
+                if (pvId >= m_prototypes.size())
+                    m_prototypes.resize(pvId + 1);
+                m_prototypes[pvId] = decodeType(pData, pEnd);
+                event.value = m_prototypes[pvId];
+                return true;
+            case 'U':
+                if (pvId >= m_prototypes.size() || !m_prototypes[pvId].valid())
+                    corrupted();
+                event.kind = TraceEvent::Kind::Update;
+                m_lastArrival += static_cast<int64_t>(arrival);
+                event.arrival = m_lastArrival;
+                event.value = m_prototypes[pvId].cloneEmpty();
+                decodeValue(pData, pEnd, event.value);
+                return true;
+            default:
+                corrupted();
+        }
+    } catch (const std::exception & e) {
+        LOG_ERROR("Trace: error decoding a record of PV %u: %s", event.pvId, e.what());
+    }
+    return false;
+}
@@ -33,6 +33,7 @@
 ******************************************************************************/
 #include "shutdown.h"
 #include "uaplatformlayer.h"
+#include "uathread.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -72,16 +73,36 @@ unsigned int ShutDownFlag()
  ****************************************/
 #ifdef __linux__
 #include <signal.h>
+#include <semaphore.h>
+#include <errno.h>
+
+/* Semaphore posted by the signal handler to wake up WaitForShutDown(). sem_post is async-signal-safe. */
+static sem_t g_ShutDownSem;
 
 /** Signal handler for SIG_INT and SIGTERM. */
 void signal_handler(int signo)
 {
     SHUTDOWN_TRACE("Received signal %i\n", signo);
     g_ShutDown = 1;
+    sem_post(&g_ShutDownSem);
+}
+
+void WaitForShutDown()
+{
+    while (g_ShutDown == 0)
+    {
+        /* Retry if the wait is interrupted by a signal that is not ours. */
+        if (sem_wait(&g_ShutDownSem) != 0 && errno != EINTR)
+        {
+            break;
+        }
+    }
 }
 
 void RegisterSignalHandler()
 {
+    sem_init(&g_ShutDownSem, 0, 0);
+
     /* register signal handlers. */
     struct sigaction new_action, old_action;
 
@@ -154,6 +175,17 @@ void RegisterSignalHandler()
 }
 #endif
 
+#ifndef __linux__
+/* There is no signal to wait on, so fall back to polling the shutdown flag. */
+void WaitForShutDown()
+{
+    while (ShutDownFlag() == 0)
+    {
+        UaThread::msleep(100);
+    }
+}
+#endif
+
 char* getAppPath()
 {
     char* pszAppPath = NULL;
@@ -0,0 +1,61 @@
+#include <typeMap.h>
+
+namespace {
+
+// Per-thread buffer of the string conversions. Only grows, so the copies stop allocating
+// once it holds the longest string of the PVs served by the thread.
+std::string & stringBuffer() {
+    thread_local std::string buffer;
+    if (buffer.capacity() < 64)
+        buffer.reserve(64);
+    return buffer;
+}
+
+}
+
+namespace typemap {
+
+template<>
+bool toVariant<std::string>(const pvxs::Value & field, UaVariant & variant) {
+    std::string & buffer = stringBuffer();
+    if (!field.as(buffer))
+        return false;
+
+    // The only allocation is the copy owned by the variant
+    OpcUa_Variant raw;
+    OpcUa_Variant_Initialize(&raw);
+    raw.Datatype = OpcUaType_String;
+    if (OpcUa_IsBad(OpcUa_String_AttachCopy(&raw.Value.String, buffer.c_str())))
+        return false;
+    variant.clear();
+    variant.attach(&raw);
+    return true;
+}
+
+template<>
+bool fromVariant<std::string>(const UaVariant & variant, pvxs::Value & field) {
+    const OpcUa_Variant * pRaw = variant;
+    if (pRaw->Datatype != OpcUaType_String || pRaw->ArrayType != OpcUa_VariantArrayType_Scalar)
+        return false;
+
+    std::string & buffer = stringBuffer();
+    const OpcUa_CharA * pString = OpcUa_String_GetRawString(&pRaw->Value.String);
+    buffer.assign(pString != OpcUa_Null ? pString : "", OpcUa_String_StrSize(&pRaw->Value.String));
+    return field.tryFrom(buffer);
+}
+
+}
+
+OpcUa_StatusCode TypeMap::toVariant(const pvxs::Value & field, UaVariant & variant) {
+    const Entry * pEntry = find(field.type().code);
+    if (pEntry == nullptr)
+        return OpcUa_BadNotSupported;
+    return pEntry->toVariant(field, variant) ? OpcUa_Good : OpcUa_BadTypeMismatch;
+}
+
+OpcUa_StatusCode TypeMap::fromVariant(const UaVariant & variant, pvxs::Value & field) {
+    const Entry * pEntry = find(variant.type());
+    if (pEntry == nullptr || variant.isArray())
+        return OpcUa_BadTypeMismatch;
+    return pEntry->fromVariant(variant, field) ? OpcUa_Good : OpcUa_BadTypeMismatch;
+}
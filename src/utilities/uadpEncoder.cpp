@@ -0,0 +1,167 @@
+#include <uadpEncoder.h>
+
+namespace {
+
+// UADPFlags: version 1, PublisherId, GroupHeader, PayloadHeader and ExtendedFlags1 enabled
+const uint8_t UadpFlags = 0x01 | 0x10 | 0x20 | 0x40 | 0x80;
+// ExtendedFlags1: UInt16 PublisherId, Timestamp enabled
+const uint8_t ExtendedFlags1 = 0x01 | 0x20;
+// GroupFlags: WriterGroupId, GroupVersion, NetworkMessageNumber and SequenceNumber enabled
+const uint8_t GroupFlags = 0x01 | 0x02 | 0x04 | 0x08;
+// DataSetFlags1: valid, DataValue field encoding, SequenceNumber, ConfigurationVersion and DataSetFlags2 enabled
+const uint8_t DataSetFlags1 = 0x01 | (0x02 << 1) | 0x08 | 0x20 | 0x40 | 0x80;
+
+// DataValue encoding mask
+const uint8_t DataValueHasValue = 0x01;
+const uint8_t DataValueHasStatus = 0x02;
+const uint8_t DataValueHasSourceTimestamp = 0x04;
+
+// Variant encoding mask: one-dimensional array of the built-in type
+const uint8_t VariantArrayValues = 0x80;
+
+const uint32_t StatusGood = 0;
+
+}
+
+void UadpEncoder::writeUInt16(uint16_t value) {
+    m_buffer.push_back(static_cast<uint8_t>(value));
+    m_buffer.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void UadpEncoder::writeUInt32(uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+        m_buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void UadpEncoder::writeUInt64(uint64_t value) {
+    for (int i = 0; i < 8; ++i)
+        m_buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void UadpEncoder::beginNetworkMessage(uint16_t publisherId, uint16_t writerGroupId, uint32_t groupVersion,
+                                      uint16_t sequenceNumber, uint16_t dataSetWriterId, int64_t timestamp) {
+    m_buffer.clear();
+
+    writeByte(UadpFlags);
+    writeByte(ExtendedFlags1);
+    writeUInt16(publisherId);
+
+    // GroupHeader
+    writeByte(GroupFlags);
+    writeUInt16(writerGroupId);
+    writeUInt32(groupVersion);
+    writeUInt16(1);                 // NetworkMessageNumber, every message fits in one
+    writeUInt16(sequenceNumber);
+
+    // PayloadHeader, one DataSetMessage. With a single message the payload has no Sizes array.
+    writeByte(1);
+    writeUInt16(dataSetWriterId);
+
+    writeDateTime(timestamp);
+}
+
+void UadpEncoder::beginDataSetMessage(MessageType type, uint16_t sequenceNumber, uint32_t majorVersion, uint32_t minorVersion) {
+    writeByte(DataSetFlags1);
+    writeByte(static_cast<uint8_t>(type));
+    writeUInt16(sequenceNumber);
+    writeUInt32(majorVersion);
+    writeUInt32(minorVersion);
+
+    // Keep alive messages have no FieldCount
+    m_fieldCount = 0;
+    m_fieldCountPos = 0;
+    if (type != MessageType::KeepAlive) {
+        m_fieldCountPos = m_buffer.size();
+        writeUInt16(0);
+    }
+}
+
+void UadpEncoder::beginDataValue(uint8_t builtInType, bool array, uint32_t statusCode, int64_t sourceTimestamp) {
+    uint8_t mask = DataValueHasValue;
+    if (statusCode != StatusGood)
+        mask |= DataValueHasStatus;
+    if (sourceTimestamp != 0)
+        mask |= DataValueHasSourceTimestamp;
+
+    writeByte(mask);
+    writeByte(array ? static_cast<uint8_t>(builtInType | VariantArrayValues) : builtInType);
+    ++m_fieldCount;
+}
+
+void UadpEncoder::endDataValue(uint32_t statusCode, int64_t sourceTimestamp) {
+    if (statusCode != StatusGood)
+        writeUInt32(statusCode);
+    if (sourceTimestamp != 0)
+        writeDateTime(sourceTimestamp);
+}
+
+size_t UadpEncoder::fixedSize(uint8_t builtInType) {
+    switch (builtInType) {
+        case Boolean:
+        case SByte:
+        case Byte:
+            return 1;
+        case Int16:
+        case UInt16:
+            return 2;
+        case Int32:
+        case UInt32:
+        case Float:
+            return 4;
+        case Int64:
+        case UInt64:
+        case Double:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+void UadpEncoder::writeScalar(uint8_t builtInType, const void * pValue, uint32_t statusCode, int64_t sourceTimestamp) {
+    const uint8_t * pBytes = static_cast<const uint8_t*>(pValue);
+
+    beginDataValue(builtInType, false, statusCode, sourceTimestamp);
+    m_buffer.insert(m_buffer.end(), pBytes, pBytes + fixedSize(builtInType));
+    endDataValue(statusCode, sourceTimestamp);
+}
+
+void UadpEncoder::writeArray(uint8_t builtInType, const void * pValues, uint32_t count, uint32_t statusCode, int64_t sourceTimestamp) {
+    const uint8_t * pBytes = static_cast<const uint8_t*>(pValues);
+
+    beginDataValue(builtInType, true, statusCode, sourceTimestamp);
+    writeUInt32(count);
+    if (count > 0)
+        m_buffer.insert(m_buffer.end(), pBytes, pBytes + static_cast<size_t>(count) * fixedSize(builtInType));
+    endDataValue(statusCode, sourceTimestamp);
+}
+
+void UadpEncoder::writeString(std::string_view value, uint32_t statusCode, int64_t sourceTimestamp) {
+    beginDataValue(String, false, statusCode, sourceTimestamp);
+    writeUInt32(static_cast<uint32_t>(value.size()));
+    m_buffer.insert(m_buffer.end(), value.begin(), value.end());
+    endDataValue(statusCode, sourceTimestamp);
+}
+
+void UadpEncoder::writeStringArray(const std::string_view * pValues, uint32_t count, uint32_t statusCode, int64_t sourceTimestamp) {
+    beginDataValue(String, true, statusCode, sourceTimestamp);
+    writeUInt32(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        writeUInt32(static_cast<uint32_t>(pValues[i].size()));
+        m_buffer.insert(m_buffer.end(), pValues[i].begin(), pValues[i].end());
+    }
+    endDataValue(statusCode, sourceTimestamp);
+}
+
+void UadpEncoder::writeEmpty(uint32_t statusCode) {
+    // DataValue without value, only the status
+    writeByte(DataValueHasStatus);
+    writeUInt32(statusCode);
+    ++m_fieldCount;
+}
+
+void UadpEncoder::endDataSetMessage() {
+    if (m_fieldCountPos == 0)
+        return;
+    m_buffer[m_fieldCountPos] = static_cast<uint8_t>(m_fieldCount);
+    m_buffer[m_fieldCountPos + 1] = static_cast<uint8_t>(m_fieldCount >> 8);
+}
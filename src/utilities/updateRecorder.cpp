@@ -0,0 +1,516 @@
+#include <updateRecorder.h>
+#include <logger.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// File format, little-endian:
+//   segment = SegmentHeader, blocks, index entries, IndexTrailer (the last two when the segment is closed)
+//   block   = BlockHeader, runs
+//   run     = pvId, count, type, statusCode, then count updates of (time, severity, value)
+// Every integer of a run is a varint. The time and the value of the first update of a run are
+// absolute, the rest are deltas: zigzag differences, or the XOR of the bits for floating point values.
+
+constexpr char SegmentMagic[8] = {'E', 'P', 'R', 'E', 'C', 'S', 'E', 'G'};
+constexpr char IndexMagic[8] = {'E', 'P', 'R', 'E', 'C', 'I', 'D', 'X'};
+constexpr uint32_t BlockMagic = 0x4B4C4252;     // "RBLK"
+constexpr uint32_t FormatVersion = 1;
+
+struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t size;          // Bytes of the runs
+    uint32_t runs;
+    uint32_t records;
+};
+
+struct IndexTrailer {
+    uint64_t indexOffset;
+    uint64_t entries;
+    char magic[8];
+};
+
+bool isFloatingPoint(uint8_t type) {
+    return type == OpcUaType_Double || type == OpcUaType_Float;
+}
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void putVarint(std::vector<uint8_t> & buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+bool getVarint(const uint8_t *& pData, const uint8_t * pEnd, uint64_t & value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && pData < pEnd; shift += 7) {
+        uint8_t byte = *pData++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Segment files of a directory. Their names (creation time and number) sort in creation order.
+std::vector<std::string> segmentPaths(const std::string & directory) {
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (const auto & file : std::filesystem::directory_iterator(directory, error)) {
+        std::string name = file.path().filename().string();
+        if (name.rfind("segment-", 0) == 0 && file.path().extension() == ".rec")
+            paths.push_back(file.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+std::string trim(const std::string & str) {
+    size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value)
+        power <<= 1;
+    return power;
+}
+
+}
+
+UpdateRecorder::UpdateRecorder(const RecorderConfig & config) : m_config(config) {
+
+    m_config.ringCapacity = roundUpToPowerOfTwo(std::max<size_t>(m_config.ringCapacity, 2));
+    m_config.blockRecords = std::max<size_t>(m_config.blockRecords, 1);
+    m_cells.reset(new Cell[m_config.ringCapacity]);
+    for (size_t i = 0; i < m_config.ringCapacity; ++i)
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+
+    m_pending.reserve(m_config.blockRecords);
+}
+
+UpdateRecorder::~UpdateRecorder() {
+    stop();
+}
+
+bool UpdateRecorder::start() {
+    if (m_thread.joinable())
+        return true;
+
+    // The segments of the previous runs count for maxSegments too
+    m_segments = segmentPaths(m_config.directory);
+    if (!openSegment())
+        return false;
+
+    m_stopping = false;
+    m_thread = std::thread([this]() { run(); });
+    LOG_INFO("Recorder: writing the gateway updates to %s", m_config.directory.c_str());
+    return true;
+}
+
+void UpdateRecorder::stop() {
+    if (!m_thread.joinable())
+        return;
+
+    m_stopping.store(true, std::memory_order_release);
+    m_thread.join();
+}
+
+void UpdateRecorder::record(uint32_t pvId, int64_t timestamp, const UaVariant & value, OpcUa_StatusCode statusCode, uint8_t severity) {
+
+    // Values that can not be encoded are recorded without value, the update itself is still recorded
+    uint8_t type = OpcUaType_Null;
+    uint64_t bits = 0;
+    if (OpcUa_IsNotBad(statusCode) && !HistoryStore::encode(value, type, bits)) {
+        type = OpcUaType_Null;
+        bits = 0;
+    }
+
+    size_t pos = m_writePos.load(std::memory_order_relaxed);
+    Cell * cell;
+    while (true) {
+        cell = &m_cells[pos & (m_config.ringCapacity - 1)];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (m_writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Full: the update is dropped, the update path never waits for the disk
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = m_writePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->record = Record{timestamp, bits, pvId, statusCode, type, severity};
+    cell->sequence.store(pos + 1, std::memory_order_release);
+}
+
+bool UpdateRecorder::pop(Record & record) {
+    Cell & cell = m_cells[m_readPos & (m_config.ringCapacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != m_readPos + 1)
+        return false;
+
+    record = cell.record;
+    cell.sequence.store(m_readPos + m_config.ringCapacity, std::memory_order_release);
+    ++m_readPos;
+    return true;
+}
+
+void UpdateRecorder::run() {
+
+    uint64_t reportedDrops = 0;
+    auto firstPending = std::chrono::steady_clock::now();
+    Record record;
+
+    while (!m_stopping.load(std::memory_order_acquire)) {
+        bool popped = false;
+        while (m_pending.size() < m_config.blockRecords && pop(record)) {
+            if (m_pending.empty())
+                firstPending = std::chrono::steady_clock::now();
+            m_pending.push_back(record);
+            popped = true;
+        }
+
+        if (m_pending.size() >= m_config.blockRecords
+            || (!m_pending.empty() && std::chrono::steady_clock::now() - firstPending >= m_config.flushInterval))
+            writeBlock();
+        else if (!popped)
+            // The producers never notify, the writer polls the ring
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        uint64_t drops = dropped();
+        if (drops != reportedDrops) {
+            LOG_WARNING("Recorder: %llu updates dropped, the ring buffer was full",
+                        static_cast<unsigned long long>(drops - reportedDrops));
+            reportedDrops = drops;
+        }
+    }
+
+    // Everything queued before stop() is written
+    while (pop(record)) {
+        m_pending.push_back(record);
+        if (m_pending.size() >= m_config.blockRecords)
+            writeBlock();
+    }
+    if (!m_pending.empty())
+        writeBlock();
+    closeSegment();
+}
+
+void UpdateRecorder::writeBlock() {
+
+    // Runs of the same PV, in the order the gateway forwarded the updates
+    std::stable_sort(m_pending.begin(), m_pending.end(),
+                     [](const Record & a, const Record & b) { return a.pvId < b.pvId; });
+
+    std::vector<IndexEntry> blockIndex;
+    m_block.assign(sizeof(BlockHeader), 0);
+    size_t i = 0;
+    while (i < m_pending.size()) {
+        const Record & first = m_pending[i];
+        size_t end = i + 1;
+        while (end < m_pending.size() && m_pending[end].pvId == first.pvId
+               && m_pending[end].type == first.type && m_pending[end].statusCode == first.statusCode)
+            ++end;
+
+        // Offset relative to the block for now
+        IndexEntry entry{first.pvId, static_cast<uint32_t>(end - i), m_block.size(), first.timestamp, first.timestamp};
+        putVarint(m_block, first.pvId);
+        putVarint(m_block, end - i);
+        m_block.push_back(first.type);
+        putVarint(m_block, first.statusCode);
+
+        bool floatingPoint = isFloatingPoint(first.type);
+        for (size_t k = i; k < end; ++k) {
+            const Record & record = m_pending[k];
+            if (k == i) {
+                putVarint(m_block, zigzag(record.timestamp));
+                m_block.push_back(record.severity);
+                putVarint(m_block, record.bits);
+            } else {
+                const Record & previous = m_pending[k - 1];
+                putVarint(m_block, zigzag(record.timestamp - previous.timestamp));
+                m_block.push_back(record.severity);
+                putVarint(m_block, floatingPoint ? (record.bits ^ previous.bits)
+                                                 : zigzag(static_cast<int64_t>(record.bits - previous.bits)));
+            }
+            entry.minTime = std::min(entry.minTime, record.timestamp);
+            entry.maxTime = std::max(entry.maxTime, record.timestamp);
+        }
+        blockIndex.push_back(entry);
+        i = end;
+    }
+
+    BlockHeader header{BlockMagic, static_cast<uint32_t>(m_block.size() - sizeof(BlockHeader)),
+                       static_cast<uint32_t>(blockIndex.size()), static_cast<uint32_t>(m_pending.size())};
+    memcpy(m_block.data(), &header, sizeof(header));
+    m_pending.clear();
+
+    if (m_block.size() > m_config.segmentBytes - sizeof(SegmentHeader)) {
+        LOG_ERROR("Recorder: block of %zu bytes does not fit in a segment, it is discarded", m_block.size());
+        return;
+    }
+    if (m_pMapping != nullptr && m_segmentUsed + m_block.size() > m_config.segmentBytes)
+        closeSegment();
+    if (m_pMapping == nullptr && !openSegment())
+        return;
+
+    memcpy(m_pMapping + m_segmentUsed, m_block.data(), m_block.size());
+    for (IndexEntry & entry : blockIndex) {
+        entry.offset += m_segmentUsed;
+        m_index.push_back(entry);
+    }
+    m_segmentUsed += m_block.size();
+
+    // Written back by the kernel even if the process dies, this only bounds the loss on a power failure
+    msync(m_pMapping, m_segmentUsed, MS_ASYNC);
+}
+
+bool UpdateRecorder::openSegment() {
+
+    int64_t milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    char name[64];
+    snprintf(name, sizeof(name), "/segment-%016lld-%06llu.rec",
+             static_cast<long long>(milliseconds), static_cast<unsigned long long>(m_segmentNumber++));
+    std::string path = m_config.directory + name;
+
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        LOG_ERROR("Recorder: can not create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (ftruncate(m_fd, static_cast<off_t>(m_config.segmentBytes)) != 0) {
+        LOG_ERROR("Recorder: can not allocate %s: %s", path.c_str(), strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    void * pMapping = mmap(nullptr, m_config.segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (pMapping == MAP_FAILED) {
+        LOG_ERROR("Recorder: can not map %s: %s", path.c_str(), strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_pMapping = static_cast<uint8_t*>(pMapping);
+
+    SegmentHeader header{};
+    memcpy(header.magic, SegmentMagic, sizeof(header.magic));
+    header.version = FormatVersion;
+    memcpy(m_pMapping, &header, sizeof(header));
+    m_segmentUsed = sizeof(header);
+    m_index.clear();
+
+    m_segments.push_back(path);
+    if (m_config.maxSegments > 0 && m_segments.size() > m_config.maxSegments) {
+        size_t excess = m_segments.size() - m_config.maxSegments;
+        for (size_t i = 0; i < excess; ++i)
+            unlink(m_segments[i].c_str());
+        m_segments.erase(m_segments.begin(), m_segments.begin() + static_cast<std::ptrdiff_t>(excess));
+    }
+    return true;
+}
+
+void UpdateRecorder::closeSegment() {
+    if (m_pMapping == nullptr)
+        return;
+
+    munmap(m_pMapping, m_config.segmentBytes);
+    m_pMapping = nullptr;
+
+    // The index replaces the unused tail of the file, sorted by PV for the range scans
+    std::stable_sort(m_index.begin(), m_index.end(),
+                     [](const IndexEntry & a, const IndexEntry & b) { return a.pvId < b.pvId; });
+
+    IndexTrailer trailer{m_segmentUsed, m_index.size(), {}};
+    memcpy(trailer.magic, IndexMagic, sizeof(trailer.magic));
+
+    size_t indexBytes = m_index.size() * sizeof(IndexEntry);
+    bool written = ftruncate(m_fd, static_cast<off_t>(m_segmentUsed)) == 0
+        && pwrite(m_fd, m_index.data(), indexBytes, static_cast<off_t>(m_segmentUsed)) == static_cast<ssize_t>(indexBytes)
+        && pwrite(m_fd, &trailer, sizeof(trailer), static_cast<off_t>(m_segmentUsed + indexBytes)) == sizeof(trailer);
+    if (!written)
+        LOG_ERROR("Recorder: can not write the index of %s: %s", m_segments.back().c_str(), strerror(errno));
+
+    close(m_fd);
+    m_fd = -1;
+    m_index.clear();
+}
+
+const uint8_t * UpdateRecorder::decodeRun(const uint8_t * pData, const uint8_t * pEnd, uint32_t pvId,
+                                          int64_t startTime, int64_t endTime, std::vector<RecordedUpdate> & updates) {
+
+    uint64_t runPvId, count, statusCode;
+    if (!getVarint(pData, pEnd, runPvId) || !getVarint(pData, pEnd, count) || pData >= pEnd)
+        return nullptr;
+    uint8_t type = *pData++;
+    if (!getVarint(pData, pEnd, statusCode))
+        return nullptr;
+
+    bool floatingPoint = isFloatingPoint(type);
+    bool wanted = runPvId == pvId;
+    int64_t time = 0;
+    uint64_t bits = 0;
+    for (uint64_t k = 0; k < count; ++k) {
+        uint64_t encodedTime, encodedValue;
+        if (!getVarint(pData, pEnd, encodedTime) || pData >= pEnd)
+            return nullptr;
+        uint8_t severity = *pData++;
+        if (!getVarint(pData, pEnd, encodedValue))
+            return nullptr;
+
+        if (k == 0) {
+            time = unzigzag(encodedTime);
+            bits = encodedValue;
+        } else {
+            time += unzigzag(encodedTime);
+            bits = floatingPoint ? (bits ^ encodedValue) : (bits + static_cast<uint64_t>(unzigzag(encodedValue)));
+        }
+
+        if (wanted && time >= startTime && time <= endTime)
+            updates.push_back(RecordedUpdate{pvId, severity, HistorySample{time, bits, type, static_cast<OpcUa_StatusCode>(statusCode)}});
+    }
+    return pData;
+}
+
+void UpdateRecorder::readSegment(const std::string & path, uint32_t pvId, int64_t startTime, int64_t endTime,
+                                 std::vector<RecordedUpdate> & updates) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(SegmentHeader)) {
+        close(fd);
+        return;
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    void * pMapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMapping == MAP_FAILED)
+        return;
+
+    const uint8_t * pData = static_cast<const uint8_t*>(pMapping);
+    const uint8_t * pEnd = pData + size;
+    if (memcmp(pData, SegmentMagic, sizeof(SegmentMagic)) != 0) {
+        munmap(pMapping, size);
+        return;
+    }
+
+    IndexTrailer trailer;
+    bool indexed = false;
+    if (size >= sizeof(SegmentHeader) + sizeof(trailer)) {
+        memcpy(&trailer, pEnd - sizeof(trailer), sizeof(trailer));
+        indexed = memcmp(trailer.magic, IndexMagic, sizeof(IndexMagic)) == 0
+            && trailer.indexOffset <= size && trailer.entries <= size / sizeof(IndexEntry)
+            && trailer.indexOffset + trailer.entries * sizeof(IndexEntry) + sizeof(trailer) == size;
+    }
+
+    if (indexed) {
+        // Binary search of the runs of the PV
+        std::vector<IndexEntry> index(trailer.entries);
+        memcpy(index.data(), pData + trailer.indexOffset, trailer.entries * sizeof(IndexEntry));
+        auto it = std::lower_bound(index.begin(), index.end(), pvId,
+                                   [](const IndexEntry & entry, uint32_t id) { return entry.pvId < id; });
+        for (; it != index.end() && it->pvId == pvId; ++it)
+            if (it->maxTime >= startTime && it->minTime <= endTime && it->offset < trailer.indexOffset)
+                decodeRun(pData + it->offset, pData + trailer.indexOffset, pvId, startTime, endTime, updates);
+    } else {
+        // Segment of a run that did not stop cleanly: every block is scanned
+        const uint8_t * pBlock = pData + sizeof(SegmentHeader);
+        BlockHeader header;
+        while (pBlock + sizeof(header) <= pEnd) {
+            memcpy(&header, pBlock, sizeof(header));
+            if (header.magic != BlockMagic || header.size > static_cast<size_t>(pEnd - pBlock) - sizeof(header))
+                break;
+            const uint8_t * pRun = pBlock + sizeof(header);
+            const uint8_t * pBlockEnd = pRun + header.size;
+            for (uint32_t r = 0; r < header.runs && pRun != nullptr; ++r)
+                pRun = decodeRun(pRun, pBlockEnd, pvId, startTime, endTime, updates);
+            pBlock = pBlockEnd;
+        }
+    }
+
+    munmap(pMapping, size);
+}
+
+size_t UpdateRecorder::read(const std::string & directory, uint32_t pvId, int64_t startTime, int64_t endTime,
+                            std::vector<RecordedUpdate> & updates) {
+
+    std::vector<std::string> paths = segmentPaths(directory);
+
+    size_t initialSize = updates.size();
+    for (const std::string & path : paths)
+        readSegment(path, pvId, startTime, endTime, updates);
+    return updates.size() - initialSize;
+}
+
+bool UpdateRecorder::loadConfig(const std::string & path, RecorderConfig & config) {
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t equal = line.find('=');
+        if (line.empty() || line[0] == '#' || equal == std::string::npos)
+            continue;
+
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        try {
+            if (key == "directory")
+                config.directory = value;
+            else if (key == "segmentMB")
+                config.segmentBytes = static_cast<size_t>(std::stoul(value)) << 20;
+            else if (key == "blockRecords")
+                config.blockRecords = static_cast<size_t>(std::stoul(value));
+            else if (key == "flushInterval")
+                config.flushInterval = std::chrono::milliseconds(std::stoul(value));
+            else if (key == "ringCapacity")
+                config.ringCapacity = static_cast<size_t>(std::stoul(value));
+            else if (key == "maxSegments")
+                config.maxSegments = static_cast<size_t>(std::stoul(value));
+            else
+                LOG_WARNING("Recorder: unknown key %s in %s", key.c_str(), path.c_str());
+        } catch (const std::exception &) {
+            LOG_WARNING("Recorder: invalid value for %s in %s", key.c_str(), path.c_str());
+        }
+    }
+
+    return !config.directory.empty();
+}
@@ -0,0 +1,71 @@
+/**
+ * @file eventQueueTest.cpp
+ * @brief Tests of the overflow policies of the EventQueue with the elements pushed with OverflowPolicy::Block.
+ *
+ * @author Pablo Del Río López
+ * @date 2025-06-01
+ */
+
+#include <eventQueue.h>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char * what) {
+    if (!condition) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// A coalescing monitor update behind a queued put of the same PV does not replace the put
+void coalesceBehindPut() {
+    EventQueue<std::string, uint32_t> queue(10, 10);
+    check(queue.push("put", 7, OverflowPolicy::Block, Lane::Fast), "the put is queued");
+    check(queue.push("update 1", 7, OverflowPolicy::Coalesce, Lane::Fast), "the first update is queued");
+    check(queue.push("update 2", 7, OverflowPolicy::Coalesce, Lane::Fast), "the second update is coalesced");
+
+    std::string item;
+    check(queue.pop(item) && item == "put", "the put is popped first");
+    check(queue.pop(item) && item == "update 2", "the update is the last one");
+    check(queue.size() == 0, "nothing else is queued");
+}
+
+// A full lane drops the updates, never the puts, even when the put is the oldest element of the PV
+void dropOldestBehindPut() {
+    EventQueue<std::string, uint32_t> queue(10, 2);
+    check(queue.push("put", 7, OverflowPolicy::Block, Lane::Fast), "the put is queued");
+    check(queue.push("update 1", 7, OverflowPolicy::DropOldestPerPV, Lane::Fast), "the first update is queued");
+    check(queue.push("update 2", 7, OverflowPolicy::DropOldestPerPV, Lane::Fast), "the second update replaces the first");
+
+    std::string item;
+    check(queue.pop(item) && item == "put", "the put is kept");
+    check(queue.pop(item) && item == "update 2", "the last update is kept");
+}
+
+// A lane full of puts drops the update being pushed
+void dropOldestFullOfPuts() {
+    EventQueue<std::string, uint32_t> queue(10, 2);
+    check(queue.push("put 1", 7, OverflowPolicy::Block, Lane::Fast), "the first put is queued");
+    check(queue.push("put 2", 8, OverflowPolicy::Block, Lane::Fast), "the second put is queued");
+    check(!queue.push("update", 7, OverflowPolicy::DropOldestPerPV, Lane::Fast), "the update is dropped");
+    check(queue.drops().at(7) == 1, "the drop is accounted to the PV of the update");
+
+    std::string item;
+    check(queue.pop(item) && item == "put 1", "the first put is kept");
+    check(queue.pop(item) && item == "put 2", "the second put is kept");
+}
+
+}
+
+int main() {
+    coalesceBehindPut();
+    dropOldestBehindPut();
+    dropOldestFullOfPuts();
+    if (failures == 0)
+        printf("All the EventQueue tests passed\n");
+    return failures == 0 ? 0 : 1;
+}